@@ -2,11 +2,11 @@
 //@author Bastian
 #pragma once
 #include <vector>
-#include <boost/align/aligned_allocator.hpp>
+#include "numa_allocator.h"
 
 #define ALIGNMENT 64 // memory border to align a memory address to
 #define CACHELINE_SIZE 64
 const int CACHELINE_FLOATS = CACHELINE_SIZE/sizeof(float);
 
 template <typename T>
-using aligned_vector = std::vector<T, boost::alignment::aligned_allocator<T, ALIGNMENT>>;
\ No newline at end of file
+using aligned_vector = std::vector<T, numa_allocator<T, ALIGNMENT>>; // placement of large buffers: see memory_placement
\ No newline at end of file
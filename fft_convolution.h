@@ -0,0 +1,424 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <math.h>
+#include <omp.h>
+#include "matrix.h"
+
+using namespace std;
+
+using fft_complex = complex<double>;
+
+/**
+ * @brief Complex 1D FFT of arbitrary length (mixed radix, decimation in time).
+ * - radix 4 and 2 butterflies for powers of two, generic butterfly for all other factors
+ * - the transform is not normalized. forward and inverse plans are separate objects
+ * - const after construction, so one plan can be shared by all threads
+ */
+class fft_plan
+{
+public:
+
+    fft_plan() : m_n(0), m_inverse(false), m_largest_factor(1) { }
+
+    fft_plan(int n, bool inverse) : m_n(n), m_inverse(inverse), m_largest_factor(1)
+    {
+        if (n <= 0)
+        {
+            cerr << "Invalid fft_plan size" << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        m_twiddles.reserve(n);
+
+        for (int i = 0; i < n; ++i)
+        {
+            cdouble phase = (inverse ? 2.0 : -2.0) * M_PI * i / n;
+            m_twiddles.push_back(polar(1.0, phase));
+        }
+
+        // Factorize n. Prefer radix 4, then 2, then odd factors
+        int p = 4;
+        int rest = n;
+        cint sqrt_n = floor(sqrt(double(n)));
+
+        do
+        {
+            while (rest % p != 0)
+            {
+                switch (p)
+                {
+                case 4: p = 2;
+                    break;
+                case 2: p = 3;
+                    break;
+                default: p += 2;
+                    break;
+                }
+
+                if (p > sqrt_n)
+                    p = rest;
+            }
+
+            rest /= p;
+            m_factors.push_back(p);
+            m_factors.push_back(rest);
+            m_largest_factor = max(m_largest_factor, p);
+        }
+        while (rest > 1);
+    }
+
+    int size() const
+    {
+        return m_n;
+    }
+
+    /**
+     * @brief Elements of the scratch buffer of transform (the largest radix)
+     */
+    int scratch_size() const
+    {
+        return m_largest_factor;
+    }
+
+    /**
+     * @brief Transforms in into out. in and out must not overlap and contain size() elements
+     * @param scratch scratch_size() elements used by the generic butterfly. Each thread needs its own
+     */
+    void transform(const fft_complex * in, fft_complex * out, fft_complex * scratch) const
+    {
+        work(out, in, 1, m_factors.data(), scratch);
+    }
+
+private:
+
+    int m_n;
+    bool m_inverse;
+    vector<fft_complex> m_twiddles; // exp(-+2 pi i k / n)
+    vector<int> m_factors; // pairs of (radix, remaining length)
+    int m_largest_factor;
+
+    void work(fft_complex * out, const fft_complex * in, cint fstride, const int * factors, fft_complex * scratch) const
+    {
+        cint p = factors[0];
+        cint m = factors[1];
+        fft_complex * out_begin = out;
+        const fft_complex * const out_end = out + p * m;
+
+        if (m == 1)
+        {
+            do
+            {
+                *out = *in;
+                in += fstride;
+            }
+            while (++out != out_end);
+        }
+        else
+        {
+            do
+            {
+                // recursive call: DFT of size m*p performed by doing p instances of smaller DFTs of size m
+                work(out, in, fstride * p, factors + 2, scratch);
+                in += fstride;
+            }
+            while ((out += m) != out_end);
+        }
+
+        switch (p)
+        {
+        case 2: butterfly_2(out_begin, fstride, m);
+            break;
+        case 4: butterfly_4(out_begin, fstride, m);
+            break;
+        default: butterfly_generic(out_begin, fstride, m, p, scratch);
+            break;
+        }
+    }
+
+    void butterfly_2(fft_complex * out, cint fstride, cint m) const
+    {
+        fft_complex * out2 = out + m;
+
+        for (int k = 0; k < m; ++k)
+        {
+            const fft_complex t = out2[k] * m_twiddles[k * fstride];
+            out2[k] = out[k] - t;
+            out[k] += t;
+        }
+    }
+
+    void butterfly_4(fft_complex * out, cint fstride, cint m) const
+    {
+        for (int k = 0; k < m; ++k)
+        {
+            const fft_complex s0 = out[k + m] * m_twiddles[k * fstride];
+            const fft_complex s1 = out[k + 2 * m] * m_twiddles[2 * k * fstride];
+            const fft_complex s2 = out[k + 3 * m] * m_twiddles[3 * k * fstride];
+
+            const fft_complex s5 = out[k] - s1;
+            const fft_complex s3 = s0 + s2;
+            const fft_complex s4 = s0 - s2;
+            const fft_complex s0p = out[k] + s1;
+
+            out[k + 2 * m] = s0p - s3;
+            out[k] = s0p + s3;
+
+            if (m_inverse)
+            {
+                out[k + m] = fft_complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+                out[k + 3 * m] = fft_complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+            }
+            else
+            {
+                out[k + m] = fft_complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+                out[k + 3 * m] = fft_complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+            }
+        }
+    }
+
+    void butterfly_generic(fft_complex * out, cint fstride, cint m, cint p, fft_complex * scratch) const
+    {
+        for (int u = 0; u < m; ++u)
+        {
+            for (int q = 0, k = u; q < p; ++q, k += m)
+                scratch[q] = out[k];
+
+            for (int q1 = 0, k = u; q1 < p; ++q1, k += m)
+            {
+                int twiddle_index = 0;
+                out[k] = scratch[0];
+
+                for (int q = 1; q < p; ++q)
+                {
+                    twiddle_index += fstride * k;
+                    if (twiddle_index >= m_n)
+                        twiddle_index -= m_n;
+                    out[k] += scratch[q] * m_twiddles[twiddle_index];
+                }
+            }
+        }
+    }
+};
+
+/**
+ * @brief Calculates the inner and outer filling of a whole (periodic) space with real-to-complex FFTs.
+ * - the space is transformed once per step, both fillings are obtained by multiplication with precomputed kernel spectra
+ * - only the non-redundant half of the spectrum (width / 2 + 1 columns) is stored
+ * - two real rows are packed into one complex transform (forward), the inner and outer
+ *   result rows share one complex transform (inverse)
+ * - cost is O(W*H*log(W*H)) per step, independent of the mask radius
+ */
+class fft_convolution
+{
+public:
+
+    fft_convolution(int width, int height) :
+        m_width(width),
+        m_height(height),
+        m_spectrum_width(width / 2 + 1),
+        m_row_forward(width, false),
+        m_row_inverse(width, true),
+        m_column_forward(height, false),
+        m_column_inverse(height, true),
+        m_spectrum(m_spectrum_width * height),
+        m_spectrum_inner(m_spectrum_width * height),
+        m_spectrum_outer(m_spectrum_width * height)
+    {
+    }
+
+    int getWidth() const
+    {
+        return m_width;
+    }
+
+    int getHeight() const
+    {
+        return m_height;
+    }
+
+    /**
+     * @brief Precomputes the kernel spectra from the masks. The result of convolve() is normalized by mask_sum
+     * @param mask_inner mask of the inner circle (without alignment offset)
+     * @param mask_outer mask of the outer ring (without alignment offset)
+     */
+    void set_kernels(const aligned_matrix<float> & mask_inner, cfloat inner_mask_sum, const aligned_matrix<float> & mask_outer, cfloat outer_mask_sum)
+    {
+        set_kernel(mask_inner, inner_mask_sum, m_kernel_inner);
+        set_kernel(mask_outer, outer_mask_sum, m_kernel_outer);
+    }
+
+    /**
+     * @brief Calculates the fillings of all cells in space
+     * @param space the current space. Must have the size of this convolution
+     * @param inner destination of the inner fillings (m)
+     * @param outer destination of the outer fillings (n)
+     */
+    void convolve(const aligned_matrix<float> & space, aligned_matrix<float> & inner, aligned_matrix<float> & outer)
+    {
+        assert(space.getNumCols() == m_width && space.getNumRows() == m_height);
+        assert(inner.getNumCols() == m_width && outer.getNumCols() == m_width);
+
+        forward(space, m_spectrum);
+
+        cint size = m_spectrum_width * m_height;
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < size; ++i)
+        {
+            m_spectrum_inner[i] = m_spectrum[i] * m_kernel_inner[i];
+            m_spectrum_outer[i] = m_spectrum[i] * m_kernel_outer[i];
+        }
+
+        transform_columns(m_spectrum_inner, m_column_inverse);
+        transform_columns(m_spectrum_outer, m_column_inverse);
+
+        #pragma omp parallel
+        {
+            vector<fft_complex> row_in(m_width);
+            vector<fft_complex> row_out(m_width);
+            vector<fft_complex> scratch(m_row_inverse.scratch_size());
+
+            #pragma omp for schedule(static)
+            for (int y = 0; y < m_height; ++y)
+            {
+                const fft_complex * a = &m_spectrum_inner[y * m_spectrum_width];
+                const fft_complex * b = &m_spectrum_outer[y * m_spectrum_width];
+
+                // Both results are real: ifft(A + iB) = ifft(A) + i ifft(B)
+                for (int k = 0; k < m_spectrum_width; ++k)
+                    row_in[k] = a[k] + fft_complex(-b[k].imag(), b[k].real());
+                for (int k = m_spectrum_width; k < m_width; ++k)
+                    row_in[k] = conj(a[m_width - k]) + fft_complex(b[m_width - k].imag(), b[m_width - k].real());
+
+                m_row_inverse.transform(row_in.data(), row_out.data(), scratch.data());
+
+                float * inner_row = inner.getRow_ptr(y);
+                float * outer_row = outer.getRow_ptr(y);
+
+                for (int x = 0; x < m_width; ++x)
+                {
+                    inner_row[x] = row_out[x].real();
+                    outer_row[x] = row_out[x].imag();
+                }
+            }
+        }
+    }
+
+private:
+
+    int m_width;
+    int m_height;
+    int m_spectrum_width; // number of stored spectrum columns (width / 2 + 1)
+
+    fft_plan m_row_forward;
+    fft_plan m_row_inverse;
+    fft_plan m_column_forward;
+    fft_plan m_column_inverse;
+
+    vector<fft_complex> m_spectrum; // spectrum of the current space
+    vector<fft_complex> m_spectrum_inner; // product with inner kernel
+    vector<fft_complex> m_spectrum_outer; // product with outer kernel
+    vector<fft_complex> m_kernel_inner; // normalized spectrum of the inner mask
+    vector<fft_complex> m_kernel_outer; // normalized spectrum of the outer mask
+
+    /**
+     * @brief Places the mask into a space sized matrix (center at index (0,0), mirrored to turn
+     * the correlation of getFilling into a convolution) and stores its normalized spectrum
+     */
+    void set_kernel(const aligned_matrix<float> & mask, cfloat mask_sum, vector<fft_complex> & kernel)
+    {
+        aligned_matrix<float> k = aligned_matrix<float>(m_width, m_height);
+
+        cint center_x = mask.getNumCols() / 2;
+        cint center_y = mask.getNumRows() / 2;
+
+        for (int j = 0; j < mask.getNumRows(); ++j)
+        {
+            for (int i = 0; i < mask.getNumCols(); ++i)
+            {
+                // a mask larger than the space wraps around multiple times, exactly like getValueWrapped
+                cint x = center_x - i;
+                cint y = center_y - j;
+                k.setValueWrapped(k.getValueWrapped(x, y) + mask.getValue(i, j), x, y);
+            }
+        }
+
+        kernel.resize(m_spectrum_width * m_height);
+        forward(k, kernel);
+
+        // fold normalization of inverse transform and mask into the kernel
+        cdouble scale = 1.0 / (double(m_width) * m_height * mask_sum);
+
+        for (fft_complex & c : kernel)
+            c *= scale;
+    }
+
+    /**
+     * @brief 2D real-to-complex transform of src into spectrum (m_spectrum_width x m_height, row major)
+     */
+    void forward(const aligned_matrix<float> & src, vector<fft_complex> & spectrum) const
+    {
+        #pragma omp parallel
+        {
+            vector<fft_complex> row_in(m_width);
+            vector<fft_complex> row_out(m_width);
+            vector<fft_complex> scratch(m_row_forward.scratch_size());
+
+            #pragma omp for schedule(static)
+            for (int pair = 0; pair < (m_height + 1) / 2; ++pair)
+            {
+                cint y0 = 2 * pair;
+                cint y1 = y0 + 1;
+                const float * row0 = src.getRow_ptr(y0);
+                const float * row1 = y1 < m_height ? src.getRow_ptr(y1) : nullptr;
+
+                // transform two real rows with one complex transform
+                for (int x = 0; x < m_width; ++x)
+                    row_in[x] = fft_complex(row0[x], row1 != nullptr ? row1[x] : 0);
+
+                m_row_forward.transform(row_in.data(), row_out.data(), scratch.data());
+
+                for (int k = 0; k < m_spectrum_width; ++k)
+                {
+                    const fft_complex z = row_out[k];
+                    const fft_complex z_mirror = conj(row_out[(m_width - k) % m_width]);
+
+                    spectrum[y0 * m_spectrum_width + k] = 0.5 * (z + z_mirror);
+
+                    if (row1 != nullptr)
+                        spectrum[y1 * m_spectrum_width + k] = fft_complex(0, -0.5) * (z - z_mirror);
+                }
+            }
+        }
+
+        transform_columns(spectrum, m_column_forward);
+    }
+
+    /**
+     * @brief Applies plan to all columns of a half spectrum in-place
+     */
+    void transform_columns(vector<fft_complex> & spectrum, const fft_plan & plan) const
+    {
+        #pragma omp parallel
+        {
+            vector<fft_complex> column_in(m_height);
+            vector<fft_complex> column_out(m_height);
+            vector<fft_complex> scratch(plan.scratch_size());
+
+            #pragma omp for schedule(static)
+            for (int k = 0; k < m_spectrum_width; ++k)
+            {
+                for (int y = 0; y < m_height; ++y)
+                    column_in[y] = spectrum[y * m_spectrum_width + k];
+
+                plan.transform(column_in.data(), column_out.data(), scratch.data());
+
+                for (int y = 0; y < m_height; ++y)
+                    spectrum[y * m_spectrum_width + k] = column_out[y];
+            }
+        }
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <iostream>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+#include "matrix.h"
+#include "simd_kernels.h"
+
+using namespace std;
+
+/**
+ * @brief Scales of the fixed point engine (see fixed_point_filling). A state s in [0,1] is stored as
+ * round(s * state_one), a mask weight w in [0,1] as round(w * weight_one)
+ * - 8 bit: vpmaddubsw multiplies unsigned bytes (states) with signed bytes (weights) and adds pairs in int16 with
+ *   saturation. 2 * 255 * 64 < 32767, so the pairs never saturate
+ * - 16 bit: vpmaddwd multiplies signed words and adds pairs in int32. States use 15 bits, weights 8 bits
+ */
+template <typename state_type>
+struct fixed_point_scale;
+
+template <>
+struct fixed_point_scale<uint8_t>
+{
+    static constexpr int state_one = 255;
+    static constexpr int weight_one = INT8_KERNEL_WEIGHT_MAX;
+};
+
+template <>
+struct fixed_point_scale<uint16_t>
+{
+    static constexpr int state_one = 32767;
+    static constexpr int weight_one = INT16_KERNEL_WEIGHT_MAX;
+};
+
+#define FIXED_POINT_MASK_COLUMNS 16 //the columns of the quantized masks are rounded up to a multiple of this (the narrowest step of the integer kernels)
+
+/**
+ * @brief Quantized space and masks of the FIXED_POINT filling engine
+ * - the masks are cut to the bounding box of their nonzero cells like the compact masks, there is one mask per shape
+ *   (the space is read unaligned)
+ * - the space copy has the geometry of space_current (including its halo), the simulator refreshes it every step
+ * - a filling is the integer dot product divided by state_one times the integer sum of the quantized mask, so a mask
+ *   over a full neighborhood still gives exactly 1
+ */
+template <typename state_type, typename weight_type>
+class fixed_point_filling
+{
+public:
+
+    aligned_matrix<state_type> space; // quantized copy of space_current
+    aligned_matrix<weight_type> inner; // quantized inner mask, rows padded to whole cache lines
+    aligned_matrix<weight_type> outer; // quantized outer mask, same geometry as inner
+    int left = 0; // columns from the first column of the masks to the cell they are centered at
+    int top = 0; // rows from the first row of the masks to the cell they are centered at
+    double inner_norm = 0; // 1 / (state_one * sum of the quantized inner weights)
+    double outer_norm = 0;
+
+    /**
+     * @brief Quantizes mask_inner and mask_outer (one of the shifted masks each) and allocates the space copy
+     * @param center_x column of the masks the cell is centered at
+     * @param center_y row of the masks the cell is centered at
+     * @param space_template the space whose geometry is copied
+     */
+    void initialize(const aligned_matrix<float> & mask_inner, const aligned_matrix<float> & mask_outer, cint center_x, cint center_y, const aligned_matrix<float> & space_template)
+    {
+        assert(mask_inner.getLd() == mask_outer.getLd() && mask_inner.getNumRows() == mask_outer.getNumRows());
+
+        // bounding box of the cells that are not 0 in any of the masks (over the whole leading dimension)
+        int x_begin = mask_inner.getLd();
+        int x_end = 0;
+        int y_begin = mask_inner.getNumRows();
+        int y_end = 0;
+
+        for (int y = 0; y < mask_inner.getNumRows(); ++y)
+        {
+            for (int x = 0; x < mask_inner.getLd(); ++x)
+            {
+                if (mask_inner.getValue(x, y) != 0 || mask_outer.getValue(x, y) != 0)
+                {
+                    x_begin = min(x_begin, x);
+                    x_end = max(x_end, x + 1);
+                    y_begin = min(y_begin, y);
+                    y_end = max(y_end, y + 1);
+                }
+            }
+        }
+
+        assert(x_begin < x_end && y_begin < y_end);
+
+        x_end = x_begin + (x_end - x_begin + FIXED_POINT_MASK_COLUMNS - 1) / FIXED_POINT_MASK_COLUMNS * FIXED_POINT_MASK_COLUMNS;
+
+        inner = aligned_matrix<weight_type>(x_end - x_begin, y_end - y_begin);
+        outer = aligned_matrix<weight_type>(x_end - x_begin, y_end - y_begin);
+
+        long inner_sum = 0;
+        long outer_sum = 0;
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            for (int x = x_begin; x < x_end; ++x)
+            {
+                const weight_type wi = quantize_weight(x < mask_inner.getLd() ? mask_inner.getValue(x, y) : 0);
+                const weight_type wo = quantize_weight(x < mask_outer.getLd() ? mask_outer.getValue(x, y) : 0);
+
+                inner.setValue(wi, x - x_begin, y - y_begin);
+                outer.setValue(wo, x - x_begin, y - y_begin);
+                inner_sum += wi;
+                outer_sum += wo;
+            }
+        }
+
+        left = center_x - x_begin;
+        top = center_y - y_begin;
+        inner_norm = 1.0 / (double(fixed_point_scale<state_type>::state_one) * inner_sum);
+        outer_norm = 1.0 / (double(fixed_point_scale<state_type>::state_one) * outer_sum);
+
+        space = space_template.hasHalo() ?
+                aligned_matrix<state_type>(space_template.getNumCols(), space_template.getNumRows(), space_template.getHaloColumns(), space_template.getHaloRows()) :
+                aligned_matrix<state_type>(space_template.getNumCols(), space_template.getNumRows());
+    }
+
+    /**
+     * @brief Returns if the space copy still has the geometry of space_template. The halo columns are aligned to
+     * cache lines of state_type, so the copy can have more of them
+     */
+    bool fits(const aligned_matrix<float> & space_template) const
+    {
+        return space.getNumCols() == space_template.getNumCols() && space.getNumRows() == space_template.getNumRows()
+                && space.getHaloColumns() >= space_template.getHaloColumns() && space.getHaloRows() == space_template.getHaloRows();
+    }
+
+    /**
+     * @brief Quantizes n states (clamped to [0,1]) from src to dst
+     */
+    static void encode(const float * src, state_type * dst, cint n)
+    {
+        cfloat one = fixed_point_scale<state_type>::state_one;
+
+        #pragma omp simd
+        for (int i = 0; i < n; ++i)
+        {
+            // comparisons instead of fminf / fmaxf, which do not vectorize without -ffinite-math-only (NaN becomes 0)
+            cfloat state = src[i] > 0.0f ? (src[i] < 1.0f ? src[i] : 1.0f) : 0.0f;
+            dst[i] = state_type(state * one + 0.5f);
+        }
+    }
+
+    /**
+     * @brief Returns the quantized weight w (in [0,1])
+     */
+    static weight_type quantize_weight(cfloat w)
+    {
+        return weight_type(lrintf(fminf(1.0f, fmaxf(0.0f, w)) * fixed_point_scale<state_type>::weight_one));
+    }
+};
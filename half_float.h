@@ -0,0 +1,199 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+
+using namespace std;
+
+/**
+ * @brief The precision the states of the simulation are stored with. Calculations are always done in float
+ */
+enum class storage_precision
+{
+    /**
+     * @brief IEEE single precision, 4 bytes per cell
+     */
+    FP32 = 0,
+
+    /**
+     * @brief IEEE half precision (1 sign, 5 exponent, 10 mantissa bits), 2 bytes per cell
+     */
+    FP16 = 1,
+
+    /**
+     * @brief bfloat16 (upper half of a float: 1 sign, 8 exponent, 7 mantissa bits), 2 bytes per cell
+     */
+    BF16 = 2
+};
+
+/**
+ * @brief Returns the name of the storage precision as used by storage_precision_from_name
+ */
+inline string storage_precision_name(storage_precision precision)
+{
+    switch (precision)
+    {
+    case storage_precision::FP16: return "FP16";
+    case storage_precision::BF16: return "BF16";
+    default: return "FP32";
+    }
+}
+
+/**
+ * @brief Returns storage precision from name. Returns FP32 if name is invalid
+ */
+inline storage_precision storage_precision_from_name(string name)
+{
+    if (name == "FP16")
+        return storage_precision::FP16;
+    else if (name == "BF16")
+        return storage_precision::BF16;
+    else if (name != "FP32")
+        cerr << "Unknown storage precision " << name << ", using FP32" << endl;
+
+    return storage_precision::FP32;
+}
+
+/**
+ * @brief Converts float to half precision, rounding to nearest even. Handles subnormals, infinity and NaN
+ */
+inline uint16_t float_to_half(const float value)
+{
+    uint32_t x;
+    memcpy(&x, &value, sizeof (float));
+
+    const uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+
+    uint32_t h;
+
+    if (x >= 0x47800000)
+    {
+        // too large for half (or infinity / NaN)
+        h = x > 0x7f800000 ? 0x7e00 : 0x7c00;
+    }
+    else if (x < 0x38800000)
+    {
+        // subnormal half: adding 0.5 moves the mantissa to the lowest bits, the float addition does the rounding
+        float f;
+        memcpy(&f, &x, sizeof (float));
+        f += 0.5f;
+        memcpy(&h, &f, sizeof (float));
+        h -= 0x3f000000;
+    }
+    else
+    {
+        // normal half: rebias the exponent and round the mantissa
+        const uint32_t mantissa_odd = (x >> 13) & 1;
+        x += 0xc8000fff + mantissa_odd;
+        h = x >> 13;
+    }
+
+    return uint16_t(h | sign);
+}
+
+/**
+ * @brief Converts half precision to float (exact)
+ */
+inline float half_to_float(const uint16_t value)
+{
+    uint32_t x = uint32_t(value & 0x7fff) << 13;
+    const uint32_t exponent = x & 0x0f800000;
+
+    x += 0x38000000; // rebias the exponent
+
+    if (exponent == 0x0f800000)
+    {
+        x += 0x38000000; // infinity / NaN
+    }
+    else if (exponent == 0)
+    {
+        // subnormal half, renormalize with a float subtraction
+        x += 0x00800000;
+        float f;
+        memcpy(&f, &x, sizeof (float));
+        f -= 6.10351562e-05f; // 2^-14
+        memcpy(&x, &f, sizeof (float));
+    }
+
+    x |= uint32_t(value & 0x8000) << 16;
+
+    float f;
+    memcpy(&f, &x, sizeof (float));
+    return f;
+}
+
+/**
+ * @brief Converts float to bfloat16, rounding to nearest even
+ */
+inline uint16_t float_to_bfloat16(const float value)
+{
+    uint32_t x;
+    memcpy(&x, &value, sizeof (float));
+
+    if ((x & 0x7fffffff) > 0x7f800000)
+        return uint16_t((x >> 16) | 0x40); // keep NaN a quiet NaN
+
+    x += 0x7fff + ((x >> 16) & 1);
+    return uint16_t(x >> 16);
+}
+
+/**
+ * @brief Converts bfloat16 to float (exact)
+ */
+inline float bfloat16_to_float(const uint16_t value)
+{
+    const uint32_t x = uint32_t(value) << 16;
+    float f;
+    memcpy(&f, &x, sizeof (float));
+    return f;
+}
+
+/**
+ * @brief Rounds value to the given storage precision
+ */
+inline float storage_round(const float value, storage_precision precision)
+{
+    switch (precision)
+    {
+    case storage_precision::FP16: return half_to_float(float_to_half(value));
+    case storage_precision::BF16: return bfloat16_to_float(float_to_bfloat16(value));
+    default: return value;
+    }
+}
+
+/**
+ * @brief Converts n floats to the storage precision (FP16 or BF16)
+ */
+inline void storage_encode(const float * src, uint16_t * dst, const int n, storage_precision precision)
+{
+    if (precision == storage_precision::FP16)
+    {
+        for (int i = 0; i < n; ++i)
+            dst[i] = float_to_half(src[i]);
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i)
+            dst[i] = float_to_bfloat16(src[i]);
+    }
+}
+
+/**
+ * @brief Converts n values in storage precision (FP16 or BF16) to float
+ */
+inline void storage_decode(const uint16_t * src, float * dst, const int n, storage_precision precision)
+{
+    if (precision == storage_precision::FP16)
+    {
+        for (int i = 0; i < n; ++i)
+            dst[i] = half_to_float(src[i]);
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i)
+            dst[i] = bfloat16_to_float(src[i]);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <math.h>
+
+using namespace std;
+
+/**
+ * @brief The time derivative of the states with the smooth time stepping (rules that are not discrete)
+ */
+enum class time_stepping
+{
+    /**
+     * @brief f' = 2 s(n, m) - 1, as the reference implementation
+     */
+    TWO_S_MINUS_ONE = 0,
+
+    /**
+     * @brief f' = s(n, m) - f, the alternative smooth time stepping of the paper by S. Rafler
+     */
+    S_MINUS_F = 1
+};
+
+/**
+ * @brief How the smooth time stepping is integrated over dt
+ */
+enum class integrator
+{
+    /**
+     * @brief Forward Euler, one filling pass per step
+     */
+    EULER = 0,
+
+    /**
+     * @brief Explicit midpoint method (RK2), two filling passes per step
+     */
+    MIDPOINT = 1,
+
+    /**
+     * @brief Classic Runge-Kutta method (RK4), four filling passes per step
+     */
+    RK4 = 2
+};
+
+/**
+ * @brief Coefficients of an explicit Runge-Kutta method whose stages only depend on the previous stage:
+ * k_i = f'(Y_i), Y_0 = f, Y_i = f + offset[i] * dt * k_(i-1), f(t + dt) = f + dt * sum weight[i] * k_i
+ * - all states (Y_i and the result) are clamped to [0,1], like the Euler step of the reference implementation
+ * - f + dt * k_embedded is a solution of lower order (Euler for MIDPOINT, midpoint for RK4). Its difference to the
+ *   result estimates the local error of adaptive time steps (embedded_order is the order of that solution)
+ */
+struct integrator_tableau
+{
+    int stages;
+    float offset[4];
+    float weight[4];
+    int embedded;
+    int embedded_order;
+};
+
+/**
+ * @brief Returns the coefficients of the integrator
+ */
+inline integrator_tableau integrator_tableau_for(integrator method)
+{
+    switch (method)
+    {
+    case integrator::MIDPOINT: return integrator_tableau{2, {0, 0.5f}, {0, 1}, 0, 1};
+    case integrator::RK4: return integrator_tableau{4, {0, 0.5f, 0.5f, 1}, {1.0f / 6, 2.0f / 6, 2.0f / 6, 1.0f / 6}, 1, 2};
+    default: return integrator_tableau{1, {0}, {1}, -1, 0};
+    }
+}
+
+/**
+ * @brief Returns the time derivative of state with the state function value s
+ */
+template <typename T>
+inline T time_derivative(time_stepping stepping, const T s, const T state)
+{
+    return stepping == time_stepping::S_MINUS_F ? s - state : T(2) * s - T(1);
+}
+
+/**
+ * @brief Returns the name of the integrator as used by integrator_from_name
+ */
+inline string integrator_name(integrator method)
+{
+    switch (method)
+    {
+    case integrator::MIDPOINT: return "MIDPOINT";
+    case integrator::RK4: return "RK4";
+    default: return "EULER";
+    }
+}
+
+/**
+ * @brief Returns the integrator from name. Returns EULER if name is invalid
+ */
+inline integrator integrator_from_name(string name)
+{
+    if (name == "MIDPOINT" || name == "RK2")
+        return integrator::MIDPOINT;
+    else if (name == "RK4")
+        return integrator::RK4;
+    else if (name != "EULER")
+        cerr << "Unknown integrator " << name << ", using EULER" << endl;
+
+    return integrator::EULER;
+}
+
+/**
+ * @brief Returns the name of the time stepping as used by time_stepping_from_name
+ */
+inline string time_stepping_name(time_stepping stepping)
+{
+    switch (stepping)
+    {
+    case time_stepping::S_MINUS_F: return "S_MINUS_F";
+    default: return "TWO_S_MINUS_ONE";
+    }
+}
+
+/**
+ * @brief Returns the time stepping from name. Returns TWO_S_MINUS_ONE if name is invalid
+ */
+inline time_stepping time_stepping_from_name(string name)
+{
+    if (name == "S_MINUS_F")
+        return time_stepping::S_MINUS_F;
+    else if (name != "TWO_S_MINUS_ONE")
+        cerr << "Unknown time stepping " << name << ", using TWO_S_MINUS_ONE" << endl;
+
+    return time_stepping::TWO_S_MINUS_ONE;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include "simulator.h"
+#include "simulator_core.h"
+
+using namespace std;
+
+/**
+ * @brief Divergence of the production simulator from the double precision reference after a step
+ */
+struct divergence_report
+{
+    ulong step;
+    double max_error; // max. |production - reference| over all cells
+    double mean_error; // mean |production - reference|
+    double rms_error; // root mean square of production - reference
+    int max_x; // cell with the max. error
+    int max_y;
+};
+
+/**
+ * @brief Runs a (float) production simulator and the double precision reference engine simulator_core<double> in
+ * lockstep from the same initial space and reports the divergence after each step.
+ * - the production simulator keeps its configuration (filling engine, SIMD kernels, storage precision, transition
+ *   table, ...), so the error of these optimizations is measured against an exact calculation
+ * - the production simulator has to be initialized without queue (swap() is used to advance it)
+ */
+class lockstep_validator
+{
+public:
+
+    lockstep_validator(simulator & production) :
+        m_production(production),
+        m_reference(production.m_rules),
+        m_current(production.m_rules.get_space_width(), production.m_rules.get_space_height()),
+        m_next(production.m_rules.get_space_width(), production.m_rules.get_space_height())
+    {
+        if (!production.m_initialized)
+        {
+            cerr << "Cannot run lockstep validation: Simulator is not initialized!" << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // start with the states of the production simulator (already rounded to its storage precision)
+        const aligned_matrix<float> & space = *production.m_space->buffer_read_ptr();
+
+        for (int y = 0; y < m_current.getNumRows(); ++y)
+            for (int x = 0; x < m_current.getNumCols(); ++x)
+                m_current.setValue(space.getValue(x, y), x, y);
+    }
+
+    /**
+     * @brief Simulates one step with both simulators
+     * @return the divergence after the step
+     */
+    divergence_report step()
+    {
+        m_production.simulate_step();
+        m_production.m_space->swap();
+
+        m_reference.step(m_current, m_next);
+        m_current.swap(m_next);
+
+        ++m_step;
+
+        return compare();
+    }
+
+    /**
+     * @brief Simulates steps steps with both simulators and prints the divergence after each step to out
+     * @return the divergence after each step
+     */
+    vector<divergence_report> run(cint steps, ostream & out)
+    {
+        vector<divergence_report> reports;
+
+        for (int i = 0; i < steps; ++i)
+        {
+            divergence_report report = step();
+            reports.push_back(report);
+
+            out << "Lockstep | step " << report.step
+                    << " max. error " << report.max_error << " at (" << report.max_x << ", " << report.max_y << ")"
+                    << " mean " << report.mean_error
+                    << " rms " << report.rms_error << endl;
+        }
+
+        return reports;
+    }
+
+    /**
+     * @brief Returns the current space of the reference engine
+     */
+    const aligned_matrix<double> & get_reference_space() const
+    {
+        return m_current;
+    }
+
+private:
+
+    simulator & m_production;
+    simulator_core<double> m_reference;
+    aligned_matrix<double> m_current;
+    aligned_matrix<double> m_next;
+    ulong m_step = 0;
+
+    divergence_report compare() const
+    {
+        const aligned_matrix<float> & space = *m_production.m_space->buffer_read_ptr();
+        divergence_report report = {m_step, 0, 0, 0, 0, 0};
+        double sum = 0;
+        double sum_squares = 0;
+
+        for (int y = 0; y < m_current.getNumRows(); ++y)
+        {
+            for (int x = 0; x < m_current.getNumCols(); ++x)
+            {
+                cdouble error = fabs(space.getValue(x, y) - m_current.getValue(x, y));
+                sum += error;
+                sum_squares += error * error;
+
+                if (error > report.max_error)
+                {
+                    report.max_error = error;
+                    report.max_x = x;
+                    report.max_y = y;
+                }
+            }
+        }
+
+        cdouble cells = double(m_current.getNumCols()) * m_current.getNumRows();
+        report.mean_error = sum / cells;
+        report.rms_error = sqrt(sum_squares / cells);
+
+        return report;
+    }
+};
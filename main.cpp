@@ -1,12 +1,13 @@
 #include <iostream>
 #include <math.h>
 #include <vector>
-#include <omp.h>
 #include <memory>
+#include <thread>
 #include <exception>
 #include <cstdlib>
 #include "communication.h"
 #include "simulator.h"
+#include "lockstep_validator.h"
 
 // Include the GUI headers if this is the GUI
 #if APP_GUI
@@ -17,28 +18,299 @@
 using namespace std;
 
 /**
- * Set some necessary settings for openmp
+ * @brief Returns the integer in the environment variable name, or value if it is not set
  */
-void setup_openmp()
+int env_int(const char * name, int value)
 {
-    // Enable nested threads
-    omp_set_nested(1);
+	const char * env = std::getenv(name);
+	
+	if(env)
+	{
+		char * end = nullptr;
+		value = int(std::strtol(env, &end, 10));
+		
+		if(end == env || *end != '\0')
+		{
+			cerr << "Invalid " << name << " " << env << ", expected an integer" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	return value;
+}
+
+/**
+ * @brief Returns the number in the environment variable name, or value if it is not set
+ */
+double env_double(const char * name, double value)
+{
+	const char * env = std::getenv(name);
+	
+	if(env)
+	{
+		char * end = nullptr;
+		value = std::strtod(env, &end);
+		
+		if(end == env || *end != '\0')
+		{
+			cerr << "Invalid " << name << " " << env << ", expected a number" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	return value;
+}
+
+/**
+ * @brief Returns if the environment variable name is TRUE, or value if it is not set
+ */
+bool env_flag(const char * name, bool value)
+{
+	const char * env = std::getenv(name);
+	
+	if(env)
+	{
+		value = std::string(env) == "TRUE";
+	}
+	
+	return value;
 }
 
 void set_optimization(simulator & sim)
 {
-	const char * opt_env = std::getenv("OPTIMIZE");
-	bool optimize = true;
+	sim.m_optimize = env_flag("OPTIMIZE", sim.m_optimize);
+	
+	cout << "--> Simulator optimization: " << (sim.m_optimize ? "ON" : "OFF") << endl;
+}
+
+void set_temporal_steps(simulator & sim)
+{
+	sim.m_temporal_steps = env_int("TEMPORAL_STEPS", sim.m_temporal_steps);
+	
+	cout << "--> Simulator temporal blocking: " << (sim.m_temporal_steps > 1 ? std::to_string(sim.m_temporal_steps) + " steps" : "OFF") << endl;
+}
+
+void set_skip_quiescent(simulator & sim)
+{
+	sim.m_skip_quiescent = env_flag("SKIP_QUIESCENT", sim.m_skip_quiescent);
+	
+	cout << "--> Simulator quiescent tile skipping: " << (sim.m_skip_quiescent ? "ON" : "OFF") << endl;
+}
+
+void set_memory_placement()
+{
+	memory_placement & placement = memory_placement_settings();
+	placement.huge_pages = env_flag("HUGE_PAGES", placement.huge_pages);
+	placement.first_touch = env_flag("FIRST_TOUCH", placement.first_touch);
+	bool pin = env_flag("PIN_THREADS", false);
 	
-	if(opt_env)
+	// pin before the first touch, so the pages stay on the node of their thread
+	if(pin && !pin_omp_threads())
 	{
-		optimize = std::string(opt_env) == "TRUE";
+		cerr << "Could not pin the threads!" << endl;
 	}
 	
-	cout << "--> Simulator optimization: " << (optimize ? "ON" : "OFF") << endl;
+	cout << "--> Memory huge pages: " << (placement.huge_pages ? "ON" : "OFF")
+	     << ", parallel first touch: " << (placement.first_touch ? "ON" : "OFF")
+	     << ", pinned threads: " << (pin ? "ON" : "OFF") << endl;
+}
+
+void set_integrator(ruleset & rules)
+{
+	const char * integrator_env = std::getenv("INTEGRATOR");
+	const char * stepping_env = std::getenv("TIME_STEPPING");
+	
+	if(integrator_env)
+	{
+		rules.set_integrator(integrator_from_name(std::string(integrator_env)));
+	}
+	
+	if(stepping_env)
+	{
+		rules.set_time_stepping(time_stepping_from_name(std::string(stepping_env)));
+	}
+	
+	cout << "--> Integrator: " << integrator_name(rules.get_integrator())
+	     << ", time stepping: " << time_stepping_name(rules.get_time_stepping()) << endl;
+}
+
+void set_schedule(simulator & sim)
+{
+	const char * schedule_env = std::getenv("SCHEDULE");
+	
+	if(schedule_env)
+	{
+		sim.m_schedule = tile_schedule_from_name(std::string(schedule_env));
+	}
+	
+	cout << "--> Simulator schedule: " << tile_schedule_name(sim.m_schedule) << endl;
+}
+
+void set_adaptive_dt(simulator & sim)
+{
+	sim.m_adaptive_dt = env_flag("ADAPTIVE_DT", sim.m_adaptive_dt);
+	sim.m_dt_tolerance = env_double("DT_TOLERANCE", sim.m_dt_tolerance);
+	sim.m_dt_min = env_double("DT_MIN", sim.m_dt_min);
+	sim.m_dt_max = env_double("DT_MAX", sim.m_dt_max);
 	
-	sim.m_optimize = optimize;
+	cout << "--> Simulator adaptive dt: " << (sim.m_adaptive_dt ? "ON" : "OFF") << endl;
+}
+
+void set_specialization(simulator & sim)
+{
+	sim.m_specialize = env_flag("SPECIALIZE", sim.m_specialize);
 	
+	cout << "--> Simulator specialized kernels: " << (sim.m_specialize ? "ON" : "OFF") << endl;
+}
+
+void set_filling_engine(simulator & sim)
+{
+	const char * engine_env = std::getenv("FILLING_ENGINE");
+	
+	if(engine_env)
+	{
+		sim.m_filling_engine = filling_engine_from_name(std::string(engine_env));
+	}
+	
+	cout << "--> Simulator filling engine: " << filling_engine_name(sim.m_filling_engine) << endl;
+}
+
+void set_simd_level(simulator & sim)
+{
+	const char * simd_env = std::getenv("SIMD");
+	
+	if(simd_env)
+	{
+		sim.m_simd_level = simd_level_from_name(std::string(simd_env));
+	}
+	
+	cout << "--> Simulator SIMD kernels: " << simd_level_name(sim.m_simd_level) << endl;
+}
+
+void set_tiling(simulator & sim)
+{
+	const char * tiling_env = std::getenv("TILING");
+	
+	if(tiling_env)
+	{
+		if(std::string(tiling_env) == "AUTO")
+		{
+			sim.set_tiling_for_cache(SIMULATOR_L2_CACHE_SIZE);
+		}
+		else
+		{
+			// <width>x<height>, both positive
+			char * width_end = nullptr;
+			char * height_end = nullptr;
+			long width = std::strtol(tiling_env, &width_end, 10);
+			long height = *width_end == 'x' ? std::strtol(width_end + 1, &height_end, 10) : 0;
+			
+			if(width_end == tiling_env || *width_end != 'x' || height_end == width_end + 1 || *height_end != '\0' || width <= 0 || height <= 0)
+			{
+				cerr << "Invalid TILING " << tiling_env << ", use AUTO or <width>x<height> with positive sizes" << endl;
+				exit(EXIT_FAILURE);
+			}
+			
+			sim.m_tile_width = int(width);
+			sim.m_tile_height = int(height);
+		}
+	}
+	
+	cout << "--> Simulator tiling: " << sim.m_tile_width << "x" << sim.m_tile_height << endl;
+}
+
+void set_halo(simulator & sim)
+{
+	sim.m_halo = env_flag("HALO", sim.m_halo);
+	
+	cout << "--> Simulator halo: " << (sim.m_halo ? "ON" : "OFF") << endl;
+}
+
+void set_compact_masks(simulator & sim)
+{
+	sim.m_compact_masks = env_flag("COMPACT_MASKS", sim.m_compact_masks);
+	
+	cout << "--> Simulator compact masks: " << (sim.m_compact_masks ? "ON" : "OFF") << endl;
+}
+
+void set_transition_table(simulator & sim)
+{
+	sim.m_transition_table_size = env_int("TRANSITION_TABLE", sim.m_transition_table_size);
+	
+	cout << "--> Simulator transition table: " << (sim.m_transition_table_size > 0 ? std::to_string(sim.m_transition_table_size) : "OFF") << endl;
+}
+
+void set_storage_precision(simulator & sim)
+{
+	const char * storage_env = std::getenv("STORAGE");
+	
+	if(storage_env)
+	{
+		sim.m_storage_precision = storage_precision_from_name(std::string(storage_env));
+	}
+	
+	cout << "--> Simulator storage precision: " << storage_precision_name(sim.m_storage_precision) << endl;
+}
+
+void set_fixed_point_bits(simulator & sim)
+{
+	sim.m_fixed_point_bits = env_int("FIXED_POINT_BITS", sim.m_fixed_point_bits);
+	
+	if(sim.m_fixed_point_bits != 8 && sim.m_fixed_point_bits != 16)
+	{
+		cerr << "Invalid FIXED_POINT_BITS " << sim.m_fixed_point_bits << ", use 8 or 16" << endl;
+		exit(EXIT_FAILURE);
+	}
+	
+	cout << "--> Simulator fixed point bits: " << sim.m_fixed_point_bits << endl;
+}
+
+void set_separable_tolerance(simulator & sim)
+{
+	sim.m_separable_tolerance = env_double("SEPARABLE_TOLERANCE", sim.m_separable_tolerance);
+	
+	if(sim.m_separable_tolerance < 0)
+	{
+		cerr << "Invalid SEPARABLE_TOLERANCE " << sim.m_separable_tolerance << ", must not be negative" << endl;
+		exit(EXIT_FAILURE);
+	}
+	
+	cout << "--> Simulator separable tolerance: " << sim.m_separable_tolerance << endl;
+}
+
+/**
+ * @brief Returns the number of steps of the lockstep validation against the double precision reference (0 = off)
+ */
+int get_lockstep_steps()
+{
+	int steps = env_int("LOCKSTEP", 0);
+	
+	cout << "--> Lockstep validation: " << (steps > 0 ? std::to_string(steps) + " steps" : "OFF") << endl;
+	
+	return steps;
+}
+
+/**
+ * @brief Applies the settings of the environment to a simulator (before initialize). The integrator is set on the
+ * ruleset before the simulator is created from it, see set_integrator
+ */
+void configure_simulator(simulator & sim)
+{
+	set_optimization(sim);
+	set_filling_engine(sim);
+	set_tiling(sim);
+	set_simd_level(sim);
+	set_halo(sim);
+	set_compact_masks(sim);
+	set_transition_table(sim);
+	set_storage_precision(sim);
+	set_fixed_point_bits(sim);
+	set_separable_tolerance(sim);
+	set_specialization(sim);
+	set_temporal_steps(sim);
+	set_skip_quiescent(sim);
+	set_schedule(sim);
+	set_adaptive_dt(sim);
 }
 
 #if APP_GUI
@@ -48,26 +320,27 @@ void set_optimization(simulator & sim)
  */
 int run_master(int argc, char ** argv)
 {
+    set_memory_placement();
     ruleset rules = ruleset_from_cli(argc, argv);
+    set_integrator(rules);
     simulator s(rules);
+    configure_simulator(s);
     s.initialize();
 
     GUI_TYPE g;
 
-#pragma omp parallel sections
+    // The GUI gets its own thread. The simulator stays in the main thread, so its parallel regions are not nested
+    // and reuse the (pinned) OpenMP threads that touched the buffers first instead of forking a new team every step
+    thread gui_thread([&g, &s]()
     {
-#pragma omp section
-        {
-            cout << "GUI is in thread " << omp_get_thread_num() << endl;
-            g.run(&s);
-        }
+        cout << "GUI is in its own thread" << endl;
+        g.run(&s);
+    });
 
-#pragma omp section
-        {
-            cout << "Simulator is in thread " << omp_get_thread_num() << endl;
-            s.run_simulation_master();
-        }
-    }
+    cout << "Simulator is in the main thread" << endl;
+    s.run_simulation_master();
+
+    gui_thread.join();
 
     return EXIT_SUCCESS;
 }
@@ -79,9 +352,11 @@ int run_master(int argc, char ** argv)
  */
 int run_slave(int argc, char ** argv)
 {
+    set_memory_placement();
     ruleset rules = ruleset_from_cli(argc, argv);
+    set_integrator(rules);
     simulator s(rules);
-    set_optimization(s);
+    configure_simulator(s);
     s.initialize();
     s.run_simulation_slave();
 
@@ -93,10 +368,30 @@ int run_slave(int argc, char ** argv)
  */
 int run_master_perftest(int argc, char ** argv)
 {
+    set_memory_placement();
     ruleset rules = ruleset_from_cli(argc, argv);
+    set_integrator(rules);
     simulator s(rules);
-    set_optimization(s);
+    configure_simulator(s);
+    
+    int lockstep_steps = get_lockstep_steps();
+    
     s.initialize();
+    
+    if (lockstep_steps > 0)
+    {
+        if (mpi_comm_size() != 1)
+        {
+            cerr << "Lockstep validation runs on a single rank only!" << endl;
+            return EXIT_FAILURE;
+        }
+        
+        lockstep_validator validator(s);
+        validator.run(lockstep_steps, cout);
+        
+        return EXIT_SUCCESS;
+    }
+    
     s.run_simulation_master();
 
     return EXIT_SUCCESS;
@@ -104,8 +399,6 @@ int run_master_perftest(int argc, char ** argv)
 
 int main(int argc, char ** argv)
 {
-    setup_openmp();
-
     try
     {
         mpi_manager mpi(argc, argv);
@@ -5,6 +5,7 @@
 #include <math.h>
 #include "aligned_vector.h"
 #include <assert.h>
+#include <algorithm>
 #include "communication.h"
 
 /*
@@ -54,6 +55,21 @@ inline int matrix_index_wrapped(cint x, cint y, cint w, cint h, cint ld)
     return matrix_index(x >= 0 ? x % w : (w + x) % w, y >= 0 ? y % h : (h + y) % h, ld);
 }
 
+/**
+ * @brief folds a single coordinate back into [0, n). Faster than matrix_index_wrapped
+ * if c is usually inside the matrix, as the modulo is only calculated if needed
+ * @param c coordinate, can be negative
+ * @param n size of the dimension
+ * @return Wrapped coordinate
+ */
+inline int wrap_coordinate(cint c, cint n)
+{
+    if (c >= 0)
+        return c < n ? c : c % n;
+    else
+        return c >= -n ? n + c : (n + c % n) % n;
+}
+
 /**
  * @brief Calculates the ideal ld to 64 byte alignment
  * @param size
@@ -82,6 +98,18 @@ private:
     int m_offset;
     int m_leftOffset; // number of elements left from (a circles) center
     int m_rightOffset; // number of elements right from (a circles) center
+    int m_haloColumns; // number of ghost columns left and right of the matrix
+    int m_haloRows; // number of ghost rows above and below the matrix
+    int m_origin; // index of element (0,0). Not 0 if the matrix has a halo
+
+    /**
+     * @brief rounds the number of halo columns up to a full cache line
+     */
+    static int halo_columns_aligned(cint halo_columns)
+    {
+        cint line = CACHELINE_SIZE / sizeof (T);
+        return line * ((halo_columns + line - 1) / line);
+    }
 
 public:
 
@@ -94,7 +122,10 @@ public:
         m_ld(0),
         m_offset(0),
         m_leftOffset(0),
-        m_rightOffset(0)
+        m_rightOffset(0),
+        m_haloColumns(0),
+        m_haloRows(0),
+        m_origin(0)
     { }
 
     /**
@@ -109,9 +140,40 @@ public:
         m_columns(columns),
         m_offset(0),
         m_leftOffset(ceil(columns / 2)),
-        m_rightOffset(matrix_calc_ld_with_padding(sizeof (T), columns, CACHELINE_SIZE) - m_leftOffset)
+        m_rightOffset(matrix_calc_ld_with_padding(sizeof (T), columns, CACHELINE_SIZE) - m_leftOffset),
+        m_haloColumns(0),
+        m_haloRows(0),
+        m_origin(0)
+    {
+        assert((m_ld * sizeof (T)) % CACHELINE_SIZE == 0);
+    }
+
+    /**
+     * @brief halo constructor. Surrounds the matrix with ghost cells that hold the values of the opposite edge
+     * (periodic boundary, see update_halo). Coordinates -halo_columns <= x < columns + halo_columns and
+     * -halo_rows <= y < rows + halo_rows are valid, so a mask never has to wrap
+     * - halo_columns is rounded up to a cache line, so element (0,0) stays aligned
+     * - getValues() points to element (0,0)
+     * @param columns
+     * @param rows
+     * @param halo_columns minimum number of ghost columns on the left and right side
+     * @param halo_rows number of ghost rows on the top and bottom side
+     */
+    aligned_matrix(cint columns, cint rows, cint halo_columns, cint halo_rows) :
+        m_Mat(aligned_vector<T>(matrix_calc_ld_with_padding(sizeof (T), columns + 2 * halo_columns_aligned(halo_columns), CACHELINE_SIZE) * (rows + 2 * halo_rows))),
+        m_rows(rows),
+        m_columns(columns),
+        m_ld(matrix_calc_ld_with_padding(sizeof (T), columns + 2 * halo_columns_aligned(halo_columns), CACHELINE_SIZE)),
+        m_offset(0),
+        m_leftOffset(ceil(columns / 2)),
+        m_rightOffset(columns - m_leftOffset),
+        m_haloColumns(halo_columns_aligned(halo_columns)),
+        m_haloRows(halo_rows),
+        m_origin(halo_rows * m_ld + m_haloColumns)
     {
+        assert(rows > 0 && columns > 0 && halo_columns >= 0 && halo_rows >= 0);
         assert((m_ld * sizeof (T)) % CACHELINE_SIZE == 0);
+        assert((m_origin * sizeof (T)) % ALIGNMENT == 0);
     }
 
     /**
@@ -129,7 +191,10 @@ public:
         m_rows(rows),
         m_offset(offset),
         m_leftOffset(ceil(columns / 2) + offset),
-        m_rightOffset(CACHELINE_FLOATS * ceil(float(offset + columns) / CACHELINE_FLOATS) - m_leftOffset)
+        m_rightOffset(CACHELINE_FLOATS * ceil(float(offset + columns) / CACHELINE_FLOATS) - m_leftOffset),
+        m_haloColumns(0),
+        m_haloRows(0),
+        m_origin(0)
     {
         assert(rows > 0 && columns > 0 && offset >= 0 && offset <= CACHELINE_FLOATS);
         assert(m_ld * sizeof (T) % CACHELINE_SIZE == 0);
@@ -148,19 +213,56 @@ public:
         m_ld(copy.m_ld),
         m_offset(copy.m_offset),
         m_leftOffset(copy.m_leftOffset),
-        m_rightOffset(copy.m_rightOffset)
+        m_rightOffset(copy.m_rightOffset),
+        m_haloColumns(copy.m_haloColumns),
+        m_haloRows(copy.m_haloRows),
+        m_origin(copy.m_origin)
     {}
 
+    /**
+     * @brief takes the elements of other without copying them, other becomes empty
+     */
+    aligned_matrix(aligned_matrix<T> && other) : aligned_matrix()
+    {
+        swap(other);
+    }
+
+    /**
+     * @brief copy (or, from a temporary, move) and swap
+     */
+    aligned_matrix<T> & operator=(aligned_matrix<T> other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    /**
+     * @brief exchanges the contents of both matrices without copying the elements
+     */
+    void swap(aligned_matrix<T> & other)
+    {
+        m_Mat.swap(other.m_Mat);
+        std::swap(m_rows, other.m_rows);
+        std::swap(m_columns, other.m_columns);
+        std::swap(m_ld, other.m_ld);
+        std::swap(m_offset, other.m_offset);
+        std::swap(m_leftOffset, other.m_leftOffset);
+        std::swap(m_rightOffset, other.m_rightOffset);
+        std::swap(m_haloColumns, other.m_haloColumns);
+        std::swap(m_haloRows, other.m_haloRows);
+        std::swap(m_origin, other.m_origin);
+    }
+
     // Getter and Setter methods
 
     inline T getValue(cint x, cint y) const
     {
-        return m_Mat[matrix_index(x, y, m_ld)];
+        return m_Mat[m_origin + matrix_index(x, y, m_ld)];
     }
 
     inline T getValueWrapped(cint x, cint y) const
     {
-        return m_Mat[matrix_index_wrapped(x, y, m_columns, m_rows, m_ld)];
+        return m_Mat[m_origin + matrix_index_wrapped(x, y, m_columns, m_rows, m_ld)];
     }
     
     /**
@@ -169,47 +271,47 @@ public:
      */
     inline T getValueWrappedLd(cint col, cint row) const
     {
-        return m_Mat[matrix_index_wrapped(col, row, m_ld, m_rows, m_ld)];
+        return m_Mat[m_origin + matrix_index_wrapped(col, row, m_ld, m_rows, m_ld)];
     }
     
     inline T* getRow_ptr(int row)
     {
-        return &m_Mat.data()[matrix_index(0, row, m_ld)];
+        return &m_Mat.data()[m_origin + matrix_index(0, row, m_ld)];
     }
 
     inline const T* getRow_ptr(int row) const
     {
-        return &m_Mat.data()[matrix_index(0, row, m_ld)];
+        return &m_Mat.data()[m_origin + matrix_index(0, row, m_ld)];
     }
 
     inline const T* getValue_ptr(cint col, cint row) const
     {
-        return &m_Mat.data()[matrix_index(col, row, m_ld)];
+        return &m_Mat.data()[m_origin + matrix_index(col, row, m_ld)];
     }
 
     inline const T* getValueWrapped_ptr(cint col, cint row) const
     {
-        return &m_Mat.data()[matrix_index_wrapped(col, row, m_columns, m_rows, m_ld)];
+        return &m_Mat.data()[m_origin + matrix_index_wrapped(col, row, m_columns, m_rows, m_ld)];
     }
     
     inline const T* getValueWrappedLd_ptr(cint col, cint row) const
     {
-        return &m_Mat.data()[matrix_index_wrapped(col, row, m_ld, m_rows, m_ld)];
+        return &m_Mat.data()[m_origin + matrix_index_wrapped(col, row, m_ld, m_rows, m_ld)];
     }
 
     inline void setValue(T val, cint col, cint row)
     {
-        m_Mat[matrix_index(col, row, m_ld)] = val;
+        m_Mat[m_origin + matrix_index(col, row, m_ld)] = val;
     }
 
     inline void setValueWrapped(T val, cint col, cint row)
     {
-        m_Mat[matrix_index_wrapped(col, row, m_columns, m_rows, m_ld)] = val;
+        m_Mat[m_origin + matrix_index_wrapped(col, row, m_columns, m_rows, m_ld)] = val;
     }
 
     const T * getValues() const
     {
-        return m_Mat.data();
+        return m_Mat.data() + m_origin;
     }
 
     int getLd() const
@@ -237,6 +339,58 @@ public:
         return this->m_rightOffset;
     }
 
+    int getHaloColumns() const
+    {
+        return this->m_haloColumns;
+    }
+
+    int getHaloRows() const
+    {
+        return this->m_haloRows;
+    }
+
+    bool hasHalo() const
+    {
+        return m_haloColumns > 0 || m_haloRows > 0;
+    }
+
+    /**
+     * @brief Refreshes the ghost cells with the values of the opposite edge (periodic boundary)
+     * - the columns are done first, so the corners of the halo get their values from the row copies
+     * - the loops are shared by the threads of the enclosing parallel region (call with all of them), serial outside of one
+     */
+    void update_halo()
+    {
+        assert(m_haloColumns <= m_columns && m_haloRows <= m_rows);
+
+        if (m_haloColumns > 0)
+        {
+            #pragma omp for schedule(static)
+            for (int y = 0; y < m_rows; ++y)
+            {
+                T * row = getRow_ptr(y);
+
+                for (int x = 1; x <= m_haloColumns; ++x)
+                {
+                    row[-x] = row[m_columns - x];
+                    row[m_columns - 1 + x] = row[x - 1];
+                }
+            }
+        }
+
+        if (m_haloRows > 0)
+        {
+            cint w = m_columns + 2 * m_haloColumns;
+
+            #pragma omp for schedule(static)
+            for (int y = 1; y <= m_haloRows; ++y)
+            {
+                std::copy(getRow_ptr(m_rows - y) - m_haloColumns, getRow_ptr(m_rows - y) - m_haloColumns + w, getRow_ptr(-y) - m_haloColumns);
+                std::copy(getRow_ptr(y - 1) - m_haloColumns, getRow_ptr(y - 1) - m_haloColumns + w, getRow_ptr(m_rows - 1 + y) - m_haloColumns);
+            }
+        }
+    }
+
     // Advanced Access Methods
 
     friend ostream& operator<<(ostream& out, const aligned_matrix<T> & m)
@@ -317,8 +471,8 @@ public:
      * @brief sum accumulates all values of the matrix
      * @return
      */
-    float sum() const {
-        float s = 0;
+    T sum() const {
+        T s = 0;
 
         for (int i = 0; i < m_columns; ++i)
         {
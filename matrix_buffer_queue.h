@@ -5,6 +5,7 @@
 #include <atomic>
 #include <mutex>
 #include "matrix.h"
+#include "half_float.h"
 
 using namespace std;
 
@@ -13,6 +14,8 @@ template <typename T>
 /**
  * Combination between FIFO and state buffers. Allows in-place calculation and queueing of calculated states. 
  * Thread safe for two threads that call either push or pop.
+ * - with a snapshot precision of FP16 or BF16, only the read/write buffers are full matrices. The queued states
+ *   are converted to 16 bit snapshots on push, which halves the memory of the queue
  * 
  * @author Ruman
  */
@@ -20,7 +23,9 @@ class matrix_buffer_queue
 {
 public:
 
-    matrix_buffer_queue(int size, aligned_matrix<T> initial) : queue_max_size(size)
+    matrix_buffer_queue(int size, aligned_matrix<T> initial, storage_precision precision = storage_precision::FP32) :
+        queue_max_size(size),
+        snapshot_precision(precision)
     {
         if (size < 0)
         {
@@ -34,20 +39,26 @@ public:
             exit(EXIT_FAILURE);
         }
 
+        bool use_snapshots = precision != storage_precision::FP32 && size > 0;
+
         // Reserve size queue buffer + 2 read/write buffer
-        buffer.reserve(size + 2);
+        buffer.reserve(use_snapshots ? 2 : size + 2);
 
         buffer.push_back(initial); //Insert the initial read matrix
-        buffer.push_back(aligned_matrix<T>(initial.getNumCols(), initial.getNumRows())); //Insert the initial write matrix
+        buffer.push_back(create_like(initial)); //Insert the initial write matrix
 
         // Insert queue elements
         for (int i = 0; i < size; ++i)
         {
-            buffer.push_back(aligned_matrix<T>(initial.getNumCols(), initial.getNumRows()));
+            if (use_snapshots)
+                snapshots.push_back(aligned_matrix<uint16_t>(initial.getNumCols(), initial.getNumRows()));
+            else
+                buffer.push_back(create_like(initial));
         }
 
         queue_start = 0; //The queue is currently at position 0
         queue_size = 0; //The queue has 0 elements
+        queue_end = 0; //Snapshot written by the next push
         buffer_read = 0; //Reading happens at element 0
 
         update_buffer_pointers();
@@ -96,7 +107,17 @@ public:
             return false;
         }
         
-        buffer[queue_start].raw_copy_to(dst, x_start, w);
+        if (has_snapshots())
+        {
+            const aligned_matrix<uint16_t> & snapshot = snapshots[queue_start];
+
+            for (int y = 0; y < snapshot.getNumRows(); ++y)
+                storage_decode(snapshot.getRow_ptr(y) + x_start, dst + y * w, w, snapshot_precision);
+        }
+        else
+        {
+            buffer[queue_start].raw_copy_to(dst, x_start, w);
+        }
 
         /*int w = buffer[0].getNumCols();
         int h = buffer[0].getNumRows();
@@ -123,7 +144,7 @@ public:
      */
     bool pop(float * dst)
     {
-        return pop(dst, 0, buffer[queue_start].getNumCols());
+        return pop(dst, 0, buffer[0].getNumCols());
     }
 
     /**
@@ -138,7 +159,23 @@ public:
             return false;
         }
 
-        dst.overwrite(buffer[queue_start]);
+        if (has_snapshots())
+        {
+            const aligned_matrix<uint16_t> & snapshot = snapshots[queue_start];
+
+            if (snapshot.getNumCols() != dst.getNumCols() || snapshot.getNumRows() != dst.getNumRows())
+            {
+                cerr << "Cannot pop snapshot into matrix with different size!" << endl;
+                exit(EXIT_FAILURE);
+            }
+
+            for (int y = 0; y < snapshot.getNumRows(); ++y)
+                storage_decode(snapshot.getRow_ptr(y), dst.getRow_ptr(y), dst.getNumCols(), snapshot_precision);
+        }
+        else
+        {
+            dst.overwrite(buffer[queue_start]);
+        }
 
         //shrink the queue by 1
         queue_start = wrap_index(queue_start + 1);
@@ -154,6 +191,28 @@ public:
     {
         int expected = queue_size;
 
+        if (has_snapshots())
+        {
+            if (expected < queue_max_size)
+            {
+                // The slot behind the queue is never read by pop
+                aligned_matrix<uint16_t> & snapshot = snapshots[queue_end];
+
+                for (int y = 0; y < snapshot.getNumRows(); ++y)
+                    storage_encode(read_buffer->getRow_ptr(y), snapshot.getRow_ptr(y), snapshot.getNumCols(), snapshot_precision);
+
+                if (queue_size.compare_exchange_strong(expected, expected + 1))
+                {
+                    queue_end = wrap_index(queue_end + 1);
+                    std::swap(write_buffer, read_buffer);
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
         if (expected < queue_max_size)
         {
             if (queue_size.compare_exchange_strong(expected, expected + 1)) //Increase queue size if it did not change yet
@@ -220,15 +279,29 @@ public:
         return queue_max_size - queue_size;
     }
 
+    /**
+     * @brief creates an empty matrix with the same size and halo as m
+     */
+    static aligned_matrix<T> create_like(const aligned_matrix<T> & m)
+    {
+        if (m.hasHalo())
+            return aligned_matrix<T>(m.getNumCols(), m.getNumRows(), m.getHaloColumns(), m.getHaloRows());
+        else
+            return aligned_matrix<T>(m.getNumCols(), m.getNumRows());
+    }
+
 private:
 
     const int queue_max_size;
     vector<aligned_matrix<T>> buffer;
+    const storage_precision snapshot_precision;
+    vector<aligned_matrix<uint16_t>> snapshots; // queued states if snapshot_precision is not FP32
 
     atomic<int> queue_start; //Start of the queue. Atomic as this can be changed by another thread
     atomic<int> queue_size; // Size of the queue. Atomic as this can be changed by another thread
 
     int buffer_read; //Position where the buffer is reading
+    int queue_end; //Position of the next snapshot, only changed by push
 
 
     aligned_matrix<T> * write_buffer = nullptr;
@@ -236,7 +309,12 @@ private:
 
     inline int wrap_index(int i)
     {
-        return i % buffer.size();
+        return has_snapshots() ? i % snapshots.size() : i % buffer.size();
+    }
+
+    inline bool has_snapshots() const
+    {
+        return !snapshots.empty();
     }
 
     void update_buffer_pointers()
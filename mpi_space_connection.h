@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <string.h>
+#include "mpi_dual_connection.h"
+#include "matrix.h"
+#include "half_float.h"
+
+using namespace std;
+
+/**
+ * @brief mpi_dual_connection for a slice of columns of the space (a chunk or a border) in the storage precision of
+ * the simulator. FP16 and BF16 states are sent as 16 bit values, which halves the transferred bytes. The states are
+ * rounded to the storage precision already, so the conversion is lossless
+ * - the buffers are row major with ld = width of the slice (like aligned_matrix::raw_copy_to)
+ */
+class mpi_space_connection
+{
+public:
+
+    mpi_space_connection(int _other_rank, bool _is_sender, bool _is_reciever, int _tag, int _cells, storage_precision _precision) :
+    m_precision(_precision),
+    m_connection(_other_rank, _is_sender, _is_reciever, _tag, _cells * get_words_per_cell(_precision), MPI_UINT16_T)
+    { }
+
+    /**
+     * @brief Writes the columns [x_start, x_start + w) of space into the send buffer
+     */
+    void write(const aligned_matrix<float> & space, int x_start, int w)
+    {
+        uint16_t * buffer = m_connection.get_buffer_send()->data();
+
+        for (int y = 0; y < space.getNumRows(); ++y)
+        {
+            const float * row = space.getRow_ptr(y) + x_start;
+
+            if (m_precision == storage_precision::FP32)
+                memcpy(buffer + 2 * y * w, row, w * sizeof (float));
+            else
+                storage_encode(row, buffer + y * w, w, m_precision);
+        }
+    }
+
+    /**
+     * @brief Overwrites the columns [x_start, x_start + w) of space with the receive buffer
+     */
+    void read(aligned_matrix<float> & space, int x_start, int w)
+    {
+        const uint16_t * buffer = m_connection.get_buffer_recieve()->data();
+
+        for (int y = 0; y < space.getNumRows(); ++y)
+        {
+            float * row = space.getRow_ptr(y) + x_start;
+
+            if (m_precision == storage_precision::FP32)
+                memcpy(row, buffer + 2 * y * w, w * sizeof (float));
+            else
+                storage_decode(buffer + y * w, row, w, m_precision);
+        }
+    }
+
+    void sendrecv()
+    {
+        m_connection.sendrecv();
+    }
+
+    void recv()
+    {
+        m_connection.recv();
+    }
+
+    void send()
+    {
+        m_connection.send();
+    }
+
+    int get_other_rank()
+    {
+        return m_connection.get_other_rank();
+    }
+
+    /**
+     * @brief Returns how many 16 bit words a cell takes in the buffers
+     */
+    static int get_words_per_cell(storage_precision precision)
+    {
+        return precision == storage_precision::FP32 ? 2 : 1;
+    }
+
+private:
+
+    const storage_precision m_precision;
+
+    mpi_dual_connection<uint16_t> m_connection; // 16 bit words, a float takes two of them
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <iostream>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sched.h>
+#include <unistd.h>
+#include <omp.h>
+
+using namespace std;
+
+#define NUMA_ALLOCATOR_HUGE_PAGE_SIZE (2 * 1024 * 1024) // size of a huge page (x86-64)
+#define NUMA_ALLOCATOR_PAGE_SIZE 4096 // size of a normal page, the unit of the parallel first touch
+#define NUMA_ALLOCATOR_MIN_BYTES (256 * 1024) // smaller buffers (masks, MPI messages) are allocated as usual
+
+/**
+ * @brief How large buffers of numa_allocator are placed in memory. Set before the buffers are allocated
+ * (i.e. before simulator::initialize)
+ */
+struct memory_placement
+{
+    /**
+     * @brief Back buffers of at least NUMA_ALLOCATOR_HUGE_PAGE_SIZE with 2 MB pages. Tries explicit huge pages
+     * (MAP_HUGETLB, needs reserved pages in /proc/sys/vm/nr_hugepages) first, then transparent huge pages (madvise)
+     */
+    bool huge_pages = false;
+
+    /**
+     * @brief Touch the pages of a new buffer in parallel with schedule(static) over its pages. With first touch,
+     * each NUMA node then holds the band of rows its threads process in the tiled traversal (contiguous tiles per
+     * thread). Whole columns are shared by all threads, there is no placement that matches them
+     */
+    bool first_touch = false;
+};
+
+/**
+ * @brief Returns the global memory placement used by numa_allocator
+ */
+inline memory_placement & memory_placement_settings()
+{
+    static memory_placement settings;
+    return settings;
+}
+
+/**
+ * @brief Pins each OpenMP thread to one CPU (thread i to the i-th CPU it may run on). Call before the buffers are
+ * allocated, so the first touch is done by the pinned threads
+ * @return false if pinning failed
+ */
+inline bool pin_omp_threads()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof (cpu_set_t), &allowed) != 0)
+        return false;
+
+    bool pinned = true;
+
+    #pragma omp parallel reduction(&& : pinned)
+    {
+        // the i-th allowed CPU, wrapped if there are more threads than CPUs
+        int cpu = -1;
+        int index = omp_get_thread_num() % CPU_COUNT(&allowed);
+
+        for (int i = 0; i < CPU_SETSIZE && cpu < 0; ++i)
+        {
+            if (CPU_ISSET(i, &allowed) && index-- == 0)
+                cpu = i;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        pinned = sched_setaffinity(0, sizeof (cpu_set_t), &set) == 0;
+    }
+
+    return pinned;
+}
+
+/**
+ * @brief The buffers allocated with mmap and their sizes (the placement can change between allocate and deallocate)
+ */
+struct numa_mappings
+{
+    mutex lock;
+    unordered_map<void *, size_t> sizes;
+    atomic<size_t> live{0}; // number of entries in sizes, lets numa_deallocate skip the lock while it is 0
+};
+
+inline numa_mappings & numa_allocator_mappings()
+{
+    static numa_mappings mappings;
+    return mappings;
+}
+
+/**
+ * @brief Allocates bytes aligned to alignment, placed according to memory_placement_settings()
+ */
+inline void * numa_allocate(const size_t bytes, const size_t alignment)
+{
+    const memory_placement & settings = memory_placement_settings();
+    void * p = nullptr;
+
+    if (settings.huge_pages && bytes >= NUMA_ALLOCATOR_HUGE_PAGE_SIZE)
+    {
+        const size_t size = (bytes + NUMA_ALLOCATOR_HUGE_PAGE_SIZE - 1) / NUMA_ALLOCATOR_HUGE_PAGE_SIZE * NUMA_ALLOCATOR_HUGE_PAGE_SIZE;
+
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (p == MAP_FAILED)
+        {
+            // no explicit huge pages reserved, map 2 MB aligned and ask for transparent huge pages
+            char * mapping = (char *) mmap(nullptr, size + NUMA_ALLOCATOR_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (mapping == MAP_FAILED)
+                throw bad_alloc();
+
+            char * aligned = mapping + (NUMA_ALLOCATOR_HUGE_PAGE_SIZE - size_t(mapping) % NUMA_ALLOCATOR_HUGE_PAGE_SIZE) % NUMA_ALLOCATOR_HUGE_PAGE_SIZE;
+
+            if (aligned > mapping)
+                munmap(mapping, aligned - mapping);
+
+            if (aligned + size < mapping + size + NUMA_ALLOCATOR_HUGE_PAGE_SIZE)
+                munmap(aligned + size, mapping + size + NUMA_ALLOCATOR_HUGE_PAGE_SIZE - (aligned + size));
+
+            madvise(aligned, size, MADV_HUGEPAGE);
+            p = aligned;
+        }
+
+        numa_mappings & mappings = numa_allocator_mappings();
+        lock_guard<mutex> guard(mappings.lock);
+        mappings.sizes[p] = size;
+        mappings.live.store(mappings.sizes.size(), memory_order_release);
+    }
+    else if (posix_memalign(&p, alignment, bytes) != 0)
+    {
+        throw bad_alloc();
+    }
+
+    if (settings.first_touch && bytes >= NUMA_ALLOCATOR_MIN_BYTES)
+    {
+        // the first write to a page decides its NUMA node. Huge pages are placed as a whole by their first page
+        char * buffer = (char *) p;
+        const long pages = (bytes + NUMA_ALLOCATOR_PAGE_SIZE - 1) / NUMA_ALLOCATOR_PAGE_SIZE;
+
+        #pragma omp parallel for schedule(static)
+        for (long page = 0; page < pages; ++page)
+            buffer[page * NUMA_ALLOCATOR_PAGE_SIZE] = 0;
+    }
+
+    return p;
+}
+
+/**
+ * @brief Frees memory of numa_allocate
+ */
+inline void numa_deallocate(void * p)
+{
+    if (p == nullptr)
+        return;
+
+    numa_mappings & mappings = numa_allocator_mappings();
+
+    if (mappings.live.load(memory_order_acquire) == 0)
+    {
+        free(p);
+        return;
+    }
+
+    size_t size = 0;
+
+    {
+        lock_guard<mutex> guard(mappings.lock);
+        auto mapping = mappings.sizes.find(p);
+
+        if (mapping != mappings.sizes.end())
+        {
+            size = mapping->second;
+            mappings.sizes.erase(mapping);
+            mappings.live.store(mappings.sizes.size(), memory_order_release);
+        }
+    }
+
+    if (size > 0)
+        munmap(p, size);
+    else
+        free(p);
+}
+
+/**
+ * @brief Aligned allocator for the simulation buffers, see memory_placement. Without huge pages and first touch it
+ * behaves like an aligned allocator
+ */
+template <typename T, size_t Alignment>
+class numa_allocator
+{
+public:
+
+    typedef T value_type;
+    typedef T * pointer;
+    typedef const T * const_pointer;
+    typedef T & reference;
+    typedef const T & const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef numa_allocator<U, Alignment> other;
+    };
+
+    numa_allocator() { }
+
+    template <typename U>
+    numa_allocator(const numa_allocator<U, Alignment> &) { }
+
+    T * allocate(const size_t n)
+    {
+        return (T *) numa_allocate(n * sizeof (T), Alignment);
+    }
+
+    void deallocate(T * p, size_t)
+    {
+        numa_deallocate(p);
+    }
+};
+
+template <typename T, typename U, size_t Alignment>
+inline bool operator==(const numa_allocator<T, Alignment> &, const numa_allocator<U, Alignment> &)
+{
+    return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+inline bool operator!=(const numa_allocator<T, Alignment> &, const numa_allocator<U, Alignment> &)
+{
+    return false;
+}
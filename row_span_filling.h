@@ -0,0 +1,226 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <omp.h>
+#include "matrix.h"
+
+using namespace std;
+
+/**
+ * @brief A run of mask elements in one mask row that are exactly 1.0. Columns relative to the mask center
+ */
+struct mask_span
+{
+    int x_begin; // first column of the span
+    int x_end; // column after the span
+};
+
+/**
+ * @brief A mask element with a weight in (0,1), i.e. on the anti-aliased rim of a circle. Column relative to the mask center
+ */
+struct mask_rim_weight
+{
+    int dx;
+    float weight;
+};
+
+/**
+ * @brief The spans and rim weights of one mask row. Indices point into the lists of span_mask
+ */
+struct mask_span_row
+{
+    int dy; // row relative to the mask center
+    int span_begin;
+    int span_end;
+    int rim_begin;
+    int rim_end;
+};
+
+/**
+ * @brief Describes a mask as list of interior spans plus explicit rim weights.
+ * - the circles drawn by aligned_matrix::set_circle are 1.0 inside and only fractional on a thin rim,
+ *   so the number of spans is O(r) and the number of rim weights is O(r)
+ * - the center is the same as used by getFilling_unoptimized (columns / 2, rows / 2)
+ * - grouped by rows, so a user only has to wrap the row index once per mask row
+ */
+class span_mask
+{
+public:
+
+    span_mask() : m_width(0), m_height(0), m_reach_left(0), m_reach_right(0) { }
+
+    span_mask(const aligned_matrix<float> & mask) :
+        m_width(mask.getNumCols()),
+        m_height(mask.getNumRows()),
+        m_reach_left(0),
+        m_reach_right(0)
+    {
+        cint center_x = mask.getNumCols() / 2;
+        cint center_y = mask.getNumRows() / 2;
+
+        for (int j = 0; j < mask.getNumRows(); ++j)
+        {
+            mask_span_row row = {j - center_y, int(m_spans.size()), 0, int(m_rim.size()), 0};
+            int i = 0;
+
+            while (i < mask.getNumCols())
+            {
+                cfloat v = mask.getValue(i, j);
+
+                if (v == 1)
+                {
+                    int end = i + 1;
+
+                    while (end < mask.getNumCols() && mask.getValue(end, j) == 1)
+                        ++end;
+
+                    m_spans.push_back(mask_span{i - center_x, end - center_x});
+                    include_columns(i - center_x, end - center_x);
+                    i = end;
+                }
+                else
+                {
+                    if (v != 0)
+                    {
+                        m_rim.push_back(mask_rim_weight{i - center_x, v});
+                        include_columns(i - center_x, i + 1 - center_x);
+                    }
+
+                    ++i;
+                }
+            }
+
+            row.span_end = m_spans.size();
+            row.rim_end = m_rim.size();
+
+            // skip empty rows
+            if (row.span_end > row.span_begin || row.rim_end > row.rim_begin)
+                m_rows.push_back(row);
+        }
+    }
+
+    const vector<mask_span_row> & rows() const
+    {
+        return m_rows;
+    }
+
+    const vector<mask_span> & spans() const
+    {
+        return m_spans;
+    }
+
+    const vector<mask_rim_weight> & rim() const
+    {
+        return m_rim;
+    }
+
+    /**
+     * @brief Returns the number of columns of the described mask
+     */
+    int getNumCols() const
+    {
+        return m_width;
+    }
+
+    int getNumRows() const
+    {
+        return m_height;
+    }
+
+    /**
+     * @brief Returns how many columns left of the center the mask reaches (positive value)
+     */
+    int getReachLeft() const
+    {
+        return m_reach_left;
+    }
+
+    /**
+     * @brief Returns how many columns right of the center the mask reaches (column after the last non-zero element)
+     */
+    int getReachRight() const
+    {
+        return m_reach_right;
+    }
+
+private:
+
+    int m_width;
+    int m_height;
+    int m_reach_left;
+    int m_reach_right;
+    vector<mask_span_row> m_rows;
+    vector<mask_span> m_spans;
+    vector<mask_rim_weight> m_rim;
+
+    void include_columns(cint x_begin, cint x_end)
+    {
+        m_reach_left = max(m_reach_left, -x_begin);
+        m_reach_right = max(m_reach_right, x_end);
+    }
+};
+
+/**
+ * @brief Per-row prefix sums of a periodic space.
+ * - each row is extended by border columns on both sides (wrapped values), so span sums never need to wrap in x
+ * - accumulated in double, the sums of long rows lose too much precision in float
+ */
+class row_prefix_sums
+{
+public:
+
+    row_prefix_sums() : m_width(0), m_height(0), m_border(0), m_ld(0) { }
+
+    /**
+     * @brief Recalculates the prefix sums of space. The rows are shared by the threads of the enclosing parallel
+     * region (call with all of them), serial outside of one
+     * @param border how many columns a span may reach over the left or right edge of space
+     */
+    void update(const aligned_matrix<float> & space, cint border)
+    {
+        #pragma omp single
+        {
+            m_width = space.getNumCols();
+            m_height = space.getNumRows();
+            m_border = border;
+            m_ld = m_width + 2 * border + 1;
+
+            if (m_sums.size() != size_t(m_ld) * m_height)
+                m_sums.resize(size_t(m_ld) * m_height);
+        }
+
+        #pragma omp for schedule(static)
+        for (int y = 0; y < m_height; ++y)
+        {
+            const float * row = space.getRow_ptr(y);
+            double * sums = &m_sums[size_t(y) * m_ld];
+            double s = 0;
+
+            sums[0] = 0;
+
+            for (int t = 0; t < m_ld - 1; ++t)
+            {
+                s += row[wrap_coordinate(t - m_border, m_width)];
+                sums[t + 1] = s;
+            }
+        }
+    }
+
+    /**
+     * @brief Returns pointer to the prefix sums of row y. Index x (-border <= x <= width + border) is the sum of all elements left of column x
+     */
+    inline const double * getRow_ptr(cint y) const
+    {
+        return &m_sums[size_t(y) * m_ld + m_border];
+    }
+
+private:
+
+    int m_width;
+    int m_height;
+    int m_border;
+    int m_ld;
+    vector<double> m_sums;
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <iostream>
+#include "integrator.h"
 
 #define RULESET_DEFAULT_SPACE_W 720
 #define RULESET_DEFAULT_SPACE_H 256
@@ -205,6 +206,45 @@ public:
         this->m_delta_time = dt;
     }
 
+    /**
+     * @brief If the batched transfer function uses a lower degree exp approximation (relative error < 5e-5)
+     */
+    bool get_fast_sigmoid() const
+    {
+        return m_fast_sigmoid;
+    }
+
+    void set_fast_sigmoid(bool fast)
+    {
+        this->m_fast_sigmoid = fast;
+    }
+
+    /**
+     * @brief How the smooth time stepping is integrated (ignored by discrete rules)
+     */
+    integrator get_integrator() const
+    {
+        return m_integrator;
+    }
+
+    void set_integrator(integrator method)
+    {
+        this->m_integrator = method;
+    }
+
+    /**
+     * @brief The time derivative of the smooth time stepping (ignored by discrete rules)
+     */
+    time_stepping get_time_stepping() const
+    {
+        return m_time_stepping;
+    }
+
+    void set_time_stepping(time_stepping stepping)
+    {
+        this->m_time_stepping = stepping;
+    }
+
 private:
 
     int m_space_width;
@@ -222,6 +262,9 @@ private:
     float alpha_n; // outer sigmoid width
     bool m_is_discrete;
     float m_delta_time;
+    bool m_fast_sigmoid = false;
+    integrator m_integrator = integrator::EULER;
+    time_stepping m_time_stepping = time_stepping::TWO_S_MINUS_ONE;
 
 protected:
 
@@ -233,6 +276,77 @@ protected:
 
 };
 
+/**
+ * @brief The values of the Smooth Life L ruleset as compile time constants (used by specialized kernels)
+ */
+struct ruleset_smooth_life_l_constants
+{
+    static constexpr float radius_outer = 21;
+    static constexpr float radius_ratio = 3.0;
+    static constexpr float birth_min = 0.257;
+    static constexpr float birth_max = 0.336;
+    static constexpr float death_min = 0.365;
+    static constexpr float death_max = 0.549;
+    static constexpr float alpha_m = 0.147;
+    static constexpr float alpha_n = 0.028;
+    static constexpr bool is_discrete = false;
+    static constexpr float delta_time = 0.1;
+};
+
+/**
+ * @brief The values of the ruleset suggested in paper by S. Rafler as compile time constants (used by specialized kernels)
+ */
+struct ruleset_rafler_paper_constants
+{
+    static constexpr float radius_outer = 21;
+    static constexpr float radius_ratio = 3;
+    static constexpr float birth_min = 0.278;
+    static constexpr float birth_max = 0.365;
+    static constexpr float death_min = 0.267;
+    static constexpr float death_max = 0.445;
+    static constexpr float alpha_m = 0.147;
+    static constexpr float alpha_n = 0.028;
+    static constexpr bool is_discrete = false;
+    static constexpr float delta_time = 0.05;
+};
+
+/**
+ * @brief Sets the values of rules to the given constants (e.g. ruleset_smooth_life_l_constants)
+ */
+template <class constants>
+inline void ruleset_set_constants(ruleset & rules)
+{
+    rules.set_radius_outer(constants::radius_outer);
+    rules.set_radius_ratio(constants::radius_ratio);
+    rules.set_birth_min(constants::birth_min);
+    rules.set_birth_max(constants::birth_max);
+    rules.set_death_min(constants::death_min);
+    rules.set_death_max(constants::death_max);
+    rules.set_alpha_m(constants::alpha_m);
+    rules.set_alpha_n(constants::alpha_n);
+    rules.set_is_discrete(constants::is_discrete);
+    rules.set_delta_time(constants::delta_time);
+}
+
+/**
+ * @brief Returns true if all values of rules (except the space size) are the given constants. Rulesets changed on the
+ * command line or created with "new" do not match and use the generic kernels
+ */
+template <class constants>
+inline bool ruleset_has_constants(const ruleset & rules)
+{
+    return rules.get_radius_outer() == constants::radius_outer &&
+            rules.get_radius_ratio() == constants::radius_ratio &&
+            rules.get_birth_min() == constants::birth_min &&
+            rules.get_birth_max() == constants::birth_max &&
+            rules.get_death_min() == constants::death_min &&
+            rules.get_death_max() == constants::death_max &&
+            rules.get_alpha_m() == constants::alpha_m &&
+            rules.get_alpha_n() == constants::alpha_n &&
+            rules.get_is_discrete() == constants::is_discrete &&
+            rules.get_delta_time() == constants::delta_time;
+}
+
 /**
  * @brief Smooth Life L ruleset
  */
@@ -243,16 +357,7 @@ public:
     ruleset_smooth_life_l(int width, int height) : ruleset(width, height)
     {
         printf("Using ruleset: smooth life l\n");
-        set_radius_outer(21);
-        set_radius_ratio(3.0);
-        set_birth_min(0.257);
-        set_birth_max(0.336);
-        set_death_min(0.365);
-        set_death_max(0.549);
-        set_alpha_m(0.147);
-        set_alpha_n(0.028);
-        set_is_discrete(false);
-        set_delta_time(0.1);
+        ruleset_set_constants<ruleset_smooth_life_l_constants>(*this);
     }
 };
 
@@ -266,16 +371,7 @@ public:
     ruleset_rafler_paper(int width, int height) : ruleset(width, height)
     {
         printf("Using ruleset: rafler paper\n");
-        set_alpha_n(0.028);
-        set_alpha_m(0.147);
-        set_radius_outer(21);
-        set_radius_ratio(3);
-        set_birth_min(0.278);
-        set_birth_max(0.365);
-        set_death_min(0.267);
-        set_death_max(0.445);
-        set_is_discrete(false);
-        set_delta_time(0.05);
+        ruleset_set_constants<ruleset_rafler_paper_constants>(*this);
     }
 };
 
@@ -296,8 +392,8 @@ inline void cli_print_help()
 {
     cout << "smooth_life" << endl;
     cout << "smooth_life help" << endl;
-    cout << "smooth_life <ruleset> (w) (h) (ra) (rr) (b1) (b2) (d1) (d2) (alpha_m) (alpha_n) (dt) (discrete 0/1); set to = for no change" << endl;
-    cout << "smooth_life new (w) (h) (ra) (rr) (b1) (b2) (d1) (d2) (alpha_m) (alpha_n) (dt) (discrete 0/1)" << endl;
+    cout << "smooth_life <ruleset> (w) (h) (ra) (rr) (b1) (b2) (d1) (d2) (alpha_m) (alpha_n) (dt) (discrete 0/1) (fast sigmoid 0/1); set to = for no change" << endl;
+    cout << "smooth_life new (w) (h) (ra) (rr) (b1) (b2) (d1) (d2) (alpha_m) (alpha_n) (dt) (discrete 0/1) (fast sigmoid 0/1)" << endl;
 }
 
 inline void ruleset_cli_set_float_value(char ** argv, int index, ruleset & base, bool new_ruleset, void (ruleset::*set)(float))
@@ -342,9 +438,9 @@ inline ruleset ruleset_from_cli(int argc, char ** argv)
     }
     else
     {
-        if (string(argv[1]) == "help" || params > 13)
+        if (string(argv[1]) == "help" || params > 14)
         {
-            if (params > 13)
+            if (params > 14)
                 cerr << "Too many parameters!" << endl;
 
             cli_print_help();
@@ -400,6 +496,9 @@ inline ruleset ruleset_from_cli(int argc, char ** argv)
             //Set discrete
             if (params >= 13)
                 ruleset_cli_set_bool_value(argv, 13, base, new_ruleset, &ruleset::set_is_discrete);
+            //Set fast sigmoid (optional for new rulesets)
+            if (params >= 14)
+                ruleset_cli_set_bool_value(argv, 14, base, false, &ruleset::set_fast_sigmoid);
 
             return base;
         }
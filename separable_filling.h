@@ -0,0 +1,286 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <assert.h>
+#include <omp.h>
+#include "matrix.h"
+#include "simd_kernels.h"
+
+using namespace std;
+
+#define SEPARABLE_FILLING_STRIP 64 //columns of the strips of the passes
+#define SEPARABLE_FILLING_BLOCK_ROWS 32 //rows of a strip the terms are summed for at once in the vertical pass
+#define SEPARABLE_FILLING_MAX_SWEEPS 64 //limit of the Jacobi sweeps of the SVD (they converge after about 10)
+
+/**
+ * @brief Approximates the filling of a mask by a sum of separable (rank 1) kernels of its SVD:
+ * mask = sum of column_i * row_i^T over i < rank (row_i includes the singular value)
+ * - rank is the smallest number of terms whose error bound is at most the tolerance. The bound is the sum of the
+ *   magnitudes of the left out part of the mask divided by the mask sum, no state in [0,1] can have a larger error
+ * - each term is applied as a horizontal pass over the rows of the space into a temporary field and a vertical pass
+ *   over its columns added to the fillings, so a cell costs 2 * rank * (mask size) instead of (mask size)^2
+ * - the space is periodic like in getValueWrapped
+ */
+class separable_filling
+{
+public:
+
+    /**
+     * @brief Decomposes mask (centered at columns / 2, rows / 2 like in simulator_core::filling)
+     * @param mask_sum the results of convolve are divided by it
+     * @param tolerance largest allowed error bound, 0 keeps all terms
+     */
+    void set_mask(const aligned_matrix<float> & mask, cfloat mask_sum, cdouble tolerance)
+    {
+        cint rows = mask.getNumRows();
+        cint columns = mask.getNumCols();
+
+        // one-sided Jacobi SVD: the columns of u are rotated until they are orthogonal, v holds the rotations.
+        // mask = u * v^T, the norm of a column of u is its singular value
+        vector<double> u(size_t(rows) * columns);
+        vector<double> v(size_t(columns) * columns, 0);
+
+        for (int y = 0; y < rows; ++y)
+            for (int x = 0; x < columns; ++x)
+                u[y * columns + x] = mask.getValue(x, y);
+
+        for (int x = 0; x < columns; ++x)
+            v[x * columns + x] = 1;
+
+        for (int sweep = 0; sweep < SEPARABLE_FILLING_MAX_SWEEPS; ++sweep)
+        {
+            bool rotated = false;
+
+            for (int p = 0; p < columns - 1; ++p)
+            {
+                for (int q = p + 1; q < columns; ++q)
+                {
+                    double alpha = 0;
+                    double beta = 0;
+                    double gamma = 0;
+
+                    for (int y = 0; y < rows; ++y)
+                    {
+                        alpha += u[y * columns + p] * u[y * columns + p];
+                        beta += u[y * columns + q] * u[y * columns + q];
+                        gamma += u[y * columns + p] * u[y * columns + q];
+                    }
+
+                    if (fabs(gamma) <= 1.0e-15 * sqrt(alpha * beta) || gamma == 0)
+                        continue;
+
+                    rotated = true;
+
+                    cdouble zeta = (beta - alpha) / (2 * gamma);
+                    cdouble t = (zeta >= 0 ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+                    cdouble c = 1 / sqrt(1 + t * t);
+                    cdouble s = c * t;
+
+                    rotate(u, rows, columns, p, q, c, s);
+                    rotate(v, columns, columns, p, q, c, s);
+                }
+            }
+
+            if (!rotated)
+                break;
+        }
+
+        // terms by descending singular value
+        vector<double> norms(columns);
+        vector<int> order(columns);
+
+        for (int x = 0; x < columns; ++x)
+        {
+            double norm = 0;
+
+            for (int y = 0; y < rows; ++y)
+                norm += u[y * columns + x] * u[y * columns + x];
+
+            norms[x] = norm;
+            order[x] = x;
+        }
+
+        sort(order.begin(), order.end(), [&norms](int a, int b) { return norms[a] > norms[b]; });
+
+        // add terms until the rest of the mask is within the tolerance
+        vector<double> residual(size_t(rows) * columns);
+
+        for (int y = 0; y < rows; ++y)
+            for (int x = 0; x < columns; ++x)
+                residual[y * columns + x] = mask.getValue(x, y);
+
+        m_rows = rows;
+        m_columns = columns;
+        m_column_kernels.clear();
+        m_row_kernels.clear();
+        m_error_bound = residual_bound(residual, mask_sum);
+
+        for (int i = 0; i < columns && m_error_bound > tolerance; ++i)
+        {
+            cint term = order[i];
+
+            for (int y = 0; y < rows; ++y)
+            {
+                // normalization folded into the vertical kernel
+                m_column_kernels.push_back(u[y * columns + term] / mask_sum);
+
+                for (int x = 0; x < columns; ++x)
+                    residual[y * columns + x] -= u[y * columns + term] * v[x * columns + term];
+            }
+
+            for (int x = 0; x < columns; ++x)
+                m_row_kernels.push_back(v[x * columns + term]);
+
+            m_error_bound = residual_bound(residual, mask_sum);
+        }
+    }
+
+    /**
+     * @brief Returns the number of separable terms
+     */
+    int rank() const
+    {
+        return m_columns > 0 ? m_row_kernels.size() / m_columns : 0;
+    }
+
+    /**
+     * @brief Returns the largest error of a filling over all states in [0,1]
+     */
+    double error_bound() const
+    {
+        return m_error_bound;
+    }
+
+    /**
+     * @brief Calculates the approximated fillings of all cells of space. The strips of columns are shared by the
+     * threads of the enclosing parallel region (call with all of them), serial outside of one
+     * @param filling receives the fillings, must have the size of space
+     * @param kernel applies the 1D kernels (see line_filter_kernel_for)
+     */
+    void convolve(const aligned_matrix<float> & space, aligned_matrix<float> & filling, line_filter_kernel kernel)
+    {
+        cint w = space.getNumCols();
+        cint h = space.getNumRows();
+        cint center_x = m_columns / 2;
+        cint center_y = m_rows / 2;
+        cint extended_h = h + m_rows - 1;
+
+        assert(filling.getNumCols() == w && filling.getNumRows() == h);
+
+        #pragma omp single
+        {
+            if (m_strip_buffers.size() < size_t(omp_get_num_threads()))
+                m_strip_buffers.resize(omp_get_num_threads());
+        }
+
+        // the buffers are kept between the calls
+        strip_buffer & buffer = m_strip_buffers[omp_get_thread_num()];
+        buffer.extended_row.resize(SEPARABLE_FILLING_STRIP + m_columns - 1);
+
+        if (buffer.rows_filtered.getNumRows() != rank() * extended_h)
+            buffer.rows_filtered = aligned_matrix<float>(SEPARABLE_FILLING_STRIP, rank() * extended_h);
+
+        // Both passes are done for a strip of columns at a time, the filtered rows of all terms of the strip stay in
+        // the cache. The terms are summed in the strip, each filling is written once
+        #pragma omp for schedule(static)
+        for (int strip = 0; strip < w; strip += SEPARABLE_FILLING_STRIP)
+        {
+            cint n = min(SEPARABLE_FILLING_STRIP, w - strip);
+            cint extended_w = n + m_columns - 1;
+            cint strip_begin = strip - center_x;
+
+            // horizontal pass: the row kernels over the strip of each row of space. Row y of the result of a term is
+            // stored at y + center_y of its block of rows and repeated above and below (wrapped), so the vertical
+            // pass never wraps
+            for (int y = 0; y < h; ++y)
+            {
+                const float * const s_row = space.getRow_ptr(y);
+
+                if (strip_begin >= 0 && strip_begin + extended_w <= w)
+                {
+                    copy(s_row + strip_begin, s_row + strip_begin + extended_w, buffer.extended_row.begin());
+                }
+                else
+                {
+                    for (int x = 0; x < extended_w; ++x)
+                        buffer.extended_row[x] = s_row[wrap_coordinate(strip_begin + x, w)];
+                }
+
+                for (int term = 0; term < rank(); ++term)
+                {
+                    float * const out = buffer.rows_filtered.getRow_ptr(term * extended_h + y + center_y);
+                    kernel(buffer.extended_row.data(), 1, &m_row_kernels[size_t(term) * m_columns], m_columns, n, out, false);
+
+                    for (int e = (y + center_y) % h; e < extended_h; e += h)
+                    {
+                        if (e != y + center_y)
+                            copy(out, out + n, buffer.rows_filtered.getRow_ptr(term * extended_h + e));
+                    }
+                }
+            }
+
+            // vertical pass: the column kernels of all terms over the filtered rows of the strip, for blocks of rows.
+            // The rows a term reads for a block stay in the L1 cache
+            for (int y_block = 0; y_block < h; y_block += SEPARABLE_FILLING_BLOCK_ROWS)
+            {
+                cint rows = min(SEPARABLE_FILLING_BLOCK_ROWS, h - y_block);
+                alignas(ALIGNMENT) float sum[SEPARABLE_FILLING_BLOCK_ROWS][SEPARABLE_FILLING_STRIP];
+
+                // the tolerance allows to leave out the whole mask
+                if (rank() == 0)
+                    fill(&sum[0][0], &sum[0][0] + SEPARABLE_FILLING_BLOCK_ROWS * SEPARABLE_FILLING_STRIP, 0.0f);
+
+                for (int term = 0; term < rank(); ++term)
+                {
+                    for (int i = 0; i < rows; ++i)
+                        kernel(buffer.rows_filtered.getRow_ptr(term * extended_h + y_block + i), buffer.rows_filtered.getLd(), &m_column_kernels[size_t(term) * m_rows], m_rows, n, sum[i], term > 0);
+                }
+
+                for (int i = 0; i < rows; ++i)
+                    copy(sum[i], sum[i] + n, filling.getRow_ptr(y_block + i) + strip);
+            }
+        }
+    }
+
+private:
+
+    int m_rows = 0;
+    int m_columns = 0;
+    vector<float> m_row_kernels; // rank x columns, the horizontal kernel of each term
+    vector<float> m_column_kernels; // rank x rows, the vertical kernel of each term (divided by the mask sum)
+    double m_error_bound = 0;
+    /**
+     * @brief Working memory of a thread in convolve
+     */
+    struct strip_buffer
+    {
+        vector<float> extended_row; // the columns of a row of space the row kernels of a strip read (wrapped)
+        aligned_matrix<float> rows_filtered; // results of the horizontal pass of a strip, extended rows of each term
+    };
+
+    vector<strip_buffer> m_strip_buffers; // one per thread
+
+    static void rotate(vector<double> & a, cint rows, cint columns, cint p, cint q, cdouble c, cdouble s)
+    {
+        for (int y = 0; y < rows; ++y)
+        {
+            cdouble ap = a[y * columns + p];
+            cdouble aq = a[y * columns + q];
+            a[y * columns + p] = c * ap - s * aq;
+            a[y * columns + q] = s * ap + c * aq;
+        }
+    }
+
+    static double residual_bound(const vector<double> & residual, cfloat mask_sum)
+    {
+        double sum = 0;
+
+        for (double r : residual)
+            sum += fabs(r);
+
+        return sum / mask_sum;
+    }
+};
@@ -0,0 +1,1418 @@
+#include "simd_kernels.h"
+#include "aligned_vector.h"
+#include <string.h>
+#include <assert.h>
+
+#if SIMD_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+simd_level simd_level_detect()
+{
+#if SIMD_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return simd_level::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+        return simd_level::AVX2;
+#endif
+
+    return simd_level::PORTABLE;
+}
+
+filling_kernel filling_kernel_for(simd_level level)
+{
+    switch (level)
+    {
+    case simd_level::AVX2: return filling_kernel_avx2;
+    case simd_level::AVX512: return filling_kernel_avx512;
+    default: return filling_kernel_portable;
+    }
+}
+
+fused_filling_kernel fused_filling_kernel_for(simd_level level)
+{
+    switch (level)
+    {
+    case simd_level::AVX2: return fused_filling_kernel_avx2;
+    case simd_level::AVX512: return fused_filling_kernel_avx512;
+    default: return fused_filling_kernel_portable;
+    }
+}
+
+float filling_kernel_portable(const float * s, int s_ld, const float * m, int m_ld, int rows, int n)
+{
+    float f = 0;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * const __restrict__ s_row = s + y * s_ld;
+        const float * const __restrict__ m_row = m + y * m_ld;
+        #pragma omp simd reduction(+:f)
+        for (int x = 0; x < n; ++x)
+            f += s_row[x] * m_row[x];
+    }
+
+    return f;
+}
+
+void fused_filling_kernel_portable(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    float fi = 0;
+    float fo = 0;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * const __restrict__ s_row = s + y * s_ld;
+        const float * const __restrict__ mi_row = m_inner + y * m_ld;
+        const float * const __restrict__ mo_row = m_outer + y * m_ld;
+        #pragma omp simd reduction(+:fi, fo)
+        for (int x = 0; x < n; ++x)
+        {
+            fi += s_row[x] * mi_row[x];
+            fo += s_row[x] * mo_row[x];
+        }
+    }
+
+    f_inner += fi;
+    f_outer += fo;
+}
+
+#if SIMD_KERNELS_X86
+
+/*
+ * - four independent accumulators hide the FMA latency. They are carried over all rows
+ * - unaligned loads: same speed as aligned loads on aligned data, but the wrapped cases of getFilling are not always aligned
+ * - the row tail is done with a masked load instead of a scalar loop
+ */
+
+__attribute__((target("avx2,fma")))
+static inline float horizontal_sum_avx2(const __m256 v)
+{
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const __m128 quarter = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(quarter, _mm_shuffle_ps(quarter, quarter, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+float filling_kernel_avx2(const float * s, int s_ld, const float * m, int m_ld, int rows, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i tail_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n % 8), lane);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * m_row = m + y * m_ld;
+        int x = 0;
+
+        for (; x + 32 <= n; x += 32)
+        {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + x), _mm256_loadu_ps(m_row + x), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + x + 8), _mm256_loadu_ps(m_row + x + 8), acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + x + 16), _mm256_loadu_ps(m_row + x + 16), acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + x + 24), _mm256_loadu_ps(m_row + x + 24), acc3);
+        }
+        if (x + 16 <= n)
+        {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + x), _mm256_loadu_ps(m_row + x), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + x + 8), _mm256_loadu_ps(m_row + x + 8), acc1);
+            x += 16;
+        }
+        if (x + 8 <= n)
+        {
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + x), _mm256_loadu_ps(m_row + x), acc2);
+            x += 8;
+        }
+        if (x < n)
+        {
+            acc3 = _mm256_fmadd_ps(_mm256_maskload_ps(s_row + x, tail_mask), _mm256_maskload_ps(m_row + x, tail_mask), acc3);
+        }
+    }
+
+    return horizontal_sum_avx2(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+}
+
+/**
+ * Sum of the lanes of v, like _mm512_reduce_add_ps. The unmasked extracts of gcc pass an undefined vector as source
+ * and trigger -Wuninitialized, the masked ones with all lanes set do not
+ */
+__attribute__((target("avx512f")))
+static inline float horizontal_sum_avx512(const __m512 v)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256 lower = _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(zero, 0xF, _mm512_castps_pd(v), 0));
+    const __m256 upper = _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(zero, 0xF, _mm512_castps_pd(v), 1));
+    return horizontal_sum_avx2(_mm256_add_ps(lower, upper));
+}
+
+__attribute__((target("avx512f")))
+float filling_kernel_avx512(const float * s, int s_ld, const float * m, int m_ld, int rows, int n)
+{
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+
+    const __mmask16 tail_mask = (__mmask16) ((1u << (n % 16)) - 1);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * m_row = m + y * m_ld;
+        int x = 0;
+
+        for (; x + 64 <= n; x += 64)
+        {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + x), _mm512_loadu_ps(m_row + x), acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + x + 16), _mm512_loadu_ps(m_row + x + 16), acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + x + 32), _mm512_loadu_ps(m_row + x + 32), acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + x + 48), _mm512_loadu_ps(m_row + x + 48), acc3);
+        }
+        if (x + 32 <= n)
+        {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + x), _mm512_loadu_ps(m_row + x), acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + x + 16), _mm512_loadu_ps(m_row + x + 16), acc1);
+            x += 32;
+        }
+        if (x + 16 <= n)
+        {
+            acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + x), _mm512_loadu_ps(m_row + x), acc2);
+            x += 16;
+        }
+        if (x < n)
+        {
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail_mask, s_row + x), _mm512_maskz_loadu_ps(tail_mask, m_row + x), acc3);
+        }
+    }
+
+    return horizontal_sum_avx512(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx2,fma")))
+void fused_filling_kernel_avx2(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    __m256 acc_inner0 = _mm256_setzero_ps();
+    __m256 acc_inner1 = _mm256_setzero_ps();
+    __m256 acc_outer0 = _mm256_setzero_ps();
+    __m256 acc_outer1 = _mm256_setzero_ps();
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i tail_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n % 8), lane);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * mi_row = m_inner + y * m_ld;
+        const float * mo_row = m_outer + y * m_ld;
+        int x = 0;
+
+        for (; x + 16 <= n; x += 16)
+        {
+            const __m256 s0 = _mm256_loadu_ps(s_row + x);
+            const __m256 s1 = _mm256_loadu_ps(s_row + x + 8);
+            acc_inner0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mo_row + x), acc_outer0);
+            acc_inner1 = _mm256_fmadd_ps(s1, _mm256_loadu_ps(mi_row + x + 8), acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s1, _mm256_loadu_ps(mo_row + x + 8), acc_outer1);
+        }
+        if (x + 8 <= n)
+        {
+            const __m256 s0 = _mm256_loadu_ps(s_row + x);
+            acc_inner0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mo_row + x), acc_outer0);
+            x += 8;
+        }
+        if (x < n)
+        {
+            const __m256 s0 = _mm256_maskload_ps(s_row + x, tail_mask);
+            acc_inner1 = _mm256_fmadd_ps(s0, _mm256_maskload_ps(mi_row + x, tail_mask), acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s0, _mm256_maskload_ps(mo_row + x, tail_mask), acc_outer1);
+        }
+    }
+
+    f_inner += horizontal_sum_avx2(_mm256_add_ps(acc_inner0, acc_inner1));
+    f_outer += horizontal_sum_avx2(_mm256_add_ps(acc_outer0, acc_outer1));
+}
+
+__attribute__((target("avx512f")))
+void fused_filling_kernel_avx512(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    __m512 acc_inner0 = _mm512_setzero_ps();
+    __m512 acc_inner1 = _mm512_setzero_ps();
+    __m512 acc_outer0 = _mm512_setzero_ps();
+    __m512 acc_outer1 = _mm512_setzero_ps();
+
+    const __mmask16 tail_mask = (__mmask16) ((1u << (n % 16)) - 1);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * mi_row = m_inner + y * m_ld;
+        const float * mo_row = m_outer + y * m_ld;
+        int x = 0;
+
+        for (; x + 32 <= n; x += 32)
+        {
+            const __m512 s0 = _mm512_loadu_ps(s_row + x);
+            const __m512 s1 = _mm512_loadu_ps(s_row + x + 16);
+            acc_inner0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mo_row + x), acc_outer0);
+            acc_inner1 = _mm512_fmadd_ps(s1, _mm512_loadu_ps(mi_row + x + 16), acc_inner1);
+            acc_outer1 = _mm512_fmadd_ps(s1, _mm512_loadu_ps(mo_row + x + 16), acc_outer1);
+        }
+        if (x + 16 <= n)
+        {
+            const __m512 s0 = _mm512_loadu_ps(s_row + x);
+            acc_inner0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mo_row + x), acc_outer0);
+            x += 16;
+        }
+        if (x < n)
+        {
+            const __m512 s0 = _mm512_maskz_loadu_ps(tail_mask, s_row + x);
+            acc_inner1 = _mm512_fmadd_ps(s0, _mm512_maskz_loadu_ps(tail_mask, mi_row + x), acc_inner1);
+            acc_outer1 = _mm512_fmadd_ps(s0, _mm512_maskz_loadu_ps(tail_mask, mo_row + x), acc_outer1);
+        }
+    }
+
+    f_inner += horizontal_sum_avx512(_mm512_add_ps(acc_inner0, acc_inner1));
+    f_outer += horizontal_sum_avx512(_mm512_add_ps(acc_outer0, acc_outer1));
+}
+
+#else
+
+float filling_kernel_avx2(const float * s, int s_ld, const float * m, int m_ld, int rows, int n)
+{
+    return filling_kernel_portable(s, s_ld, m, m_ld, rows, n);
+}
+
+float filling_kernel_avx512(const float * s, int s_ld, const float * m, int m_ld, int rows, int n)
+{
+    return filling_kernel_portable(s, s_ld, m, m_ld, rows, n);
+}
+
+void fused_filling_kernel_avx2(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    fused_filling_kernel_portable(s, s_ld, m_inner, m_outer, m_ld, rows, n, f_inner, f_outer);
+}
+
+void fused_filling_kernel_avx512(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    fused_filling_kernel_portable(s, s_ld, m_inner, m_outer, m_ld, rows, n, f_inner, f_outer);
+}
+
+#endif
+
+/*
+ * Kernels with the block size as template parameters. They are only used for full mask blocks (the mask is accessed
+ * without wrapping or over the halo), so the mask rows are contiguous: m_ld == columns.
+ * - all trip counts are known at compile time, the column loop is unrolled completely and there are no tails
+ * - the masks have 2 * ra + 2 rows. They are padded to whole cache lines depending on their offset,
+ *   so there are two widths per radius
+ */
+
+#define FIXED_KERNEL_ROWS (2 * FIXED_KERNEL_RADIUS + 2)
+#define FIXED_KERNEL_COLUMNS_NARROW ((FIXED_KERNEL_ROWS + 15) / 16 * 16)
+#define FIXED_KERNEL_COLUMNS_WIDE (FIXED_KERNEL_COLUMNS_NARROW + 16)
+
+template <int rows, int columns>
+static float fixed_filling_kernel_portable(const float * s, int s_ld, const float * m, int, int, int)
+{
+    float f = 0;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * const __restrict__ s_row = s + y * s_ld;
+        const float * const __restrict__ m_row = m + y * columns;
+        #pragma omp simd reduction(+:f)
+        for (int x = 0; x < columns; ++x)
+            f += s_row[x] * m_row[x];
+    }
+
+    return f;
+}
+
+template <int rows, int columns>
+static void fixed_fused_filling_kernel_portable(const float * s, int s_ld, const float * m_inner, const float * m_outer, int, int, int, float & f_inner, float & f_outer)
+{
+    float fi = 0;
+    float fo = 0;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * const __restrict__ s_row = s + y * s_ld;
+        const float * const __restrict__ mi_row = m_inner + y * columns;
+        const float * const __restrict__ mo_row = m_outer + y * columns;
+        #pragma omp simd reduction(+:fi, fo)
+        for (int x = 0; x < columns; ++x)
+        {
+            fi += s_row[x] * mi_row[x];
+            fo += s_row[x] * mo_row[x];
+        }
+    }
+
+    f_inner += fi;
+    f_outer += fo;
+}
+
+#if SIMD_KERNELS_X86
+
+template <int rows, int columns>
+__attribute__((target("avx2,fma")))
+static float fixed_filling_kernel_avx2(const float * s, int s_ld, const float * m, int, int, int)
+{
+    static_assert(columns % 8 == 0, "fixed kernels need whole vectors");
+
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * m_row = m + y * columns;
+
+        for (int v = 0; v < columns / 8; ++v)
+            acc[v % 4] = _mm256_fmadd_ps(_mm256_loadu_ps(s_row + 8 * v), _mm256_loadu_ps(m_row + 8 * v), acc[v % 4]);
+    }
+
+    return horizontal_sum_avx2(_mm256_add_ps(_mm256_add_ps(acc[0], acc[1]), _mm256_add_ps(acc[2], acc[3])));
+}
+
+template <int rows, int columns>
+__attribute__((target("avx2,fma")))
+static void fixed_fused_filling_kernel_avx2(const float * s, int s_ld, const float * m_inner, const float * m_outer, int, int, int, float & f_inner, float & f_outer)
+{
+    static_assert(columns % 8 == 0, "fixed kernels need whole vectors");
+
+    __m256 acc_inner[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    __m256 acc_outer[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * mi_row = m_inner + y * columns;
+        const float * mo_row = m_outer + y * columns;
+
+        for (int v = 0; v < columns / 8; ++v)
+        {
+            const __m256 s0 = _mm256_loadu_ps(s_row + 8 * v);
+            acc_inner[v % 2] = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mi_row + 8 * v), acc_inner[v % 2]);
+            acc_outer[v % 2] = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mo_row + 8 * v), acc_outer[v % 2]);
+        }
+    }
+
+    f_inner += horizontal_sum_avx2(_mm256_add_ps(acc_inner[0], acc_inner[1]));
+    f_outer += horizontal_sum_avx2(_mm256_add_ps(acc_outer[0], acc_outer[1]));
+}
+
+template <int rows, int columns>
+__attribute__((target("avx512f")))
+static float fixed_filling_kernel_avx512(const float * s, int s_ld, const float * m, int, int, int)
+{
+    static_assert(columns % 16 == 0, "fixed kernels need whole vectors");
+
+    __m512 acc[columns / 16];
+
+    for (int v = 0; v < columns / 16; ++v)
+        acc[v] = _mm512_setzero_ps();
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * m_row = m + y * columns;
+
+        for (int v = 0; v < columns / 16; ++v)
+            acc[v] = _mm512_fmadd_ps(_mm512_loadu_ps(s_row + 16 * v), _mm512_loadu_ps(m_row + 16 * v), acc[v]);
+    }
+
+    for (int v = 1; v < columns / 16; ++v)
+        acc[0] = _mm512_add_ps(acc[0], acc[v]);
+
+    return horizontal_sum_avx512(acc[0]);
+}
+
+template <int rows, int columns>
+__attribute__((target("avx512f")))
+static void fixed_fused_filling_kernel_avx512(const float * s, int s_ld, const float * m_inner, const float * m_outer, int, int, int, float & f_inner, float & f_outer)
+{
+    static_assert(columns % 16 == 0, "fixed kernels need whole vectors");
+
+    __m512 acc_inner[columns / 16];
+    __m512 acc_outer[columns / 16];
+
+    for (int v = 0; v < columns / 16; ++v)
+    {
+        acc_inner[v] = _mm512_setzero_ps();
+        acc_outer[v] = _mm512_setzero_ps();
+    }
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * mi_row = m_inner + y * columns;
+        const float * mo_row = m_outer + y * columns;
+
+        for (int v = 0; v < columns / 16; ++v)
+        {
+            const __m512 s0 = _mm512_loadu_ps(s_row + 16 * v);
+            acc_inner[v] = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mi_row + 16 * v), acc_inner[v]);
+            acc_outer[v] = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mo_row + 16 * v), acc_outer[v]);
+        }
+    }
+
+    for (int v = 1; v < columns / 16; ++v)
+    {
+        acc_inner[0] = _mm512_add_ps(acc_inner[0], acc_inner[v]);
+        acc_outer[0] = _mm512_add_ps(acc_outer[0], acc_outer[v]);
+    }
+
+    f_inner += horizontal_sum_avx512(acc_inner[0]);
+    f_outer += horizontal_sum_avx512(acc_outer[0]);
+}
+
+#endif
+
+template <int rows, int columns>
+static filling_kernel fixed_filling_kernel_select(simd_level level)
+{
+#if SIMD_KERNELS_X86
+    switch (level)
+    {
+    case simd_level::AVX2: return fixed_filling_kernel_avx2<rows, columns>;
+    case simd_level::AVX512: return fixed_filling_kernel_avx512<rows, columns>;
+    default: break;
+    }
+#endif
+
+    return fixed_filling_kernel_portable<rows, columns>;
+}
+
+template <int rows, int columns>
+static fused_filling_kernel fixed_fused_filling_kernel_select(simd_level level)
+{
+#if SIMD_KERNELS_X86
+    switch (level)
+    {
+    case simd_level::AVX2: return fixed_fused_filling_kernel_avx2<rows, columns>;
+    case simd_level::AVX512: return fixed_fused_filling_kernel_avx512<rows, columns>;
+    default: break;
+    }
+#endif
+
+    return fixed_fused_filling_kernel_portable<rows, columns>;
+}
+
+filling_kernel fixed_filling_kernel_for(simd_level level, int rows, int columns)
+{
+    if (rows == FIXED_KERNEL_ROWS && columns == FIXED_KERNEL_COLUMNS_NARROW)
+        return fixed_filling_kernel_select<FIXED_KERNEL_ROWS, FIXED_KERNEL_COLUMNS_NARROW>(level);
+    if (rows == FIXED_KERNEL_ROWS && columns == FIXED_KERNEL_COLUMNS_WIDE)
+        return fixed_filling_kernel_select<FIXED_KERNEL_ROWS, FIXED_KERNEL_COLUMNS_WIDE>(level);
+
+    return nullptr;
+}
+
+fused_filling_kernel fixed_fused_filling_kernel_for(simd_level level, int rows, int columns)
+{
+    if (rows == FIXED_KERNEL_ROWS && columns == FIXED_KERNEL_COLUMNS_NARROW)
+        return fixed_fused_filling_kernel_select<FIXED_KERNEL_ROWS, FIXED_KERNEL_COLUMNS_NARROW>(level);
+    if (rows == FIXED_KERNEL_ROWS && columns == FIXED_KERNEL_COLUMNS_WIDE)
+        return fixed_fused_filling_kernel_select<FIXED_KERNEL_ROWS, FIXED_KERNEL_COLUMNS_WIDE>(level);
+
+    return nullptr;
+}
+
+/*
+ * Register-blocked kernels: FILLING_BLOCK_CELLS cells of a column per pass over the masks. The mask vectors are
+ * loaded once per row and used for all cells, so a pair of FMAs costs 1.5 loads with one cell and 0.75 loads with
+ * four cells (the space rows of the cells overlap, but the partial sums do not)
+ */
+
+static void blocked_fused_filling_kernel_portable(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float * f_inner, float * f_outer)
+{
+    float fi[FILLING_BLOCK_CELLS] = {};
+    float fo[FILLING_BLOCK_CELLS] = {};
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * const __restrict__ mi_row = m_inner + y * m_ld;
+        const float * const __restrict__ mo_row = m_outer + y * m_ld;
+
+        for (int j = 0; j < FILLING_BLOCK_CELLS; ++j)
+        {
+            const float * const __restrict__ s_row = s + (y + j) * s_ld;
+            float ti = 0;
+            float to = 0;
+            #pragma omp simd reduction(+:ti, to)
+            for (int x = 0; x < n; ++x)
+            {
+                ti += s_row[x] * mi_row[x];
+                to += s_row[x] * mo_row[x];
+            }
+
+            fi[j] += ti;
+            fo[j] += to;
+        }
+    }
+
+    for (int j = 0; j < FILLING_BLOCK_CELLS; ++j)
+    {
+        f_inner[j] = fi[j];
+        f_outer[j] = fo[j];
+    }
+}
+
+#if SIMD_KERNELS_X86
+
+/*
+ * - 8 accumulators (inner and outer of 4 cells) hide the FMA latency, 3 more registers hold the mask and space vectors
+ * - the row tail is done with masked loads
+ */
+
+__attribute__((target("avx2,fma")))
+static void blocked_fused_filling_kernel_avx2(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float * f_inner, float * f_outer)
+{
+    static_assert(FILLING_BLOCK_CELLS == 4, "the blocked kernels keep 4 cells in registers");
+
+    __m256 acc_inner0 = _mm256_setzero_ps();
+    __m256 acc_inner1 = _mm256_setzero_ps();
+    __m256 acc_inner2 = _mm256_setzero_ps();
+    __m256 acc_inner3 = _mm256_setzero_ps();
+    __m256 acc_outer0 = _mm256_setzero_ps();
+    __m256 acc_outer1 = _mm256_setzero_ps();
+    __m256 acc_outer2 = _mm256_setzero_ps();
+    __m256 acc_outer3 = _mm256_setzero_ps();
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i tail_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n % 8), lane);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * mi_row = m_inner + y * m_ld;
+        const float * mo_row = m_outer + y * m_ld;
+        int x = 0;
+
+        for (; x + 8 <= n; x += 8)
+        {
+            const __m256 mi = _mm256_loadu_ps(mi_row + x);
+            const __m256 mo = _mm256_loadu_ps(mo_row + x);
+            __m256 s0 = _mm256_loadu_ps(s_row + x);
+            acc_inner0 = _mm256_fmadd_ps(s0, mi, acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, mo, acc_outer0);
+            s0 = _mm256_loadu_ps(s_row + s_ld + x);
+            acc_inner1 = _mm256_fmadd_ps(s0, mi, acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s0, mo, acc_outer1);
+            s0 = _mm256_loadu_ps(s_row + 2 * s_ld + x);
+            acc_inner2 = _mm256_fmadd_ps(s0, mi, acc_inner2);
+            acc_outer2 = _mm256_fmadd_ps(s0, mo, acc_outer2);
+            s0 = _mm256_loadu_ps(s_row + 3 * s_ld + x);
+            acc_inner3 = _mm256_fmadd_ps(s0, mi, acc_inner3);
+            acc_outer3 = _mm256_fmadd_ps(s0, mo, acc_outer3);
+        }
+        if (x < n)
+        {
+            const __m256 mi = _mm256_maskload_ps(mi_row + x, tail_mask);
+            const __m256 mo = _mm256_maskload_ps(mo_row + x, tail_mask);
+            __m256 s0 = _mm256_maskload_ps(s_row + x, tail_mask);
+            acc_inner0 = _mm256_fmadd_ps(s0, mi, acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, mo, acc_outer0);
+            s0 = _mm256_maskload_ps(s_row + s_ld + x, tail_mask);
+            acc_inner1 = _mm256_fmadd_ps(s0, mi, acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s0, mo, acc_outer1);
+            s0 = _mm256_maskload_ps(s_row + 2 * s_ld + x, tail_mask);
+            acc_inner2 = _mm256_fmadd_ps(s0, mi, acc_inner2);
+            acc_outer2 = _mm256_fmadd_ps(s0, mo, acc_outer2);
+            s0 = _mm256_maskload_ps(s_row + 3 * s_ld + x, tail_mask);
+            acc_inner3 = _mm256_fmadd_ps(s0, mi, acc_inner3);
+            acc_outer3 = _mm256_fmadd_ps(s0, mo, acc_outer3);
+        }
+    }
+
+    f_inner[0] = horizontal_sum_avx2(acc_inner0);
+    f_inner[1] = horizontal_sum_avx2(acc_inner1);
+    f_inner[2] = horizontal_sum_avx2(acc_inner2);
+    f_inner[3] = horizontal_sum_avx2(acc_inner3);
+    f_outer[0] = horizontal_sum_avx2(acc_outer0);
+    f_outer[1] = horizontal_sum_avx2(acc_outer1);
+    f_outer[2] = horizontal_sum_avx2(acc_outer2);
+    f_outer[3] = horizontal_sum_avx2(acc_outer3);
+}
+
+__attribute__((target("avx512f")))
+static void blocked_fused_filling_kernel_avx512(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float * f_inner, float * f_outer)
+{
+    __m512 acc_inner0 = _mm512_setzero_ps();
+    __m512 acc_inner1 = _mm512_setzero_ps();
+    __m512 acc_inner2 = _mm512_setzero_ps();
+    __m512 acc_inner3 = _mm512_setzero_ps();
+    __m512 acc_outer0 = _mm512_setzero_ps();
+    __m512 acc_outer1 = _mm512_setzero_ps();
+    __m512 acc_outer2 = _mm512_setzero_ps();
+    __m512 acc_outer3 = _mm512_setzero_ps();
+
+    const __mmask16 tail_mask = (__mmask16) ((1u << (n % 16)) - 1);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const float * s_row = s + y * s_ld;
+        const float * mi_row = m_inner + y * m_ld;
+        const float * mo_row = m_outer + y * m_ld;
+
+        for (int x = 0; x < n; x += 16)
+        {
+            // the last step is masked (all lanes for whole vectors)
+            const __mmask16 mask = x + 16 <= n ? (__mmask16) 0xFFFF : tail_mask;
+            const __m512 mi = _mm512_maskz_loadu_ps(mask, mi_row + x);
+            const __m512 mo = _mm512_maskz_loadu_ps(mask, mo_row + x);
+            __m512 s0 = _mm512_maskz_loadu_ps(mask, s_row + x);
+            acc_inner0 = _mm512_fmadd_ps(s0, mi, acc_inner0);
+            acc_outer0 = _mm512_fmadd_ps(s0, mo, acc_outer0);
+            s0 = _mm512_maskz_loadu_ps(mask, s_row + s_ld + x);
+            acc_inner1 = _mm512_fmadd_ps(s0, mi, acc_inner1);
+            acc_outer1 = _mm512_fmadd_ps(s0, mo, acc_outer1);
+            s0 = _mm512_maskz_loadu_ps(mask, s_row + 2 * s_ld + x);
+            acc_inner2 = _mm512_fmadd_ps(s0, mi, acc_inner2);
+            acc_outer2 = _mm512_fmadd_ps(s0, mo, acc_outer2);
+            s0 = _mm512_maskz_loadu_ps(mask, s_row + 3 * s_ld + x);
+            acc_inner3 = _mm512_fmadd_ps(s0, mi, acc_inner3);
+            acc_outer3 = _mm512_fmadd_ps(s0, mo, acc_outer3);
+        }
+    }
+
+    f_inner[0] = horizontal_sum_avx512(acc_inner0);
+    f_inner[1] = horizontal_sum_avx512(acc_inner1);
+    f_inner[2] = horizontal_sum_avx512(acc_inner2);
+    f_inner[3] = horizontal_sum_avx512(acc_inner3);
+    f_outer[0] = horizontal_sum_avx512(acc_outer0);
+    f_outer[1] = horizontal_sum_avx512(acc_outer1);
+    f_outer[2] = horizontal_sum_avx512(acc_outer2);
+    f_outer[3] = horizontal_sum_avx512(acc_outer3);
+}
+
+#endif
+
+blocked_fused_filling_kernel blocked_fused_filling_kernel_for(simd_level level)
+{
+#if SIMD_KERNELS_X86
+    switch (level)
+    {
+    case simd_level::AVX2: return blocked_fused_filling_kernel_avx2;
+    case simd_level::AVX512: return blocked_fused_filling_kernel_avx512;
+    default: break;
+    }
+#endif
+
+    return blocked_fused_filling_kernel_portable;
+}
+
+/*
+ * 1D filter kernels of the separable filling engine. The sums of 4 vectors of cells stay in registers while the taps
+ * are applied, every weight is broadcast once per 4 vectors
+ */
+
+static void line_filter_kernel_portable(const float * s, int stride, const float * k, int taps, int n, float * out, bool accumulate)
+{
+    for (int x = 0; x < n; ++x)
+    {
+        float f = accumulate ? out[x] : 0;
+
+        for (int i = 0; i < taps; ++i)
+            f += k[i] * s[i * stride + x];
+
+        out[x] = f;
+    }
+}
+
+#if SIMD_KERNELS_X86
+
+__attribute__((target("avx2,fma")))
+static void line_filter_kernel_avx2(const float * s, int stride, const float * k, int taps, int n, float * out, bool accumulate)
+{
+    int x = 0;
+
+    for (; x + 32 <= n; x += 32)
+    {
+        __m256 acc0 = accumulate ? _mm256_loadu_ps(out + x) : _mm256_setzero_ps();
+        __m256 acc1 = accumulate ? _mm256_loadu_ps(out + x + 8) : _mm256_setzero_ps();
+        __m256 acc2 = accumulate ? _mm256_loadu_ps(out + x + 16) : _mm256_setzero_ps();
+        __m256 acc3 = accumulate ? _mm256_loadu_ps(out + x + 24) : _mm256_setzero_ps();
+
+        for (int i = 0; i < taps; ++i)
+        {
+            const __m256 weight = _mm256_broadcast_ss(k + i);
+            const float * s_line = s + i * stride + x;
+            acc0 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(s_line), acc0);
+            acc1 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(s_line + 8), acc1);
+            acc2 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(s_line + 16), acc2);
+            acc3 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(s_line + 24), acc3);
+        }
+
+        _mm256_storeu_ps(out + x, acc0);
+        _mm256_storeu_ps(out + x + 8, acc1);
+        _mm256_storeu_ps(out + x + 16, acc2);
+        _mm256_storeu_ps(out + x + 24, acc3);
+    }
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (; x < n; x += 8)
+    {
+        // the last vector is masked (all lanes for whole vectors)
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - x), lane);
+        __m256 acc = accumulate ? _mm256_maskload_ps(out + x, mask) : _mm256_setzero_ps();
+
+        for (int i = 0; i < taps; ++i)
+            acc = _mm256_fmadd_ps(_mm256_broadcast_ss(k + i), _mm256_maskload_ps(s + i * stride + x, mask), acc);
+
+        _mm256_maskstore_ps(out + x, mask, acc);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void line_filter_kernel_avx512(const float * s, int stride, const float * k, int taps, int n, float * out, bool accumulate)
+{
+    int x = 0;
+
+    for (; x + 64 <= n; x += 64)
+    {
+        __m512 acc0 = accumulate ? _mm512_loadu_ps(out + x) : _mm512_setzero_ps();
+        __m512 acc1 = accumulate ? _mm512_loadu_ps(out + x + 16) : _mm512_setzero_ps();
+        __m512 acc2 = accumulate ? _mm512_loadu_ps(out + x + 32) : _mm512_setzero_ps();
+        __m512 acc3 = accumulate ? _mm512_loadu_ps(out + x + 48) : _mm512_setzero_ps();
+
+        for (int i = 0; i < taps; ++i)
+        {
+            const __m512 weight = _mm512_set1_ps(k[i]);
+            const float * s_line = s + i * stride + x;
+            acc0 = _mm512_fmadd_ps(weight, _mm512_loadu_ps(s_line), acc0);
+            acc1 = _mm512_fmadd_ps(weight, _mm512_loadu_ps(s_line + 16), acc1);
+            acc2 = _mm512_fmadd_ps(weight, _mm512_loadu_ps(s_line + 32), acc2);
+            acc3 = _mm512_fmadd_ps(weight, _mm512_loadu_ps(s_line + 48), acc3);
+        }
+
+        _mm512_storeu_ps(out + x, acc0);
+        _mm512_storeu_ps(out + x + 16, acc1);
+        _mm512_storeu_ps(out + x + 32, acc2);
+        _mm512_storeu_ps(out + x + 48, acc3);
+    }
+
+    for (; x < n; x += 16)
+    {
+        const __mmask16 mask = n - x >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << (n - x)) - 1);
+        __m512 acc = accumulate ? _mm512_maskz_loadu_ps(mask, out + x) : _mm512_setzero_ps();
+
+        for (int i = 0; i < taps; ++i)
+            acc = _mm512_fmadd_ps(_mm512_set1_ps(k[i]), _mm512_maskz_loadu_ps(mask, s + i * stride + x), acc);
+
+        _mm512_mask_storeu_ps(out + x, mask, acc);
+    }
+}
+
+#endif
+
+line_filter_kernel line_filter_kernel_for(simd_level level)
+{
+#if SIMD_KERNELS_X86
+    switch (level)
+    {
+    case simd_level::AVX2: return line_filter_kernel_avx2;
+    case simd_level::AVX512: return line_filter_kernel_avx512;
+    default: break;
+    }
+#endif
+
+    return line_filter_kernel_portable;
+}
+
+/*
+ * Symmetric fused filling kernels. The mirrored rows are added before they are multiplied, the loop structure is the
+ * one of the fused kernels (two pairs of sums to hide the FMA latency)
+ */
+
+static void symmetric_fused_filling_kernel_portable(const float * s, int s_ld, int mirror, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    float sum_inner = 0;
+    float sum_outer = 0;
+
+    for (int r = 0; r < rows; ++r)
+    {
+        const float * up = s - (r + mirror) * s_ld;
+        const float * down = s + r * s_ld;
+        const float * mi_row = m_inner + r * m_ld;
+        const float * mo_row = m_outer + r * m_ld;
+
+        #pragma omp simd reduction(+:sum_inner,sum_outer)
+        for (int x = 0; x < n; ++x)
+        {
+            const float folded = up[x] + down[x];
+            sum_inner += mi_row[x] * folded;
+            sum_outer += mo_row[x] * folded;
+        }
+    }
+
+    f_inner += sum_inner;
+    f_outer += sum_outer;
+}
+
+#if SIMD_KERNELS_X86
+
+__attribute__((target("avx2,fma")))
+static void symmetric_fused_filling_kernel_avx2(const float * s, int s_ld, int mirror, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    __m256 acc_inner0 = _mm256_setzero_ps();
+    __m256 acc_inner1 = _mm256_setzero_ps();
+    __m256 acc_outer0 = _mm256_setzero_ps();
+    __m256 acc_outer1 = _mm256_setzero_ps();
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i tail_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n % 8), lane);
+
+    for (int r = 0; r < rows; ++r)
+    {
+        const float * up = s - (r + mirror) * s_ld;
+        const float * down = s + r * s_ld;
+        const float * mi_row = m_inner + r * m_ld;
+        const float * mo_row = m_outer + r * m_ld;
+        int x = 0;
+
+        for (; x + 16 <= n; x += 16)
+        {
+            const __m256 s0 = _mm256_add_ps(_mm256_loadu_ps(up + x), _mm256_loadu_ps(down + x));
+            const __m256 s1 = _mm256_add_ps(_mm256_loadu_ps(up + x + 8), _mm256_loadu_ps(down + x + 8));
+            acc_inner0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mo_row + x), acc_outer0);
+            acc_inner1 = _mm256_fmadd_ps(s1, _mm256_loadu_ps(mi_row + x + 8), acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s1, _mm256_loadu_ps(mo_row + x + 8), acc_outer1);
+        }
+        if (x + 8 <= n)
+        {
+            const __m256 s0 = _mm256_add_ps(_mm256_loadu_ps(up + x), _mm256_loadu_ps(down + x));
+            acc_inner0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mo_row + x), acc_outer0);
+            x += 8;
+        }
+        if (x < n)
+        {
+            const __m256 s0 = _mm256_add_ps(_mm256_maskload_ps(up + x, tail_mask), _mm256_maskload_ps(down + x, tail_mask));
+            acc_inner1 = _mm256_fmadd_ps(s0, _mm256_maskload_ps(mi_row + x, tail_mask), acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s0, _mm256_maskload_ps(mo_row + x, tail_mask), acc_outer1);
+        }
+    }
+
+    f_inner += horizontal_sum_avx2(_mm256_add_ps(acc_inner0, acc_inner1));
+    f_outer += horizontal_sum_avx2(_mm256_add_ps(acc_outer0, acc_outer1));
+}
+
+__attribute__((target("avx512f")))
+static void symmetric_fused_filling_kernel_avx512(const float * s, int s_ld, int mirror, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    __m512 acc_inner0 = _mm512_setzero_ps();
+    __m512 acc_inner1 = _mm512_setzero_ps();
+    __m512 acc_outer0 = _mm512_setzero_ps();
+    __m512 acc_outer1 = _mm512_setzero_ps();
+
+    const __mmask16 tail_mask = (__mmask16) ((1u << (n % 16)) - 1);
+
+    for (int r = 0; r < rows; ++r)
+    {
+        const float * up = s - (r + mirror) * s_ld;
+        const float * down = s + r * s_ld;
+        const float * mi_row = m_inner + r * m_ld;
+        const float * mo_row = m_outer + r * m_ld;
+        int x = 0;
+
+        for (; x + 32 <= n; x += 32)
+        {
+            const __m512 s0 = _mm512_add_ps(_mm512_loadu_ps(up + x), _mm512_loadu_ps(down + x));
+            const __m512 s1 = _mm512_add_ps(_mm512_loadu_ps(up + x + 16), _mm512_loadu_ps(down + x + 16));
+            acc_inner0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mo_row + x), acc_outer0);
+            acc_inner1 = _mm512_fmadd_ps(s1, _mm512_loadu_ps(mi_row + x + 16), acc_inner1);
+            acc_outer1 = _mm512_fmadd_ps(s1, _mm512_loadu_ps(mo_row + x + 16), acc_outer1);
+        }
+        if (x + 16 <= n)
+        {
+            const __m512 s0 = _mm512_add_ps(_mm512_loadu_ps(up + x), _mm512_loadu_ps(down + x));
+            acc_inner0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm512_fmadd_ps(s0, _mm512_loadu_ps(mo_row + x), acc_outer0);
+            x += 16;
+        }
+        if (x < n)
+        {
+            const __m512 s0 = _mm512_add_ps(_mm512_maskz_loadu_ps(tail_mask, up + x), _mm512_maskz_loadu_ps(tail_mask, down + x));
+            acc_inner1 = _mm512_fmadd_ps(s0, _mm512_maskz_loadu_ps(tail_mask, mi_row + x), acc_inner1);
+            acc_outer1 = _mm512_fmadd_ps(s0, _mm512_maskz_loadu_ps(tail_mask, mo_row + x), acc_outer1);
+        }
+    }
+
+    f_inner += horizontal_sum_avx512(_mm512_add_ps(acc_inner0, acc_inner1));
+    f_outer += horizontal_sum_avx512(_mm512_add_ps(acc_outer0, acc_outer1));
+}
+
+#endif
+
+symmetric_fused_filling_kernel symmetric_fused_filling_kernel_for(simd_level level)
+{
+#if SIMD_KERNELS_X86
+    switch (level)
+    {
+    case simd_level::AVX2: return symmetric_fused_filling_kernel_avx2;
+    case simd_level::AVX512: return symmetric_fused_filling_kernel_avx512;
+    default: break;
+    }
+#endif
+
+    return symmetric_fused_filling_kernel_portable;
+}
+
+/*
+ * Kernels for spaces stored in FP16 / BF16. The masks stay in float, the space is converted on load and accumulated in float
+ */
+
+template <storage_precision precision>
+static inline float decode_storage(const uint16_t v)
+{
+    return precision == storage_precision::FP16 ? half_to_float(v) : bfloat16_to_float(v);
+}
+
+template <storage_precision precision>
+static float half_filling_kernel_portable(const uint16_t * s, int s_ld, const float * m, int m_ld, int rows, int n)
+{
+    float f = 0;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const uint16_t * const __restrict__ s_row = s + y * s_ld;
+        const float * const __restrict__ m_row = m + y * m_ld;
+        #pragma omp simd reduction(+:f)
+        for (int x = 0; x < n; ++x)
+            f += decode_storage<precision>(s_row[x]) * m_row[x];
+    }
+
+    return f;
+}
+
+template <storage_precision precision>
+static void half_fused_filling_kernel_portable(const uint16_t * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    float fi = 0;
+    float fo = 0;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const uint16_t * const __restrict__ s_row = s + y * s_ld;
+        const float * const __restrict__ mi_row = m_inner + y * m_ld;
+        const float * const __restrict__ mo_row = m_outer + y * m_ld;
+        #pragma omp simd reduction(+:fi, fo)
+        for (int x = 0; x < n; ++x)
+        {
+            const float v = decode_storage<precision>(s_row[x]);
+            fi += v * mi_row[x];
+            fo += v * mo_row[x];
+        }
+    }
+
+    f_inner += fi;
+    f_outer += fo;
+}
+
+#if SIMD_KERNELS_X86
+
+/*
+ * - FP16 is converted with F16C (vcvtph2ps), BF16 by moving the bits to the upper half of a float
+ * - there is no masked 16 bit load in AVX2, the row tail is copied into a zero padded buffer
+ */
+
+template <storage_precision precision>
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 load_storage_avx2(const uint16_t * p)
+{
+    const __m128i v = _mm_loadu_si128((const __m128i *) p);
+
+    if (precision == storage_precision::FP16)
+        return _mm256_cvtph_ps(v);
+    else
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(v), 16));
+}
+
+template <storage_precision precision>
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 load_storage_tail_avx2(const uint16_t * p, int n)
+{
+    uint16_t tail[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    memcpy(tail, p, n * sizeof (uint16_t));
+    return load_storage_avx2<precision>(tail);
+}
+
+template <storage_precision precision>
+__attribute__((target("avx2,fma,f16c")))
+static float half_filling_kernel_avx2(const uint16_t * s, int s_ld, const float * m, int m_ld, int rows, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i tail_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n % 8), lane);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const uint16_t * s_row = s + y * s_ld;
+        const float * m_row = m + y * m_ld;
+        int x = 0;
+
+        for (; x + 16 <= n; x += 16)
+        {
+            acc0 = _mm256_fmadd_ps(load_storage_avx2<precision>(s_row + x), _mm256_loadu_ps(m_row + x), acc0);
+            acc1 = _mm256_fmadd_ps(load_storage_avx2<precision>(s_row + x + 8), _mm256_loadu_ps(m_row + x + 8), acc1);
+        }
+        if (x + 8 <= n)
+        {
+            acc0 = _mm256_fmadd_ps(load_storage_avx2<precision>(s_row + x), _mm256_loadu_ps(m_row + x), acc0);
+            x += 8;
+        }
+        if (x < n)
+        {
+            acc1 = _mm256_fmadd_ps(load_storage_tail_avx2<precision>(s_row + x, n - x), _mm256_maskload_ps(m_row + x, tail_mask), acc1);
+        }
+    }
+
+    return horizontal_sum_avx2(_mm256_add_ps(acc0, acc1));
+}
+
+template <storage_precision precision>
+__attribute__((target("avx2,fma,f16c")))
+static void half_fused_filling_kernel_avx2(const uint16_t * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer)
+{
+    __m256 acc_inner0 = _mm256_setzero_ps();
+    __m256 acc_inner1 = _mm256_setzero_ps();
+    __m256 acc_outer0 = _mm256_setzero_ps();
+    __m256 acc_outer1 = _mm256_setzero_ps();
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i tail_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n % 8), lane);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const uint16_t * s_row = s + y * s_ld;
+        const float * mi_row = m_inner + y * m_ld;
+        const float * mo_row = m_outer + y * m_ld;
+        int x = 0;
+
+        for (; x + 16 <= n; x += 16)
+        {
+            const __m256 s0 = load_storage_avx2<precision>(s_row + x);
+            const __m256 s1 = load_storage_avx2<precision>(s_row + x + 8);
+            acc_inner0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mo_row + x), acc_outer0);
+            acc_inner1 = _mm256_fmadd_ps(s1, _mm256_loadu_ps(mi_row + x + 8), acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s1, _mm256_loadu_ps(mo_row + x + 8), acc_outer1);
+        }
+        if (x + 8 <= n)
+        {
+            const __m256 s0 = load_storage_avx2<precision>(s_row + x);
+            acc_inner0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mi_row + x), acc_inner0);
+            acc_outer0 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(mo_row + x), acc_outer0);
+            x += 8;
+        }
+        if (x < n)
+        {
+            const __m256 s0 = load_storage_tail_avx2<precision>(s_row + x, n - x);
+            acc_inner1 = _mm256_fmadd_ps(s0, _mm256_maskload_ps(mi_row + x, tail_mask), acc_inner1);
+            acc_outer1 = _mm256_fmadd_ps(s0, _mm256_maskload_ps(mo_row + x, tail_mask), acc_outer1);
+        }
+    }
+
+    f_inner += horizontal_sum_avx2(_mm256_add_ps(acc_inner0, acc_inner1));
+    f_outer += horizontal_sum_avx2(_mm256_add_ps(acc_outer0, acc_outer1));
+}
+
+#endif
+
+half_filling_kernel half_filling_kernel_for(simd_level level, storage_precision precision)
+{
+#if SIMD_KERNELS_X86
+    if (level != simd_level::PORTABLE)
+        return precision == storage_precision::FP16 ? half_filling_kernel_avx2<storage_precision::FP16> : half_filling_kernel_avx2<storage_precision::BF16>;
+#endif
+
+    return precision == storage_precision::FP16 ? half_filling_kernel_portable<storage_precision::FP16> : half_filling_kernel_portable<storage_precision::BF16>;
+}
+
+half_fused_filling_kernel half_fused_filling_kernel_for(simd_level level, storage_precision precision)
+{
+#if SIMD_KERNELS_X86
+    if (level != simd_level::PORTABLE)
+        return precision == storage_precision::FP16 ? half_fused_filling_kernel_avx2<storage_precision::FP16> : half_fused_filling_kernel_avx2<storage_precision::BF16>;
+#endif
+
+    return precision == storage_precision::FP16 ? half_fused_filling_kernel_portable<storage_precision::FP16> : half_fused_filling_kernel_portable<storage_precision::BF16>;
+}
+
+/*
+ * Kernels for the FIXED_POINT engine. The products of states and weights are integers, they are summed exactly
+ */
+
+template <typename state_type, typename weight_type>
+static void int_fused_filling_kernel_portable(const state_type * s, int s_ld, const weight_type * m_inner, const weight_type * m_outer, int m_ld, int rows, int n, int64_t & f_inner, int64_t & f_outer)
+{
+    int64_t fi = 0;
+    int64_t fo = 0;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const state_type * const __restrict__ s_row = s + y * s_ld;
+        const weight_type * const __restrict__ mi_row = m_inner + y * m_ld;
+        const weight_type * const __restrict__ mo_row = m_outer + y * m_ld;
+        #pragma omp simd reduction(+:fi, fo)
+        for (int x = 0; x < n; ++x)
+        {
+            fi += int32_t(s_row[x]) * mi_row[x];
+            fo += int32_t(s_row[x]) * mo_row[x];
+        }
+    }
+
+    f_inner += fi;
+    f_outer += fo;
+}
+
+#if SIMD_KERNELS_X86
+
+/*
+ * - 8 bit: vpmaddubsw multiplies 32 states with 32 weights and adds pairs to int16, vpmaddwd with 1 adds pairs of
+ *   those to int32. 16 bit: vpmaddwd multiplies 16 states with 16 weights and adds pairs to int32
+ * - the int32 lanes are flushed to int64 every flush_rows rows, before they could overflow
+ * - columns > 0 fixes the width at compile time (see int8_fixed_fused_filling_kernel_for), the column steps are
+ *   unrolled and the tail branches disappear. Most of the time of the generic kernel is spent on the row overhead
+ * - the row tail is done with 128 bit steps. The last one overlaps the previous step, the weights of the overlapping
+ *   columns are masked out. Blocks narrower than one 128 bit step use a scalar loop
+ *   (the quantized masks are a multiple of 16 columns wide, only blocks of wrapped neighborhoods have a tail)
+ */
+
+__attribute__((target("avx2")))
+static inline int64_t horizontal_sum_epi32_avx2(const __m256i v)
+{
+    const __m256i wide = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(wide), _mm256_extracti128_si256(wide, 1));
+    return _mm_cvtsi128_si64(_mm_add_epi64(half, _mm_unpackhi_epi64(half, half)));
+}
+
+// 16 bytes loaded at int_kernel_tail_masks + r keep the last r bytes of a 128 bit vector
+static const int8_t int_kernel_tail_masks[32] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+__attribute__((target("avx2")))
+static inline void int8_step_128(const __m128i s, const __m128i m_inner, const __m128i m_outer, __m256i & acc_inner, __m256i & acc_outer)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    acc_inner = _mm256_add_epi32(acc_inner, _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_madd_epi16(_mm_maddubs_epi16(s, m_inner), ones), 0));
+    acc_outer = _mm256_add_epi32(acc_outer, _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_madd_epi16(_mm_maddubs_epi16(s, m_outer), ones), 0));
+}
+
+__attribute__((target("avx2")))
+static inline void int16_step_128(const __m128i s, const __m128i m_inner, const __m128i m_outer, __m256i & acc_inner, __m256i & acc_outer)
+{
+    acc_inner = _mm256_add_epi32(acc_inner, _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_madd_epi16(s, m_inner), 0));
+    acc_outer = _mm256_add_epi32(acc_outer, _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_madd_epi16(s, m_outer), 0));
+}
+
+/**
+ * @brief Returns the number of rows after which the int32 lanes have to be flushed
+ * @param lane_step_max largest value one vector step adds to a lane
+ * @param columns_per_step columns of a vector step
+ */
+static inline int int_kernel_flush_rows(const int64_t lane_step_max, const int columns_per_step, const int n)
+{
+    // the two 128 bit steps of the tail add at most as much as a full step each
+    const int64_t lane_row_max = lane_step_max * (n / columns_per_step + 2);
+    assert(lane_row_max <= INT32_MAX);
+
+    return max(int64_t(1), INT32_MAX / lane_row_max);
+}
+
+template <int columns>
+__attribute__((target("avx2")))
+static void int8_fused_filling_kernel_avx2(const uint8_t * s, int s_ld, const int8_t * m_inner, const int8_t * m_outer, int m_ld, int rows, int columns_n, int64_t & f_inner, int64_t & f_outer)
+{
+    const int n = columns > 0 ? columns : columns_n;
+    const __m256i ones = _mm256_set1_epi16(1);
+    const int flush_rows = int_kernel_flush_rows(4 * 255 * INT8_KERNEL_WEIGHT_MAX, 32, n);
+
+    __m256i acc_inner = _mm256_setzero_si256();
+    __m256i acc_outer = _mm256_setzero_si256();
+    int64_t fi = 0;
+    int64_t fo = 0;
+    int rows_to_flush = flush_rows;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const uint8_t * s_row = s + y * s_ld;
+        const int8_t * mi_row = m_inner + y * m_ld;
+        const int8_t * mo_row = m_outer + y * m_ld;
+        int x = 0;
+
+        for (; x + 32 <= n; x += 32)
+        {
+            const __m256i s0 = _mm256_loadu_si256((const __m256i *) (s_row + x));
+            acc_inner = _mm256_add_epi32(acc_inner, _mm256_madd_epi16(_mm256_maddubs_epi16(s0, _mm256_loadu_si256((const __m256i *) (mi_row + x))), ones));
+            acc_outer = _mm256_add_epi32(acc_outer, _mm256_madd_epi16(_mm256_maddubs_epi16(s0, _mm256_loadu_si256((const __m256i *) (mo_row + x))), ones));
+        }
+        if (x + 16 <= n)
+        {
+            int8_step_128(_mm_loadu_si128((const __m128i *) (s_row + x)), _mm_loadu_si128((const __m128i *) (mi_row + x)),
+                          _mm_loadu_si128((const __m128i *) (mo_row + x)), acc_inner, acc_outer);
+            x += 16;
+        }
+        if (x < n && n >= 16)
+        {
+            // the last 16 columns, the weights of the columns that were already added are masked out
+            const __m128i tail_mask = _mm_loadu_si128((const __m128i *) (int_kernel_tail_masks + n - x));
+            int8_step_128(_mm_loadu_si128((const __m128i *) (s_row + n - 16)), _mm_and_si128(tail_mask, _mm_loadu_si128((const __m128i *) (mi_row + n - 16))),
+                          _mm_and_si128(tail_mask, _mm_loadu_si128((const __m128i *) (mo_row + n - 16))), acc_inner, acc_outer);
+        }
+        else
+        {
+            // less than one step, fits into int32
+            int32_t ti = 0;
+            int32_t to = 0;
+
+            for (; x < n; ++x)
+            {
+                ti += int32_t(s_row[x]) * mi_row[x];
+                to += int32_t(s_row[x]) * mo_row[x];
+            }
+
+            fi += ti;
+            fo += to;
+        }
+
+        if (--rows_to_flush == 0)
+        {
+            rows_to_flush = flush_rows;
+            fi += horizontal_sum_epi32_avx2(acc_inner);
+            fo += horizontal_sum_epi32_avx2(acc_outer);
+            acc_inner = _mm256_setzero_si256();
+            acc_outer = _mm256_setzero_si256();
+        }
+    }
+
+    f_inner += fi + horizontal_sum_epi32_avx2(acc_inner);
+    f_outer += fo + horizontal_sum_epi32_avx2(acc_outer);
+}
+
+template <int columns>
+__attribute__((target("avx2")))
+static void int16_fused_filling_kernel_avx2(const uint16_t * s, int s_ld, const int16_t * m_inner, const int16_t * m_outer, int m_ld, int rows, int columns_n, int64_t & f_inner, int64_t & f_outer)
+{
+    const int n = columns > 0 ? columns : columns_n;
+    const int flush_rows = int_kernel_flush_rows(2 * 32767 * INT16_KERNEL_WEIGHT_MAX, 16, n);
+
+    __m256i acc_inner = _mm256_setzero_si256();
+    __m256i acc_outer = _mm256_setzero_si256();
+    int64_t fi = 0;
+    int64_t fo = 0;
+    int rows_to_flush = flush_rows;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const uint16_t * s_row = s + y * s_ld;
+        const int16_t * mi_row = m_inner + y * m_ld;
+        const int16_t * mo_row = m_outer + y * m_ld;
+        int x = 0;
+
+        for (; x + 16 <= n; x += 16)
+        {
+            const __m256i s0 = _mm256_loadu_si256((const __m256i *) (s_row + x));
+            acc_inner = _mm256_add_epi32(acc_inner, _mm256_madd_epi16(s0, _mm256_loadu_si256((const __m256i *) (mi_row + x))));
+            acc_outer = _mm256_add_epi32(acc_outer, _mm256_madd_epi16(s0, _mm256_loadu_si256((const __m256i *) (mo_row + x))));
+        }
+        if (x + 8 <= n)
+        {
+            int16_step_128(_mm_loadu_si128((const __m128i *) (s_row + x)), _mm_loadu_si128((const __m128i *) (mi_row + x)),
+                           _mm_loadu_si128((const __m128i *) (mo_row + x)), acc_inner, acc_outer);
+            x += 8;
+        }
+        if (x < n && n >= 8)
+        {
+            // the last 8 columns, the weights of the columns that were already added are masked out
+            const __m128i tail_mask = _mm_loadu_si128((const __m128i *) (int_kernel_tail_masks + 2 * (n - x)));
+            int16_step_128(_mm_loadu_si128((const __m128i *) (s_row + n - 8)), _mm_and_si128(tail_mask, _mm_loadu_si128((const __m128i *) (mi_row + n - 8))),
+                           _mm_and_si128(tail_mask, _mm_loadu_si128((const __m128i *) (mo_row + n - 8))), acc_inner, acc_outer);
+        }
+        else
+        {
+            // less than one step, fits into int32
+            int32_t ti = 0;
+            int32_t to = 0;
+
+            for (; x < n; ++x)
+            {
+                ti += int32_t(s_row[x]) * mi_row[x];
+                to += int32_t(s_row[x]) * mo_row[x];
+            }
+
+            fi += ti;
+            fo += to;
+        }
+
+        if (--rows_to_flush == 0)
+        {
+            rows_to_flush = flush_rows;
+            fi += horizontal_sum_epi32_avx2(acc_inner);
+            fo += horizontal_sum_epi32_avx2(acc_outer);
+            acc_inner = _mm256_setzero_si256();
+            acc_outer = _mm256_setzero_si256();
+        }
+    }
+
+    f_inner += fi + horizontal_sum_epi32_avx2(acc_inner);
+    f_outer += fo + horizontal_sum_epi32_avx2(acc_outer);
+}
+
+#endif
+
+int8_fused_filling_kernel int8_fused_filling_kernel_for(simd_level level)
+{
+#if SIMD_KERNELS_X86
+    if (level != simd_level::PORTABLE)
+        return int8_fused_filling_kernel_avx2<0>;
+#endif
+
+    return int_fused_filling_kernel_portable<uint8_t, int8_t>;
+}
+
+int16_fused_filling_kernel int16_fused_filling_kernel_for(simd_level level)
+{
+#if SIMD_KERNELS_X86
+    if (level != simd_level::PORTABLE)
+        return int16_fused_filling_kernel_avx2<0>;
+#endif
+
+    return int_fused_filling_kernel_portable<uint16_t, int16_t>;
+}
+
+int8_fused_filling_kernel int8_fixed_fused_filling_kernel_for(simd_level level, int columns)
+{
+#if SIMD_KERNELS_X86
+    if (level != simd_level::PORTABLE && columns == FIXED_KERNEL_COLUMNS_NARROW)
+        return int8_fused_filling_kernel_avx2<FIXED_KERNEL_COLUMNS_NARROW>;
+#endif
+
+    return nullptr;
+}
+
+int16_fused_filling_kernel int16_fixed_fused_filling_kernel_for(simd_level level, int columns)
+{
+#if SIMD_KERNELS_X86
+    if (level != simd_level::PORTABLE && columns == FIXED_KERNEL_COLUMNS_NARROW)
+        return int16_fused_filling_kernel_avx2<FIXED_KERNEL_COLUMNS_NARROW>;
+#endif
+
+    return nullptr;
+}
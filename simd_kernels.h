@@ -0,0 +1,226 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include "half_float.h"
+
+using namespace std;
+
+/*
+ * Hand-written SIMD kernels for the hottest loops. Selected at runtime, the portable
+ * versions are used on every other platform (e.g. MIC)
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__MIC__)
+#define SIMD_KERNELS_X86 1
+#else
+#define SIMD_KERNELS_X86 0
+#endif
+
+/**
+ * @brief The outer radius the fixed kernels are specialized for (ruleset_smooth_life_l and ruleset_rafler_paper)
+ */
+#define FIXED_KERNEL_RADIUS 21
+
+#define FILLING_BLOCK_CELLS 4 //cells of a column calculated by one call of a blocked_fused_filling_kernel
+
+#define INT8_KERNEL_WEIGHT_MAX 64 //largest magnitude of the mask weights of the 8 bit kernels (pairs of vpmaddubsw saturate at 32767)
+#define INT16_KERNEL_WEIGHT_MAX 255 //largest magnitude of the mask weights of the 16 bit kernels (bounds how often the int32 lanes are flushed)
+
+/**
+ * @brief The instruction set used by the hand-written kernels
+ */
+enum class simd_level
+{
+    /**
+     * @brief Compiler vectorized code (#pragma omp simd)
+     */
+    PORTABLE = 0,
+
+    /**
+     * @brief AVX2 + FMA intrinsics
+     */
+    AVX2 = 1,
+
+    /**
+     * @brief AVX-512F intrinsics
+     */
+    AVX512 = 2
+};
+
+/**
+ * @brief Calculates the sum of s[r * s_ld + x] * m[r * m_ld + x] over rows r < rows and columns x < n.
+ * - this is the dot product of a mask block with a space block, as done by the loops of getFilling
+ */
+typedef float (*filling_kernel)(const float * s, int s_ld, const float * m, int m_ld, int rows, int n);
+
+/**
+ * @brief Adds the dot products of a space block with two mask blocks of the same geometry to f_inner and f_outer.
+ * - the space block is loaded only once for both masks
+ */
+typedef void (*fused_filling_kernel)(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer);
+
+/**
+ * @brief Like filling_kernel, but the space block is stored in FP16 or BF16 (see storage_precision). Accumulates in float
+ */
+typedef float (*half_filling_kernel)(const uint16_t * s, int s_ld, const float * m, int m_ld, int rows, int n);
+
+/**
+ * @brief Like fused_filling_kernel, but the space block is stored in FP16 or BF16 (see storage_precision). Accumulates in float
+ */
+typedef void (*half_fused_filling_kernel)(const uint16_t * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer);
+
+/**
+ * @brief Calculates the fused fillings of FILLING_BLOCK_CELLS cells below each other with the same masks:
+ * f_inner[j] = sum of s[(r + j) * s_ld + x] * m_inner[r * m_ld + x] over rows r < rows and columns x < n (f_outer alike).
+ * - register blocking: each loaded mask vector is used for all cells, the partial sums of all cells stay in registers
+ * - s has rows + FILLING_BLOCK_CELLS - 1 rows
+ */
+typedef void (*blocked_fused_filling_kernel)(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float * f_inner, float * f_outer);
+
+/**
+ * @brief Filters n cells with a 1D kernel of taps weights: out[x] = sum of k[i] * s[i * stride + x] over i < taps,
+ * added to out if accumulate. stride 1 filters along a row, the leading dimension along columns (see separable_filling.h)
+ */
+typedef void (*line_filter_kernel)(const float * s, int stride, const float * k, int taps, int n, float * out, bool accumulate);
+
+/**
+ * @brief Like fused_filling_kernel for masks that are symmetric in y, from their lower halves (see symmetric_filling.h):
+ * adds the sum of m[r * m_ld + x] * (s[r * s_ld + x] + s[-(r + mirror) * s_ld + x]) over rows r < rows and columns
+ * x < n. s points to the center row of the space block
+ * - the mirrored rows are added before they are multiplied, half of the products and mask loads of fused_filling_kernel
+ */
+typedef void (*symmetric_fused_filling_kernel)(const float * s, int s_ld, int mirror, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer);
+
+/**
+ * @brief Like fused_filling_kernel for the FIXED_POINT engine: 8 bit states (unsigned) and 8 bit mask weights (signed,
+ * at most INT8_KERNEL_WEIGHT_MAX in magnitude). The products are summed exactly in integers, see fixed_point_filling.h
+ */
+typedef void (*int8_fused_filling_kernel)(const uint8_t * s, int s_ld, const int8_t * m_inner, const int8_t * m_outer, int m_ld, int rows, int n, int64_t & f_inner, int64_t & f_outer);
+
+/**
+ * @brief Like int8_fused_filling_kernel with 16 bit states (at most 32767) and 16 bit mask weights (at most
+ * INT16_KERNEL_WEIGHT_MAX in magnitude)
+ */
+typedef void (*int16_fused_filling_kernel)(const uint16_t * s, int s_ld, const int16_t * m_inner, const int16_t * m_outer, int m_ld, int rows, int n, int64_t & f_inner, int64_t & f_outer);
+
+/**
+ * @brief Returns the best instruction set supported by this CPU (via CPUID)
+ */
+simd_level simd_level_detect();
+
+/**
+ * @brief Returns the filling kernel for the given instruction set. The caller has to make sure the CPU supports it
+ */
+filling_kernel filling_kernel_for(simd_level level);
+
+/**
+ * @brief Returns the fused filling kernel for the given instruction set. The caller has to make sure the CPU supports it
+ */
+fused_filling_kernel fused_filling_kernel_for(simd_level level);
+
+/**
+ * @brief Returns a filling kernel with rows and columns fixed at compile time (fully unrolled, no tails) or nullptr if
+ * there is no specialization for this block size. Only for full mask blocks: m_ld must be columns, the rows and n
+ * arguments are ignored. There are specializations for the masks of the predefined rulesets (see FIXED_KERNEL_RADIUS)
+ */
+filling_kernel fixed_filling_kernel_for(simd_level level, int rows, int columns);
+
+/**
+ * @brief Like fixed_filling_kernel_for, for the fused filling kernel
+ */
+fused_filling_kernel fixed_fused_filling_kernel_for(simd_level level, int rows, int columns);
+
+/**
+ * @brief Returns the blocked fused filling kernel for the given instruction set. The caller has to make sure the CPU supports it
+ */
+blocked_fused_filling_kernel blocked_fused_filling_kernel_for(simd_level level);
+
+/**
+ * @brief Returns the 1D filter kernel for the given instruction set. The caller has to make sure the CPU supports it
+ */
+line_filter_kernel line_filter_kernel_for(simd_level level);
+
+/**
+ * @brief Returns the symmetric fused filling kernel for the given instruction set. The caller has to make sure the CPU supports it
+ */
+symmetric_fused_filling_kernel symmetric_fused_filling_kernel_for(simd_level level);
+
+/**
+ * @brief Returns the filling kernel for spaces stored in FP16 or BF16. AVX2 and AVX-512 both use the AVX2 + F16C version
+ */
+half_filling_kernel half_filling_kernel_for(simd_level level, storage_precision precision);
+
+/**
+ * @brief Returns the fused filling kernel for spaces stored in FP16 or BF16. AVX2 and AVX-512 both use the AVX2 + F16C version
+ */
+half_fused_filling_kernel half_fused_filling_kernel_for(simd_level level, storage_precision precision);
+
+/**
+ * @brief Returns the fused filling kernel for 8 bit fixed point spaces. AVX2 and AVX-512 both use the AVX2 version (vpmaddubsw)
+ */
+int8_fused_filling_kernel int8_fused_filling_kernel_for(simd_level level);
+
+/**
+ * @brief Returns the fused filling kernel for 16 bit fixed point spaces. AVX2 and AVX-512 both use the AVX2 version (vpmaddwd)
+ */
+int16_fused_filling_kernel int16_fused_filling_kernel_for(simd_level level);
+
+/**
+ * @brief Returns a fixed point kernel with the number of columns fixed at compile time or nullptr if there is no
+ * specialization for it (or the portable kernels are selected). Only for full mask blocks: n must be columns. There
+ * is a specialization for the width of the quantized masks of the predefined rulesets (see FIXED_KERNEL_RADIUS)
+ */
+int8_fused_filling_kernel int8_fixed_fused_filling_kernel_for(simd_level level, int columns);
+
+/**
+ * @brief Like int8_fixed_fused_filling_kernel_for, for 16 bit fixed point spaces
+ */
+int16_fused_filling_kernel int16_fixed_fused_filling_kernel_for(simd_level level, int columns);
+
+float filling_kernel_portable(const float * s, int s_ld, const float * m, int m_ld, int rows, int n);
+float filling_kernel_avx2(const float * s, int s_ld, const float * m, int m_ld, int rows, int n);
+float filling_kernel_avx512(const float * s, int s_ld, const float * m, int m_ld, int rows, int n);
+
+void fused_filling_kernel_portable(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer);
+void fused_filling_kernel_avx2(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer);
+void fused_filling_kernel_avx512(const float * s, int s_ld, const float * m_inner, const float * m_outer, int m_ld, int rows, int n, float & f_inner, float & f_outer);
+
+/**
+ * @brief Returns the name of the instruction set as used by simd_level_from_name
+ */
+inline string simd_level_name(simd_level level)
+{
+    switch (level)
+    {
+    case simd_level::AVX2: return "AVX2";
+    case simd_level::AVX512: return "AVX512";
+    default: return "PORTABLE";
+    }
+}
+
+/**
+ * @brief Returns the instruction set from name. Returns the detected instruction set if name is invalid or not supported by this CPU
+ */
+inline simd_level simd_level_from_name(string name)
+{
+    simd_level detected = simd_level_detect();
+    simd_level level = detected;
+
+    if (name == "PORTABLE")
+        level = simd_level::PORTABLE;
+    else if (name == "AVX2")
+        level = simd_level::AVX2;
+    else if (name == "AVX512")
+        level = simd_level::AVX512;
+    else
+        cerr << "Unknown instruction set " << name << ", using " << simd_level_name(detected) << endl;
+
+    if (level > detected)
+    {
+        cerr << "Instruction set " << name << " is not supported by this CPU, using " << simd_level_name(detected) << endl;
+        level = detected;
+    }
+
+    return level;
+}
@@ -2,10 +2,12 @@
 #include "aligned_vector.h"
 #include "mpi_async_connection.h"
 #include "mpi_dual_connection.h"
+#include "mpi_space_connection.h"
 #include <assert.h>
 #include <mpi.h>
 #include <omp.h>
 #include <math.h>
+#include <string.h>
 
 /*
  * DONE:
@@ -14,6 +16,9 @@
  */
 #define EPSILON 5.0e-5
 
+static_assert(ruleset_smooth_life_l_constants::radius_outer == FIXED_KERNEL_RADIUS && ruleset_rafler_paper_constants::radius_outer == FIXED_KERNEL_RADIUS,
+              "the fixed kernels are specialized for the radius of the predefined rulesets");
+
 /**
  * returns true, if |a-b| < deviation is true
  */
@@ -22,148 +27,1446 @@ inline bool isApprox(cfloat a, cfloat b, cfloat deviation)
     return abs(a - b) < deviation;
 }
 
-/**
- * returns true, if |a-b| < EPSILON is true
- */
-inline bool isApprox(cfloat a, cfloat b)
+/**
+ * returns true, if |a-b| < EPSILON is true
+ */
+inline bool isApprox(cfloat a, cfloat b)
+{
+    return isApprox(a, b, EPSILON);
+}
+
+simulator::simulator(const ruleset & r) : m_rules(r), m_core(r)
+{
+}
+
+simulator::~simulator()
+{
+    if (m_space != nullptr)
+    {
+        delete m_space;
+    }
+
+    if (m_fft != nullptr)
+    {
+        delete m_fft;
+    }
+
+}
+
+void simulator::initialize(aligned_matrix<float> & predefined_space)
+{
+    if (predefined_space.getNumRows() != m_rules.get_space_height() || predefined_space.getNumCols() != m_rules.get_space_width())
+    {
+        cerr << "Could not initialize simulator: Invalid predefined space size!" << endl;
+        exit(-1);
+    }
+
+    cout << "Initializing ..." << endl;
+
+    // Determine the queue size
+    // If have a master simulator, we NEED a queue -> set it to SPACE_QUEUE_MAX_SIZE
+    // A slave simulator or perftest-master simulator does not need a queue and it's overhead
+    // Set it to 0 then, so we can use swap()
+    int queue_size;
+
+    if (!APP_UNIT_TEST && !APP_PERFTEST && mpi_get_role() == mpi_role::SIMULATOR_MASTER)
+        queue_size = SPACE_QUEUE_MAX_SIZE;
+    else
+        queue_size = 0;
+
+    m_outer_masks.reserve(CACHELINE_FLOATS);
+    m_inner_masks.reserve(CACHELINE_FLOATS);
+
+    initiate_masks();
+
+    if (m_halo)
+    {
+        // The halo must hold everything a mask reaches over the edges of space
+        int halo_columns = 0;
+
+        for (const aligned_matrix<float> & mask : m_outer_masks)
+            halo_columns = max(halo_columns, max(mask.getLeftOffset(), mask.getRightOffset()));
+
+        aligned_matrix<float> halo_space = aligned_matrix<float>(predefined_space.getNumCols(), predefined_space.getNumRows(), halo_columns, m_outer_masks[0].getNumRows() / 2);
+
+        if (halo_space.getHaloColumns() > halo_space.getNumCols() || halo_space.getHaloRows() > halo_space.getNumRows())
+        {
+            // the ghost cells are copies of the opposite edge, which is too narrow
+            cout << "Simulator | The halo is wider than the space, it is turned off" << endl;
+            m_halo = false;
+        }
+        else
+        {
+            halo_space.overwrite(predefined_space);
+
+            m_space = new matrix_buffer_queue<float>(queue_size, halo_space, m_storage_precision);
+        }
+    }
+
+    if (!m_halo)
+    {
+        m_space = new matrix_buffer_queue<float>(queue_size, predefined_space, m_storage_precision);
+    }
+
+    if (m_storage_precision != storage_precision::FP32)
+    {
+        cout << "Simulator | States are stored in " << storage_precision_name(m_storage_precision) << endl;
+
+        // The initial states have to be representable in the storage precision, too
+        for (int y = 0; y < space_current->getNumRows(); ++y)
+            for (int x = 0; x < space_current->getNumCols(); ++x)
+                space_current->setValue(storage_round(space_current->getValue(x, y), m_storage_precision), x, y);
+
+        m_space_half = space_current->hasHalo() ?
+                aligned_matrix<uint16_t>(space_current->getNumCols(), space_current->getNumRows(), space_current->getHaloColumns(), space_current->getHaloRows()) :
+                aligned_matrix<uint16_t>(space_current->getNumCols(), space_current->getNumRows());
+    }
+
+    //space_current = new vectorized_matrix<float>(predefined_space);
+    //space_next = new vectorized_matrix<float>(rules.get_space_width(), rules.get_space_height());
+
+    m_offset_from_mask_center = m_inner_masks[0].getLeftOffset();
+    m_outer_mask_sum = m_outer_masks[0].sum(); // the sum remains the same for all masks, supposedly
+    m_inner_mask_sum = m_inner_masks[0].sum();
+
+    if (m_compact_masks)
+        initiate_compact_masks();
+
+    // the engines below build their mask decompositions on first use, the engine can be switched at runtime
+    m_spans_initiated = false;
+
+    if (m_filling_engine == filling_engine::PREFIX_SUM)
+        initiate_spans();
+
+    m_rects_initiated = false;
+
+    if (m_filling_engine == filling_engine::SAT)
+        initiate_rects();
+
+    m_symmetric.clear();
+
+    if (m_filling_engine == filling_engine::SYMMETRIC_Y)
+        initiate_symmetric();
+
+    m_differences_initiated = false;
+
+    if (m_filling_engine == filling_engine::SLIDING_WINDOW)
+        initiate_differences();
+
+    if (m_filling_engine == filling_engine::FFT)
+        initiate_fft();
+
+    // built on demand if the engine is switched at runtime
+    m_fixed_point_initiated_bits = 0;
+
+    if (m_filling_engine == filling_engine::FIXED_POINT)
+        initiate_fixed_point();
+
+    m_separable_initiated_tolerance = -1;
+
+    if (m_filling_engine == filling_engine::SEPARABLE)
+    {
+        initiate_separable();
+        cout << "Simulator | Separable fillings max. error " << measure_separable_error() << " against getFilling_unoptimized" << endl;
+    }
+
+    m_transfer_function = transfer_function(m_rules);
+
+    if (!m_specialize)
+        m_transfer_function.disable_specialization();
+
+    if (m_transition_table_size > 0)
+    {
+        double error = m_transfer_function.build_table(m_transition_table_size);
+        cout << "Simulator | Transition table " << m_transition_table_size << "x" << m_transition_table_size << ", max. error " << error << endl;
+    }
+
+    // A cell stays 0 if its whole neighborhood is 0 only if s(0, 0) maps 0 to 0 (after rounding to the storage precision).
+    // Euler steps are clamped, discrete rules are not (s(0, 0) is tiny but not 0)
+    float zero = 0;
+    float next = 1;
+    m_transfer_function.apply(&zero, &zero, &zero, &next, 1);
+    m_zero_is_fixed_point = storage_round(next, m_storage_precision) == 0 && storage_round(m_core.next_state(0, 0, 0), m_storage_precision) == 0;
+    m_quiescent_tiles = 0;
+
+    if (m_skip_quiescent && !m_zero_is_fixed_point)
+        cout << "Simulator | 0 is no fixed point of the rules, quiescent tiles are not skipped" << endl;
+
+    // The adaptive dt needs the embedded solution of a Runge-Kutta integrator to estimate the error
+    if (m_adaptive_dt && m_rules.get_is_discrete())
+    {
+        cout << "Simulator | Discrete rules have no time step, dt is not adapted" << endl;
+        m_adaptive_dt = false;
+    }
+
+    if (m_adaptive_dt && get_stages() == 1)
+    {
+        cout << "Simulator | Adaptive dt needs an error estimate, using the MIDPOINT integrator" << endl;
+        m_rules.set_integrator(integrator::MIDPOINT);
+        m_core = simulator_core<float>(m_rules);
+    }
+
+    if (m_adaptive_dt && (m_dt_min <= 0 || m_dt_min > m_dt_max || m_dt_tolerance <= 0))
+    {
+        cerr << "Invalid adaptive dt: bounds [" << m_dt_min << ", " << m_dt_max << "], tolerance " << m_dt_tolerance << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    m_delta_time = m_adaptive_dt ? fmaxf(m_dt_min, fminf(m_dt_max, m_rules.get_delta_time())) : m_rules.get_delta_time();
+    m_simulated_time = 0;
+    m_rejected_steps = 0;
+
+    // The stages of the Runge-Kutta integrators need the states at the begin of the step and the sum of the derivatives
+    m_tableau = integrator_tableau_for(m_rules.get_integrator());
+    m_stage = 0;
+
+    if (get_stages() > 1)
+    {
+        // m_stage_base is swapped with space_current, it needs the same halo
+        m_stage_base = matrix_buffer_queue<float>::create_like(*space_current);
+        m_stage_sum = matrix_buffer_queue<float>::create_like(*space_current);
+
+        // only the last stage would be skipped, its derivative sum needs the others
+        if (m_skip_quiescent)
+            cout << "Simulator | Quiescent tiles are only skipped with the Euler integrator" << endl;
+
+        m_zero_is_fixed_point = false;
+
+        if (m_adaptive_dt)
+        {
+            m_stage_error = aligned_matrix<float>(space_current->getNumCols(), space_current->getNumRows());
+            cout << "Simulator | Adaptive dt in [" << m_dt_min << ", " << m_dt_max << "], tolerance " << m_dt_tolerance << endl;
+        }
+
+        cout << "Simulator | Integrator " << integrator_name(m_rules.get_integrator()) << " with " << get_stages() << " stages" << endl;
+    }
+
+    // With more than one rank, the temporal steps only reduce the border exchanges (see run_simulation_slave)
+    if (m_temporal_steps > 1 && !use_temporal_tiles())
+    {
+        const string limitation = get_temporal_blocking_limitation();
+
+        cout << "Simulator | A single rank calculates single steps instead of temporal blocks: "
+                << (limitation.empty() ? "a step reads the space from the L2 cache already" : limitation) << endl;
+    }
+
+    m_initialized = true;
+}
+
+void simulator::initiate_masks()
+{
+    // Initialize masks
+    /* NOTE:
+        - to allow vectorization, we add additional padding to the left side of the masks
+        - this increases the effective leading dimension of the matrices
+        - however, using the right offset, the space and the masks will always
+          be aligned to the cacheline_size (64)
+        - we may still accept peel loops. this will be determined during advanced
+          performance testing
+     */
+    for (int o = 0; o < CACHELINE_FLOATS; ++o)
+    {
+        m_inner_masks.push_back(simulator_core<float>::inner_mask(m_rules, o));
+        m_outer_masks.push_back(simulator_core<float>::outer_mask(m_rules, o));
+        assert(m_inner_masks[0].getLd() == m_outer_masks[0].getLd());
+        assert(m_inner_masks[0].getLeftOffset() == m_outer_masks[0].getLeftOffset());
+        assert(m_inner_masks[0].getRightOffset() == m_outer_masks[0].getRightOffset());
+    }
+}
+
+void simulator::initiate_compact_masks()
+{
+    const aligned_matrix<float> & inner = m_inner_masks[0];
+    const aligned_matrix<float> & outer = m_outer_masks[0];
+
+    // bounding box of the cells that are not 0 in any of the masks (over the whole leading dimension)
+    int x_begin = inner.getLd();
+    int x_end = 0;
+    int y_begin = inner.getNumRows();
+    int y_end = 0;
+
+    for (int y = 0; y < inner.getNumRows(); ++y)
+    {
+        for (int x = 0; x < inner.getLd(); ++x)
+        {
+            if (inner.getValue(x, y) != 0 || outer.getValue(x, y) != 0)
+            {
+                x_begin = min(x_begin, x);
+                x_end = max(x_end, x + 1);
+                y_begin = min(y_begin, y);
+                y_end = max(y_end, y + 1);
+            }
+        }
+    }
+
+    assert(x_begin < x_end && y_begin < y_end);
+
+    // whole vectors per row, a masked tail costs more than a few zeros
+    x_end = x_begin + (x_end - x_begin + SIMULATOR_COMPACT_MASK_COLUMNS - 1) / SIMULATOR_COMPACT_MASK_COLUMNS * SIMULATOR_COMPACT_MASK_COLUMNS;
+
+    // the rows are padded to whole cache lines (offset 0), the kernels only read the columns of the box
+    m_inner_compact_mask = aligned_matrix<float>(x_end - x_begin, y_end - y_begin, 0);
+    m_outer_compact_mask = aligned_matrix<float>(x_end - x_begin, y_end - y_begin, 0);
+
+    for (int y = y_begin; y < y_end; ++y)
+    {
+        for (int x = x_begin; x < x_end; ++x)
+        {
+            m_inner_compact_mask.setValue(x < inner.getLd() ? inner.getValue(x, y) : 0, x - x_begin, y - y_begin);
+            m_outer_compact_mask.setValue(x < outer.getLd() ? outer.getValue(x, y) : 0, x - x_begin, y - y_begin);
+        }
+    }
+
+    size_t masks_bytes = 0;
+
+    for (int o = 0; o < CACHELINE_FLOATS; ++o)
+        masks_bytes += (m_inner_masks[o].getLd() + m_outer_masks[o].getLd()) * m_inner_masks[o].getNumRows() * sizeof (float);
+
+    m_compact_left = m_offset_from_mask_center - x_begin;
+    m_compact_top = inner.getNumRows() / 2 - y_begin;
+
+    cout << "Simulator | Compact masks " << x_end - x_begin << "x" << y_end - y_begin << " ("
+         << 2 * m_inner_compact_mask.getLd() * m_inner_compact_mask.getNumRows() * sizeof (float) << " bytes instead of "
+         << masks_bytes << " bytes)" << endl;
+}
+
+void simulator::initiate_fft()
+{
+    cout << "Initializing FFT filling engine ..." << endl;
+
+    if (m_fft != nullptr)
+        delete m_fft;
+
+    // The FFT works on the whole local space. Slave simulators only use the part of it with chunk and borders,
+    // this is still correct as the mask never reaches over the border area
+    m_fft = new fft_convolution(space_current->getNumCols(), space_current->getNumRows());
+    m_fft->set_kernels(m_inner_masks[0], m_inner_mask_sum, m_outer_masks[0], m_outer_mask_sum);
+
+    m_filling_inner = aligned_matrix<float>(space_current->getNumCols(), space_current->getNumRows());
+    m_filling_outer = aligned_matrix<float>(space_current->getNumCols(), space_current->getNumRows());
+}
+
+void simulator::initiate_separable()
+{
+    cint w = space_current->getNumCols();
+    cint h = space_current->getNumRows();
+
+    if (m_separable_initiated_tolerance == m_separable_tolerance && m_filling_inner.getNumCols() == w && m_filling_inner.getNumRows() == h)
+        return;
+
+    cout << "Initializing SEPARABLE filling engine ..." << endl;
+
+    m_separable_inner.set_mask(m_inner_masks[0], m_inner_mask_sum, m_separable_tolerance);
+    m_separable_outer.set_mask(m_outer_masks[0], m_outer_mask_sum, m_separable_tolerance);
+    m_separable_initiated_tolerance = m_separable_tolerance;
+
+    cout << "Simulator | Separable masks of rank " << m_separable_inner.rank() << " (inner) and " << m_separable_outer.rank() << " (outer), error bound "
+            << max(m_separable_inner.error_bound(), m_separable_outer.error_bound()) << " (tolerance " << m_separable_tolerance << ")" << endl;
+
+    // shared with the FFT engine
+    if (m_filling_inner.getNumCols() != w || m_filling_inner.getNumRows() != h)
+    {
+        m_filling_inner = aligned_matrix<float>(w, h);
+        m_filling_outer = aligned_matrix<float>(w, h);
+    }
+}
+
+double simulator::measure_separable_error()
+{
+    m_separable_inner.convolve(*space_current, m_filling_inner, line_filter_kernel_for(m_simd_level));
+    m_separable_outer.convolve(*space_current, m_filling_outer, line_filter_kernel_for(m_simd_level));
+
+    cint w = space_current->getNumCols();
+    cint h = space_current->getNumRows();
+    const long cells = long(w) * h;
+    const long stride = max(1L, cells / SIMULATOR_SEPARABLE_SAMPLES);
+    double error = 0;
+
+    for (long cell = 0; cell < cells; cell += stride)
+    {
+        cint x = cell % w;
+        cint y = cell / w;
+
+        error = max(error, (double) fabs(m_filling_inner.getValue(x, y) - getFilling_unoptimized(x, y, m_inner_masks[0], m_inner_mask_sum)));
+        error = max(error, (double) fabs(m_filling_outer.getValue(x, y) - getFilling_unoptimized(x, y, m_outer_masks[0], m_outer_mask_sum)));
+    }
+
+    return error;
+}
+
+void simulator::initiate_fixed_point()
+{
+    if (m_fixed_point_bits != 8 && m_fixed_point_bits != 16)
+    {
+        cerr << "Invalid number of fixed point bits " << m_fixed_point_bits << ", use 8 or 16" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const bool fits = m_fixed_point_bits == 8 ? m_fixed_point8.fits(*space_current) : m_fixed_point16.fits(*space_current);
+
+    if (m_fixed_point_initiated_bits == m_fixed_point_bits && fits)
+        return;
+
+    cout << "Initializing " << m_fixed_point_bits << " bit FIXED_POINT filling engine ..." << endl;
+
+    // the other width is released, only one space copy is kept
+    if (m_fixed_point_bits == 8)
+    {
+        m_fixed_point8.initialize(m_inner_masks[0], m_outer_masks[0], m_offset_from_mask_center, m_inner_masks[0].getNumRows() / 2, *space_current);
+        m_fixed_point16 = fixed_point_filling<uint16_t, int16_t>();
+    }
+    else
+    {
+        m_fixed_point16.initialize(m_inner_masks[0], m_outer_masks[0], m_offset_from_mask_center, m_inner_masks[0].getNumRows() / 2, *space_current);
+        m_fixed_point8 = fixed_point_filling<uint8_t, int8_t>();
+    }
+
+    m_fixed_point_initiated_bits = m_fixed_point_bits;
+}
+
+void simulator::initiate_spans()
+{
+    if (m_spans_initiated)
+        return;
+
+    m_inner_spans = span_mask(m_inner_masks[0]);
+    m_outer_spans = span_mask(m_outer_masks[0]);
+    m_spans_initiated = true;
+}
+
+void simulator::initiate_differences()
+{
+    if (m_differences_initiated)
+        return;
+
+    m_inner_difference = sparse_mask::vertical_difference(m_inner_masks[0]);
+    m_outer_difference = sparse_mask::vertical_difference(m_outer_masks[0]);
+    m_differences_initiated = true;
+}
+
+void simulator::initiate_rects()
+{
+    if (m_rects_initiated)
+        return;
+
+    m_inner_rects = rect_mask(m_inner_masks[0]);
+    m_outer_rects = rect_mask(m_outer_masks[0]);
+    m_rects_initiated = true;
+
+    cout << "Simulator | Summed-area table masks: " << m_inner_rects.rects().size() << " rectangles + " << m_inner_rects.rim().size() << " rim cells (inner), "
+            << m_outer_rects.rects().size() << " rectangles + " << m_outer_rects.rim().size() << " rim cells (outer)" << endl;
+}
+
+void simulator::initiate_symmetric()
+{
+    if (!m_symmetric.empty())
+        return;
+
+    m_symmetric.assign(CACHELINE_FLOATS, symmetric_filling());
+
+    for (int o = 0; o < CACHELINE_FLOATS; ++o)
+        m_symmetric[o].initialize(m_inner_masks[o], m_outer_masks[o]);
+
+    if (!m_symmetric[0].symmetric)
+        cout << "Simulator | The masks are not symmetric in y, using the FUSED engine" << endl;
+}
+
+void simulator::initialize()
+{
+    cout << "Default initialization ..." << endl;
+
+    aligned_matrix<float> * space = new aligned_matrix<float>(m_rules.get_space_width(), m_rules.get_space_height());
+
+    SIMULATOR_INITIALIZATION_FUNCTION(space);
+
+    // Give space to main initialization function
+    initialize(*space);
+}
+
+void simulator::simulate_step()
+{
+    simulate_step(0, m_rules.get_space_width());
+}
+
+void simulator::update_kernels()
+{
+    m_filling_kernel = filling_kernel_for(m_simd_level);
+    m_fused_filling_kernel = fused_filling_kernel_for(m_simd_level);
+    m_blocked_fused_filling_kernel = blocked_fused_filling_kernel_for(m_simd_level);
+    m_line_filter_kernel = line_filter_kernel_for(m_simd_level);
+    m_symmetric_fused_filling_kernel = symmetric_fused_filling_kernel_for(m_simd_level);
+
+    for (int o = 0; o < CACHELINE_FLOATS; ++o)
+    {
+        m_fixed_filling_kernels[o] = m_specialize ? fixed_filling_kernel_for(m_simd_level, m_inner_masks[o].getNumRows(), m_inner_masks[o].getLd()) : nullptr;
+        m_fixed_fused_filling_kernels[o] = m_specialize ? fixed_fused_filling_kernel_for(m_simd_level, m_inner_masks[o].getNumRows(), m_inner_masks[o].getLd()) : nullptr;
+    }
+
+    // The compact masks are specialized like the full masks if their rounded width is one of the fixed sizes
+    const bool compact_fixed = m_specialize && m_compact_masks && m_inner_compact_mask.getLd() == m_inner_compact_mask.getNumCols();
+    m_fixed_compact_filling_kernel = compact_fixed ? fixed_filling_kernel_for(m_simd_level, m_inner_compact_mask.getNumRows(), m_inner_compact_mask.getLd()) : nullptr;
+    m_fixed_compact_fused_filling_kernel = compact_fixed ? fixed_fused_filling_kernel_for(m_simd_level, m_inner_compact_mask.getNumRows(), m_inner_compact_mask.getLd()) : nullptr;
+
+    if (m_storage_precision != storage_precision::FP32)
+    {
+        m_half_filling_kernel = half_filling_kernel_for(m_simd_level, m_storage_precision);
+        m_half_fused_filling_kernel = half_fused_filling_kernel_for(m_simd_level, m_storage_precision);
+    }
+
+    m_int8_fused_filling_kernel = int8_fused_filling_kernel_for(m_simd_level);
+    m_int16_fused_filling_kernel = int16_fused_filling_kernel_for(m_simd_level);
+    m_int8_fixed_fused_filling_kernel = m_specialize ? int8_fixed_fused_filling_kernel_for(m_simd_level, m_fixed_point8.inner.getNumCols()) : nullptr;
+    m_int16_fixed_fused_filling_kernel = m_specialize ? int16_fixed_fused_filling_kernel_for(m_simd_level, m_fixed_point16.inner.getNumCols()) : nullptr;
+}
+
+void simulator::simulate_step(int x_start, int w)
+{
+    if (m_adaptive_dt)
+    {
+        simulate_adaptive_step(x_start, w, false);
+        return;
+    }
+
+    simulate_stages(x_start, w);
+    m_simulated_time += m_delta_time;
+
+    //cerr << "Disabled calc" << endl;
+    ++spacetime;
+}
+
+void simulator::simulate_adaptive_step(int x_start, int w, const bool global)
+{
+    bool accepted = false;
+
+    while (!accepted)
+    {
+        simulate_stages(x_start, w);
+
+        float error = get_step_error(x_start, w);
+
+        if (global)
+            MPI_Allreduce(MPI_IN_PLACE, &error, 1, MPI_FLOAT, MPI_MAX, MPI_COMM_WORLD);
+
+        // space_current is untouched by the stages, a rejected step is just calculated again
+        accepted = control_delta_time(error);
+    }
+
+    ++spacetime;
+}
+
+float simulator::get_step_error(cint x_start, cint w)
+{
+    cint space_w = space_current->getNumCols();
+    cint h = space_current->getNumRows();
+    float error = 0;
+
+    #pragma omp parallel for schedule(static) reduction(max : error)
+    for (int i = 0; i < min(w, space_w); ++i)
+    {
+        cint x = (x_start + i) % space_w;
+
+        for (int y = 0; y < h; ++y)
+            error = fmaxf(error, m_stage_error.getValue(x, y));
+    }
+
+    return error;
+}
+
+bool simulator::control_delta_time(cfloat error)
+{
+    cfloat dt = m_delta_time;
+    const bool accepted = error <= m_dt_tolerance || dt <= m_dt_min;
+
+    // the error of the embedded solution of order p grows with dt^(p + 1)
+    float factor = SIMULATOR_DT_MAX_GROWTH;
+
+    if (error > 0)
+        factor = SIMULATOR_DT_SAFETY * powf(m_dt_tolerance / error, 1.0f / (m_tableau.embedded_order + 1));
+
+    factor = fmaxf(SIMULATOR_DT_MAX_SHRINK, fminf(SIMULATOR_DT_MAX_GROWTH, factor));
+    m_delta_time = fmaxf(m_dt_min, fminf(m_dt_max, dt * factor));
+
+    if (accepted)
+        m_simulated_time += dt;
+    else
+        ++m_rejected_steps;
+
+    return accepted;
+}
+
+void simulator::simulate_stages(cint x_start, cint w)
+{
+    cint stages = get_stages();
+    cint space_w = space_current->getNumCols();
+
+    for (m_stage = 0; m_stage < stages; ++m_stage)
+    {
+        if (m_stage == 1)
+        {
+            // keep the states of the step, the buffer becomes the stage the next fillings are calculated of
+            m_stage_base.swap(*space_current);
+        }
+
+        if (m_stage > 0)
+            space_current->swap(*space_next);
+
+        // A part of the space (MPI chunk) needs its neighbors within the mask reach in the next stage,
+        // so all stages except the last one are calculated wider (like temporal blocking)
+        cint extent = (stages - 1 - m_stage) * get_mask_reach();
+        cint begin = x_start - extent;
+        cint width = w + 2 * extent;
+
+        // The FFT has its own parallel regions, the rest of the stage is done in one
+        if (m_filling_engine == filling_engine::FFT)
+            convolve_fft();
+
+        #pragma omp parallel
+        {
+            if (width >= space_w)
+            {
+                simulate_step_in_team(0, space_w);
+            }
+            else if (begin < 0)
+            {
+                simulate_step_in_team(begin + space_w, -begin);
+                simulate_step_in_team(0, width + begin);
+            }
+            else if (begin + width > space_w)
+            {
+                simulate_step_in_team(begin, space_w - begin);
+                simulate_step_in_team(0, begin + width - space_w);
+            }
+            else
+            {
+                simulate_step_in_team(begin, width);
+            }
+        }
+    }
+
+    // space_current holds the states of the step again
+    if (stages > 1)
+        m_stage_base.swap(*space_current);
+
+    m_stage = 0;
+}
+
+void simulator::simulate_steps(cint n)
+{
+    if (m_filling_engine == filling_engine::FFT || use_temporal_tiles() || get_stages() > 1)
+    {
+        // the FFT, temporal blocks and the stages of the integrators (and the adaptive dt) open their own parallel regions
+        int step = 0;
+
+        for (; step + m_temporal_steps <= n && use_temporal_tiles(); step += m_temporal_steps)
+        {
+            simulate_temporal_block();
+            m_space->swap();
+        }
+
+        for (; step < n; ++step)
+        {
+            simulate_step();
+            m_space->swap();
+        }
+
+        return;
+    }
+
+    // The workers stay in this parallel region for all steps and only meet at the barriers of the work-sharing
+    // constructs. No threads are forked or joined between steps
+    #pragma omp parallel
+    {
+        for (int step = 0; step < n; ++step)
+        {
+            simulate_step_in_team(0, m_rules.get_space_width());
+
+            #pragma omp single
+            {
+                ++spacetime;
+                m_simulated_time += m_delta_time;
+                m_space->swap();
+            }
+        }
+    }
+}
+
+void simulator::convolve_fft()
+{
+    // The engine can be switched at runtime. Build the FFT on first use
+    if (m_fft == nullptr)
+        initiate_fft();
+
+    m_fft->convolve(*space_current, m_filling_inner, m_filling_outer);
+}
+
+void simulator::simulate_step_in_team(cint x_start, cint w)
+{
+    #pragma omp single
+    {
+        // the specialized fixed point kernels depend on the quantized masks
+        if (m_filling_engine == filling_engine::FIXED_POINT)
+            initiate_fixed_point();
+
+        // the tolerance can be changed at runtime
+        if (m_filling_engine == filling_engine::SEPARABLE)
+            initiate_separable();
+
+        if (m_filling_engine == filling_engine::PREFIX_SUM)
+            initiate_spans();
+
+        if (m_filling_engine == filling_engine::SLIDING_WINDOW)
+            initiate_differences();
+
+        if (m_filling_engine == filling_engine::SAT)
+            initiate_rects();
+
+        if (m_filling_engine == filling_engine::SYMMETRIC_Y)
+            initiate_symmetric();
+
+        update_kernels();
+    }
+
+    // refresh the ghost cells from the opposite edges, the mask never has to wrap then
+    if (space_current->hasHalo())
+        space_current->update_halo();
+
+    if (m_storage_precision != storage_precision::FP32)
+        update_space_half(x_start, w);
+
+    if (m_filling_engine == filling_engine::FIXED_POINT)
+        update_space_fixed_point(x_start, w);
+
+    if (m_filling_engine == filling_engine::SEPARABLE)
+    {
+        m_separable_inner.convolve(*space_current, m_filling_inner, m_line_filter_kernel);
+        m_separable_outer.convolve(*space_current, m_filling_outer, m_line_filter_kernel);
+    }
+
+    if (m_filling_engine == filling_engine::SAT)
+    {
+        // the outer mask contains the inner one
+        m_summed_area_table.update(*space_current, x_start, w, max(m_inner_rects.getReach(), m_outer_rects.getReach()));
+    }
+
+    if (m_filling_engine == filling_engine::PREFIX_SUM)
+    {
+        // spans reach at most columns / 2 + 1 over the left or right border
+        m_prefix_sums.update(*space_current, m_inner_spans.getNumCols() / 2 + 1);
+    }
+
+    const bool skip_quiescent = m_skip_quiescent && m_zero_is_fixed_point;
+    ulong quiescent_tiles = 0;
+
+    if (m_schedule == tile_schedule::WORK_STEALING)
+    {
+        simulate_tiles_work_stealing(x_start, w, skip_quiescent);
+    }
+    else if (m_tile_width > 0 && m_tile_height > 0)
+    {
+        // cache-blocked traversal: tiles are the parallel unit. Neighboring tile indices are horizontal neighbors
+        // and share most of the space rows they touch
+        cint tiles_x = (w + m_tile_width - 1) / m_tile_width;
+        cint tiles_y = (m_rules.get_space_height() + m_tile_height - 1) / m_tile_height;
+
+        if (skip_quiescent)
+            update_activity(x_start, w, m_tile_width, m_tile_height);
+
+        #pragma omp for schedule(static)
+        for (int tile = 0; tile < tiles_x * tiles_y; ++tile)
+        {
+            cint tile_x = x_start + (tile % tiles_x) * m_tile_width;
+            cint tile_y = (tile / tiles_x) * m_tile_height;
+            cint tile_x_end = min(tile_x + m_tile_width, x_start + w);
+            cint tile_y_end = min(tile_y + m_tile_height, m_rules.get_space_height());
+
+            if (skip_quiescent && !m_activity[tile])
+            {
+                // everything the masks reach is 0, so the tile stays 0
+                for (int x = tile_x; x < tile_x_end; ++x)
+                    zero_column(x, tile_y, tile_y_end);
+
+                ++quiescent_tiles;
+                continue;
+            }
+
+            for (int x = tile_x; x < tile_x_end; ++x)
+            {
+                simulate_column(x, tile_y, tile_y_end);
+            }
+        }
+    }
+    else if (skip_quiescent)
+    {
+        // column traversal as below, each column is simulated in runs of active tiles of the activity map
+        cint tiles_x = (w + SIMULATOR_ACTIVITY_TILE_SIZE - 1) / SIMULATOR_ACTIVITY_TILE_SIZE;
+        cint tiles_y = (m_rules.get_space_height() + SIMULATOR_ACTIVITY_TILE_SIZE - 1) / SIMULATOR_ACTIVITY_TILE_SIZE;
+
+        update_activity(x_start, w, SIMULATOR_ACTIVITY_TILE_SIZE, SIMULATOR_ACTIVITY_TILE_SIZE);
+
+        #pragma omp for schedule(static)
+        for (int x = x_start; x < x_start + w; ++x)
+        {
+            cint tile_column = (x - x_start) / SIMULATOR_ACTIVITY_TILE_SIZE;
+            const bool first_in_tile = (x - x_start) % SIMULATOR_ACTIVITY_TILE_SIZE == 0;
+            int tile_row = 0;
+
+            while (tile_row < tiles_y)
+            {
+                const uint8_t active = m_activity[tile_row * tiles_x + tile_column];
+                int run_end = tile_row + 1;
+
+                while (run_end < tiles_y && m_activity[run_end * tiles_x + tile_column] == active)
+                    ++run_end;
+
+                cint y_begin = tile_row * SIMULATOR_ACTIVITY_TILE_SIZE;
+                cint y_end = min(run_end * SIMULATOR_ACTIVITY_TILE_SIZE, m_rules.get_space_height());
+
+                if (active)
+                {
+                    simulate_column(x, y_begin, y_end);
+                }
+                else
+                {
+                    zero_column(x, y_begin, y_end);
+
+                    if (first_in_tile)
+                        quiescent_tiles += run_end - tile_row;
+                }
+
+                tile_row = run_end;
+            }
+        }
+    }
+    else
+    {
+        #pragma omp for schedule(static)
+        for (int x = x_start; x < x_start + w; ++x)
+        {
+            simulate_column(x, 0, m_rules.get_space_height());
+        }
+    }
+
+    if (quiescent_tiles > 0)
+    {
+        #pragma omp atomic
+        m_quiescent_tiles += quiescent_tiles;
+    }
+}
+
+void simulator::simulate_tiles_work_stealing(cint x_start, cint w, const bool skip_quiescent)
+{
+    cint tile_width = m_tile_width > 0 && m_tile_height > 0 ? m_tile_width : SIMULATOR_SCHEDULER_TILE_WIDTH;
+    cint tile_height = m_tile_width > 0 && m_tile_height > 0 ? m_tile_height : SIMULATOR_SCHEDULER_TILE_HEIGHT;
+    cint tiles_x = (w + tile_width - 1) / tile_width;
+    cint tiles_y = (m_rules.get_space_height() + tile_height - 1) / tile_height;
+
+    if (skip_quiescent)
+        update_activity(x_start, w, tile_width, tile_height);
+
+    #pragma omp single
+    {
+        if (m_scheduler == nullptr)
+            m_scheduler.reset(new work_stealing_scheduler());
+
+        m_tile_costs.resize(tiles_x * tiles_y);
+
+        for (int tile = 0; tile < tiles_x * tiles_y; ++tile)
+        {
+            cint tile_x = x_start + (tile % tiles_x) * tile_width;
+            cint tile_y = (tile / tiles_x) * tile_height;
+            cint tile_x_end = min(tile_x + tile_width, x_start + w);
+            cint tile_y_end = min(tile_y + tile_height, m_rules.get_space_height());
+
+            if (skip_quiescent && !m_activity[tile])
+            {
+                m_tile_costs[tile] = SIMULATOR_QUIESCENT_COST * (tile_x_end - tile_x) * (tile_y_end - tile_y);
+                ++m_quiescent_tiles;
+            }
+            else
+            {
+                m_tile_costs[tile] = tile_cost(tile_x, tile_y, tile_x_end, tile_y_end);
+            }
+        }
+
+        m_scheduler->distribute(m_tile_costs, omp_get_num_threads());
+    }
+
+    m_scheduler->work([&](cint tile)
+    {
+        cint tile_x = x_start + (tile % tiles_x) * tile_width;
+        cint tile_y = (tile / tiles_x) * tile_height;
+        cint tile_x_end = min(tile_x + tile_width, x_start + w);
+        cint tile_y_end = min(tile_y + tile_height, m_rules.get_space_height());
+
+        if (skip_quiescent && !m_activity[tile])
+        {
+            for (int x = tile_x; x < tile_x_end; ++x)
+                zero_column(x, tile_y, tile_y_end);
+        }
+        else
+        {
+            for (int x = tile_x; x < tile_x_end; ++x)
+                simulate_column(x, tile_y, tile_y_end);
+        }
+    });
+
+    // all tiles have to be done before the step ends
+    #pragma omp barrier
+}
+
+float simulator::tile_cost(cint tile_x, cint tile_y, cint tile_x_end, cint tile_y_end) const
 {
-    return isApprox(a, b, EPSILON);
+    cint cells = (tile_x_end - tile_x) * (tile_y_end - tile_y);
+
+    // the whole-field engines and the ghost cells do not have a slow path
+    if (space_current->hasHalo() || m_filling_engine == filling_engine::FFT || m_filling_engine == filling_engine::PREFIX_SUM
+            || m_filling_engine == filling_engine::SEPARABLE || m_filling_engine == filling_engine::SAT)
+        return cells;
+
+    // the masks start up to one cache line left of the reach (alignment padding)
+    cint reach = get_mask_reach();
+    cint reach_left = reach + CACHELINE_FLOATS;
+    cint space_w = space_current->getNumCols();
+    cint space_h = space_current->getNumRows();
+
+    int seam_columns = 0;
+    int seam_rows = 0;
+
+    for (int x = tile_x; x < tile_x_end; ++x)
+        seam_columns += x - reach_left < 0 || x + reach > space_w;
+
+    for (int y = tile_y; y < tile_y_end; ++y)
+        seam_rows += y - reach < 0 || y + reach > space_h;
+
+    cint seam_cells = seam_columns * (tile_y_end - tile_y) + seam_rows * (tile_x_end - tile_x) - seam_columns * seam_rows;
+
+    return cells + (SIMULATOR_SEAM_COST - 1) * seam_cells;
 }
 
-simulator::simulator(const ruleset & r) : m_rules(r)
+void simulator::zero_column(cint x, cint y_begin, cint y_end)
 {
+    for (int y = y_begin; y < y_end; ++y)
+        space_next->setValue(0, x, y);
 }
 
-simulator::~simulator()
+void simulator::update_activity(cint x_start, cint w, cint tile_width, cint tile_height)
 {
-    if (m_space != nullptr)
+    cint space_w = space_current->getNumCols();
+    cint space_h = space_current->getNumRows();
+    cint reach = get_mask_reach();
+    cint tiles_x = (w + tile_width - 1) / tile_width;
+    cint tiles_y = (space_h + tile_height - 1) / tile_height;
+    cint extended_w = w + 2 * reach; // the columns [x_start - reach, x_start + w + reach) read by the tiles
+
+    #pragma omp single
     {
-        delete m_space;
+        m_activity.assign(tiles_x * tiles_y, 0);
+        m_activity_rows.resize(space_h * tiles_x);
+        m_activity_columns.resize(omp_get_num_threads() * extended_w);
     }
-}
 
-void simulator::initialize(aligned_matrix<float> & predefined_space)
-{
-    if (predefined_space.getNumRows() != m_rules.get_space_height() || predefined_space.getNumCols() != m_rules.get_space_width())
+    // separable dilation: first mark per row the tiles that have a non-zero state within reach to the left or right
+    // (reading each row once), then look for a marked row within reach above or below
+    #pragma omp for schedule(static)
+    for (int y = 0; y < space_h; ++y)
     {
-        cerr << "Could not initialize simulator: Invalid predefined space size!" << endl;
-        exit(-1);
-    }
+        const float * row = space_current->getRow_ptr(y);
+        uint8_t * columns = m_activity_columns.data() + omp_get_thread_num() * extended_w;
 
-    cout << "Initializing ..." << endl;
+        // the extended row in contiguous pieces, split where it wraps
+        for (int i = 0, x = ((x_start - reach) % space_w + space_w) % space_w; i < extended_w; x = 0)
+        {
+            cint n = min(extended_w - i, space_w - x);
 
-    // Determine the queue size
-    // If have a master simulator, we NEED a queue -> set it to SPACE_QUEUE_MAX_SIZE
-    // A slave simulator or perftest-master simulator does not need a queue and it's overhead
-    // Set it to 0 then, so we can use swap()
-    int queue_size;
+            for (int j = 0; j < n; ++j)
+                columns[i + j] = row[x + j] != 0;
 
-    if (!APP_UNIT_TEST && !APP_PERFTEST && mpi_get_role() == mpi_role::SIMULATOR_MASTER)
-        queue_size = SPACE_QUEUE_MAX_SIZE;
-    else
-        queue_size = 0;
+            i += n;
+        }
 
-    m_space = new matrix_buffer_queue<float>(queue_size, predefined_space);
+        for (int tile_column = 0; tile_column < tiles_x; ++tile_column)
+        {
+            cint tile_x = tile_column * tile_width;
+            cint tile_x_end = min(tile_x + tile_width, w) + 2 * reach;
 
-    //space_current = new vectorized_matrix<float>(predefined_space);
-    //space_next = new vectorized_matrix<float>(rules.get_space_width(), rules.get_space_height());
+            m_activity_rows[y * tiles_x + tile_column] = memchr(columns + tile_x, 1, tile_x_end - tile_x) != nullptr;
+        }
+    }
 
-    m_outer_masks.reserve(CACHELINE_FLOATS);
-    m_inner_masks.reserve(CACHELINE_FLOATS);
+    #pragma omp for schedule(static)
+    for (int tile_row = 0; tile_row < tiles_y; ++tile_row)
+    {
+        cint tile_y = tile_row * tile_height;
+        cint tile_y_end = min(tile_y + tile_height, space_h);
+        uint8_t * active = m_activity.data() + tile_row * tiles_x;
+        int y = ((tile_y - reach) % space_h + space_h) % space_h;
 
-    initiate_masks();
+        for (int i = tile_y - reach; i < tile_y_end + reach; ++i)
+        {
+            const uint8_t * row = m_activity_rows.data() + y * tiles_x;
 
-    m_offset_from_mask_center = m_inner_masks[0].getLeftOffset();
-    m_outer_mask_sum = m_outer_masks[0].sum(); // the sum remains the same for all masks, supposedly
-    m_inner_mask_sum = m_inner_masks[0].sum();
+            for (int tile_column = 0; tile_column < tiles_x; ++tile_column)
+                active[tile_column] |= row[tile_column];
 
-    m_initialized = true;
+            if (++y == space_h)
+                y = 0;
+        }
+    }
 }
 
-void simulator::initiate_masks()
+void simulator::simulate_temporal_block()
 {
-    // Initialize masks
-    /* NOTE:
-        - to allow vectorization, we add additional padding to the left side of the masks
-        - this increases the effective leading dimension of the matrices
-        - however, using the right offset, the space and the masks will always
-          be aligned to the cacheline_size (64)
-        - we may still accept peel loops. this will be determined during advanced
-          performance testing
-     */
-    for (int o = 0; o < CACHELINE_FLOATS; ++o)
+    check_temporal_blocking();
+    update_kernels();
+
+    cint tile_width = m_tile_width > 0 && m_tile_height > 0 ? m_tile_width : SIMULATOR_TEMPORAL_TILE_SIZE;
+    cint tile_height = m_tile_width > 0 && m_tile_height > 0 ? m_tile_height : SIMULATOR_TEMPORAL_TILE_SIZE;
+    cint tiles_x = (m_rules.get_space_width() + tile_width - 1) / tile_width;
+    cint tiles_y = (m_rules.get_space_height() + tile_height - 1) / tile_height;
+    const bool skip_quiescent = m_skip_quiescent && m_zero_is_fixed_point;
+
+    #pragma omp parallel
     {
-        aligned_matrix<float> inner_mask = aligned_matrix<float>(m_rules.get_radius_outer() * 2 + 2, m_rules.get_radius_outer() * 2 + 2, o);
-        inner_mask.set_circle(m_rules.get_radius_inner(), 1, 1, o);
-        m_inner_masks.push_back(inner_mask);
+        // each thread reuses its region buffers for all of its tiles
+        aligned_matrix<float> region_a;
+        aligned_matrix<float> region_b;
+        ulong quiescent_tiles = 0;
 
-        aligned_matrix<float> outer_mask = aligned_matrix<float>(m_rules.get_radius_outer() * 2 + 2, m_rules.get_radius_outer() * 2 + 2, o);
-        outer_mask.set_circle(m_rules.get_radius_outer(), 1, 1, o);
-        outer_mask.set_circle(m_rules.get_radius_inner(), 0, 1, o);
-        m_outer_masks.push_back(outer_mask);
-        assert(m_inner_masks[0].getLd() == m_outer_masks[0].getLd());
-        assert(m_inner_masks[0].getLeftOffset() == m_outer_masks[0].getLeftOffset());
-        assert(m_inner_masks[0].getRightOffset() == m_outer_masks[0].getRightOffset());
+        #pragma omp for schedule(static)
+        for (int tile = 0; tile < tiles_x * tiles_y; ++tile)
+        {
+            cint tile_x = (tile % tiles_x) * tile_width;
+            cint tile_y = (tile / tiles_x) * tile_height;
+
+            if (simulate_tile_steps(tile_x, tile_y,
+                                    min(tile_width, m_rules.get_space_width() - tile_x),
+                                    min(tile_height, m_rules.get_space_height() - tile_y),
+                                    region_a, region_b, skip_quiescent))
+                ++quiescent_tiles;
+        }
+
+        if (quiescent_tiles > 0)
+        {
+            #pragma omp atomic
+            m_quiescent_tiles += quiescent_tiles;
+        }
     }
+
+    spacetime += m_temporal_steps;
+    m_simulated_time += m_temporal_steps * m_delta_time;
 }
 
-void simulator::initialize()
+bool simulator::simulate_tile_steps(cint tile_x, cint tile_y, cint tile_w, cint tile_h, aligned_matrix<float> & region_a, aligned_matrix<float> & region_b, const bool skip_quiescent)
 {
-    cout << "Default initialization ..." << endl;
+    cint steps = m_temporal_steps;
+    cint reach = get_mask_reach();
+    cint space_w = m_rules.get_space_width();
+    cint space_h = m_rules.get_space_height();
+
+    // the cells a kernel reads for the cell (x, y): [x - left, x + right) x [y - top, y - top + rows). The shifted masks
+    // read beyond their reach (zero padding to whole cache lines), the region has to include that, too
+    int left = 0;
+    int right = 0;
+    int top = m_inner_masks[0].getNumRows() / 2;
+    int rows = m_inner_masks[0].getNumRows();
+
+    if (m_compact_masks)
+    {
+        left = m_compact_left;
+        right = m_inner_compact_mask.getNumCols() - m_compact_left;
+        top = m_compact_top;
+        rows = m_inner_compact_mask.getNumRows();
+    }
+    else
+    {
+        for (const aligned_matrix<float> & mask : m_inner_masks)
+        {
+            left = max(left, mask.getLeftOffset());
+            right = max(right, mask.getRightOffset());
+        }
+    }
 
-    aligned_matrix<float> * space = new aligned_matrix<float>(m_rules.get_space_width(), m_rules.get_space_height());
+    // The first step calculates the tile plus (steps - 1) * reach cells on each side, every step one reach less.
+    // The region starts at a cache line, so the shifted masks are aligned like in space
+    int region_x = tile_x - (steps - 1) * reach - left;
+    region_x -= ((region_x % CACHELINE_FLOATS) + CACHELINE_FLOATS) % CACHELINE_FLOATS;
+    cint region_y = tile_y - (steps - 1) * reach - top;
+    cint region_w = tile_x + tile_w + (steps - 1) * reach + right - region_x;
+    cint region_h = tile_h + 2 * (steps - 1) * reach + rows - 1;
 
-    SIMULATOR_INITIALIZATION_FUNCTION(space);
+    if (region_a.getNumCols() < region_w || region_a.getNumRows() < region_h)
+    {
+        // both buffers start with 0, the padding of the masks reads cells that are not calculated (with weight 0)
+        region_a = aligned_matrix<float>(region_w, region_h);
+        region_b = aligned_matrix<float>(region_w, region_h);
+    }
 
-    // Give space to main initialization function
-    initialize(*space);
+    // Copy the region from space in whole rows, split where they wrap
+    bool active = false;
+
+    for (int y = 0; y < region_h; ++y)
+    {
+        const float * row = space_current->getRow_ptr(((region_y + y) % space_h + space_h) % space_h);
+        float * region_row = region_a.getRow_ptr(y);
+
+        for (int i = 0, x = (region_x % space_w + space_w) % space_w; i < region_w; x = 0)
+        {
+            cint n = min(region_w - i, space_w - x);
+
+            memcpy(region_row + i, row + x, n * sizeof (float));
+            i += n;
+        }
+
+        if (skip_quiescent)
+        {
+            for (int i = 0; i < region_w; ++i)
+                active |= region_row[i] != 0;
+        }
+    }
+
+    if (skip_quiescent && !active)
+    {
+        // everything the masks reach in all steps is 0, so the tile stays 0
+        for (int x = tile_x; x < tile_x + tile_w; ++x)
+            zero_column(x, tile_y, tile_y + tile_h);
+
+        return true;
+    }
+
+    aligned_matrix<float> * current = &region_a;
+    aligned_matrix<float> * next = &region_b;
+    cint region_ld = region_a.getLd();
+
+    float outer_batch[TRANSFER_FUNCTION_BATCH_SIZE];
+    float inner_batch[TRANSFER_FUNCTION_BATCH_SIZE];
+    float state_batch[TRANSFER_FUNCTION_BATCH_SIZE];
+    float next_batch[TRANSFER_FUNCTION_BATCH_SIZE];
+
+    for (int step = 0; step < steps; ++step)
+    {
+        cint extent = (steps - 1 - step) * reach;
+        const bool last = step == steps - 1;
+        const float * const __restrict__ values = current->getValues();
+
+        for (int x = tile_x - extent; x < tile_x + tile_w + extent; ++x)
+        {
+            // the same masks and kernels as simulate_column. The region holds the wrapped cells, so the whole mask
+            // is always one block
+            cint off = ((x - m_offset_from_mask_center) % CACHELINE_FLOATS + CACHELINE_FLOATS) % CACHELINE_FLOATS;
+            const aligned_matrix<float> & mask_inner = m_compact_masks ? m_inner_compact_mask : m_inner_masks[off];
+            const aligned_matrix<float> & mask_outer = m_compact_masks ? m_outer_compact_mask : m_outer_masks[off];
+            const filling_kernel fixed_kernel = m_compact_masks ? m_fixed_compact_filling_kernel : m_fixed_filling_kernels[off];
+            const fused_filling_kernel fixed_fused_kernel = m_compact_masks ? m_fixed_compact_fused_filling_kernel : m_fixed_fused_filling_kernels[off];
+            const filling_kernel kernel = fixed_kernel != nullptr ? fixed_kernel : m_filling_kernel;
+            const fused_filling_kernel fused_kernel = fixed_fused_kernel != nullptr ? fixed_fused_kernel : m_fused_filling_kernel;
+            cint mask_ld = mask_inner.getLd();
+            cint block_x = m_compact_masks ? x - m_compact_left - region_x : x - mask_inner.getLeftOffset() - region_x;
+            cint block_columns = m_compact_masks ? mask_inner.getNumCols() : mask_inner.getLeftOffset() + mask_inner.getRightOffset();
+
+            for (int y_begin = tile_y - extent; y_begin < tile_y + tile_h + extent; y_begin += TRANSFER_FUNCTION_BATCH_SIZE)
+            {
+                cint count = min(TRANSFER_FUNCTION_BATCH_SIZE, tile_y + tile_h + extent - y_begin);
+
+                for (int i = 0; i < count; ++i)
+                {
+                    const float * block = values + (y_begin + i - top - region_y) * region_ld + block_x;
+                    float f_inner = 0;
+                    float f_outer = 0;
+
+                    if (m_filling_engine == filling_engine::FUSED)
+                    {
+                        fused_kernel(block, region_ld, mask_inner.getValues(), mask_outer.getValues(), mask_ld, rows, block_columns, f_inner, f_outer);
+                    }
+                    else
+                    {
+                        f_inner = kernel(block, region_ld, mask_inner.getValues(), mask_ld, rows, block_columns);
+                        f_outer = kernel(block, region_ld, mask_outer.getValues(), mask_ld, rows, block_columns);
+                    }
+
+                    inner_batch[i] = f_inner / m_inner_mask_sum;
+                    outer_batch[i] = f_outer / m_outer_mask_sum;
+                    state_batch[i] = current->getValue(x - region_x, y_begin + i - region_y);
+                }
+
+                m_transfer_function.apply(outer_batch, inner_batch, state_batch, next_batch, count);
+
+                for (int i = 0; i < count; ++i)
+                {
+                    cfloat state = storage_round(next_batch[i], m_storage_precision);
+
+                    if (last)
+                        space_next->setValue(state, x, y_begin + i);
+                    else
+                        next->setValue(state, x - region_x, y_begin + i - region_y);
+                }
+            }
+        }
+
+        swap(current, next);
+    }
+
+    return false;
 }
 
-void simulator::simulate_step()
+void simulator::set_tiling_for_cache(int cache_bytes)
 {
-    simulate_step(0, m_rules.get_space_width());
+    // A tile of w x h cells touches (w + mask) x (h + mask) space cells and one inner and outer mask per alignment offset
+    cint mask_size = m_rules.get_radius_outer() * 2 + 2;
+    cint mask_bytes = mask_size * matrix_calc_ld_with_padding(sizeof (float), mask_size + CACHELINE_FLOATS, CACHELINE_SIZE);
+
+    cint tile_width = 4 * CACHELINE_FLOATS;
+    cint masks_bytes = 2 * min(tile_width, CACHELINE_FLOATS) * mask_bytes;
+    cint row_bytes = (tile_width + mask_size + CACHELINE_FLOATS) * sizeof (float); // mask rows start at cache lines
+
+    int tile_height = (cache_bytes - masks_bytes) / row_bytes - mask_size;
+
+    // the masks alone may not fit; keep a sensible minimum height anyways
+    if (tile_height < CACHELINE_FLOATS)
+        tile_height = CACHELINE_FLOATS;
+
+    m_tile_width = tile_width;
+    m_tile_height = tile_height;
+
+    cout << "Simulator | Tile size " << m_tile_width << "x" << m_tile_height << " for " << cache_bytes << " bytes cache" << endl;
 }
 
-void simulator::simulate_step(int x_start, int w)
+void simulator::simulate_column(cint x, cint y_begin, cint y_end)
 {
-    #pragma omp parallel for schedule(static)
-    for (int x = x_start; x < x_start + w; ++x)
+    // get the alignment offset caused during iteration of space
+    // NOTE: this is mostly cache optimized. Each mask is used over an entire y array
+    int off = ((x - m_offset_from_mask_center) >= 0) ?
+            (x - m_offset_from_mask_center) % CACHELINE_FLOATS :
+            (CACHELINE_FLOATS - (m_offset_from_mask_center - x) % CACHELINE_FLOATS) % CACHELINE_FLOATS; // we calc this new inside the function in this case
+    // The compact masks are the same for all columns
+    const aligned_matrix<float> const &mask_inner = m_compact_masks ? m_inner_compact_mask : m_inner_masks[off];
+    const aligned_matrix<float> const &mask_outer = m_compact_masks ? m_outer_compact_mask : m_outer_masks[off];
+    const filling_kernel fixed_kernel = m_compact_masks ? m_fixed_compact_filling_kernel : m_fixed_filling_kernels[off];
+    const fused_filling_kernel fixed_fused_kernel = m_compact_masks ? m_fixed_compact_fused_filling_kernel : m_fixed_fused_filling_kernels[off];
+
+    double m_window = 0; // fillings carried down the column by the sliding window engine
+    double n_window = 0;
+
+    float outer_batch[TRANSFER_FUNCTION_BATCH_SIZE]; // fillings waiting for apply_transfer_function
+    float inner_batch[TRANSFER_FUNCTION_BATCH_SIZE];
+    int batch_count = 0;
+
+    float m_block[FILLING_BLOCK_CELLS]; // fillings of the BLOCKED engine for the cells y .. y + FILLING_BLOCK_CELLS - 1
+    float n_block[FILLING_BLOCK_CELLS];
+
+    for (int y = y_begin; y < y_end; ++y)
     {
-        // get the alignment offset caused during iteration of space
-        // NOTE: this is mostly cache optimized. Each mask is used over an entire y array
-        int off = ((x - m_offset_from_mask_center) >= 0) ?
-                (x - m_offset_from_mask_center) % CACHELINE_FLOATS :
-                (CACHELINE_FLOATS - (m_offset_from_mask_center - x) % CACHELINE_FLOATS) % CACHELINE_FLOATS; // we calc this new inside the function in this case
-        const aligned_matrix<float> const &mask_inner = m_inner_masks[off];
-        const aligned_matrix<float> const &mask_outer = m_outer_masks[off];
-        for (int y = 0; y < m_rules.get_space_height(); ++y)
-        {
-            float n;
-            float m;
-            
+        float n;
+        float m;
+        
 	    
-            if (m_optimize)
+        if (m_filling_engine == filling_engine::FFT || m_filling_engine == filling_engine::SEPARABLE)
+        {
+            m = m_filling_inner.getValue(x, y); // filling of inner circle
+            n = m_filling_outer.getValue(x, y); // filling of outer ring
+        }
+        else if (m_filling_engine == filling_engine::PREFIX_SUM)
+        {
+            m = getFilling_spans(x, y, m_inner_spans, m_inner_mask_sum); // filling of inner circle
+            n = getFilling_spans(x, y, m_outer_spans, m_outer_mask_sum); // filling of outer ring
+        }
+        else if (m_filling_engine == filling_engine::SAT)
+        {
+            m = getFilling_sat(x, y, m_inner_rects, m_inner_mask_sum); // filling of inner circle
+            n = getFilling_sat(x, y, m_outer_rects, m_outer_mask_sum); // filling of outer ring
+        }
+        else if (m_filling_engine == filling_engine::SLIDING_WINDOW)
+        {
+            if ((y - y_begin) % m_sliding_window_anchor == 0)
             {
-		/*if (!( off >= 0 && off < CACHELINE_FLOATS ))
-		    cout << "o: " << off << " CF: " << CACHELINE_FLOATS << " x: " << x << " x_off: " << m_offset_from_mask_center << endl;
-		assert(off >= 0 && off < CACHELINE_FLOATS);*/
-                m = getFilling(x, y, mask_inner, m_inner_mask_sum); // filling of inner circle
-                n = getFilling(x, y, mask_outer, m_outer_mask_sum); // filling of outer ring
+                // (re-)anchor with the full filling
+                m_window = m_optimize ? getFilling(x, y, mask_inner, m_inner_mask_sum, fixed_kernel) : getFilling_unoptimized(x, y, m_inner_masks[0], m_inner_mask_sum);
+                n_window = m_optimize ? getFilling(x, y, mask_outer, m_outer_mask_sum, fixed_kernel) : getFilling_unoptimized(x, y, m_outer_masks[0], m_outer_mask_sum);
             }
             else
             {
-                m = getFilling_unoptimized(x, y, m_inner_masks[0], m_inner_mask_sum); // filling of inner circle
-                n = getFilling_unoptimized(x, y, m_outer_masks[0], m_outer_mask_sum); // filling of outer ring
+                // move the window one row down: add entering, subtract leaving chords
+                m_window += getFilling_sparse(x, y, m_inner_difference, m_inner_mask_sum);
+                n_window += getFilling_sparse(x, y, m_outer_difference, m_outer_mask_sum);
             }
 
+            m = m_window; // filling of inner circle
+            n = n_window; // filling of outer ring
+        }
+        else if (m_filling_engine == filling_engine::FUSED)
+        {
+            getFillings_fused(x, y, mask_inner, mask_outer, m, n, fixed_fused_kernel);
+        }
+        else if (m_filling_engine == filling_engine::SYMMETRIC_Y)
+        {
+            getFillings_symmetric(x, y, off, mask_inner, mask_outer, m, n, fixed_fused_kernel);
+        }
+        else if (m_filling_engine == filling_engine::BLOCKED)
+        {
+            cint cell = (y - y_begin) % FILLING_BLOCK_CELLS;
+
+            if (cell == 0)
+                getFillings_blocked(x, y, min(FILLING_BLOCK_CELLS, y_end - y), mask_inner, mask_outer, m_block, n_block, fixed_fused_kernel);
+
+            m = m_block[cell]; // filling of inner circle
+            n = n_block[cell]; // filling of outer ring
+        }
+        else if (m_filling_engine == filling_engine::FIXED_POINT)
+        {
+            if (m_fixed_point_initiated_bits == 8)
+                getFillings_fixed_point(x, y, m_fixed_point8, m_int8_fused_filling_kernel, m_int8_fixed_fused_filling_kernel, m, n);
+            else
+                getFillings_fixed_point(x, y, m_fixed_point16, m_int16_fused_filling_kernel, m_int16_fixed_fused_filling_kernel, m, n);
+        }
+        else if (m_optimize)
+        {
+		/*if (!( off >= 0 && off < CACHELINE_FLOATS ))
+		    cout << "o: " << off << " CF: " << CACHELINE_FLOATS << " x: " << x << " x_off: " << m_offset_from_mask_center << endl;
+		assert(off >= 0 && off < CACHELINE_FLOATS);*/
+            m = getFilling(x, y, mask_inner, m_inner_mask_sum, fixed_kernel); // filling of inner circle
+            n = getFilling(x, y, mask_outer, m_outer_mask_sum, fixed_kernel); // filling of outer ring
+        }
+        else
+        {
+            m = getFilling_unoptimized(x, y, m_inner_masks[0], m_inner_mask_sum); // filling of inner circle
+            n = getFilling_unoptimized(x, y, m_outer_masks[0], m_outer_mask_sum); // filling of outer ring
+        }
+
+        if (m_optimize)
+        {
+            // collect the fillings, the new states are calculated for a whole batch at once
+            outer_batch[batch_count] = n;
+            inner_batch[batch_count] = m;
+            ++batch_count;
+
+            if (batch_count == TRANSFER_FUNCTION_BATCH_SIZE || y == y_end - 1)
+            {
+                apply_transfer_function(x, y + 1 - batch_count, batch_count, outer_batch, inner_batch);
+                batch_count = 0;
+            }
+        }
+        else
+        {
             //Calculate the new state based on fillings n and m
             //Smooth state function must be clamped to [0,1] (this is also done by author's implementation!)
-            space_next->setValue(m_rules.get_is_discrete() ? discrete_state_func_1(n, m) : fmax(0, fmin(1, next_step_as_euler(x, y, n, m))), x, y);
+            // The state is rounded to the storage precision (no-op for FP32)
+            cfloat state = space_current->getValue(x, y);
+            cfloat next = get_stages() > 1 ? integrate_stage(x, y, m_core.state_function(n, m), state) : m_core.next_state(state, n, m);
+
+            space_next->setValue(storage_round(next, m_storage_precision), x, y);
         }
     }
+}
 
-    //cerr << "Disabled calc" << endl;
-    ++spacetime;
+void simulator::apply_transfer_function(cint x, cint y_begin, cint count, const float * outer, const float * inner)
+{
+    float state[TRANSFER_FUNCTION_BATCH_SIZE];
+    float next[TRANSFER_FUNCTION_BATCH_SIZE];
+
+    assert(count <= TRANSFER_FUNCTION_BATCH_SIZE);
+
+    // the column is strided in space, gather it into the batch
+    if (!m_rules.get_is_discrete())
+    {
+        for (int i = 0; i < count; ++i)
+            state[i] = space_current->getValue(x, y_begin + i);
+    }
+
+    if (get_stages() > 1)
+    {
+        // s(n, m) of the stage, integrated with the state the fillings were calculated of
+        m_transfer_function.apply_state_function(outer, inner, next, count);
+
+        for (int i = 0; i < count; ++i)
+            next[i] = integrate_stage(x, y_begin + i, next[i], state[i]);
+    }
+    else
+    {
+        m_transfer_function.apply(outer, inner, state, next, count);
+    }
+
+    for (int i = 0; i < count; ++i)
+        space_next->setValue(storage_round(next[i], m_storage_precision), x, y_begin + i);
+}
+
+void simulator::get_read_ranges(cint x_start, cint w, int ranges[2][2]) const
+{
+    cint space_w = space_current->getNumCols();
+    cint halo_columns = space_current->getHaloColumns();
+    cint reach = get_mask_reach();
+
+    // The cells read by the step: a chunk of an MPI rank only needs its neighbors within the mask reach. The halo
+    // holds the wrapped columns, without halo the range is split at the edges
+    int begin = x_start - reach;
+    int end = x_start + w + reach;
+
+    if (end - begin >= space_w + 2 * halo_columns)
+    {
+        begin = -halo_columns;
+        end = space_w + halo_columns;
+    }
+    else if (space_current->hasHalo())
+    {
+        begin = max(begin, -halo_columns);
+        end = min(end, space_w + halo_columns);
+    }
+
+    ranges[0][0] = begin;
+    ranges[0][1] = end;
+    ranges[1][0] = 0;
+    ranges[1][1] = 0;
+
+    if (!space_current->hasHalo() && begin < 0)
+    {
+        ranges[0][0] = 0;
+        ranges[1][0] = space_w + begin;
+        ranges[1][1] = space_w;
+    }
+    else if (!space_current->hasHalo() && end > space_w)
+    {
+        ranges[0][1] = space_w;
+        ranges[1][1] = end - space_w;
+    }
+}
+
+void simulator::update_space_half(cint x_start, cint w)
+{
+    cint halo_rows = space_current->getHaloRows();
+    int ranges[2][2];
+
+    get_read_ranges(x_start, w, ranges);
+
+    #pragma omp for schedule(static)
+    for (int y = -halo_rows; y < space_current->getNumRows() + halo_rows; ++y)
+    {
+        for (const int * range : ranges)
+        {
+            if (range[1] > range[0])
+                storage_encode(space_current->getRow_ptr(y) + range[0], m_space_half.getRow_ptr(y) + range[0], range[1] - range[0], m_storage_precision);
+        }
+    }
+}
+
+void simulator::update_space_fixed_point(cint x_start, cint w)
+{
+    cint halo_rows = space_current->getHaloRows();
+    int ranges[2][2];
+
+    get_read_ranges(x_start, w, ranges);
+
+    #pragma omp for schedule(static)
+    for (int y = -halo_rows; y < space_current->getNumRows() + halo_rows; ++y)
+    {
+        for (const int * range : ranges)
+        {
+            if (range[1] <= range[0])
+                continue;
+
+            if (m_fixed_point_initiated_bits == 8)
+                m_fixed_point8.encode(space_current->getRow_ptr(y) + range[0], m_fixed_point8.space.getRow_ptr(y) + range[0], range[1] - range[0]);
+            else
+                m_fixed_point16.encode(space_current->getRow_ptr(y) + range[0], m_fixed_point16.space.getRow_ptr(y) + range[0], range[1] - range[0]);
+        }
+    }
 }
 
 void simulator::run_simulation_slave()
@@ -182,14 +1485,14 @@ void simulator::run_simulation_slave()
         APP_COMMUNICATION_RUNNING
     });
 
-    //Connection from slave to master (data)
-    mpi_dual_connection<float> space_connection = mpi_dual_connection<float>(
+    //Connection from slave to master (data). Chunks and borders are sent in the storage precision
+    mpi_space_connection space_connection = mpi_space_connection(
             0,
             true,
             false,
             APP_MPI_TAG_SPACE,
             m_rules.get_space_height() * get_mpi_chunk_width(),
-            MPI_FLOAT);
+            m_storage_precision);
 
     // The slave has connections to the left and right rank
     int left_rank = matrix_index_wrapped(mpi_rank() - 1, 1, mpi_comm_size(), 1, mpi_comm_size());
@@ -199,20 +1502,20 @@ void simulator::run_simulation_slave()
     int border_left_tag = matrix_index_wrapped(get_mpi_chunk_index(), 1, mpi_comm_size(), 1, mpi_comm_size()) + APP_MPI_TAG_BORDER_RANGE;
     int border_right_tag = matrix_index_wrapped(get_mpi_chunk_index() + 1, 1, mpi_comm_size(), 1, mpi_comm_size()) + APP_MPI_TAG_BORDER_RANGE;
 
-    mpi_dual_connection<float> border_left_connection = mpi_dual_connection<float>(
+    mpi_space_connection border_left_connection = mpi_space_connection(
             left_rank,
             left_rank != 0,
             true,
             border_left_tag,
             m_rules.get_space_height() * get_mpi_chunk_border_width(),
-            MPI_FLOAT);
-    mpi_dual_connection<float> border_right_connection = mpi_dual_connection<float>(
+            m_storage_precision);
+    mpi_space_connection border_right_connection = mpi_space_connection(
             right_rank,
             right_rank != 0,
             true,
             border_right_tag,
             m_rules.get_space_height() * get_mpi_chunk_border_width(),
-            MPI_FLOAT);
+            m_storage_precision);
 
     
     // Use broadcast to obtain the initial space from master
@@ -241,6 +1544,12 @@ void simulator::run_simulation_slave()
                                  rules.get_space_width()); //Overwrite right border with left border of right rank*/
 
 
+    check_temporal_steps();
+
+    // Temporal blocking: the borders are exchanged every m_temporal_steps steps. In between, the chunk is calculated
+    // together with the part of the borders that is still valid. It shrinks by the mask reach every step
+    int temporal_phase = 0;
+
     m_running = true;
 
     while (m_running)
@@ -248,6 +1557,7 @@ void simulator::run_simulation_slave()
         if (m_reinitialize)
         {
             cout << "Slave " << mpi_rank() << " | Reinitialize ..." << endl;
+            temporal_phase = 0;
             
             MPI_Bcast(buffer_space.data(), m_rules.get_space_width() * m_rules.get_space_height(), MPI_FLOAT, 0, MPI_COMM_WORLD);
 
@@ -260,39 +1570,44 @@ void simulator::run_simulation_slave()
             //MPI_Barrier(MPI_COMM_WORLD);   
         }
 
-        if (left_rank != 0)
-        {
-            space_current->raw_copy_to(border_left_connection.get_buffer_send()->data(), get_mpi_chunk_border_width(), get_mpi_chunk_border_width());
-            border_left_connection.sendrecv();
-        }
-        else
-        {
-            border_left_connection.recv();
-        }
-
-        if (right_rank != 0)
+        if (temporal_phase == 0)
         {
-            space_current->raw_copy_to(border_right_connection.get_buffer_send()->data(), get_mpi_chunk_width(), get_mpi_chunk_border_width());
-            border_right_connection.sendrecv();
-        }
-        else
-        {
-            border_right_connection.recv();
-        }
+            if (left_rank != 0)
+            {
+                border_left_connection.write(*space_current, get_mpi_chunk_border_width(), get_mpi_chunk_border_width());
+                border_left_connection.sendrecv();
+            }
+            else
+            {
+                border_left_connection.recv();
+            }
+
+            if (right_rank != 0)
+            {
+                border_right_connection.write(*space_current, get_mpi_chunk_width(), get_mpi_chunk_border_width());
+                border_right_connection.sendrecv();
+            }
+            else
+            {
+                border_right_connection.recv();
+            }
 
 
-        space_current->raw_overwrite(border_left_connection.get_buffer_recieve()->data(), 0, get_mpi_chunk_border_width());
-        space_current->raw_overwrite(border_right_connection.get_buffer_recieve()->data(), get_mpi_chunk_border_width() + get_mpi_chunk_width(), get_mpi_chunk_border_width());
+            border_left_connection.read(*space_current, 0, get_mpi_chunk_border_width());
+            border_right_connection.read(*space_current, get_mpi_chunk_border_width() + get_mpi_chunk_width(), get_mpi_chunk_border_width());
+        }
 
         /**
          * The slave simulator only has to simulate one chunk. So we call simulate_step with this size.
          * The simulator obtains its left and right borders from the neighbors via MPI. The data is stored in the border area left and right
          * to the chunk area. This border area has a size % CACHELINE_SIZE
          */
-        simulate_step(get_mpi_chunk_border_width(), get_mpi_chunk_width());
+        simulate_chunk_step(get_mpi_chunk_border_width(), get_mpi_chunk_width(), temporal_phase);
+
+        temporal_phase = (temporal_phase + 1) % m_temporal_steps;
 
         //Copy the complete field into the space buffer and the borders into their respective buffers
-        space_next->raw_copy_to(space_connection.get_buffer_send()->data(), get_mpi_chunk_border_width(), get_mpi_chunk_width());
+        space_connection.write(*space_next, get_mpi_chunk_border_width(), get_mpi_chunk_width());
         space_connection.send();
 
         m_space->swap(); //The queue is disabled, use swap which yields greater performance
@@ -308,6 +1623,17 @@ void simulator::run_simulation_slave()
     cout << "Simulator | Slave shut down." << endl;
 }
 
+void simulator::simulate_chunk_step(cint border_width, cint chunk_width, cint temporal_phase)
+{
+    // every stage of the integrator reads another mask reach of the borders
+    cint temporal_extent = (m_temporal_steps - 1 - temporal_phase) * get_stages() * get_mask_reach();
+
+    if (m_adaptive_dt)
+        simulate_adaptive_step(border_width - temporal_extent, chunk_width + 2 * temporal_extent, true); // agrees on dt with all ranks
+    else
+        simulate_step(border_width - temporal_extent, chunk_width + 2 * temporal_extent);
+}
+
 void simulator::run_simulation_master()
 {
     cout << "Simulator | Running Master MPI simulator ..." << endl;
@@ -319,7 +1645,7 @@ void simulator::run_simulation_master()
 #endif    
 
     vector<mpi_dual_connection<int>> communication_connections;
-    vector<mpi_dual_connection<float>> space_connections;
+    vector<mpi_space_connection> space_connections;
 
     for (int i = 1; i < mpi_comm_size(); ++i)
     {
@@ -336,13 +1662,13 @@ void simulator::run_simulation_master()
     for (int i = 1; i < mpi_comm_size(); ++i)
     {
         // Connection from slave to master (calculated spaces)
-        space_connections.push_back(mpi_dual_connection<float>(
+        space_connections.push_back(mpi_space_connection(
                                     i,
                                     false,
                                     true,
                                     APP_MPI_TAG_SPACE,
                                     m_rules.get_space_height() * get_mpi_chunk_width(),
-                                    MPI_FLOAT));
+                                    m_storage_precision));
     }
 
     // The master has connections to the left and right rank to synchronize borders
@@ -353,20 +1679,20 @@ void simulator::run_simulation_master()
     int border_left_tag = matrix_index_wrapped(get_mpi_chunk_index(), 1, mpi_comm_size(), 1, mpi_comm_size()) + APP_MPI_TAG_BORDER_RANGE;
     int border_right_tag = matrix_index_wrapped(get_mpi_chunk_index() + 1, 1, mpi_comm_size(), 1, mpi_comm_size()) + APP_MPI_TAG_BORDER_RANGE;
 
-    mpi_dual_connection<float> border_left_connection = mpi_dual_connection<float>(
+    mpi_space_connection border_left_connection = mpi_space_connection(
             left_rank,
             true,
             false,
             border_left_tag,
             m_rules.get_space_height() * get_mpi_chunk_border_width(),
-            MPI_FLOAT);
-    mpi_dual_connection<float> border_right_connection = mpi_dual_connection<float>(
+            m_storage_precision);
+    mpi_space_connection border_right_connection = mpi_space_connection(
             right_rank,
             true,
             false,
             border_right_tag,
             m_rules.get_space_height() * get_mpi_chunk_border_width(),
-            MPI_FLOAT);
+            m_storage_precision);
 
     //Send the initial field to all slaves   
     vector<float> buffer_space = vector<float>(m_rules.get_space_width() * m_rules.get_space_height());
@@ -375,6 +1701,12 @@ void simulator::run_simulation_master()
 
     //MPI_Barrier(MPI_COMM_WORLD);
 
+    check_temporal_steps();
+
+    // Temporal blocking: the borders are sent every m_temporal_steps steps (see run_simulation_slave).
+    // The master holds the complete field, so it never calculates borders itself
+    int temporal_phase = 0;
+
     while (m_running)
     {
         if (m_reinitialize)
@@ -383,6 +1715,7 @@ void simulator::run_simulation_master()
             
             SIMULATOR_INITIALIZATION_FUNCTION(space_current);
             m_reinitialize = false;
+            temporal_phase = 0;
 
             //Resend the field if reinitialization was triggered
             vector<float> buffer_space = vector<float>(m_rules.get_space_width() * m_rules.get_space_height());
@@ -392,25 +1725,25 @@ void simulator::run_simulation_master()
             //MPI_Barrier(MPI_COMM_WORLD);
         }
 
-        if (right_rank != 0)
+        if (right_rank != 0 && temporal_phase == 0)
         {
             /**
              * We want the right border. It starts at (chunk_index + 1) * chunk_width - chunk_border_width
              */
             int chunk_index = get_mpi_chunk_index();
             int border_start = (chunk_index + 1) * get_mpi_chunk_width() - get_mpi_chunk_border_width();
-            space_current->raw_copy_to(border_right_connection.get_buffer_send()->data(), border_start, get_mpi_chunk_border_width());
+            border_right_connection.write(*space_current, border_start, get_mpi_chunk_border_width());
 
             border_right_connection.send();
         }
-        if (left_rank != 0)
+        if (left_rank != 0 && temporal_phase == 0)
         {
             /**
              * We want the left border. It starts at chunk_index * chunk_width
              */
             int chunk_index = get_mpi_chunk_index();
             int border_start = chunk_index * get_mpi_chunk_width();
-            space_current->raw_copy_to(border_left_connection.get_buffer_send()->data(), border_start, get_mpi_chunk_border_width());
+            border_left_connection.write(*space_current, border_start, get_mpi_chunk_border_width());
 
             border_left_connection.send();
         }
@@ -420,16 +1753,38 @@ void simulator::run_simulation_master()
          * access all data without copying/synching.
          * We want the master to have a workload, too; so we give it the first data chunk (the width of the field divided by count of ranks)
          * 
-         * If we only have one rank, the master will calculate all of them
+         * If we only have one rank, the master will calculate all of them. Then temporal blocking is done with tiles,
+         * if they pay off
          */
-        simulate_step(get_mpi_chunk_index() * get_mpi_chunk_width(), get_mpi_chunk_width());
+        if (mpi_comm_size() == 1 && use_temporal_tiles())
+        {
+            simulate_temporal_block();
+        }
+        else if (mpi_comm_size() == 1 && APP_PERFTEST)
+        {
+            // Nothing is shown or sent between the steps, so a batch of steps is done in one parallel region.
+            // The last step of the batch is swapped below
+            simulate_steps(SIMULATOR_STEPS_PER_BATCH - 1);
+            simulate_step();
+        }
+        else if (m_adaptive_dt && mpi_comm_size() > 1)
+        {
+            // the error estimates of all ranks are reduced, so all of them use the same dt
+            simulate_adaptive_step(get_mpi_chunk_index() * get_mpi_chunk_width(), get_mpi_chunk_width(), true);
+            temporal_phase = (temporal_phase + 1) % m_temporal_steps;
+        }
+        else
+        {
+            simulate_step(get_mpi_chunk_index() * get_mpi_chunk_width(), get_mpi_chunk_width());
+            temporal_phase = (temporal_phase + 1) % m_temporal_steps;
+        }
 
-        for (mpi_dual_connection<float> & conn : space_connections)
+        for (mpi_space_connection & conn : space_connections)
         {
             conn.recv();
 
             int chunk_index = get_mpi_chunk_index(conn.get_other_rank());
-            space_next->raw_overwrite(conn.get_buffer_recieve()->data(), chunk_index * get_mpi_chunk_width(), get_mpi_chunk_width());
+            conn.read(*space_next, chunk_index * get_mpi_chunk_width(), get_mpi_chunk_width());
         }
 
         if (ENABLE_PERF_MEASUREMENT)
@@ -454,6 +1809,9 @@ void simulator::run_simulation_master()
                 double calcss = calcs / perf_time_seconds;
                 
                 cout << "Simulator | " << calcss << " calculations / s" << " (" << calcs << " calcs in " << perf_time_seconds << "s)" << endl;
+
+                if (m_adaptive_dt)
+                    cout << "Simulator | t = " << m_simulated_time << ", dt = " << m_delta_time << ", " << m_rejected_steps << " steps rejected" << endl;
                 
                 perf_spacetime_start = spacetime;
                 perf_time_start = chrono::high_resolution_clock::now();
@@ -488,14 +1846,101 @@ void simulator::run_simulation_master()
     }
 }
 
-float simulator::getFilling(cint at_x, cint at_y, const aligned_matrix<float> &mask, cfloat mask_sum)
+int simulator::get_filling_blocks(cint at_x, cint at_y, const aligned_matrix<float> &mask, filling_block * blocks, cint cells)
 {
+    if (m_compact_masks)
+    {
+        // only the columns of the compact mask are read (unaligned), not its padding
+        assert(mask.getLd() == m_inner_compact_mask.getLd() && mask.getNumRows() == m_inner_compact_mask.getNumRows());
+
+        return get_filling_blocks(at_x - m_compact_left, at_x - m_compact_left + mask.getNumCols(),
+                                  at_y - m_compact_top, at_y - m_compact_top + mask.getNumRows() + cells - 1, mask.getLd(), blocks);
+    }
+
     // These define the rect inside the grid being accessed by mask
+    // NOTE: The masks are shifted so the rect starts at a cache line
     cint XB = at_x - mask.getLeftOffset(); // aka x_begin
     cint XE = at_x + mask.getRightOffset(); // aka x_end
     cint YB = at_y - mask.getNumRows() / 2; // aka y_begin
-    cint YE = at_y + mask.getNumRows() / 2; // aka y_end
+    cint YE = at_y + mask.getNumRows() / 2 + cells - 1; // aka y_end
+
+    assert((XB * sizeof (float)) % ALIGNMENT == 0);
+
+    return get_filling_blocks(XB, XE, YB, YE, mask.getLd(), blocks);
+}
+
+/**
+ * Splits [begin, end) of a dimension of length size into (space begin, mask begin, length) segments that do not cross
+ * the edges. A range wider than size (a mask wider than the space) crosses both edges
+ */
+inline int split_at_edges(cint begin, cint end, cint size, int segments[3][3])
+{
+    int count = 0;
+
+    for (int at = begin; at < end; ++count)
+    {
+        // the copy of the space at lies in (left of, in or right of the space)
+        cint copy = at < 0 ? -size : (at >= size ? size : 0);
+        cint segment_end = min(end, copy + size);
+
+        segments[count][0] = at - copy;
+        segments[count][1] = at - begin;
+        segments[count][2] = segment_end - at;
+        at = segment_end;
+    }
+
+    return count;
+}
+
+int simulator::get_filling_blocks(cint XB, cint XE, cint YB, cint YE, cint mask_ld, filling_block * blocks)
+{
+    cint sim_w = m_rules.get_space_width();
+    cint sim_h = m_rules.get_space_height();
+
+    if (space_current->hasHalo())
+    {
+        // the ghost cells contain the wrapped values, so a single block is enough
+        assert(XB >= -space_current->getHaloColumns() && XE <= sim_w + space_current->getHaloColumns());
+        assert(YB >= -space_current->getHaloRows() && YE <= sim_h + space_current->getHaloRows());
+
+        blocks[0].space_x = XB;
+        blocks[0].space_y = YB;
+        blocks[0].mask_offset = 0;
+        blocks[0].rows = YE - YB;
+        blocks[0].columns = XE - XB;
+
+        return 1;
+    }
+
+    // the rect is shorter than twice the space, so it crosses at most both edges per dimension
+    assert(XB > -sim_w && XE < 2 * sim_w && YB > -sim_h && YE < 2 * sim_h);
+
+    // split columns and rows at the edges into (space begin, mask begin, length) segments
+    int x_segments[3][3];
+    int y_segments[3][3];
+    cint x_count = split_at_edges(XB, XE, sim_w, x_segments);
+    cint y_count = split_at_edges(YB, YE, sim_h, y_segments);
+
+    int count = 0;
+
+    for (int j = 0; j < y_count; ++j)
+    {
+        for (int i = 0; i < x_count; ++i)
+        {
+            filling_block & block = blocks[count++];
+            block.space_x = x_segments[i][0];
+            block.space_y = y_segments[j][0];
+            block.mask_offset = y_segments[j][1] * mask_ld + x_segments[i][1];
+            block.rows = y_segments[j][2];
+            block.columns = x_segments[i][2];
+        }
+    }
+
+    return count;
+}
 
+float simulator::getFilling(cint at_x, cint at_y, const aligned_matrix<float> &mask, cfloat mask_sum, filling_kernel fixed_kernel)
+{
     cint sim_ld = space_current->getLd();
     cint mask_ld = mask.getLd();
     const float* const __restrict__ sim_space = this->space_current->getValues();
@@ -503,303 +1948,186 @@ float simulator::getFilling(cint at_x, cint at_y, const aligned_matrix<float> &m
 
     assert(long(sim_space) % ALIGNMENT == 0);
     assert(long(mask_space) % ALIGNMENT == 0);
-    //cout << "at_x: " << at_x << "  at_y: " << at_y << "  XB: " << XB << "  XE: " << XE << endl;
 
-    //NOTE: if XB or YB is negative, we do not need to check XE or YE - they have to be within the field boundaries
+    // up to 4 blocks if the mask crosses the edges of the torus (9 if it is wider or higher than the space)
+    filling_block blocks[SIMULATOR_MAX_FILLING_BLOCKS];
+    cint block_count = get_filling_blocks(at_x, at_y, mask, blocks);
+
+    // dot product of a space block with a mask block (rows x columns), see simd_kernels.h
+    // The whole mask as one block has the size the specialized kernel is made for
+    const filling_kernel kernel = (fixed_kernel != nullptr && block_count == 1) ? fixed_kernel : m_filling_kernel;
+
     float f = 0;
-    if (XB >= 0)
+
+    if (m_storage_precision != storage_precision::FP32)
     {
-        if (XE < m_rules.get_space_width())
+        // read the 16 bit copy of the space
+        cint half_ld = m_space_half.getLd();
+        const uint16_t* const __restrict__ half_space = m_space_half.getValues();
+
+        for (int i = 0; i < block_count; ++i)
         {
-            // NOTE: x accessible without wrapping
-            if (YB >= 0)
-            {
-                if (YE < m_rules.get_space_height())
-                {
-                    assert((XB * sizeof (float)) % ALIGNMENT == 0 && (XE * sizeof (float)) % ALIGNMENT == 0);
-                    // Ideal case. Access within the space without crossing edges. Tested.
-                    for (int y = YB; y < YE; ++y)
-                    {
-                        cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                        cfloat const * m_row = mask_space + (y - YB) * mask_ld; // mask row
-                        assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                        #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                        for (int x = 0; x < XE - XB; ++x)
-                            f += s_row[x] * m_row[x];
-                    }
-                }
-                else
-                {
-                    assert((XB * sizeof (float)) % ALIGNMENT == 0 && (XE * sizeof (float)) % ALIGNMENT == 0);
-                    // both loops have the same offset & mask!
-                    // special case 2. Ideally vectorized. Access over bottom border. Tested
-                    for (int y = YB; y < m_rules.get_space_height(); ++y)
-                    {
-                        cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                        cfloat const * m_row = mask_space + (y - YB) * mask_ld; // mask row
-                        assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                        #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                        for (int x = 0; x < XE - XB; ++x)
-                            f += s_row[x] * m_row[x];
-                    }
+            const filling_block & block = blocks[i];
+            f += m_half_filling_kernel(half_space + block.space_y * half_ld + block.space_x, half_ld, mask_space + block.mask_offset, mask_ld, block.rows, block.columns);
+        }
 
+        return f / mask_sum; // normalize f
+    }
 
-                    cint mask_y_off = m_rules.get_space_height() - YB; // row offset caused by prior loop
-                    for (int y = 0; y < YE - m_rules.get_space_height(); ++y)
-                    {
-                        cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                        cfloat const * m_row = mask_space + (y + mask_y_off) * mask_ld; // mask row
-                        assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                        #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                        for (int x = 0; x < XE - XB; ++x)
-                            f += s_row[x] * m_row[x];
-                    }
-                }
-            }
-            else
-            {
-                assert((XB * sizeof (float)) % ALIGNMENT == 0 && (XE * sizeof (float)) % ALIGNMENT == 0);
-                // both loops have the same offset & mask!
-                // special case 1. Ideally vectorized. Access over top border. Tested
-                cint mask_y_off = -YB;
-                for (int y = 0; y < YE; ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                    cfloat const * m_row = mask_space + (y + mask_y_off) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < XE - XB; ++x)
-                        f += s_row[x] * m_row[x];
-                }
+    for (int i = 0; i < block_count; ++i)
+    {
+        const filling_block & block = blocks[i];
+        f += kernel(sim_space + block.space_y * sim_ld + block.space_x, sim_ld, mask_space + block.mask_offset, mask_ld, block.rows, block.columns);
+    }
+
+    return f / mask_sum; // normalize f
+}
 
+void simulator::getFillings_fused(cint at_x, cint at_y, const aligned_matrix<float> &mask_inner, const aligned_matrix<float> &mask_outer, float & m, float & n, fused_filling_kernel fixed_kernel)
+{
+    // both masks are created with the same size and offset, so they share the blocks
+    assert(mask_inner.getLd() == mask_outer.getLd() && mask_inner.getNumRows() == mask_outer.getNumRows());
+    assert(mask_inner.getLeftOffset() == mask_outer.getLeftOffset());
 
-                cint mask_y_off2 = m_rules.get_space_height() + YB;
-                for (int y = m_rules.get_space_height() + YB; y < m_rules.get_space_height(); ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                    cfloat const * m_row = mask_space + (y - mask_y_off2) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < XE - XB; ++x)
-                        f += s_row[x] * m_row[x];
-                }
-            }
-        }
-        else if ((YB >= 0) && (YE < m_rules.get_space_height()))
-        {
-            // special case 4. Access of right border. Tested
-            for (int y = YB; y < YE; ++y)
-            {
-                cfloat const * s_row = sim_space + XB + y*sim_ld;
-                cfloat const * m_row = mask_space + (y - YB) * mask_ld; // mask row
-                assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                for (int x = 0; x < m_rules.get_space_width() - XB; ++x)
-                    f += s_row[x] * m_row[x];
-            }
+    cint sim_ld = space_current->getLd();
+    cint mask_ld = mask_inner.getLd();
+    const float* const __restrict__ sim_space = this->space_current->getValues();
+    const float* const __restrict__ inner_space = mask_inner.getValues();
+    const float* const __restrict__ outer_space = mask_outer.getValues();
 
+    filling_block blocks[SIMULATOR_MAX_FILLING_BLOCKS];
+    cint block_count = get_filling_blocks(at_x, at_y, mask_inner, blocks);
 
-            cint mask_x_off = m_rules.get_space_width() - XB;
-            for (int y = YB; y < YE; ++y)
-            {
-                cfloat const * s_row = sim_space + y*sim_ld;
-                cfloat const * m_row = mask_space + mask_x_off + (y - YB) * mask_ld; // mask row
-                assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                for (int x = 0; x < XE - m_rules.get_space_width(); ++x)
-                    f += s_row[x] * m_row[x];
-            }
-        }
-        else
+    // The whole mask as one block has the size the specialized kernel is made for
+    const fused_filling_kernel kernel = (fixed_kernel != nullptr && block_count == 1) ? fixed_kernel : m_fused_filling_kernel;
+
+    float f_inner = 0;
+    float f_outer = 0;
+
+    if (m_storage_precision != storage_precision::FP32)
+    {
+        // read the 16 bit copy of the space
+        cint half_ld = m_space_half.getLd();
+        const uint16_t* const __restrict__ half_space = m_space_half.getValues();
+
+        for (int i = 0; i < block_count; ++i)
         {
-            // XE >= FW
-            if (YB < 0) {
-                // hard case. top right corner
-                
-                // wrap to bottom right
-                cint mask_y_off2 = m_rules.get_space_height() + YB;
-                for (int y = m_rules.get_space_height() + YB; y < m_rules.get_space_height(); ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                    cfloat const * m_row = mask_space + (y-mask_y_off2) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < m_rules.get_space_width() - XB; ++x)
-                        f += s_row[x] * m_row[x];
-                }
-                
-                // wrap to top right
-                cint mask_y_off = -YB;
-                for (int y = 0; y < YE; ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                    cfloat const * m_row = mask_space + (y + mask_y_off) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < m_rules.get_space_width() - XB; ++x)
-                        f += s_row[x] * m_row[x];
-                }
-                
-                // wrap to bottom left
-                cint mask_x_off = m_rules.get_space_width() - XB;
-                for (int y = m_rules.get_space_height() + YB; y < m_rules.get_space_height(); ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld; // space row + x_start
-                    cfloat const * m_row = mask_space + mask_x_off + (y-mask_y_off2) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < XE - m_rules.get_space_width(); ++x)
-                        f += s_row[x] * m_row[x];
-                }
-                
-                // wrap to top left
-                for (int y = 0; y < YE; ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld; // space row + x_start
-                    cfloat const * m_row = mask_space + mask_x_off + (y + mask_y_off) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < XE - m_rules.get_space_width(); ++x)
-                        f += s_row[x] * m_row[x];
-                }
-            } else {
-                // YE >= FW
-                assert(YE >= m_rules.get_space_height());
-                // hard case. bottom right
-                cint mask_y_off = YB;
-                for (int y = YB; y < m_rules.get_space_height(); ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                    cfloat const * m_row = mask_space + (y - mask_y_off) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < m_rules.get_space_width() - XB; ++x)
-                        f += s_row[x] * m_row[x];
-                }
-                
-                cint mask_y_off2 = m_rules.get_space_height() - YB;
-                for (int y = 0; y < YE - m_rules.get_space_height(); ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld + XB; // space row + x_start
-                    cfloat const * m_row = mask_space + (y + mask_y_off2) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < m_rules.get_space_width() - XB; ++x)
-                        f += s_row[x] * m_row[x];
-                }
-                
-                cint mask_x_off = m_rules.get_space_width() - XB;
-                for (int y = YB; y < m_rules.get_space_height(); ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld; // space row + x_start
-                    cfloat const * m_row = mask_space + mask_x_off + (y - mask_y_off) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < XE - m_rules.get_space_width(); ++x)
-                        f += s_row[x] * m_row[x];
-                }
-                
-                for (int y = 0; y < YE - m_rules.get_space_height(); ++y)
-                {
-                    cfloat const * s_row = sim_space + y * sim_ld; // space row + x_start
-                    cfloat const * m_row = mask_space + mask_x_off + (y + mask_y_off2) * mask_ld; // mask row
-                    assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                    #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                    for (int x = 0; x < XE - m_rules.get_space_width(); ++x)
-                        f += s_row[x] * m_row[x];
-                }
-            }
+            const filling_block & block = blocks[i];
+            m_half_fused_filling_kernel(half_space + block.space_y * half_ld + block.space_x, half_ld,
+                                        inner_space + block.mask_offset, outer_space + block.mask_offset, mask_ld,
+                                        block.rows, block.columns, f_inner, f_outer);
         }
     }
-    else if ((YB >= 0) && (YE < m_rules.get_space_height()))
+    else
     {
-        // special case 3. Access over left border. Tested
-        cint mask_x_off = -XB;
-        for (int y = YB; y < YE; ++y)
+        for (int i = 0; i < block_count; ++i)
         {
-            cfloat const * s_row = sim_space + y*sim_ld;
-            cfloat const * m_row = mask_space + mask_x_off + (y - YB) * mask_ld; // mask row
-            assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-            #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-            for (int x = 0; x < XE; ++x)
-                f += s_row[x] * m_row[x];
-            //f += sim_space[x + y*sim_ld] * mask_space[x + mask_x_off + (y - YB) * mask_ld];
+            const filling_block & block = blocks[i];
+            kernel(sim_space + block.space_y * sim_ld + block.space_x, sim_ld,
+                   inner_space + block.mask_offset, outer_space + block.mask_offset, mask_ld,
+                   block.rows, block.columns, f_inner, f_outer);
         }
+    }
 
-        // wrapped part. we are on the right now
-        for (int y = YB; y < YE; ++y)
-        {
-            cfloat const * s_row = sim_space + y * sim_ld + m_rules.get_space_width() + XB;
-            cfloat const * m_row = mask_space + (y - YB) * mask_ld; // mask row
-            assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-            #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-            for (int x = 0; x < -XB; ++x)
-                //f += sim_space[x + y*sim_ld + m_rules.get_space_width() + XB] * mask_space[x + (y - YB) * mask_ld];
-                f += s_row[x] * m_row[x];
-        }
+    m = f_inner / m_inner_mask_sum; // filling of inner circle
+    n = f_outer / m_outer_mask_sum; // filling of outer ring
+}
+
+void simulator::getFillings_blocked(cint at_x, cint at_y, cint count, const aligned_matrix<float> &mask_inner, const aligned_matrix<float> &mask_outer, float * m, float * n, fused_filling_kernel fixed_kernel)
+{
+    assert(mask_inner.getLd() == mask_outer.getLd() && mask_inner.getNumRows() == mask_outer.getNumRows());
+    assert(count <= FILLING_BLOCK_CELLS);
+
+    filling_block blocks[SIMULATOR_MAX_FILLING_BLOCKS];
+    cint block_count = count == FILLING_BLOCK_CELLS && m_storage_precision == storage_precision::FP32 ?
+                get_filling_blocks(at_x, at_y, mask_inner, blocks, count) : 0;
+
+    if (block_count != 1)
+    {
+        // the blocked kernel needs all rows of the cells without wrapping
+        for (int i = 0; i < count; ++i)
+            getFillings_fused(at_x, at_y + i, mask_inner, mask_outer, m[i], n[i], fixed_kernel);
+
+        return;
     }
-    else
+
+    cint sim_ld = space_current->getLd();
+    const filling_block & block = blocks[0];
+    float f_inner[FILLING_BLOCK_CELLS];
+    float f_outer[FILLING_BLOCK_CELLS];
+
+    // the block spans the rows of all cells, the masks only those of the first one
+    m_blocked_fused_filling_kernel(space_current->getValues() + block.space_y * sim_ld + block.space_x, sim_ld,
+                                   mask_inner.getValues(), mask_outer.getValues(), mask_inner.getLd(),
+                                   block.rows - (count - 1), block.columns, f_inner, f_outer);
+
+    for (int i = 0; i < count; ++i)
     {
-        // XB < 0
-        if (YB < 0) {
-            // hard case. Top left corner
-            cint mask_y_off = m_rules.get_space_height() + YB;
-            for (int y = m_rules.get_space_height() + YB; y < m_rules.get_space_height(); ++y)
-            {
-                cfloat const * s_row = sim_space + y * sim_ld + m_rules.get_space_width() + XB; // space row + x_start
-                cfloat const * m_row = mask_space + (y - mask_y_off) * mask_ld; // mask row
-                assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                for (int x = 0; x < -XB; ++x)
-                    f += s_row[x] * m_row[x];
-            }
+        m[i] = f_inner[i] / m_inner_mask_sum; // filling of inner circle
+        n[i] = f_outer[i] / m_outer_mask_sum; // filling of outer ring
+    }
+}
 
-            cint mask_y_off2 = -YB;
-            for (int y = 0; y < YE; ++y)
-            {
-                cfloat const * s_row = sim_space + y * sim_ld + m_rules.get_space_width() + XB; // space row + x_start
-                cfloat const * m_row = mask_space + (y + mask_y_off2) * mask_ld; // mask row
-                assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                for (int x = 0; x < -XB; ++x)
-                    f += s_row[x] * m_row[x];
-            }
-            
-            cint mask_x_off = -XB;
-            for (int y = m_rules.get_space_height() + YB; y < m_rules.get_space_height(); ++y)
-            {
-                cfloat const * s_row = sim_space + y * sim_ld; // space row + x_start
-                cfloat const * m_row = mask_space + mask_x_off + (y - mask_y_off) * mask_ld; // mask row
-                assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                for (int x = 0; x < XE; ++x)
-                    f += s_row[x] * m_row[x];
-            }
+void simulator::getFillings_symmetric(cint at_x, cint at_y, cint off, const aligned_matrix<float> &mask_inner, const aligned_matrix<float> &mask_outer, float & m, float & n, fused_filling_kernel fixed_kernel)
+{
+    const symmetric_filling & halves = m_symmetric[off];
+    const aligned_matrix<float> & shifted = m_inner_masks[off];
 
-            for (int y = 0; y < YE; ++y)
-            {
-                cfloat const * s_row = sim_space + y * sim_ld; // space row + x_start
-                cfloat const * m_row = mask_space + mask_x_off + (y + mask_y_off2) * mask_ld; // mask row
-                assert(!(long(s_row) % ALIGNMENT || long(m_row) % ALIGNMENT));
-                #pragma omp simd aligned(s_row, m_row:64) reduction(+:f)
-                for (int x = 0; x < XE; ++x)
-                    f += s_row[x] * m_row[x];
-            }
-        } else {
-            // YE >= FW
-            assert(YE >= m_rules.get_space_height());
-            // hard case. use wrapped version.
-            for (int y = YB; y < YE; ++y)
-            {
-                cint Y = y;
-                cint YB_ = (y - YB) * mask_ld - XB;
-                for (int x = XB; x < XE; ++x)
-                    f += space_current->getValueWrapped(x, y) * mask_space[x + YB_];
-            }
-        }
+    // the halves have the geometry of the shifted masks (not of the compact ones)
+    filling_block blocks[SIMULATOR_MAX_FILLING_BLOCKS];
+    cint block_count = halves.symmetric && m_storage_precision == storage_precision::FP32 ?
+                get_filling_blocks(at_x - shifted.getLeftOffset(), at_x + shifted.getRightOffset(),
+                                   at_y - shifted.getNumRows() / 2, at_y + shifted.getNumRows() / 2, shifted.getLd(), blocks) : 0;
+
+    if (block_count != 1)
+    {
+        // the mirrored rows of a cell must not wrap
+        getFillings_fused(at_x, at_y, mask_inner, mask_outer, m, n, fixed_kernel);
+        return;
     }
 
-    return f / mask_sum; // normalize f
+    cint sim_ld = space_current->getLd();
+    float f_inner = 0;
+    float f_outer = 0;
+
+    m_symmetric_fused_filling_kernel(space_current->getValues() + at_y * sim_ld + blocks[0].space_x, sim_ld, halves.mirror,
+                                     halves.inner.getValues(), halves.outer.getValues(), halves.inner.getLd(),
+                                     halves.inner.getNumRows(), halves.inner.getLd(), f_inner, f_outer);
+
+    m = f_inner / m_inner_mask_sum; // filling of inner circle
+    n = f_outer / m_outer_mask_sum; // filling of outer ring
+}
+
+template <typename state_type, typename weight_type, typename kernel_type>
+void simulator::getFillings_fixed_point(cint at_x, cint at_y, const fixed_point_filling<state_type, weight_type> & fixed, kernel_type kernel, kernel_type fixed_kernel, float & m, float & n)
+{
+    cint space_ld = fixed.space.getLd();
+    cint mask_ld = fixed.inner.getLd();
+    const state_type* const __restrict__ space = fixed.space.getValues();
+    const weight_type* const __restrict__ inner_space = fixed.inner.getValues();
+    const weight_type* const __restrict__ outer_space = fixed.outer.getValues();
+
+    // like the compact masks, only the columns of the quantized masks are read
+    filling_block blocks[SIMULATOR_MAX_FILLING_BLOCKS];
+    cint block_count = get_filling_blocks(at_x - fixed.left, at_x - fixed.left + fixed.inner.getNumCols(),
+                                          at_y - fixed.top, at_y - fixed.top + fixed.inner.getNumRows(), mask_ld, blocks);
+
+    // The whole mask as one block has the width the specialized kernel is made for
+    const kernel_type block_kernel = (fixed_kernel != nullptr && block_count == 1) ? fixed_kernel : kernel;
+
+    int64_t f_inner = 0;
+    int64_t f_outer = 0;
+
+    for (int i = 0; i < block_count; ++i)
+    {
+        const filling_block & block = blocks[i];
+        block_kernel(space + block.space_y * space_ld + block.space_x, space_ld,
+                     inner_space + block.mask_offset, outer_space + block.mask_offset, mask_ld,
+                     block.rows, block.columns, f_inner, f_outer);
+    }
+
+    m = f_inner * fixed.inner_norm; // filling of inner circle
+    n = f_outer * fixed.outer_norm; // filling of outer ring
 }
 
 float simulator::getFilling_peeled(cint at_x, cint at_y, const vector<aligned_matrix<float>> &masks, cint offset, cfloat mask_sum)
@@ -978,37 +2306,119 @@ float simulator::getFilling_peeled(cint at_x, cint at_y, const vector<aligned_ma
 
 float simulator::getFilling_unoptimized(cint at_x, cint at_y, const aligned_matrix<float> &mask, cfloat mask_sum)
 {
-    // The theorectically considered bondaries
-    cint XB = at_x - mask.getNumCols() / 2; // aka x_begin ; Ld can be greater, than #cols!
-    cint XE = at_x + mask.getNumCols() / 2; // aka x_end
-    cint YB = at_y - mask.getNumRows() / 2; // aka y_begin
-    cint YE = at_y + mask.getNumRows() / 2; // aka y_end
+    return m_core.filling(*space_current, at_x, at_y, mask, mask_sum);
+}
 
-    float f = 0;
+float simulator::getFilling_spans(cint at_x, cint at_y, const span_mask & mask, cfloat mask_sum)
+{
+    cint sim_w = space_current->getNumCols();
+    cint sim_h = space_current->getNumRows();
+    cint sim_ld = space_current->getLd();
+    const float* const __restrict__ sim_space = space_current->getValues();
+    const bool x_inside = at_x - mask.getReachLeft() >= 0 && at_x + mask.getReachRight() <= sim_w;
+
+    const mask_span * const spans = mask.spans().data();
+    const mask_rim_weight * const rim = mask.rim().data();
 
-    if (XB >= 0 && YB >= 0 && XE < m_rules.get_space_width() && YE < m_rules.get_space_height())
+    // per-row partial sums are independent of each other, so the additions of different rows can overlap
+    double f = 0;
+    float f_rim = 0;
+
+    for (const mask_span_row & row : mask.rows())
     {
-        for (int y = YB; y < YE; ++y)
+        cint y = wrap_coordinate(at_y + row.dy, sim_h);
+        cfloat * s_row = sim_space + y * sim_ld;
+        const double * p_row = m_prefix_sums.getRow_ptr(y) + at_x;
+
+        // interior: two prefix sum lookups per span
+        double row_f = 0;
+
+        for (int i = row.span_begin; i < row.span_end; ++i)
+            row_f += p_row[spans[i].x_end] - p_row[spans[i].x_begin];
+
+        // rim: small dot product
+        float row_rim = 0;
+
+        if (x_inside)
         {
-            cint Y = y;
-            cint Y_BEG = y - YB;
-            for (int x = XB; x < XE; ++x)
-            {
-                f += space_current->getValue(x, Y) * mask.getValue(x - XB, Y_BEG);
-            }
+            for (int i = row.rim_begin; i < row.rim_end; ++i)
+                row_rim += rim[i].weight * s_row[at_x + rim[i].dx];
         }
+        else
+        {
+            for (int i = row.rim_begin; i < row.rim_end; ++i)
+                row_rim += rim[i].weight * s_row[wrap_coordinate(at_x + rim[i].dx, sim_w)];
+        }
+
+        f += row_f;
+        f_rim += row_rim;
+    }
+
+    return (f + f_rim) / mask_sum;
+}
+
+float simulator::getFilling_sat(cint at_x, cint at_y, const rect_mask & mask, cfloat mask_sum)
+{
+    cint sim_w = space_current->getNumCols();
+    cint sim_h = space_current->getNumRows();
+    cint sim_ld = space_current->getLd();
+    const float* const __restrict__ sim_space = space_current->getValues();
+    cint reach = mask.getReach();
+    const bool inside = at_x - reach >= 0 && at_x + reach < sim_w && at_y - reach >= 0 && at_y + reach < sim_h;
+
+    // interior: four table lookups per rectangle
+    double f = 0;
+
+    for (const mask_rect & rect : mask.rects())
+        f += rect.weight * m_summed_area_table.rect_sum(at_x + rect.x_begin, at_x + rect.x_end, at_y + rect.y_begin, at_y + rect.y_end);
+
+    // rim: small dot product
+    float f_rim = 0;
+
+    if (inside)
+    {
+        for (const mask_rim_cell & cell : mask.rim())
+            f_rim += cell.weight * sim_space[(at_y + cell.dy) * sim_ld + at_x + cell.dx];
     }
     else
     {
-        for (int y = YB; y < YE; ++y)
+        for (const mask_rim_cell & cell : mask.rim())
+            f_rim += cell.weight * sim_space[wrap_coordinate(at_y + cell.dy, sim_h) * sim_ld + wrap_coordinate(at_x + cell.dx, sim_w)];
+    }
+
+    return (f + f_rim) / mask_sum;
+}
+
+float simulator::getFilling_sparse(cint at_x, cint at_y, const sparse_mask & mask, cfloat mask_sum)
+{
+    cint sim_w = space_current->getNumCols();
+    cint sim_h = space_current->getNumRows();
+    cint sim_ld = space_current->getLd();
+    const float* const __restrict__ sim_space = space_current->getValues();
+    const bool x_inside = at_x - mask.getReachLeft() >= 0 && at_x + mask.getReachRight() <= sim_w;
+
+    const mask_rim_weight * const weights = mask.weights().data();
+
+    float f = 0;
+
+    for (const mask_span_row & row : mask.rows())
+    {
+        cfloat * s_row = sim_space + wrap_coordinate(at_y + row.dy, sim_h) * sim_ld;
+        float row_f = 0;
+
+        if (x_inside)
         {
-            cint Y = y;
-            cint Y_BEG = y - YB;
-            for (int x = XB; x < XE; ++x)
-            {
-                f += space_current->getValueWrapped(x, Y) * mask.getValue(x - XB, Y_BEG);
-            }
+            for (int i = row.rim_begin; i < row.rim_end; ++i)
+                row_f += weights[i].weight * s_row[at_x + weights[i].dx];
         }
+        else
+        {
+            // torus seam
+            for (int i = row.rim_begin; i < row.rim_end; ++i)
+                row_f += weights[i].weight * s_row[wrap_coordinate(at_x + weights[i].dx, sim_w)];
+        }
+
+        f += row_f;
     }
 
     return f / mask_sum;
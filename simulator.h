@@ -14,6 +14,17 @@
 #include "ruleset.h"
 #include "aligned_vector.h"
 #include "communication.h"
+#include "fft_convolution.h"
+#include "row_span_filling.h"
+#include "sliding_window_filling.h"
+#include "fixed_point_filling.h"
+#include "separable_filling.h"
+#include "summed_area_filling.h"
+#include "symmetric_filling.h"
+#include "simd_kernels.h"
+#include "transfer_function.h"
+#include "simulator_core.h"
+#include "tile_scheduler.h"
 #include <unistd.h>
 
 using namespace std;
@@ -22,6 +33,145 @@ using namespace std;
 
 #define SPACE_QUEUE_MAX_SIZE 32 //the queue size used by the program
 #define USE_PEELED false
+#define SIMULATOR_L2_CACHE_SIZE (512 * 1024) //L2 cache per core (bytes) used to choose the tile size
+#define SIMULATOR_TEMPORAL_TILE_SIZE 128 //tile width and height of temporal blocking if no tiling is set
+#define SIMULATOR_ACTIVITY_TILE_SIZE 32 //tile width and height of the activity map if no tiling is set (columns are still simulated in one piece)
+#define SIMULATOR_SCHEDULER_TILE_WIDTH 16 //tile width of the work stealing schedule if no tiling is set
+#define SIMULATOR_SCHEDULER_TILE_HEIGHT 64 //tile height of the work stealing schedule if no tiling is set
+#define SIMULATOR_STEPS_PER_BATCH 16 //steps the single rank perftest simulates per parallel region (see simulate_steps)
+#define SIMULATOR_SEAM_COST 2.0f //cost hint of a cell whose masks wrap around the space relative to an inner cell (measured 2-2.5x)
+#define SIMULATOR_QUIESCENT_COST 0.05f //cost hint of a cell of a quiescent tile (only set to 0)
+#define SIMULATOR_MAX_FILLING_BLOCKS 9 //blocks of a neighborhood that crosses both edges of both dimensions (masks larger than the space)
+#define SIMULATOR_COMPACT_MASK_COLUMNS 8 //the columns of the compact masks are rounded up to a multiple of this (floats per AVX2 vector)
+#define SIMULATOR_DT_SAFETY 0.9f //the adaptive time step aims at this fraction of the tolerance
+#define SIMULATOR_DT_MAX_GROWTH 2.0f //the adaptive time step grows at most by this factor per step
+#define SIMULATOR_DT_MAX_SHRINK 0.2f //the adaptive time step shrinks at most by this factor per rejected step
+#define SIMULATOR_SEPARABLE_SAMPLES 4096 //cells at which the SEPARABLE engine is compared to getFilling_unoptimized by initialize
+
+/**
+ * @brief The method used to calculate the inner and outer fillings
+ */
+enum class filling_engine
+{
+    /**
+     * @brief Dense dot product of each cell's neighborhood with the masks (getFilling or getFilling_unoptimized, see m_optimize)
+     */
+    DIRECT = 0,
+
+    /**
+     * @brief Fillings of the whole space via FFT convolution with precomputed kernel spectra
+     */
+    FFT = 1,
+
+    /**
+     * @brief Interior spans of the masks are summed with per-row prefix sums, only the rim is multiplied. O(ra) per cell
+     */
+    PREFIX_SUM = 2,
+
+    /**
+     * @brief Fillings are carried down each column, only the entering and leaving chords are added/subtracted.
+     * Re-anchored with the direct method every m_sliding_window_anchor rows
+     */
+    SLIDING_WINDOW = 3,
+
+    /**
+     * @brief Like DIRECT, but the inner and outer filling are accumulated in one pass over the neighborhood
+     */
+    FUSED = 4,
+
+    /**
+     * @brief Like FUSED, but with integer dot products of a quantized copy of the space (8 or 16 bit, see
+     * m_fixed_point_bits) and quantized masks. Only the fillings are converted to float, see fixed_point_filling.h
+     */
+    FIXED_POINT = 5,
+
+    /**
+     * @brief Like FUSED, but FILLING_BLOCK_CELLS cells of a column are calculated per pass over the masks, each
+     * mask vector is loaded once for all of them (see blocked_fused_filling_kernel)
+     */
+    BLOCKED = 6,
+
+    /**
+     * @brief Fillings of the whole space with the masks approximated by sums of separable kernels (SVD), applied as
+     * 1D passes. The number of terms is the smallest one within m_separable_tolerance, see separable_filling.h
+     */
+    SEPARABLE = 7,
+
+    /**
+     * @brief The masks are decomposed into rectangles (4 lookups in a summed-area table of the whole space each) plus
+     * the rim cells, see summed_area_filling.h. O(ra) per cell
+     */
+    SAT = 8,
+
+    /**
+     * @brief Like FUSED, but the rows of the space mirrored in y are added before they are multiplied with the lower
+     * half of the masks, see symmetric_filling.h. Only y is folded: the columns are read aligned like by FUSED, folding
+     * x as well needs unaligned loads of the mirrored columns and was slower than FUSED. Falls back to FUSED if the
+     * masks are not symmetric in y
+     */
+    SYMMETRIC_Y = 9
+};
+
+/**
+ * @brief Returns the name of the filling engine as used by filling_engine_from_name
+ */
+inline string filling_engine_name(filling_engine engine)
+{
+    switch (engine)
+    {
+    case filling_engine::FFT: return "FFT";
+    case filling_engine::PREFIX_SUM: return "PREFIX_SUM";
+    case filling_engine::SLIDING_WINDOW: return "SLIDING_WINDOW";
+    case filling_engine::FUSED: return "FUSED";
+    case filling_engine::FIXED_POINT: return "FIXED_POINT";
+    case filling_engine::BLOCKED: return "BLOCKED";
+    case filling_engine::SEPARABLE: return "SEPARABLE";
+    case filling_engine::SAT: return "SAT";
+    case filling_engine::SYMMETRIC_Y: return "SYMMETRIC_Y";
+    default: return "DIRECT";
+    }
+}
+
+/**
+ * @brief Returns filling engine from name. Returns DIRECT if name is invalid
+ */
+inline filling_engine filling_engine_from_name(string name)
+{
+    if (name == "FFT")
+        return filling_engine::FFT;
+    else if (name == "PREFIX_SUM")
+        return filling_engine::PREFIX_SUM;
+    else if (name == "SLIDING_WINDOW")
+        return filling_engine::SLIDING_WINDOW;
+    else if (name == "FUSED")
+        return filling_engine::FUSED;
+    else if (name == "FIXED_POINT")
+        return filling_engine::FIXED_POINT;
+    else if (name == "BLOCKED")
+        return filling_engine::BLOCKED;
+    else if (name == "SEPARABLE")
+        return filling_engine::SEPARABLE;
+    else if (name == "SAT")
+        return filling_engine::SAT;
+    else if (name == "SYMMETRIC_Y")
+        return filling_engine::SYMMETRIC_Y;
+    else if (name != "DIRECT")
+        cerr << "Unknown filling engine " << name << ", using DIRECT" << endl;
+
+    return filling_engine::DIRECT;
+}
+
+/**
+ * @brief A block of the neighborhood of a cell that can be accessed without wrapping
+ */
+struct filling_block
+{
+    int space_x; // first cell in space_current
+    int space_y;
+    int mask_offset; // index of the first mask element
+    int rows;
+    int columns;
+};
 
 /**
  * @brief Encapsulates the calculation of states
@@ -35,6 +185,10 @@ public:
     simulator(const ruleset & rules);
     ~simulator();
 
+    // owns the space queue, the FFT plans and the scheduler
+    simulator(const simulator &) = delete;
+    simulator & operator=(const simulator &) = delete;
+
     ruleset m_rules;
     
     
@@ -55,6 +209,45 @@ public:
     bool m_running = false;
     bool m_reinitialize = false;
     bool m_optimize = true; //use the optimized methods    
+    bool m_specialize = true; // use the kernels and transfer function specialized at compile time for the predefined rulesets, if they match. Set before initialize
+    filling_engine m_filling_engine = filling_engine::DIRECT; // how the fillings are calculated. Can be changed at runtime
+    simd_level m_simd_level = simd_level_detect(); // instruction set of the hand-written kernels used by getFilling
+
+    fft_convolution * m_fft = nullptr; // created on demand by the FFT engine
+    unique_ptr<work_stealing_scheduler> m_scheduler; // created on demand by the WORK_STEALING schedule
+    aligned_matrix<float> m_filling_inner; // inner fillings of the whole space (used by whole-field engines)
+    aligned_matrix<float> m_filling_outer; // outer fillings of the whole space (used by whole-field engines)
+
+    span_mask m_inner_spans; // m_inner_masks[0] as spans + rim (used by PREFIX_SUM engine)
+    span_mask m_outer_spans; // m_outer_masks[0] as spans + rim (used by PREFIX_SUM engine)
+    row_prefix_sums m_prefix_sums; // prefix sums of space_current (used by PREFIX_SUM engine)
+    bool m_spans_initiated = false; // if m_inner_spans and m_outer_spans are built, false after initialize
+
+    rect_mask m_inner_rects; // m_inner_masks[0] as rectangles + rim (used by SAT engine)
+    rect_mask m_outer_rects; // m_outer_masks[0] as rectangles + rim (used by SAT engine)
+    summed_area_table m_summed_area_table; // summed-area table of space_current (used by SAT engine)
+    bool m_rects_initiated = false; // if m_inner_rects and m_outer_rects are built, false after initialize
+
+    sparse_mask m_inner_difference; // vertical difference of m_inner_masks[0] (used by SLIDING_WINDOW engine)
+    sparse_mask m_outer_difference; // vertical difference of m_outer_masks[0] (used by SLIDING_WINDOW engine)
+    bool m_differences_initiated = false; // if m_inner_difference and m_outer_difference are built, false after initialize
+    bool m_halo = false; // surround the space with ghost cells, so the DIRECT and FUSED engines never wrap. Set before initialize
+    bool m_compact_masks = false; // the DIRECT, FUSED and SLIDING_WINDOW engines use one mask per shape cut to its nonzero cells instead of the CACHELINE_FLOATS shifted masks. Trades aligned space loads for a much smaller mask working set. Set before initialize
+    storage_precision m_storage_precision = storage_precision::FP32; // precision of the stored states, see half_float.h. Set before initialize
+    int m_transition_table_size = 0; // if > 0, s(n, m) is tabulated on a grid of this size and interpolated. Set before initialize
+    int m_sliding_window_anchor = 32; // the SLIDING_WINDOW engine recalculates the full filling every n rows to bound drift
+    int m_fixed_point_bits = 8; // bits per state of the space copy read by the FIXED_POINT engine (8 or 16). Can be changed at runtime
+    double m_separable_tolerance = 1.0e-3; // largest error of the fillings of the SEPARABLE engine (over all states), decides the number of separable terms. Can be changed at runtime
+
+    int m_tile_width = 0; // width of the tiles of the cache-blocked traversal. Set width or height to 0 to process whole columns
+    int m_tile_height = 0; // height of the tiles of the cache-blocked traversal
+    int m_temporal_steps = 1; // temporal blocking: steps calculated per tile (single rank) or per border exchange (MPI). 1 = off
+    bool m_skip_quiescent = false; // skip tiles whose neighborhood is all 0, see update_activity. Only done if 0 is a fixed point of the rules
+    tile_schedule m_schedule = tile_schedule::STATIC; // how tiles / columns are distributed to the threads. Can be changed at runtime
+    bool m_adaptive_dt = false; // control dt by the embedded error estimate of the integrator (at least MIDPOINT is used). Set before initialize
+    float m_dt_tolerance = 1.0e-3f; // largest accepted error estimate of a step (max. over all cells) with m_adaptive_dt
+    float m_dt_min = 0.01f; // bounds of the adaptive dt. Steps with dt = m_dt_min are accepted regardless of the error
+    float m_dt_max = 0.5f;
 
 
     /**
@@ -82,6 +275,47 @@ public:
      * @MakeOver Bastian
      */
     void simulate_step(int x_start, int w);       
+
+    /**
+     * @brief Simulates one step from x_start to x_start + w with the adaptive dt (see m_adaptive_dt). Steps whose error
+     * estimate exceeds m_dt_tolerance are repeated with a smaller dt, the next dt is chosen from the error of the step
+     * @param global if true, the error estimates of all MPI ranks are reduced to their maximum (one MPI_Allreduce per
+     * attempt), so all ranks reject the same steps and agree on dt. Must then be called by all ranks
+     */
+    void simulate_adaptive_step(int x_start, int w, const bool global);
+
+    /**
+     * @brief Simulates n steps of the whole field and swaps the buffers after each step (needs a space without
+     * queue, see matrix_buffer_queue::swap). The threads stay in one parallel region for all steps
+     * - the FFT engine and temporal blocking fall back to simulate_step / simulate_temporal_block
+     */
+    void simulate_steps(cint n);
+
+    /**
+     * @brief Simulates m_temporal_steps steps with temporal blocking. Each tile is advanced by all steps before the
+     * next tile is read. A tile reads a halo of m_temporal_steps * (ra + 1) cells, the overlapping parts of neighboring
+     * tiles are calculated redundantly. Uses the kernels of the DIRECT or FUSED engine (with the shifted or compact
+     * masks), the last step is written into space_next. With m_skip_quiescent, tiles whose region is 0 are skipped
+     * @note uses the tile size of the cache-blocked traversal or SIMULATOR_TEMPORAL_TILE_SIZE if there is none.
+     * Exits for other engines and integrators (see check_temporal_blocking). simulate_steps and the master of a
+     * single rank only call it if the tiles pay off (see use_temporal_tiles), otherwise they calculate single steps
+     */
+    void simulate_temporal_block();
+
+    /**
+     * @brief Simulates one step of a slave: the chunk of chunk_width cells between two borders of border_width cells
+     * at the left of space (see run_simulation_slave). With temporal blocking, the part of the borders that is still
+     * valid is calculated, too (redundantly to the neighbors), so the borders only have to be exchanged before
+     * temporal_phase 0
+     * @param temporal_phase steps since the borders were exchanged (0 .. m_temporal_steps - 1)
+     */
+    void simulate_chunk_step(cint border_width, cint chunk_width, cint temporal_phase);
+
+    /**
+     * @brief Sets the tile size so the space rows touched by a tile plus the masks used by it fit into cache_bytes
+     * @param cache_bytes size of the cache (usually L2 per core)
+     */
+    void set_tiling_for_cache(int cache_bytes);
     
     /**
      * @brief Runs simulation as master simulator. Distributes work over MPI, but also does some work itself.
@@ -119,11 +353,77 @@ public:
     }
     
     
+    /**
+     * @brief Returns the number of filling passes per step (the stages of the integrator, 1 for discrete rules)
+     */
+    int get_stages() const
+    {
+        return m_core.get_stages();
+    }
+
+    /**
+     * @brief Returns the dt of the next step (the dt of the rules unless m_adaptive_dt)
+     */
+    float get_delta_time() const
+    {
+        return m_delta_time;
+    }
+
+    /**
+     * @brief Returns the simulated time since initialize (sum of the dt of all accepted steps)
+     */
+    double get_simulated_time() const
+    {
+        return m_simulated_time;
+    }
+
+    /**
+     * @brief Returns how many steps were rejected (and repeated with a smaller dt) by m_adaptive_dt since initialize
+     */
+    ulong get_rejected_steps() const
+    {
+        return m_rejected_steps;
+    }
+
+    /**
+     * @brief Returns how many tiles were stolen by the threads of the WORK_STEALING schedule
+     */
+    ulong get_stolen_tiles() const
+    {
+        return m_scheduler != nullptr ? m_scheduler->get_steals() : 0;
+    }
+
+    /**
+     * @brief Returns how many tiles were skipped by m_skip_quiescent since initialize
+     */
+    ulong get_quiescent_tiles() const
+    {
+        return m_quiescent_tiles;
+    }
+
     int get_num_of_masks() const {
         assert(m_outer_masks.size() == m_inner_masks.size());
         return m_outer_masks.size();
     }
 
+    /**
+     * @brief Returns the size of the border of a slave simulator chunk
+     * @return 
+     */
+    int get_mpi_chunk_border_width()
+    {
+        return matrix_calc_ld_with_padding(sizeof(float), m_rules.get_radius_outer() + 1, CACHELINE_SIZE);
+    }
+
+    /**
+     * @brief Returns how many cells the masks reach from the center to each side (ra + 1). This is how far the
+     * valid part of a halo shrinks per step
+     */
+    int get_mask_reach() const
+    {
+        return m_inner_masks[0].getNumRows() / 2;
+    }
+
 private:
     
     /**
@@ -142,15 +442,6 @@ private:
         return get_mpi_chunk_index(mpi_rank());
     }
     
-    /**
-     * @brief Returns the size of the border of a slave simulator chunk
-     * @return 
-     */
-    int get_mpi_chunk_border_width()
-    {
-        return matrix_calc_ld_with_padding(sizeof(float), m_rules.get_radius_outer() + 1, CACHELINE_SIZE);
-    }
-    
     /**
      * @brief Returns how much width of the field calculation a rank gets. Exits program if division cannot be done.
      * @return 
@@ -168,12 +459,310 @@ private:
         return m_rules.get_space_width() / ranks;
     }
     
+    /**
+     * @brief Exits if the MPI chunk borders cannot hold the halo of m_temporal_steps steps
+     */
+    void check_temporal_steps()
+    {
+        if (m_temporal_steps < 1)
+        {
+            cerr << "Invalid number of temporal steps " << m_temporal_steps << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // every stage of the integrator needs another mask reach of the border
+        if (mpi_comm_size() > 1 && m_temporal_steps * get_stages() * get_mask_reach() > get_mpi_chunk_border_width())
+        {
+            cerr << "Cannot use " << m_temporal_steps << " temporal steps with " << get_stages() << " stages: The chunk border of " << get_mpi_chunk_border_width()
+                    << " cells holds " << get_mpi_chunk_border_width() / get_mask_reach() << " stages at most!" << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /**
+     * @brief Returns why the engine or the integrator cannot be used with temporal blocking of tiles (single rank),
+     * or an empty string. The tiles are calculated in separate buffers, so only the engines that read the space with
+     * the mask kernels work
+     */
+    string get_temporal_blocking_limitation() const
+    {
+        if (get_stages() > 1)
+            return "the tiles only support the Euler integrator, not " + integrator_name(m_rules.get_integrator());
+
+        if (!m_optimize)
+            return "the tiles only support the optimized DIRECT and FUSED engines, not the unoptimized one";
+
+        if (m_filling_engine != filling_engine::DIRECT && m_filling_engine != filling_engine::FUSED)
+            return "the tiles only support the optimized DIRECT and FUSED engines, not " + filling_engine_name(m_filling_engine);
+
+        return "";
+    }
+
+    /**
+     * @brief Exits if the engine or the integrator cannot be used with temporal blocking of tiles
+     */
+    void check_temporal_blocking() const
+    {
+        const string limitation = get_temporal_blocking_limitation();
+
+        if (!limitation.empty())
+        {
+            cerr << "Cannot use temporal blocking: " << limitation << "!" << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /**
+     * @brief Returns if a single rank calculates m_temporal_steps steps with temporal blocking of tiles. The tiles
+     * calculate their halos redundantly, which only pays off if a step cannot read the space from the cache: a
+     * column of the step reads a stripe of the mask width over the whole height. Without a tile size, the tiles are
+     * only used if the stripe does not fit into SIMULATOR_L2_CACHE_SIZE
+     */
+    bool use_temporal_tiles() const
+    {
+        if (m_temporal_steps <= 1 || !get_temporal_blocking_limitation().empty())
+            return false;
+
+        if (m_tile_width > 0 && m_tile_height > 0)
+            return true;
+
+        return (m_inner_masks[0].getLd() + CACHELINE_FLOATS) * m_rules.get_space_height() * sizeof (float) > SIMULATOR_L2_CACHE_SIZE;
+    }
+
+
     /**
      * @brief prepares all offset masks (CACHELINE_SIZE / sizeof(floats) many)
      * @author Bastian
      */
     void initiate_masks();    
 
+    filling_kernel m_filling_kernel = filling_kernel_portable; // the kernel for m_simd_level, updated every step
+    fused_filling_kernel m_fused_filling_kernel = fused_filling_kernel_portable; // the fused kernel for m_simd_level, updated every step
+    blocked_fused_filling_kernel m_blocked_fused_filling_kernel = nullptr; // the blocked kernel for m_simd_level, updated every step
+    line_filter_kernel m_line_filter_kernel = nullptr; // the 1D filter kernel of the SEPARABLE engine for m_simd_level, updated every step
+    symmetric_fused_filling_kernel m_symmetric_fused_filling_kernel = nullptr; // the kernel of the SYMMETRIC_Y engine for m_simd_level, updated every step
+    vector<symmetric_filling> m_symmetric; // lower halves of m_inner_masks[o] and m_outer_masks[o] for each offset o (used by SYMMETRIC_Y engine), empty after initialize
+    aligned_matrix<float> m_inner_compact_mask; // m_inner_masks[0] cut to the nonzero cells of both masks (m_compact_masks)
+    aligned_matrix<float> m_outer_compact_mask; // m_outer_masks[0] cut to the same cells
+    int m_compact_left = 0; // columns from the first column of the compact masks to the cell they are centered at
+    int m_compact_top = 0; // rows from the first row of the compact masks to the cell they are centered at
+    filling_kernel m_fixed_compact_filling_kernel = nullptr; // specialized kernels for the compact masks or nullptr, updated every step
+    fused_filling_kernel m_fixed_compact_fused_filling_kernel = nullptr;
+
+    /**
+     * @brief cuts m_inner_masks[0] and m_outer_masks[0] to the bounding box of their nonzero cells
+     */
+    void initiate_compact_masks();
+
+    filling_kernel m_fixed_filling_kernels[CACHELINE_FLOATS]; // specialized kernels for the full masks of each offset or nullptr, updated every step
+    fused_filling_kernel m_fixed_fused_filling_kernels[CACHELINE_FLOATS];
+    simulator_core<float> m_core; // masks, unoptimized filling and state function shared with the double precision reference
+    transfer_function m_transfer_function; // batched version of the state function of m_core, built by initialize
+    aligned_matrix<uint16_t> m_space_half; // 16 bit copy of space_current read by the DIRECT and FUSED engines, if m_storage_precision is not FP32
+    half_filling_kernel m_half_filling_kernel = nullptr; // kernels for m_space_half, updated every step
+    half_fused_filling_kernel m_half_fused_filling_kernel = nullptr;
+
+    /**
+     * @brief Builds the FFT convolution and its kernel spectra from m_inner_masks[0] and m_outer_masks[0]
+     */
+    void initiate_fft();
+
+    fixed_point_filling<uint8_t, int8_t> m_fixed_point8; // quantized space and masks of the FIXED_POINT engine with 8 bits
+    fixed_point_filling<uint16_t, int16_t> m_fixed_point16; // quantized space and masks of the FIXED_POINT engine with 16 bits
+    int m_fixed_point_initiated_bits = 0; // the bits m_fixed_point8 or m_fixed_point16 were built for, 0 after initialize
+    int8_fused_filling_kernel m_int8_fused_filling_kernel = nullptr; // kernels of the FIXED_POINT engine, updated every step
+    int16_fused_filling_kernel m_int16_fused_filling_kernel = nullptr;
+    int8_fused_filling_kernel m_int8_fixed_fused_filling_kernel = nullptr; // specialized for the width of the quantized masks or nullptr
+    int16_fused_filling_kernel m_int16_fixed_fused_filling_kernel = nullptr;
+
+    separable_filling m_separable_inner; // separable approximation of m_inner_masks[0] (SEPARABLE engine)
+    separable_filling m_separable_outer; // separable approximation of m_outer_masks[0]
+    double m_separable_initiated_tolerance = -1; // the tolerance m_separable_inner and m_separable_outer were built for, -1 after initialize
+
+    /**
+     * @brief Decomposes the masks for the SEPARABLE engine with m_separable_tolerance, if they were not built for it yet
+     */
+    void initiate_separable();
+
+    /**
+     * @brief Calculates the fillings of space_current with the SEPARABLE engine and returns their largest deviation
+     * from getFilling_unoptimized (at up to SIMULATOR_SEPARABLE_SAMPLES cells). Call outside of parallel regions
+     */
+    double measure_separable_error();
+
+    /**
+     * @brief Builds the quantized masks and space copy of the FIXED_POINT engine for m_fixed_point_bits, if they do not
+     * exist yet. Exits if m_fixed_point_bits is not 8 or 16
+     */
+    void initiate_fixed_point();
+
+    /**
+     * @brief Decomposes the masks into spans for the PREFIX_SUM engine, if they were not built yet
+     */
+    void initiate_spans();
+
+    /**
+     * @brief Builds the vertical differences of the masks for the SLIDING_WINDOW engine, if they were not built yet
+     */
+    void initiate_differences();
+
+    /**
+     * @brief Decomposes the masks into rectangles for the SAT engine, if they were not built yet
+     */
+    void initiate_rects();
+
+    /**
+     * @brief Folds the masks of all offsets to their lower halves for the SYMMETRIC_Y engine, if they were not built yet
+     */
+    void initiate_symmetric();
+
+    vector<uint8_t> m_activity; // per tile of the activity map: 1 if a cell within the mask reach of the tile is not 0 (row major)
+    vector<uint8_t> m_activity_rows; // per space row and tile column: 1 if the row has a non-zero state within the mask reach of the tile columns
+    vector<uint8_t> m_activity_columns; // per thread: 1 per column of an extended row with a non-zero state (see update_activity)
+    vector<float> m_tile_costs; // cost hints of the tiles of the current step (WORK_STEALING schedule), reused between steps
+    bool m_zero_is_fixed_point = false; // if a cell with 0 neighborhood stays 0 (set by initialize)
+    ulong m_quiescent_tiles = 0; // number of skipped tiles since initialize
+
+    int m_stage = 0; // stage of the integrator the current filling pass calculates (see integrator_tableau)
+    integrator_tableau m_tableau; // the coefficients of the integrator of m_rules (set by initialize)
+    aligned_matrix<float> m_stage_base; // the states at the begin of the step while the stages are calculated (more than one stage)
+    aligned_matrix<float> m_stage_sum; // weighted sum of the time derivatives of the stages so far
+    aligned_matrix<float> m_stage_error; // derivative of the embedded stage, then the error estimate of the step (m_adaptive_dt)
+
+    float m_delta_time = 0; // dt of the current step (set by initialize, controlled by m_adaptive_dt)
+    double m_simulated_time = 0; // sum of dt of the accepted steps
+    ulong m_rejected_steps = 0; // steps repeated with a smaller dt
+
+    /**
+     * @brief Calculates all stages of a step from x_start to x_start + w into space_next (see simulate_step)
+     */
+    void simulate_stages(cint x_start, cint w);
+
+    /**
+     * @brief Returns the maximum error estimate of the last step from x_start to x_start + w (wrapped)
+     */
+    float get_step_error(cint x_start, cint w);
+
+    /**
+     * @brief Accepts or rejects the last step by its error estimate and chooses the dt of the next attempt
+     * @return true if the step is accepted
+     */
+    bool control_delta_time(cfloat error);
+
+    /**
+     * @brief Returns the state of cell (x, y) after the current stage from s(n, m) of the stage and the state the
+     * fillings were calculated of (see integrator_tableau). Updates m_stage_sum
+     */
+    inline float integrate_stage(cint x, cint y, cfloat s, cfloat state)
+    {
+        cfloat k = time_derivative<float>(m_rules.get_time_stepping(), s, state);
+        cfloat sum = (m_stage == 0 ? 0.0f : m_stage_sum.getValue(x, y)) + m_tableau.weight[m_stage] * k;
+        cfloat base = m_stage == 0 ? state : m_stage_base.getValue(x, y);
+        cfloat dt = m_delta_time;
+
+        m_stage_sum.setValue(sum, x, y);
+
+        if (m_adaptive_dt)
+        {
+            if (m_stage == m_tableau.embedded)
+                m_stage_error.setValue(k, x, y);
+            else if (m_stage == m_tableau.stages - 1)
+            {
+                // both solutions are clamped, cells that are saturated at 0 or 1 have no error
+                cfloat embedded = fmaxf(0.0f, fminf(1.0f, base + dt * m_stage_error.getValue(x, y)));
+                m_stage_error.setValue(fabsf(fmaxf(0.0f, fminf(1.0f, base + dt * sum)) - embedded), x, y);
+            }
+        }
+
+        if (m_stage == m_tableau.stages - 1)
+            return fmaxf(0.0f, fminf(1.0f, base + dt * sum));
+
+        return fmaxf(0.0f, fminf(1.0f, base + m_tableau.offset[m_stage + 1] * dt * k));
+    }
+
+    /**
+     * @brief Builds m_activity for space_current. A tile is active if its cells or the cells within the mask reach
+     * around it (wrapped) contain a state that is not 0. Called by all threads of the team (see simulate_step_in_team)
+     * @param x_start first column of the tiles (see simulate_step(x_start, w))
+     * @param w width of the simulated area
+     * @param tile_width width of the tiles
+     * @param tile_height height of the tiles
+     */
+    void update_activity(cint x_start, cint w, cint tile_width, cint tile_height);
+
+    /**
+     * @brief Calculates the fillings of the whole space with the FFT engine
+     */
+    void convolve_fft();
+
+    /**
+     * @brief The work of simulate_step(x_start, w) except the FFT. Has to be called by all threads of a parallel
+     * region: the loops are shared with orphaned work-sharing constructs, the serial parts are done by one thread
+     */
+    void simulate_step_in_team(cint x_start, cint w);
+
+    /**
+     * @brief Simulates the tiles of simulate_step(x_start, w) with the work stealing scheduler. Called by all threads
+     * of the team (see simulate_step_in_team)
+     * @param skip_quiescent if quiescent tiles are skipped (update_activity is called with the tiles of the schedule)
+     */
+    void simulate_tiles_work_stealing(cint x_start, cint w, const bool skip_quiescent);
+
+    /**
+     * @brief Returns the cost hint of a tile for the work stealing scheduler: the number of cells, weighted by
+     * SIMULATOR_SEAM_COST for cells whose masks wrap around the space (slow path of getFilling)
+     */
+    float tile_cost(cint tile_x, cint tile_y, cint tile_x_end, cint tile_y_end) const;
+
+    /**
+     * @brief Sets the next states of column x in [y_begin, y_end) to 0 (for quiescent tiles)
+     */
+    void zero_column(cint x, cint y_begin, cint y_end);
+
+    /**
+     * @brief Selects the filling kernels for m_simd_level. Called every step, the level can be changed at runtime
+     */
+    void update_kernels();
+
+    /**
+     * @brief Advances the tile by m_temporal_steps steps (see simulate_temporal_block)
+     * @param region_a buffer for the region read by the tile, resized if necessary
+     * @param region_b second buffer of the same size
+     * @param skip_quiescent if the tile is set to 0 when its whole region is 0
+     * @return if the tile was skipped
+     */
+    bool simulate_tile_steps(cint tile_x, cint tile_y, cint tile_w, cint tile_h, aligned_matrix<float> & region_a, aligned_matrix<float> & region_b, const bool skip_quiescent);
+
+    /**
+     * @brief Calculates the next state of the cells (x, y_begin) to (x, y_end - 1)
+     */
+    void simulate_column(cint x, cint y_begin, cint y_end);
+
+    /**
+     * @brief calculates the new states of count cells of column x starting at y_begin with the batched transfer function
+     * @param outer outer fillings of the cells
+     * @param inner inner fillings of the cells
+     */
+    void apply_transfer_function(cint x, cint y_begin, cint count, const float * outer, const float * inner);
+
+    /**
+     * @brief Returns the columns of space_current the cells [x_start, x_start + w) read as up to two ranges
+     * [begin, end) (the second one is empty unless the range wraps and there is no halo)
+     */
+    void get_read_ranges(cint x_start, cint w, int ranges[2][2]) const;
+
+    /**
+     * @brief converts the columns of space_current the cells [x_start, x_start + w) read (and the halo rows) to
+     * m_space_half. Called by all threads of the team (see simulate_step_in_team)
+     */
+    void update_space_half(cint x_start, cint w);
+
+    /**
+     * @brief quantizes the columns of space_current the cells [x_start, x_start + w) read (and the halo rows) into the
+     * space copy of the FIXED_POINT engine. Called by all threads of the team (see simulate_step_in_team)
+     */
+    void update_space_fixed_point(cint x_start, cint w);
+
     void space_set_random(aligned_matrix<float>* space)
     {
         random_device rd;
@@ -293,64 +882,69 @@ private:
         }
     }
 
-    inline float sigma1(cfloat x,cfloat a, cfloat alpha)
-    {
-        return 1.0 / ( 1.0 + exp(-(x-a)*4.0/alpha));
-    }
-
-    /*inline float sigma2(cfloat x,cfloat a,cfloat b, cfloat alpha)
-    {
-        return sigma1(x,a,alpha) * ( 1.0 - sigma1(x,b,alpha));
-    }
-
-    inline float sigmam(cfloat x,cfloat y,cfloat m, cfloat alpha)
-    {
-        return x * ( 1.0 - sigma1(m,0.5, alpha)) + y*sigma1(m, 0.5, alpha);
-    }*/
+    /**
+     * @brief calculates the area around the point (x,y) based on the mask & normalizes it by mask_sum
+     * @param at_x space x-coordinate
+     * @param at_y space y-coordinate
+     * @param mask a non-sparsed matrix with target set [0,1]
+     * @param mask_sum the sum of all values in the given matrix (the maximal, obtainable value of this function)
+     * @param fixed_kernel kernel specialized for the full mask (see fixed_filling_kernel_for), used if the mask does not wrap. Can be nullptr
+     * @return a float with a value in [0,1]
+     * @author Bastian
+     */
+    float getFilling(cint at_x, cint at_y, const aligned_matrix<float> const &mask, cfloat mask_sum, filling_kernel fixed_kernel = nullptr);
 
-    //Corrected rules according to ref. implementation
-    inline float sigma2(cfloat x, cfloat a, cfloat b)
-    {
-        return sigma1(x,a,m_rules.get_alpha_n()) * ( 1.0 - sigma1(x,b,m_rules.get_alpha_n()));
-    }
+    /**
+     * @brief calculates the inner and outer filling around the point (x,y) in one pass over the neighborhood
+     * @param mask_inner inner mask, must have the same size and offset as mask_outer
+     * @param mask_outer outer mask
+     * @param m the inner filling normalized by m_inner_mask_sum
+     * @param n the outer filling normalized by m_outer_mask_sum
+     * @param fixed_kernel kernel specialized for the full masks (see fixed_fused_filling_kernel_for), used if the masks do not wrap. Can be nullptr
+     */
+    void getFillings_fused(cint at_x, cint at_y, const aligned_matrix<float> &mask_inner, const aligned_matrix<float> &mask_outer, float & m, float & n, fused_filling_kernel fixed_kernel = nullptr);
 
-    inline float sigmam(cfloat x, cfloat y, cfloat m)
-    {
-        return x * ( 1.0 - sigma1(m,0.5,m_rules.get_alpha_m())) + y*sigma1(m, 0.5, m_rules.get_alpha_m());
-    }
+    /**
+     * @brief calculates the inner and outer fillings of the cells (x,y) .. (x,y + count - 1) with the BLOCKED engine.
+     * Falls back to getFillings_fused per cell if count is not FILLING_BLOCK_CELLS, the neighborhoods wrap or the
+     * states are not stored in FP32
+     * @param m receives count inner fillings
+     * @param n receives count outer fillings
+     */
+    void getFillings_blocked(cint at_x, cint at_y, cint count, const aligned_matrix<float> &mask_inner, const aligned_matrix<float> &mask_outer, float * m, float * n, fused_filling_kernel fixed_kernel = nullptr);
 
     /**
-     * @brief s Calculates the new state
-     * @param n Outer filling
-     * @param m Inner Filling
-     * @return New state
+     * @brief calculates the inner and outer fillings of the cell (x,y) with the halves of the masks of offset off in
+     * m_symmetric. Falls back to getFillings_fused (with the given masks) if the masks are not symmetric, the
+     * neighborhood wraps or the states are not stored in FP32
      */
-    inline float discrete_state_func_1(cfloat outer, cfloat inner)
-    {
-        //According to ref. implementation
-        return sigmam(sigma2(outer,m_rules.get_birth_min(),m_rules.get_birth_max()),sigma2(outer,m_rules.get_death_min(),m_rules.get_death_max()),inner);
-    }
+    void getFillings_symmetric(cint at_x, cint at_y, cint off, const aligned_matrix<float> &mask_inner, const aligned_matrix<float> &mask_outer, float & m, float & n, fused_filling_kernel fixed_kernel = nullptr);
 
-    inline float discrete_as_euler(cfloat outer, cfloat inner)
-    {
-        return 2.0 * discrete_state_func_1(outer, inner) - 1.0;
-    }
+    /**
+     * @brief calculates the inner and outer filling around the point (x,y) with the FIXED_POINT engine
+     * @param fixed quantized space and masks (m_fixed_point8 or m_fixed_point16)
+     * @param kernel the integer kernel for fixed
+     * @param fixed_kernel kernel specialized for the width of the quantized masks, used if they do not wrap. Can be nullptr
+     * @param m the inner filling, normalized by the sum of the quantized inner mask
+     * @param n the outer filling, normalized by the sum of the quantized outer mask
+     */
+    template <typename state_type, typename weight_type, typename kernel_type>
+    void getFillings_fixed_point(cint at_x, cint at_y, const fixed_point_filling<state_type, weight_type> & fixed, kernel_type kernel, kernel_type fixed_kernel, float & m, float & n);
 
-    inline float next_step_as_euler(cint x, cint y, cfloat outer, cfloat inner)
-    {
-        return space_current->getValue(x,y) + m_rules.get_delta_time() * discrete_as_euler(outer,inner);
-    }
+    /**
+     * @brief splits the neighborhood of (x,y) accessed by mask into blocks that do not cross the edges of space
+     * @param mask one of the shifted masks or, with m_compact_masks, one of the compact masks
+     * @param blocks receives up to SIMULATOR_MAX_FILLING_BLOCKS blocks
+     * @param cells the neighborhoods of the cells (x,y) .. (x,y + cells - 1) together
+     * @return the number of blocks
+     */
+    int get_filling_blocks(cint at_x, cint at_y, const aligned_matrix<float> &mask, filling_block * blocks, cint cells = 1);
 
     /**
-     * @brief calculates the area around the point (x,y) based on the mask & normalizes it by mask_sum
-     * @param at_x space x-coordinate
-     * @param at_y space y-coordinate
-     * @param mask a non-sparsed matrix with target set [0,1]
-     * @param mask_sum the sum of all values in the given matrix (the maximal, obtainable value of this function)
-     * @return a float with a value in [0,1]
-     * @author Bastian
+     * @brief splits the rect [XB, XE) x [YB, YE) of space (may reach over the edges) into blocks that do not cross the
+     * edges of space. The mask of the rect has the leading dimension mask_ld
      */
-    float getFilling(cint at_x, cint at_y, const aligned_matrix<float> const &mask, cfloat mask_sum);
+    int get_filling_blocks(cint XB, cint XE, cint YB, cint YE, cint mask_ld, filling_block * blocks);
     //float getFilling(cint at_x, cint at_y, const vector<aligned_matrix<float>> &masks, cint offset, cfloat mask_sum);
 
     /**
@@ -378,4 +972,35 @@ private:
      * @author Bastian
      */
     float getFilling_unoptimized(cint at_x, cint at_y, const aligned_matrix<float> & mask, cfloat mask_sum);
+
+    /**
+     * @brief calculates the area around the point (x,y) based on the mask & normalizes it by mask_sum
+     * - sums the interior spans of the mask with m_prefix_sums (must be up to date), multiplies only the rim
+     * @param at_x space x-coordinate
+     * @param at_y space y-coordinate
+     * @param mask span description of a mask
+     * @param mask_sum the sum of all values in the given matrix (the maximal, obtainable value of this function)
+     * @return a float with a value in [0,1]
+     */
+    float getFilling_spans(cint at_x, cint at_y, const span_mask & mask, cfloat mask_sum);
+
+    /**
+     * @brief calculates the area around the point (x,y) based on the mask & normalizes it by mask_sum
+     * - sums the rectangles of the mask with m_summed_area_table (must be up to date), multiplies only the rim
+     * @param mask rectangle description of a mask
+     * @param mask_sum the sum of all values in the given matrix (the maximal, obtainable value of this function)
+     * @return a float with a value in [0,1]
+     */
+    float getFilling_sat(cint at_x, cint at_y, const rect_mask & mask, cfloat mask_sum);
+
+    /**
+     * @brief calculates the weighted sum around the point (x,y) based on a sparse mask & normalizes it by mask_sum
+     * - used with the vertical difference masks to move a filling from row y - 1 to row y
+     * @param at_x space x-coordinate
+     * @param at_y space y-coordinate
+     * @param mask sparse mask, weights can be negative
+     * @param mask_sum the sum of all values of the mask the sparse mask was derived from
+     * @return the normalized weighted sum
+     */
+    float getFilling_sparse(cint at_x, cint at_y, const sparse_mask & mask, cfloat mask_sum);
 };
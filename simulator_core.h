@@ -0,0 +1,209 @@
+#pragma once
+
+#include <iostream>
+#include <math.h>
+#include <utility>
+#include "matrix.h"
+#include "ruleset.h"
+
+using namespace std;
+
+/**
+ * @brief The reference parts of the simulation, generic over the scalar type T of the states:
+ * mask construction, the dense filling and the state function s(n, m) with the integrators of the ruleset.
+ * - simulator uses simulator_core<float> for its unoptimized code path
+ * - simulator_core<double> is the double precision reference engine, see lockstep_validator
+ */
+template <typename T>
+class simulator_core
+{
+public:
+
+    simulator_core(const ruleset & rules) :
+        m_rules(rules),
+        m_inner_mask(inner_mask(rules, 0)),
+        m_outer_mask(outer_mask(rules, 0)),
+        m_inner_mask_sum(m_inner_mask.sum()),
+        m_outer_mask_sum(m_outer_mask.sum())
+    {
+    }
+
+    /**
+     * @brief Returns the mask of the inner circle, shifted right by offset (see aligned_matrix(columns, rows, offset))
+     */
+    static aligned_matrix<T> inner_mask(const ruleset & rules, cint offset)
+    {
+        aligned_matrix<T> mask = aligned_matrix<T>(rules.get_radius_outer() * 2 + 2, rules.get_radius_outer() * 2 + 2, offset);
+        mask.set_circle(rules.get_radius_inner(), 1, 1, offset);
+
+        return mask;
+    }
+
+    /**
+     * @brief Returns the mask of the outer ring, shifted right by offset (see aligned_matrix(columns, rows, offset))
+     */
+    static aligned_matrix<T> outer_mask(const ruleset & rules, cint offset)
+    {
+        aligned_matrix<T> mask = aligned_matrix<T>(rules.get_radius_outer() * 2 + 2, rules.get_radius_outer() * 2 + 2, offset);
+        mask.set_circle(rules.get_radius_outer(), 1, 1, offset);
+        mask.set_circle(rules.get_radius_inner(), 0, 1, offset);
+
+        return mask;
+    }
+
+    /**
+     * @brief s(n, m) according to the reference implementation
+     * @param outer outer filling n
+     * @param inner inner filling m
+     */
+    inline T state_function(const T outer, const T inner) const
+    {
+        return sigmam(sigma2(outer, m_rules.get_birth_min(), m_rules.get_birth_max()), sigma2(outer, m_rules.get_death_min(), m_rules.get_death_max()), inner);
+    }
+
+    /**
+     * @brief Returns the next state of a cell. Euler steps are clamped to [0,1] (as done by the reference implementation)
+     */
+    inline T next_state(const T state, const T outer, const T inner) const
+    {
+        if (m_rules.get_is_discrete())
+            return state_function(outer, inner);
+
+        const T euler = state + T(m_rules.get_delta_time()) * time_derivative<T>(m_rules.get_time_stepping(), state_function(outer, inner), state);
+
+        return fmax(0, fmin(1, euler));
+    }
+
+    /**
+     * @brief Returns the number of filling passes per step (the stages of the integrator, 1 for discrete rules)
+     */
+    int get_stages() const
+    {
+        return m_rules.get_is_discrete() ? 1 : integrator_tableau_for(m_rules.get_integrator()).stages;
+    }
+
+    /**
+     * @brief calculates the area around the point (x,y) of space based on the mask & normalizes it by mask_sum.
+     * Accesses outside of space are wrapped
+     * @param mask a non-sparsed matrix with target set [0,1], centered at (columns / 2, rows / 2)
+     * @param mask_sum the sum of all values in the given matrix
+     */
+    T filling(const aligned_matrix<T> & space, cint at_x, cint at_y, const aligned_matrix<T> & mask, const T mask_sum) const
+    {
+        cint XB = at_x - mask.getNumCols() / 2;
+        cint XE = at_x + mask.getNumCols() / 2;
+        cint YB = at_y - mask.getNumRows() / 2;
+        cint YE = at_y + mask.getNumRows() / 2;
+
+        T f = 0;
+
+        if (XB >= 0 && YB >= 0 && XE < space.getNumCols() && YE < space.getNumRows())
+        {
+            for (int y = YB; y < YE; ++y)
+                for (int x = XB; x < XE; ++x)
+                    f += space.getValue(x, y) * mask.getValue(x - XB, y - YB);
+        }
+        else
+        {
+            for (int y = YB; y < YE; ++y)
+                for (int x = XB; x < XE; ++x)
+                    f += space.getValueWrapped(x, y) * mask.getValue(x - XB, y - YB);
+        }
+
+        return f / mask_sum;
+    }
+
+    /**
+     * @brief Calculates the next states of the whole space
+     */
+    void step(const aligned_matrix<T> & current, aligned_matrix<T> & next) const
+    {
+        if (get_stages() > 1)
+        {
+            step_runge_kutta(current, next);
+            return;
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int x = 0; x < current.getNumCols(); ++x)
+        {
+            for (int y = 0; y < current.getNumRows(); ++y)
+            {
+                const T m = filling(current, x, y, m_inner_mask, m_inner_mask_sum);
+                const T n = filling(current, x, y, m_outer_mask, m_outer_mask_sum);
+
+                next.setValue(next_state(current.getValue(x, y), n, m), x, y);
+            }
+        }
+    }
+
+private:
+
+    ruleset m_rules;
+
+    /**
+     * @brief step with the Runge-Kutta integrators, see integrator_tableau
+     */
+    void step_runge_kutta(const aligned_matrix<T> & current, aligned_matrix<T> & next) const
+    {
+        const integrator_tableau tableau = integrator_tableau_for(m_rules.get_integrator());
+        const T dt = m_rules.get_delta_time();
+        const time_stepping stepping = m_rules.get_time_stepping();
+        cint w = current.getNumCols();
+        cint h = current.getNumRows();
+
+        aligned_matrix<T> stage = current;
+        aligned_matrix<T> derivative = aligned_matrix<T>(w, h);
+        aligned_matrix<T> sum = aligned_matrix<T>(w, h);
+
+        for (int i = 0; i < tableau.stages; ++i)
+        {
+            #pragma omp parallel for schedule(static)
+            for (int x = 0; x < w; ++x)
+            {
+                for (int y = 0; y < h; ++y)
+                {
+                    const T m = filling(stage, x, y, m_inner_mask, m_inner_mask_sum);
+                    const T n = filling(stage, x, y, m_outer_mask, m_outer_mask_sum);
+                    const T k = time_derivative<T>(stepping, state_function(n, m), stage.getValue(x, y));
+
+                    derivative.setValue(k, x, y);
+                    sum.setValue((i == 0 ? 0 : sum.getValue(x, y)) + T(tableau.weight[i]) * k, x, y);
+                }
+            }
+
+            if (i == tableau.stages - 1)
+                break;
+
+            #pragma omp parallel for schedule(static)
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x)
+                    stage.setValue(fmax(0, fmin(1, current.getValue(x, y) + T(tableau.offset[i + 1]) * dt * derivative.getValue(x, y))), x, y);
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                next.setValue(fmax(0, fmin(1, current.getValue(x, y) + dt * sum.getValue(x, y))), x, y);
+    }
+
+    aligned_matrix<T> m_inner_mask;
+    aligned_matrix<T> m_outer_mask;
+    T m_inner_mask_sum;
+    T m_outer_mask_sum;
+
+    inline T sigma1(const T x, const T a, const T alpha) const
+    {
+        return 1.0 / (1.0 + exp(-(x - a) * 4.0 / alpha));
+    }
+
+    inline T sigma2(const T x, const T a, const T b) const
+    {
+        return sigma1(x, a, m_rules.get_alpha_n()) * (1.0 - sigma1(x, b, m_rules.get_alpha_n()));
+    }
+
+    inline T sigmam(const T x, const T y, const T m) const
+    {
+        return x * (1.0 - sigma1(m, 0.5, m_rules.get_alpha_m())) + y * sigma1(m, 0.5, m_rules.get_alpha_m());
+    }
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include "matrix.h"
+#include "row_span_filling.h"
+
+using namespace std;
+
+/**
+ * @brief A mask that only stores its non-zero elements, grouped by rows. Coordinates relative to the mask center
+ * - the center is the same as used by getFilling_unoptimized (columns / 2, rows / 2)
+ * - the rows use mask_span_row, only the rim part of it is used
+ */
+class sparse_mask
+{
+public:
+
+    sparse_mask() : m_reach_left(0), m_reach_right(0) { }
+
+    /**
+     * @brief Returns the change of the filling with mask if the cell moves from row y - 1 to row y.
+     * - filling(y) = filling(y - 1) + sum of the returned weights applied at (x + dx, y + dy)
+     * - the difference of two neighboring mask rows is only non-zero at the chords entering and leaving the circle
+     */
+    static sparse_mask vertical_difference(const aligned_matrix<float> & mask)
+    {
+        sparse_mask diff;
+
+        cint center_x = mask.getNumCols() / 2;
+        cint center_y = mask.getNumRows() / 2;
+
+        // difference row k = mask row (k - 1) - mask row k, mask rows outside of the mask are 0
+        for (int k = 0; k <= mask.getNumRows(); ++k)
+        {
+            vector<float> weights(mask.getNumCols());
+
+            for (int i = 0; i < mask.getNumCols(); ++i)
+            {
+                cfloat above = k > 0 ? mask.getValue(i, k - 1) : 0;
+                cfloat below = k < mask.getNumRows() ? mask.getValue(i, k) : 0;
+                weights[i] = above - below;
+            }
+
+            diff.add_row(k - center_y - 1, center_x, weights);
+        }
+
+        return diff;
+    }
+
+    const vector<mask_span_row> & rows() const
+    {
+        return m_rows;
+    }
+
+    const vector<mask_rim_weight> & weights() const
+    {
+        return m_weights;
+    }
+
+    /**
+     * @brief Returns how many columns left of the center the mask reaches (positive value)
+     */
+    int getReachLeft() const
+    {
+        return m_reach_left;
+    }
+
+    /**
+     * @brief Returns how many columns right of the center the mask reaches (column after the last non-zero element)
+     */
+    int getReachRight() const
+    {
+        return m_reach_right;
+    }
+
+private:
+
+    int m_reach_left;
+    int m_reach_right;
+    vector<mask_span_row> m_rows;
+    vector<mask_rim_weight> m_weights;
+
+    void add_row(cint dy, cint center_x, const vector<float> & weights)
+    {
+        mask_span_row row = {dy, 0, 0, int(m_weights.size()), 0};
+
+        for (int i = 0; i < int(weights.size()); ++i)
+        {
+            if (weights[i] != 0)
+            {
+                m_weights.push_back(mask_rim_weight{i - center_x, weights[i]});
+                m_reach_left = max(m_reach_left, center_x - i);
+                m_reach_right = max(m_reach_right, i + 1 - center_x);
+            }
+        }
+
+        row.rim_end = m_weights.size();
+
+        if (row.rim_end > row.rim_begin)
+            m_rows.push_back(row);
+    }
+};
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <cstdlib>
+#include <assert.h>
+#include <omp.h>
+#include "matrix.h"
+
+using namespace std;
+
+#define SUMMED_AREA_TABLE_STRIP 64 //columns of the strips the column sums of summed_area_table are calculated in
+
+/**
+ * @brief A rectangle of mask elements with the same weight. Rows and columns relative to the mask center, the ends
+ * are exclusive
+ */
+struct mask_rect
+{
+    int x_begin;
+    int x_end;
+    int y_begin;
+    int y_end;
+    float weight;
+};
+
+/**
+ * @brief A mask element that is not covered by the rectangles of rect_mask (the anti-aliased rim of a circle)
+ */
+struct mask_rim_cell
+{
+    int dx;
+    int dy;
+    float weight;
+};
+
+/**
+ * @brief Describes a mask as weighted rectangles plus rim corrections, for lookups in a summed_area_table.
+ * - each row is covered by one span of weight 1 from its first to its last element that is exactly 1.0 (the hull,
+ *   the hole of a ring included). Then the runs of the rest that are exactly -1.0 (the hole) get spans of weight -1
+ * - consecutive rows with the same spans are merged into rectangles, a disk of radius r needs O(r) of them
+ * - the elements that are still not 0 (fractional weights on the rims) are kept as single cells
+ * - the center is the same as used by getFilling_unoptimized (columns / 2, rows / 2)
+ */
+class rect_mask
+{
+public:
+
+    rect_mask() { }
+
+    rect_mask(const aligned_matrix<float> & mask) :
+        m_width(mask.getNumCols()),
+        m_height(mask.getNumRows())
+    {
+        cint center_x = mask.getNumCols() / 2;
+        cint center_y = mask.getNumRows() / 2;
+
+        vector<float> residual(size_t(m_width) * m_height);
+
+        for (int j = 0; j < m_height; ++j)
+            for (int i = 0; i < m_width; ++i)
+                residual[j * m_width + i] = mask.getValue(i, j);
+
+        // the hull of each row with weight 1
+        vector<vector<mask_rect>> row_spans(m_height);
+
+        for (int j = 0; j < m_height; ++j)
+        {
+            float * const row = &residual[j * m_width];
+            int first = -1;
+            int last = -1;
+
+            for (int i = 0; i < m_width; ++i)
+            {
+                if (row[i] == 1)
+                {
+                    if (first < 0)
+                        first = i;
+
+                    last = i;
+                }
+            }
+
+            if (first >= 0)
+            {
+                row_spans[j].push_back(mask_rect{first - center_x, last + 1 - center_x, j - center_y, j + 1 - center_y, 1});
+
+                for (int i = first; i <= last; ++i)
+                    row[i] -= 1;
+            }
+        }
+
+        add_rects(row_spans);
+
+        // the holes inside the hulls with weight -1
+        for (int j = 0; j < m_height; ++j)
+        {
+            float * const row = &residual[j * m_width];
+            row_spans[j].clear();
+
+            for (int i = 0; i < m_width; ++i)
+            {
+                if (row[i] == -1)
+                {
+                    int end = i + 1;
+
+                    while (end < m_width && row[end] == -1)
+                        ++end;
+
+                    row_spans[j].push_back(mask_rect{i - center_x, end - center_x, j - center_y, j + 1 - center_y, -1});
+
+                    for (int k = i; k < end; ++k)
+                        row[k] = 0;
+
+                    i = end - 1;
+                }
+            }
+        }
+
+        add_rects(row_spans);
+
+        for (int j = 0; j < m_height; ++j)
+        {
+            for (int i = 0; i < m_width; ++i)
+            {
+                cfloat v = residual[j * m_width + i];
+
+                if (v != 0)
+                {
+                    m_rim.push_back(mask_rim_cell{i - center_x, j - center_y, v});
+                    m_reach = max(m_reach, max(abs(i - center_x), abs(j - center_y)));
+                }
+            }
+        }
+    }
+
+    const vector<mask_rect> & rects() const
+    {
+        return m_rects;
+    }
+
+    const vector<mask_rim_cell> & rim() const
+    {
+        return m_rim;
+    }
+
+    /**
+     * @brief Returns how many cells the rectangles (including their ends) and the rim reach from the center in any direction
+     */
+    int getReach() const
+    {
+        return m_reach;
+    }
+
+private:
+
+    int m_width = 0;
+    int m_height = 0;
+    int m_reach = 0;
+    vector<mask_rect> m_rects;
+    vector<mask_rim_cell> m_rim;
+
+    static bool same_spans(const vector<mask_rect> & a, const vector<mask_rect> & b)
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (size_t k = 0; k < a.size(); ++k)
+        {
+            if (a[k].x_begin != b[k].x_begin || a[k].x_end != b[k].x_end)
+                return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Merges the spans of consecutive rows with the same spans into rectangles
+     */
+    void add_rects(const vector<vector<mask_rect>> & row_spans)
+    {
+        int j = 0;
+
+        while (j < m_height)
+        {
+            int end = j + 1;
+
+            while (end < m_height && same_spans(row_spans[j], row_spans[end]))
+                ++end;
+
+            for (mask_rect rect : row_spans[j])
+            {
+                rect.y_end = rect.y_begin + (end - j);
+                m_rects.push_back(rect);
+                m_reach = max(m_reach, max(max(-rect.x_begin, rect.x_end), max(-rect.y_begin, rect.y_end)));
+            }
+
+            j = end;
+        }
+    }
+};
+
+/**
+ * @brief 2D summed-area table of a periodic space.
+ * - the table is extended by border cells on all sides (wrapped values), so rectangles never need to wrap
+ * - it covers only the columns of a part of the space (an MPI chunk) plus the border, the other columns are not read
+ * - stored in double and accumulated with compensated (Kahan) sums along the rows and the columns, so the rounding
+ *   error of an entry does not grow with its position. The entries reach width * height (67M for 8k x 8k), in float
+ *   the difference of two of them could not even tell a state from 0
+ */
+class summed_area_table
+{
+public:
+
+    summed_area_table() : m_width(0), m_height(0), m_border(0), m_x_begin(0), m_ld(0) { }
+
+    /**
+     * @brief Recalculates the table of the columns [x_start, x_start + w) of space. The rows and columns are shared by
+     * the threads of the enclosing parallel region (call with all of them), serial outside of one
+     * @param border how many cells a rectangle may reach over the edges of the columns and of space
+     */
+    void update(const aligned_matrix<float> & space, cint x_start, cint w, cint border)
+    {
+        cint rows = space.getNumRows() + 2 * border + 1;
+
+        #pragma omp single
+        {
+            m_width = space.getNumCols();
+            m_height = space.getNumRows();
+            m_border = border;
+            m_x_begin = w >= m_width ? -border : x_start - border;
+            m_ld = min(w, m_width) + 2 * border + 1;
+
+            if (m_sums.size() != size_t(m_ld) * rows)
+                m_sums.resize(size_t(m_ld) * rows);
+        }
+
+        // row prefix sums (entry t of table row r + 1 is the sum of the first t cells of the wrapped row r)
+        #pragma omp for schedule(static)
+        for (int r = 0; r < rows - 1; ++r)
+        {
+            const float * row = space.getRow_ptr(wrap_coordinate(r - m_border, m_height));
+            double * sums = &m_sums[size_t(r + 1) * m_ld];
+            double s = 0;
+            double c = 0;
+
+            sums[0] = 0;
+
+            for (int t = 0; t < m_ld - 1; ++t)
+            {
+                cint x = t + m_x_begin;
+                kahan_add(s, c, (x >= 0 && x < m_width) ? row[x] : row[wrap_coordinate(x, m_width)]);
+                sums[t + 1] = s - c;
+            }
+        }
+
+        // column sums of the row prefix sums. The running sums and their compensations of a strip stay in the cache
+        #pragma omp for schedule(static)
+        for (int strip = 0; strip < m_ld; strip += SUMMED_AREA_TABLE_STRIP)
+        {
+            cint n = min(SUMMED_AREA_TABLE_STRIP, m_ld - strip);
+            double s[SUMMED_AREA_TABLE_STRIP] = {};
+            double c[SUMMED_AREA_TABLE_STRIP] = {};
+
+            for (int i = 0; i < n; ++i)
+                m_sums[strip + i] = 0;
+
+            for (int r = 1; r < rows; ++r)
+            {
+                double * sums = &m_sums[size_t(r) * m_ld + strip];
+
+                for (int i = 0; i < n; ++i)
+                {
+                    kahan_add(s[i], c[i], sums[i]);
+                    sums[i] = s[i] - c[i];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the sum of the cells in columns [x_begin, x_end) and rows [y_begin, y_end) (not wrapped).
+     * x_start - border <= x_begin <= x_end <= x_start + w + border, -border <= y_begin <= y_end <= height + border
+     */
+    inline double rect_sum(cint x_begin, cint x_end, cint y_begin, cint y_end) const
+    {
+        assert(x_begin >= m_x_begin && x_end < m_x_begin + m_ld);
+        assert(y_begin >= -m_border && y_end <= m_height + m_border);
+
+        const double * top = getRow_ptr(y_begin);
+        const double * bottom = getRow_ptr(y_end);
+
+        return (bottom[x_end] - bottom[x_begin]) - (top[x_end] - top[x_begin]);
+    }
+
+    /**
+     * @brief Returns pointer to table row y (-border <= y <= height + border). Index x (x_start - border <= x <=
+     * x_start + w + border) is the sum of all cells above row y, left of column x and right of x_start - border
+     */
+    inline const double * getRow_ptr(cint y) const
+    {
+        return m_sums.data() + (ptrdiff_t(y + m_border) * m_ld - m_x_begin);
+    }
+
+private:
+
+    int m_width;
+    int m_height;
+    int m_border;
+    int m_x_begin; // the column of the first table column
+    int m_ld;
+    vector<double> m_sums;
+
+    /**
+     * @brief Adds v to the sum s with the running compensation c (Kahan). s - c is the compensated sum
+     */
+    static inline void kahan_add(double & s, double & c, cdouble v)
+    {
+        cdouble y = v - c;
+        cdouble t = s + y;
+        c = (t - s) - y;
+        s = t;
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <iostream>
+#include <math.h>
+#include <assert.h>
+#include "matrix.h"
+
+using namespace std;
+
+#define SYMMETRIC_FILLING_TOLERANCE 1.0e-6 //largest difference of mirrored mask cells that still counts as symmetric
+
+/**
+ * @brief Lower halves of a pair of masks that are symmetric in y, for the SYMMETRIC_Y filling engine (see
+ * symmetric_fused_filling_kernel). Only y is folded, the columns of the halves are the full columns of the masks
+ * - the masks are centered at row rows / 2 like in simulator_core::filling. set_circle centers the circles at the
+ *   corner of that row (mirror 1), masks centered at the middle of the row have mirror 0
+ * - row r of a half holds the mask row of offset r from the center row. The center row appears twice in the folded
+ *   sums if mirror is 0, its weights are halved
+ * - the halves keep the columns of the masks (and their shift, see aligned_matrix(columns, rows, offset)), so the
+ *   space is read aligned like by the fused kernels
+ */
+class symmetric_filling
+{
+public:
+
+    aligned_matrix<float> inner; // lower half of the inner mask
+    aligned_matrix<float> outer; // lower half of the outer mask, same geometry as inner
+    int mirror = 0; // the row at offset -r - mirror mirrors the row at offset r
+    bool symmetric = false; // false if the masks are not symmetric in y, the halves are empty then
+
+    /**
+     * @brief Folds mask_inner and mask_outer (one of the shifted masks each) to their lower halves
+     * @return if both masks are symmetric in y (about the same row)
+     */
+    bool initialize(const aligned_matrix<float> & mask_inner, const aligned_matrix<float> & mask_outer)
+    {
+        assert(mask_inner.getLd() == mask_outer.getLd() && mask_inner.getNumRows() == mask_outer.getNumRows());
+
+        cint center_y = mask_inner.getNumRows() / 2;
+
+        symmetric = false;
+        inner = aligned_matrix<float>();
+        outer = aligned_matrix<float>();
+
+        for (int m : {1, 0})
+        {
+            mirror = m;
+
+            if (is_symmetric(mask_inner, center_y) && is_symmetric(mask_outer, center_y))
+            {
+                symmetric = true;
+                break;
+            }
+        }
+
+        if (!symmetric)
+            return false;
+
+        // the center row and the rows below it up to the last one that is not 0 in any of the masks
+        int rows = 1;
+
+        for (int y = center_y; y < mask_inner.getNumRows(); ++y)
+        {
+            for (int x = 0; x < mask_inner.getLd(); ++x)
+            {
+                if (mask_inner.getValue(x, y) != 0 || mask_outer.getValue(x, y) != 0)
+                    rows = y - center_y + 1;
+            }
+        }
+
+        inner = aligned_matrix<float>(mask_inner.getLd(), rows, 0);
+        outer = aligned_matrix<float>(mask_outer.getLd(), rows, 0);
+
+        for (int r = 0; r < rows; ++r)
+        {
+            cfloat fold = mirror == 0 && r == 0 ? 0.5f : 1.0f;
+
+            for (int x = 0; x < mask_inner.getLd(); ++x)
+            {
+                inner.setValue(fold * mask_inner.getValue(x, center_y + r), x, r);
+                outer.setValue(fold * mask_outer.getValue(x, center_y + r), x, r);
+            }
+        }
+
+        return true;
+    }
+
+private:
+
+    bool is_symmetric(const aligned_matrix<float> & mask, cint center_y) const
+    {
+        for (int y = 0; y < mask.getNumRows(); ++y)
+        {
+            cint mirrored_y = 2 * center_y - mirror - y;
+
+            for (int x = 0; x < mask.getLd(); ++x)
+            {
+                cfloat mirrored = mirrored_y >= 0 && mirrored_y < mask.getNumRows() ? mask.getValue(x, mirrored_y) : 0;
+
+                if (fabs(mask.getValue(x, y) - mirrored) > SYMMETRIC_FILLING_TOLERANCE)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+};
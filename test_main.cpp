@@ -5,6 +5,9 @@
 #include "matrix.h"
 #include "matrix_buffer_queue.h"
 #include "simulator.h"
+#include "lockstep_validator.h"
+#include <functional>
+#include <thread>
 
 /*
  * TODO: use space copy constructor
@@ -38,7 +41,7 @@ SCENARIO("The area of all offset masks should be the same", "[masks]") {
     {
         ruleset rules = ruleset_smooth_life_l(400, 400);
 
-        simulator sim = simulator(rules);
+        simulator sim(rules);
         sim.m_optimize = false;
         sim.initialize(); // initializes masks as well
         
@@ -85,6 +88,41 @@ SCENARIO("Test pointer and wrapper correctness of matrix class", "[matrix][cache
     }
 }
 
+SCENARIO("Test ghost cells of matrix with halo", "[matrix][halo]")
+{
+    GIVEN("a 37x23 matrix with a halo of 5 columns and 4 rows and distinct values")
+    {
+        aligned_matrix<float> matrix = aligned_matrix<float>(37, 23, 5, 4);
+
+        for (int row = 0; row < matrix.getNumRows(); ++row)
+            for (int col = 0; col < matrix.getNumCols(); ++col)
+                matrix.setValue(col + 100 * row, col, row);
+
+        THEN("element (0,0) is aligned and the halo is rounded up to a cache line")
+        {
+            REQUIRE(long(matrix.getValues()) % ALIGNMENT == 0);
+            REQUIRE(matrix.getHaloColumns() == CACHELINE_FLOATS);
+            REQUIRE(matrix.getHaloRows() == 4);
+        }
+
+        WHEN("the halo is updated")
+        {
+            matrix.update_halo();
+
+            THEN("the ghost cells contain the wrapped values")
+            {
+                for (int row = -matrix.getHaloRows(); row < matrix.getNumRows() + matrix.getHaloRows(); ++row)
+                {
+                    for (int col = -matrix.getHaloColumns(); col < matrix.getNumCols() + matrix.getHaloColumns(); ++col)
+                    {
+                        REQUIRE(matrix.getValue(col, row) == matrix.getValueWrapped(col, row));
+                    }
+                }
+            }
+        }
+    }
+}
+
 /* test by ruman */
 SCENARIO("Test correct behaviour of matrix_buffer_queue", "[matrix][queue]")
 {
@@ -162,6 +200,50 @@ SCENARIO("Test correct behaviour of matrix_buffer_queue", "[matrix][queue]")
     }
 }
 
+SCENARIO("Test matrix_buffer_queue with 16 bit snapshots", "[matrix][queue][storage]")
+{
+    for (storage_precision precision : {storage_precision::FP16, storage_precision::BF16})
+    {
+        GIVEN("a 100x100 matrix buffer queue with 4 " + storage_precision_name(precision) + " snapshots")
+        {
+            matrix_buffer_queue<float> queue(4, aligned_matrix<float>(100, 100), precision);
+
+            WHEN("Pushing 4 matrices composed only of 0, 0.1, 0.2, 0.3")
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    for (int y = 0; y < queue.buffer_read_ptr()->getNumRows(); ++y)
+                        for (int x = 0; x < queue.buffer_read_ptr()->getNumCols(); ++x)
+                            queue.buffer_read_ptr()->setValue(0.1f * i, x, y);
+
+                    REQUIRE(queue.push());
+                }
+
+                THEN("the queue is full")
+                {
+                    REQUIRE(queue.size() == 4);
+                    REQUIRE_FALSE(queue.push());
+                }
+
+                THEN("the matrices are popped in order, rounded to the storage precision")
+                {
+                    aligned_matrix<float> popped = aligned_matrix<float>(100, 100);
+                    vector<float> raw(100 * 100);
+
+                    REQUIRE(queue.pop(popped));
+                    REQUIRE(popped.getValue(99, 99) == 0);
+                    REQUIRE(queue.pop(raw.data()));
+                    REQUIRE(raw[100 * 100 - 1] == storage_round(0.1f, precision));
+                    REQUIRE(queue.pop(popped));
+                    REQUIRE(popped.getValue(17, 3) == storage_round(0.2f, precision));
+                    REQUIRE(queue.pop());
+                    REQUIRE_FALSE(queue.pop());
+                }
+            }
+        }
+    }
+}
+
 /* test by ruman */
 SCENARIO("Test optimized simulation: Initialize at center", "[simulator]")
 {
@@ -183,11 +265,11 @@ SCENARIO("Test optimized simulation: Initialize at center", "[simulator]")
         {
             ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
 
-            simulator unoptimized_simulator = simulator(rules);
+            simulator unoptimized_simulator(rules);
             unoptimized_simulator.m_optimize = false;
             unoptimized_simulator.initialize(space);
 
-            simulator optimized_simulator = simulator(rules);
+            simulator optimized_simulator(rules);
             optimized_simulator.m_optimize = true;
             optimized_simulator.initialize(*(new aligned_matrix<float>(space)));
 
@@ -242,11 +324,11 @@ SCENARIO("Test optimized simulation: Initialize at left/right border with short
         {
             ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
 
-            simulator unoptimized_simulator = simulator(rules);
+            simulator unoptimized_simulator(rules);
             unoptimized_simulator.m_optimize = false;
             unoptimized_simulator.initialize(space);
 
-            simulator optimized_simulator = simulator(rules);
+            simulator optimized_simulator(rules);
             optimized_simulator.m_optimize = true;
             optimized_simulator.initialize(*(new aligned_matrix<float>(space))); // matrix copy constructor!
 
@@ -299,11 +381,11 @@ SCENARIO("Test optimized simulation: Initialize at top/bottom border with short
         {
             ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
 
-            simulator unoptimized_simulator = simulator(rules);
+            simulator unoptimized_simulator(rules);
             unoptimized_simulator.m_optimize = false;
             unoptimized_simulator.initialize(space);
 
-            simulator optimized_simulator = simulator(rules);
+            simulator optimized_simulator(rules);
             optimized_simulator.m_optimize = true;
             optimized_simulator.initialize(*(new aligned_matrix<float>(space)));
 
@@ -356,11 +438,11 @@ SCENARIO("Test optimized simulation: Initialize at left/right border with long t
         {
             ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
 
-            simulator unoptimized_simulator = simulator(rules);
+            simulator unoptimized_simulator(rules);
             unoptimized_simulator.m_optimize = false;
             unoptimized_simulator.initialize(space);
 
-            simulator optimized_simulator = simulator(rules);
+            simulator optimized_simulator(rules);
             optimized_simulator.m_optimize = true;
             optimized_simulator.initialize(*(new aligned_matrix<float>(space)));
 
@@ -395,4 +477,2064 @@ SCENARIO("Test optimized simulation: Initialize at left/right border with long t
             }
         }
     }
-}
\ No newline at end of file
+}
+/**
+ * Fills a space with state '1' in a block crossing the left/right and the top/bottom border
+ */
+inline aligned_matrix<float> create_border_block_space(cint w, cint h)
+{
+    aligned_matrix<float> space = aligned_matrix<float>(w, h);
+
+    for (int column = -w / 4; column < w / 4; ++column)
+    {
+        for (int row = -h / 4; row < h / 8; ++row)
+        {
+            space.setValueWrapped(1, column, row);
+        }
+    }
+
+    return space;
+}
+
+/**
+ * Fills a space with random states (the same ones in every test)
+ */
+inline aligned_matrix<float> create_random_space(cint w, cint h)
+{
+    default_random_engine re(42);
+    uniform_real_distribution<float> random_state(0, 1);
+    aligned_matrix<float> space = aligned_matrix<float>(w, h);
+
+    for (int y = 0; y < space.getNumRows(); ++y)
+        for (int x = 0; x < space.getNumCols(); ++x)
+            space.setValue(random_state(re), x, y);
+
+    return space;
+}
+
+/**
+ * Simulates space with the unoptimized reference simulator and a simulator set up by configure.
+ * Requires both to calculate the same state after the first step (within first_step_deviation) and after every
+ * following step (within deviation). The first step only differs by the rounding of the fillings, the steep sigmoids
+ * of the transfer function amplify that difference in the following steps until it saturates (at about 4e-5 with
+ * float fillings and ruleset_smooth_life_l)
+ */
+inline void require_same_as_unoptimized(const ruleset & rules, aligned_matrix<float> & space, std::function<void(simulator &)> configure, cint steps, cfloat first_step_deviation, cfloat deviation)
+{
+    simulator unoptimized_simulator(rules);
+    unoptimized_simulator.m_optimize = false;
+    unoptimized_simulator.initialize(*(new aligned_matrix<float>(space)));
+
+    simulator tested_simulator(rules);
+    configure(tested_simulator);
+    tested_simulator.initialize(*(new aligned_matrix<float>(space)));
+
+    for (int steps_done = 0; steps_done < steps; ++steps_done)
+    {
+        // simulate_step writes into the next space, swap to compare (and continue with) the new states
+        unoptimized_simulator.simulate_step();
+        unoptimized_simulator.m_space->swap();
+        tested_simulator.simulate_step();
+        tested_simulator.m_space->swap();
+
+        aligned_matrix<float> space_unoptimized = unoptimized_simulator.get_current_space();
+        aligned_matrix<float> space_tested = tested_simulator.get_current_space();
+
+        float max_deviation = 0;
+
+        for (int column = 0; column < space.getNumCols(); ++column)
+            for (int row = 0; row < space.getNumRows(); ++row)
+                max_deviation = fmaxf(max_deviation, fabsf(space_unoptimized.getValue(column, row) - space_tested.getValue(column, row)));
+
+        INFO("step " << steps_done + 1 << " max. deviation " << max_deviation);
+        REQUIRE(max_deviation < (steps_done == 0 ? first_step_deviation : deviation));
+    }
+}
+
+/**
+ * require_same_as_unoptimized with ruleset_smooth_life_l
+ */
+inline void require_same_as_unoptimized(aligned_matrix<float> & space, std::function<void(simulator &)> configure, cint steps, cfloat first_step_deviation, cfloat deviation)
+{
+    require_same_as_unoptimized(ruleset_smooth_life_l(space.getNumCols(), space.getNumRows()), space, configure, steps, first_step_deviation, deviation);
+}
+
+/**
+ * The spaces every filling engine is compared on with the unoptimized simulator: the 120x96 border block with
+ * ruleset_smooth_life_l (outer radius 21), a random 120x96 space with an outer radius of 6 and a random 40x48 space
+ * that is narrower than the masks of ruleset_smooth_life_l, so the engines take their wrapped paths everywhere
+ */
+inline void require_engine_same_as_unoptimized(std::function<void(simulator &)> configure, cint steps, cfloat first_step_deviation, cfloat deviation)
+{
+    GIVEN("a 120x96 state space with state '1' at the borders and the ruleset smooth life l")
+    {
+        aligned_matrix<float> space = create_border_block_space(120, 96);
+
+        THEN("the same states are calculated")
+        {
+            require_same_as_unoptimized(space, configure, steps, first_step_deviation, deviation);
+        }
+    }
+
+    GIVEN("a random 120x96 state space and the ruleset smooth life l with outer radius 6")
+    {
+        aligned_matrix<float> space = create_random_space(120, 96);
+
+        THEN("the same states are calculated")
+        {
+            require_same_as_unoptimized(ruleset(120, 96, 6, 3, 0.257, 0.336, 0.365, 0.549, 0.147, 0.028, 0.1, false), space, configure, steps, first_step_deviation, deviation);
+        }
+    }
+
+    GIVEN("a random 40x48 state space narrower than the masks of the ruleset smooth life l")
+    {
+        aligned_matrix<float> space = create_random_space(40, 48);
+
+        THEN("the same states are calculated")
+        {
+            require_same_as_unoptimized(space, configure, steps, first_step_deviation, deviation);
+        }
+    }
+}
+
+SCENARIO("Test FFT filling engine against unoptimized simulation", "[simulator][fft]")
+{
+    require_engine_same_as_unoptimized([](simulator & s)
+    {
+        s.m_filling_engine = filling_engine::FFT;
+    }, 5, 0.5e-5, 5.0e-5);
+}
+
+SCENARIO("Test separable approximation of the masks", "[separable]")
+{
+    GIVEN("the masks of ruleset_smooth_life_l and a random 120x96 space")
+    {
+        ruleset rules = ruleset_smooth_life_l(120, 96);
+        simulator_core<float> core = simulator_core<float>(rules);
+        aligned_matrix<float> mask_inner = simulator_core<float>::inner_mask(rules, 0);
+        aligned_matrix<float> mask_outer = simulator_core<float>::outer_mask(rules, 0);
+
+        aligned_matrix<float> space = create_random_space(120, 96);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            THEN("the fillings with " + simd_level_name(simd_level(level)) + " kernels are within the error bound of the tolerance and looser tolerances need less terms")
+            {
+                int previous_rank = mask_outer.getNumCols() + 1;
+
+                for (double tolerance : {1.0e-6, 1.0e-3, 1.0e-2})
+                {
+                    separable_filling inner;
+                    separable_filling outer;
+                    inner.set_mask(mask_inner, mask_inner.sum(), tolerance);
+                    outer.set_mask(mask_outer, mask_outer.sum(), tolerance);
+
+                    REQUIRE(inner.error_bound() <= tolerance);
+                    REQUIRE(outer.error_bound() <= tolerance);
+                    REQUIRE(outer.rank() <= previous_rank);
+                    previous_rank = outer.rank();
+
+                    aligned_matrix<float> filling_inner = aligned_matrix<float>(space.getNumCols(), space.getNumRows());
+                    aligned_matrix<float> filling_outer = aligned_matrix<float>(space.getNumCols(), space.getNumRows());
+                    inner.convolve(space, filling_inner, line_filter_kernel_for(simd_level(level)));
+                    outer.convolve(space, filling_outer, line_filter_kernel_for(simd_level(level)));
+
+                    double error = 0;
+
+                    for (int y = 0; y < space.getNumRows(); ++y)
+                    {
+                        for (int x = 0; x < space.getNumCols(); ++x)
+                        {
+                            error = fmax(error, fabs(filling_inner.getValue(x, y) - core.filling(space, x, y, mask_inner, mask_inner.sum())));
+                            error = fmax(error, fabs(filling_outer.getValue(x, y) - core.filling(space, x, y, mask_outer, mask_outer.sum())));
+                        }
+                    }
+
+                    cout << "Separable masks of rank " << inner.rank() << " and " << outer.rank() << " | tolerance " << tolerance << " max. error " << error << endl;
+
+                    // float rounding of the passes on top of the bound
+                    REQUIRE(error <= tolerance + 1.0e-5);
+                }
+
+                REQUIRE(previous_rank < mask_outer.getNumCols() / 2);
+            }
+        }
+    }
+}
+
+SCENARIO("Test separable filling engine against unoptimized simulation", "[simulator][separable]")
+{
+    // with all terms of the masks
+    require_engine_same_as_unoptimized([](simulator & s)
+    {
+        s.m_filling_engine = filling_engine::SEPARABLE;
+        s.m_separable_tolerance = 0;
+    }, 3, 1.5e-5, 5.0e-5);
+}
+
+SCENARIO("Test prefix sum filling engine against unoptimized simulation", "[simulator][prefix_sum]")
+{
+    require_engine_same_as_unoptimized([](simulator & s)
+    {
+        s.m_filling_engine = filling_engine::PREFIX_SUM;
+    }, 5, 0.5e-5, 5.0e-5);
+}
+
+SCENARIO("Test rectangle decomposition of the masks with a summed-area table", "[sat]")
+{
+    GIVEN("the masks of ruleset_smooth_life_l and a random 120x96 space")
+    {
+        ruleset rules = ruleset_smooth_life_l(120, 96);
+        simulator_core<float> core = simulator_core<float>(rules);
+        aligned_matrix<float> mask_inner = simulator_core<float>::inner_mask(rules, 0);
+        aligned_matrix<float> mask_outer = simulator_core<float>::outer_mask(rules, 0);
+
+        aligned_matrix<float> space = create_random_space(120, 96);
+
+        rect_mask inner = rect_mask(mask_inner);
+        rect_mask outer = rect_mask(mask_outer);
+
+        THEN("the disks need less rectangles than rows and the rim is a small part of the masks")
+        {
+            REQUIRE(inner.rects().size() < size_t(mask_inner.getNumRows()));
+            REQUIRE(outer.rects().size() < size_t(mask_outer.getNumRows()));
+            REQUIRE(outer.rim().size() < size_t(mask_outer.getNumRows() * mask_outer.getNumCols()) / 4);
+        }
+
+        THEN("the rectangles plus the rim give the fillings of the masks")
+        {
+            summed_area_table table;
+            table.update(space, 0, space.getNumCols(), max(inner.getReach(), outer.getReach()));
+
+            double error = 0;
+
+            for (int y = 0; y < space.getNumRows(); ++y)
+            {
+                for (int x = 0; x < space.getNumCols(); ++x)
+                {
+                    for (int k = 0; k < 2; ++k)
+                    {
+                        const rect_mask & mask = k == 0 ? inner : outer;
+                        const aligned_matrix<float> & matrix = k == 0 ? mask_inner : mask_outer;
+                        double f = 0;
+
+                        for (const mask_rect & rect : mask.rects())
+                            f += rect.weight * table.rect_sum(x + rect.x_begin, x + rect.x_end, y + rect.y_begin, y + rect.y_end);
+
+                        for (const mask_rim_cell & cell : mask.rim())
+                            f += cell.weight * space.getValueWrapped(x + cell.dx, y + cell.dy);
+
+                        error = fmax(error, fabs(f / matrix.sum() - core.filling(space, x, y, matrix, matrix.sum())));
+                    }
+                }
+            }
+
+            REQUIRE(error <= 1.0e-5);
+        }
+
+        THEN("a table of a chunk at the right edge gives the same rectangle sums as the table of the whole space")
+        {
+            cint reach = max(inner.getReach(), outer.getReach());
+            summed_area_table whole;
+            summed_area_table chunk;
+            whole.update(space, 0, space.getNumCols(), reach);
+            chunk.update(space, 80, 40, reach);
+
+            for (int y = 0; y < space.getNumRows(); ++y)
+            {
+                for (int x = 80; x < 120; ++x)
+                {
+                    for (const mask_rect & rect : outer.rects())
+                    {
+                        REQUIRE(isApprox(chunk.rect_sum(x + rect.x_begin, x + rect.x_end, y + rect.y_begin, y + rect.y_end),
+                                         whole.rect_sum(x + rect.x_begin, x + rect.x_end, y + rect.y_begin, y + rect.y_end), 1.0e-9));
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("a random 4096x2048 space with states in [0.5, 1]")
+    {
+        // The table entries reach 6M. A float table could not even resolve single states there
+        default_random_engine re(42);
+        uniform_real_distribution<float> random_state(0.5, 1);
+        aligned_matrix<float> space = aligned_matrix<float>(4096, 2048);
+
+        for (int y = 0; y < space.getNumRows(); ++y)
+            for (int x = 0; x < space.getNumCols(); ++x)
+                space.setValue(random_state(re), x, y);
+
+        summed_area_table table;
+        table.update(space, 0, space.getNumCols(), 22);
+
+        THEN("the sums of small rectangles far from the origin are exact to single precision")
+        {
+            double error = 0;
+
+            for (int y = space.getNumRows() - 64; y < space.getNumRows(); y += 7)
+            {
+                for (int x = space.getNumCols() - 64; x < space.getNumCols(); x += 5)
+                {
+                    double sum = 0;
+
+                    for (int j = y - 21; j < y + 22; ++j)
+                        for (int i = x - 3; i < x + 4; ++i)
+                            sum += space.getValueWrapped(i, j);
+
+                    error = fmax(error, fabs(table.rect_sum(x - 3, x + 4, y - 21, y + 22) - sum));
+                }
+            }
+
+            REQUIRE(error <= 1.0e-6);
+        }
+    }
+}
+
+SCENARIO("Test summed-area table filling engine against unoptimized simulation", "[simulator][sat]")
+{
+    require_engine_same_as_unoptimized([](simulator & s)
+    {
+        s.m_filling_engine = filling_engine::SAT;
+    }, 5, 0.5e-5, 5.0e-5);
+}
+
+SCENARIO("Test sliding window filling engine against unoptimized simulation", "[simulator][sliding_window]")
+{
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+
+        THEN("the sliding window engine calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_filling_engine = filling_engine::SLIDING_WINDOW;
+            }, 5, 0.5e-5, 5.0e-5);
+        }
+    }
+}
+
+SCENARIO("Test tiled simulation against unoptimized simulation", "[simulator][tiling]")
+{
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+
+        THEN("the tiled traversal calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_tile_width = 40;
+                s.m_tile_height = 36;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+
+        THEN("the tiled traversal with sliding window engine calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_filling_engine = filling_engine::SLIDING_WINDOW;
+                s.m_tile_width = 40;
+                s.m_tile_height = 36;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+    }
+}
+
+SCENARIO("Test hand-written SIMD filling kernels", "[simd]")
+{
+    GIVEN("a space block and a mask block with unaligned start and odd sizes")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        aligned_matrix<float> mask = aligned_matrix<float>(100, 50);
+        mask.set_circle(20, 1, 1, 0);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            filling_kernel kernel = filling_kernel_for(simd_level(level));
+
+            THEN("the " + simd_level_name(simd_level(level)) + " kernel calculates the same dot products as the portable kernel")
+            {
+                for (int n = 0; n < 100; n += 7)
+                {
+                    for (int rows = 1; rows < 50; rows += 5)
+                    {
+                        cfloat expected = filling_kernel_portable(space.getValue_ptr(3, 11), space.getLd(), mask.getValue_ptr(1, 0), mask.getLd(), rows, n);
+                        cfloat calculated = kernel(space.getValue_ptr(3, 11), space.getLd(), mask.getValue_ptr(1, 0), mask.getLd(), rows, n);
+
+                        REQUIRE(isApprox(expected, calculated, 1.0e-3));
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            THEN("the optimized simulation with " + simd_level_name(simd_level(level)) + " kernels calculates the same states")
+            {
+                require_same_as_unoptimized(space, [level](simulator & s)
+                {
+                    s.m_simd_level = simd_level(level);
+                }, 3, 0.5e-5, 5.0e-5);
+            }
+        }
+    }
+}
+
+SCENARIO("Test symmetric filling kernels against the fused kernels", "[symmetric][simd]")
+{
+    GIVEN("the shifted masks of ruleset_smooth_life_l, masks centered at the middle of a row and a random 120x96 space")
+    {
+        ruleset rules = ruleset_smooth_life_l(120, 96);
+
+        // set_circle centers the masks of the rulesets at the corner of the center row, odd masks at its middle
+        aligned_matrix<float> odd_inner = aligned_matrix<float>(29, 29, 0);
+        aligned_matrix<float> odd_outer = aligned_matrix<float>(29, 29, 0);
+        odd_inner.set_circle(14.5, 14.5, 4.5, 1, 1, 0);
+        odd_outer.set_circle(14.5, 14.5, 13, 1, 1, 0);
+        odd_outer.set_circle(14.5, 14.5, 4.5, 0, 1, 0);
+
+        vector<pair<aligned_matrix<float>, aligned_matrix<float>>> masks = {{odd_inner, odd_outer}};
+
+        for (int o = 0; o < CACHELINE_FLOATS; ++o)
+            masks.push_back({simulator_core<float>::inner_mask(rules, o), simulator_core<float>::outer_mask(rules, o)});
+
+        aligned_matrix<float> space = create_random_space(120, 96);
+
+        THEN("masks that are not symmetric in y are detected")
+        {
+            aligned_matrix<float> asymmetric = simulator_core<float>::outer_mask(rules, 0);
+            asymmetric.setValue(0.5f, asymmetric.getNumCols() / 2, 1);
+            symmetric_filling halves;
+
+            REQUIRE(!halves.initialize(asymmetric, asymmetric));
+        }
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            THEN("the " + simd_level_name(simd_level(level)) + " kernel calculates the same fillings as the fused kernel with the whole masks")
+            {
+                const symmetric_fused_filling_kernel kernel = symmetric_fused_filling_kernel_for(simd_level(level));
+                const fused_filling_kernel fused = fused_filling_kernel_for(simd_level(level));
+
+                for (int k = 0; k < int(masks.size()); ++k)
+                {
+                    const aligned_matrix<float> & mask_inner = masks[k].first;
+                    const aligned_matrix<float> & mask_outer = masks[k].second;
+                    cint rows = mask_inner.getNumRows();
+                    cint ld = mask_inner.getLd();
+                    symmetric_filling halves;
+
+                    REQUIRE(halves.initialize(mask_inner, mask_outer));
+                    REQUIRE(halves.mirror == (k == 0 ? 0 : 1));
+                    REQUIRE(halves.inner.getNumRows() <= rows / 2 + 1);
+
+                    double error = 0;
+
+                    // the blocks of the cells start at column x, the center rows at y
+                    for (int y = rows / 2; y + rows / 2 < space.getNumRows(); ++y)
+                    {
+                        for (int x = 0; x + ld <= space.getNumCols(); ++x)
+                        {
+                            float f_inner = 0;
+                            float f_outer = 0;
+                            float g_inner = 0;
+                            float g_outer = 0;
+                            kernel(space.getValues() + y * space.getLd() + x, space.getLd(), halves.mirror,
+                                   halves.inner.getValues(), halves.outer.getValues(), halves.inner.getLd(), halves.inner.getNumRows(), ld, f_inner, f_outer);
+                            fused(space.getValues() + (y - rows / 2) * space.getLd() + x, space.getLd(),
+                                  mask_inner.getValues(), mask_outer.getValues(), ld, rows, ld, g_inner, g_outer);
+
+                            error = fmax(error, fabs(f_inner - g_inner) / mask_inner.sum());
+                            error = fmax(error, fabs(f_outer - g_outer) / mask_outer.sum());
+                        }
+                    }
+
+                    REQUIRE(error <= 1.0e-6);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Test kernels specialized for the predefined rulesets", "[simd][specialized]")
+{
+    GIVEN("a space and the masks of the predefined rulesets for all offsets")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        // some fractional values
+        for (int y = 0; y < space.getNumRows(); ++y)
+            for (int x = 0; x < space.getNumCols(); ++x)
+                space.setValue(space.getValue(x, y) * ((x * 7 + y * 13) % 31) / 31.0f, x, y);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            THEN("the fixed " + simd_level_name(simd_level(level)) + " kernels calculate the same dot products as the generic kernels")
+            {
+                for (int o = 0; o < CACHELINE_FLOATS; ++o)
+                {
+                    aligned_matrix<float> mask_inner = simulator_core<float>::inner_mask(rules, o);
+                    aligned_matrix<float> mask_outer = simulator_core<float>::outer_mask(rules, o);
+                    cint rows = mask_inner.getNumRows();
+                    cint columns = mask_inner.getLd();
+
+                    filling_kernel kernel = fixed_filling_kernel_for(simd_level(level), rows, columns);
+                    fused_filling_kernel fused_kernel = fixed_fused_filling_kernel_for(simd_level(level), rows, columns);
+
+                    REQUIRE(kernel != nullptr);
+                    REQUIRE(fused_kernel != nullptr);
+
+                    cfloat expected_inner = filling_kernel_portable(space.getValue_ptr(16, 11), space.getLd(), mask_inner.getValues(), columns, rows, columns);
+                    cfloat expected_outer = filling_kernel_portable(space.getValue_ptr(16, 11), space.getLd(), mask_outer.getValues(), columns, rows, columns);
+                    float fused_inner = 0;
+                    float fused_outer = 0;
+                    fused_kernel(space.getValue_ptr(16, 11), space.getLd(), mask_inner.getValues(), mask_outer.getValues(), columns, rows, columns, fused_inner, fused_outer);
+
+                    REQUIRE(isApprox(expected_inner, kernel(space.getValue_ptr(16, 11), space.getLd(), mask_inner.getValues(), columns, rows, columns), 1.0e-3));
+                    REQUIRE(isApprox(expected_inner, fused_inner, 1.0e-3));
+                    REQUIRE(isApprox(expected_outer, fused_outer, 1.0e-3));
+                }
+
+                REQUIRE(fixed_filling_kernel_for(simd_level(level), 40, 48) == nullptr);
+                REQUIRE(fixed_fused_filling_kernel_for(simd_level(level), 44, 80) == nullptr);
+            }
+        }
+    }
+
+    GIVEN("the predefined rulesets and a custom ruleset")
+    {
+        ruleset custom = ruleset_smooth_life_l(64, 64);
+        custom.set_birth_min(0.26);
+
+        THEN("only the predefined rulesets use the specialized transfer function")
+        {
+            REQUIRE(transfer_function(ruleset_smooth_life_l(64, 64)).isSpecialized());
+            REQUIRE(transfer_function(ruleset_rafler_paper(64, 64)).isSpecialized());
+            REQUIRE_FALSE(transfer_function(custom).isSpecialized());
+        }
+
+        THEN("the specialized transfer function calculates the same states as the generic one")
+        {
+            cint count = 257;
+            vector<float> outer(count), inner(count), state(count), next_specialized(count), next_generic(count);
+
+            for (ruleset rules : {ruleset(ruleset_smooth_life_l(64, 64)), ruleset(ruleset_rafler_paper(64, 64))})
+            {
+                transfer_function specialized = transfer_function(rules);
+                transfer_function generic = transfer_function(rules);
+                generic.disable_specialization();
+
+                for (int j = 0; j < count; j += 8)
+                {
+                    for (int i = 0; i < count; ++i)
+                    {
+                        outer[i] = i / double(count - 1);
+                        inner[i] = j / double(count - 1);
+                        state[i] = (i * 7 + j * 3) % count / double(count - 1);
+                    }
+
+                    specialized.apply(outer.data(), inner.data(), state.data(), next_specialized.data(), count);
+                    generic.apply(outer.data(), inner.data(), state.data(), next_generic.data(), count);
+
+                    for (int i = 0; i < count; ++i)
+                        REQUIRE(isApprox(next_specialized[i], next_generic[i], 1.0e-6));
+                }
+            }
+        }
+    }
+
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+
+        THEN("the fused engine without specialized kernels calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_filling_engine = filling_engine::FUSED;
+                s.m_specialize = false;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+    }
+}
+
+SCENARIO("Test fused filling engine against unoptimized simulation", "[simulator][fused]")
+{
+    GIVEN("a space block and two mask blocks with unaligned start and odd sizes")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        aligned_matrix<float> mask_inner = aligned_matrix<float>(100, 50);
+        aligned_matrix<float> mask_outer = aligned_matrix<float>(100, 50);
+        mask_inner.set_circle(10, 1, 1, 0);
+        mask_outer.set_circle(20, 1, 1, 0);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            fused_filling_kernel kernel = fused_filling_kernel_for(simd_level(level));
+
+            THEN("the fused " + simd_level_name(simd_level(level)) + " kernel calculates the same dot products as the single kernels")
+            {
+                for (int n = 0; n < 100; n += 7)
+                {
+                    for (int rows = 1; rows < 50; rows += 5)
+                    {
+                        cfloat expected_inner = filling_kernel_portable(space.getValue_ptr(3, 11), space.getLd(), mask_inner.getValue_ptr(1, 0), mask_inner.getLd(), rows, n);
+                        cfloat expected_outer = filling_kernel_portable(space.getValue_ptr(3, 11), space.getLd(), mask_outer.getValue_ptr(1, 0), mask_outer.getLd(), rows, n);
+                        float calculated_inner = 0;
+                        float calculated_outer = 0;
+                        kernel(space.getValue_ptr(3, 11), space.getLd(), mask_inner.getValue_ptr(1, 0), mask_outer.getValue_ptr(1, 0), mask_inner.getLd(), rows, n, calculated_inner, calculated_outer);
+
+                        REQUIRE(isApprox(expected_inner, calculated_inner, 1.0e-3));
+                        REQUIRE(isApprox(expected_outer, calculated_outer, 1.0e-3));
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("a 120x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(120, 96);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            THEN("the fused engine with " + simd_level_name(simd_level(level)) + " kernels calculates the same states")
+            {
+                require_same_as_unoptimized(space, [level](simulator & s)
+                {
+                    s.m_filling_engine = filling_engine::FUSED;
+                    s.m_simd_level = simd_level(level);
+                }, 3, 0.5e-5, 5.0e-5);
+            }
+        }
+    }
+}
+
+SCENARIO("Test blocked filling engine against unoptimized simulation", "[simulator][blocked]")
+{
+    GIVEN("a space block and two mask blocks with unaligned start and odd sizes")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        aligned_matrix<float> mask_inner = aligned_matrix<float>(100, 50);
+        aligned_matrix<float> mask_outer = aligned_matrix<float>(100, 50);
+        mask_inner.set_circle(10, 1, 1, 0);
+        mask_outer.set_circle(20, 1, 1, 0);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            blocked_fused_filling_kernel kernel = blocked_fused_filling_kernel_for(simd_level(level));
+
+            THEN("the blocked " + simd_level_name(simd_level(level)) + " kernel calculates the same dot products as the fused kernel per cell")
+            {
+                for (int n = 0; n < 100; n += 7)
+                {
+                    for (int rows = 1; rows < 50; rows += 5)
+                    {
+                        float calculated_inner[FILLING_BLOCK_CELLS];
+                        float calculated_outer[FILLING_BLOCK_CELLS];
+                        kernel(space.getValue_ptr(3, 11), space.getLd(), mask_inner.getValue_ptr(1, 0), mask_outer.getValue_ptr(1, 0), mask_inner.getLd(), rows, n, calculated_inner, calculated_outer);
+
+                        for (int cell = 0; cell < FILLING_BLOCK_CELLS; ++cell)
+                        {
+                            float expected_inner = 0;
+                            float expected_outer = 0;
+                            fused_filling_kernel_portable(space.getValue_ptr(3, 11 + cell), space.getLd(), mask_inner.getValue_ptr(1, 0), mask_outer.getValue_ptr(1, 0), mask_inner.getLd(), rows, n, expected_inner, expected_outer);
+
+                            REQUIRE(isApprox(expected_inner, calculated_inner[cell], 1.0e-3));
+                            REQUIRE(isApprox(expected_outer, calculated_outer[cell], 1.0e-3));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    require_engine_same_as_unoptimized([](simulator & s)
+    {
+        s.m_filling_engine = filling_engine::BLOCKED;
+    }, 3, 0.5e-5, 5.0e-5);
+
+    GIVEN("a 120x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(120, 96);
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            THEN("the blocked engine with " + simd_level_name(simd_level(level)) + " kernels calculates the same states")
+            {
+                require_same_as_unoptimized(space, [level](simulator & s)
+                {
+                    s.m_filling_engine = filling_engine::BLOCKED;
+                    s.m_simd_level = simd_level(level);
+                }, 3, 0.5e-5, 5.0e-5);
+            }
+        }
+
+        THEN("the blocked engine with compact masks and halo calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_compact_masks = true;
+                s.m_halo = true;
+                s.m_filling_engine = filling_engine::BLOCKED;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+    }
+}
+
+SCENARIO("Test y-symmetric filling engine against unoptimized simulation", "[simulator][symmetric]")
+{
+    require_engine_same_as_unoptimized([](simulator & s)
+    {
+        s.m_filling_engine = filling_engine::SYMMETRIC_Y;
+    }, 5, 0.5e-5, 5.0e-5);
+
+    GIVEN("the same 120x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(120, 96);
+
+        THEN("the y-symmetric engine with halo calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_filling_engine = filling_engine::SYMMETRIC_Y;
+                s.m_halo = true;
+            }, 5, 0.5e-5, 5.0e-5);
+        }
+    }
+}
+
+SCENARIO("Test halo-padded space against unoptimized simulation", "[simulator][halo]")
+{
+    GIVEN("a 120x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(120, 96);
+
+        THEN("the direct engine with halo calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_halo = true;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+
+        THEN("the fused engine with halo calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_halo = true;
+                s.m_filling_engine = filling_engine::FUSED;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+
+        THEN("the sliding window engine with halo calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_halo = true;
+                s.m_filling_engine = filling_engine::SLIDING_WINDOW;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+    }
+
+    GIVEN("a random 40x48 state space narrower than the halo")
+    {
+        aligned_matrix<float> space = create_random_space(40, 48);
+
+        THEN("the halo is turned off and the same states are calculated")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_halo = true;
+                s.m_filling_engine = filling_engine::FUSED;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+    }
+}
+
+SCENARIO("Test compact masks against unoptimized simulation", "[simulator][compact]")
+{
+    GIVEN("a 120x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(120, 96);
+
+        THEN("the direct engine with compact masks calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_compact_masks = true;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+
+        THEN("the fused engine with compact masks calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_compact_masks = true;
+                s.m_filling_engine = filling_engine::FUSED;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+
+        THEN("the fused engine with compact masks and halo calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_compact_masks = true;
+                s.m_halo = true;
+                s.m_filling_engine = filling_engine::FUSED;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+
+        THEN("the sliding window engine with compact masks calculates the same states")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_compact_masks = true;
+                s.m_filling_engine = filling_engine::SLIDING_WINDOW;
+            }, 3, 0.5e-5, 5.0e-5);
+        }
+    }
+}
+
+/**
+ * @brief The transfer function of the ruleset calculated in double precision, like discrete_state_func_1 and next_step_as_euler
+ */
+inline double reference_transfer_function(const ruleset & rules, cdouble n, cdouble m, cdouble state)
+{
+    auto sigma1 = [](cdouble x, cdouble a, cdouble alpha) { return 1.0 / (1.0 + exp(-(x - a) * 4.0 / alpha)); };
+    cdouble alive = sigma1(m, 0.5, rules.get_alpha_m());
+    cdouble birth = sigma1(n, rules.get_birth_min(), rules.get_alpha_n()) * (1.0 - sigma1(n, rules.get_birth_max(), rules.get_alpha_n()));
+    cdouble death = sigma1(n, rules.get_death_min(), rules.get_alpha_n()) * (1.0 - sigma1(n, rules.get_death_max(), rules.get_alpha_n()));
+    cdouble s = birth * (1.0 - alive) + death * alive;
+
+    return rules.get_is_discrete() ? s : fmax(0, fmin(1, state + rules.get_delta_time() * (2.0 * s - 1.0)));
+}
+
+SCENARIO("Test batched transfer function against double precision", "[transfer]")
+{
+    GIVEN("fillings and states covering [0,1]")
+    {
+        cint count = 257;
+        vector<float> outer(count), inner(count), state(count), next(count);
+
+        for (int fast = 0; fast <= 1; ++fast)
+        {
+            for (int discrete = 0; discrete <= 1; ++discrete)
+            {
+                ruleset rules = ruleset_smooth_life_l(64, 64);
+                rules.set_fast_sigmoid(fast == 1);
+                rules.set_is_discrete(discrete == 1);
+                transfer_function transfer = transfer_function(rules);
+
+                // bound of the state error caused by the relative error of the exp, see exp_vectorizable
+                cdouble bound = fast == 1 ? 5.0e-5 : 1.0e-6;
+
+                THEN(string(fast == 1 ? "the fast" : "the accurate") + " sigmoid stays within its error bound in " + (discrete == 1 ? "discrete" : "Euler") + " mode")
+                {
+                    double max_error = 0;
+
+                    for (int j = 0; j < count; ++j)
+                    {
+                        for (int i = 0; i < count; ++i)
+                        {
+                            outer[i] = i / double(count - 1);
+                            inner[i] = j / double(count - 1);
+                            state[i] = (i * 7 + j * 3) % count / double(count - 1);
+                        }
+
+                        transfer.apply(outer.data(), inner.data(), state.data(), next.data(), count);
+
+                        for (int i = 0; i < count; ++i)
+                            max_error = fmax(max_error, fabs(next[i] - reference_transfer_function(rules, outer[i], inner[i], state[i])));
+                    }
+
+                    cout << "Transfer function | max. error " << max_error << endl;
+                    REQUIRE(max_error < bound);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Test transition table against double precision", "[transfer][table]")
+{
+    GIVEN("the discrete transfer function of smooth life l")
+    {
+        ruleset rules = ruleset_smooth_life_l(64, 64);
+        rules.set_is_discrete(true);
+
+        transfer_function coarse = transfer_function(rules);
+        transfer_function fine = transfer_function(rules);
+        cdouble coarse_error = coarse.build_table(256);
+        cdouble fine_error = fine.build_table(1024);
+
+        cout << "Transition table | max. error 256x256: " << coarse_error << " 1024x1024: " << fine_error << endl;
+
+        THEN("the error of the bilinear interpolation decreases quadratically with the table size")
+        {
+            REQUIRE(fine_error < coarse_error / 8);
+        }
+
+        THEN("the interpolated states stay within the reported error")
+        {
+            cint count = 1001;
+            vector<float> outer(count), inner(count), state(count, 0), next(count);
+            double max_error = 0;
+
+            for (int j = 0; j < count; ++j)
+            {
+                for (int i = 0; i < count; ++i)
+                {
+                    outer[i] = i / double(count - 1);
+                    inner[i] = j / double(count - 1);
+                }
+
+                fine.apply(outer.data(), inner.data(), state.data(), next.data(), count);
+
+                for (int i = 0; i < count; ++i)
+                    max_error = fmax(max_error, fabs(next[i] - reference_transfer_function(rules, outer[i], inner[i], 0)));
+            }
+
+            REQUIRE(max_error <= 1.5 * fine_error);
+        }
+    }
+
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+
+        THEN("the simulation with a 1024x1024 transition table stays close to the unoptimized simulation")
+        {
+            require_same_as_unoptimized(space, [](simulator & s)
+            {
+                s.m_transition_table_size = 1024;
+            }, 3, 1.0e-4, 1.0e-3);
+        }
+    }
+}
+
+SCENARIO("Test FP16 and BF16 conversion", "[storage]")
+{
+    THEN("all half precision and bfloat16 values survive the round trip")
+    {
+        for (int h = 0; h < 65536; ++h)
+        {
+            // skip NaNs
+            if ((h & 0x7c00) != 0x7c00 || (h & 0x03ff) == 0)
+                REQUIRE(float_to_half(half_to_float(h)) == h);
+            if ((h & 0x7f80) != 0x7f80 || (h & 0x007f) == 0)
+                REQUIRE(float_to_bfloat16(bfloat16_to_float(h)) == h);
+        }
+    }
+
+    THEN("states in [0,1] are rounded to the nearest value")
+    {
+        double max_error_fp16 = 0;
+        double max_error_bf16 = 0;
+
+        for (int i = 0; i <= 1000000; ++i)
+        {
+            cfloat v = i / 1000000.0f;
+            max_error_fp16 = fmax(max_error_fp16, fabs(storage_round(v, storage_precision::FP16) - v) / fmax(v, 6.1e-5));
+            max_error_bf16 = fmax(max_error_bf16, fabs(storage_round(v, storage_precision::BF16) - v) / v);
+        }
+
+        // half an ulp: 2^-11 and 2^-8 relative (FP16 subnormals are absolute below 2^-14)
+        REQUIRE(max_error_fp16 <= 1.0 / 2048);
+        REQUIRE(max_error_bf16 <= 1.0 / 256);
+    }
+}
+
+SCENARIO("Test filling kernels for 16 bit spaces", "[storage][simd]")
+{
+    GIVEN("a space block stored in FP16 and BF16 and a mask block")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        aligned_matrix<float> mask_inner = aligned_matrix<float>(100, 50);
+        aligned_matrix<float> mask_outer = aligned_matrix<float>(100, 50);
+        mask_inner.set_circle(10, 1, 1, 0);
+        mask_outer.set_circle(20, 0.5, 1, 0);
+
+        // some fractional values
+        for (int y = 0; y < space.getNumRows(); ++y)
+            for (int x = 0; x < space.getNumCols(); ++x)
+                space.setValue(space.getValue(x, y) * ((x * 7 + y * 13) % 31) / 31.0f, x, y);
+
+        for (storage_precision precision : {storage_precision::FP16, storage_precision::BF16})
+        {
+            aligned_matrix<uint16_t> encoded = aligned_matrix<uint16_t>(space.getNumCols(), space.getNumRows());
+            aligned_matrix<float> decoded = aligned_matrix<float>(space.getNumCols(), space.getNumRows());
+
+            for (int y = 0; y < space.getNumRows(); ++y)
+            {
+                storage_encode(space.getRow_ptr(y), encoded.getRow_ptr(y), space.getNumCols(), precision);
+                storage_decode(encoded.getRow_ptr(y), decoded.getRow_ptr(y), space.getNumCols(), precision);
+            }
+
+            for (int level = 0; level <= int(simd_level_detect()); ++level)
+            {
+                half_filling_kernel kernel = half_filling_kernel_for(simd_level(level), precision);
+                half_fused_filling_kernel fused_kernel = half_fused_filling_kernel_for(simd_level(level), precision);
+
+                THEN("the " + storage_precision_name(precision) + " kernels for " + simd_level_name(simd_level(level)) + " calculate the same dot products as the float kernel on the decoded space")
+                {
+                    for (int n = 0; n < 100; n += 7)
+                    {
+                        for (int rows = 1; rows < 50; rows += 5)
+                        {
+                            cfloat expected_inner = filling_kernel_portable(decoded.getValue_ptr(3, 11), decoded.getLd(), mask_inner.getValue_ptr(1, 0), mask_inner.getLd(), rows, n);
+                            cfloat expected_outer = filling_kernel_portable(decoded.getValue_ptr(3, 11), decoded.getLd(), mask_outer.getValue_ptr(1, 0), mask_outer.getLd(), rows, n);
+                            float fused_inner = 0;
+                            float fused_outer = 0;
+                            fused_kernel(encoded.getValue_ptr(3, 11), encoded.getLd(), mask_inner.getValue_ptr(1, 0), mask_outer.getValue_ptr(1, 0), mask_inner.getLd(), rows, n, fused_inner, fused_outer);
+
+                            REQUIRE(isApprox(expected_inner, kernel(encoded.getValue_ptr(3, 11), encoded.getLd(), mask_inner.getValue_ptr(1, 0), mask_inner.getLd(), rows, n), 1.0e-3));
+                            REQUIRE(isApprox(expected_inner, fused_inner, 1.0e-3));
+                            REQUIRE(isApprox(expected_outer, fused_outer, 1.0e-3));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Test accuracy of 16 bit storage against FP32", "[simulator][storage]")
+{
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        for (storage_precision precision : {storage_precision::FP16, storage_precision::BF16})
+        {
+            for (filling_engine engine : {filling_engine::DIRECT, filling_engine::FUSED})
+            {
+                THEN("the " + filling_engine_name(engine) + " engine with " + storage_precision_name(precision) + " storage stays close to FP32")
+                {
+                    simulator reference(rules);
+                    reference.m_filling_engine = engine;
+                    reference.initialize(*(new aligned_matrix<float>(space)));
+
+                    simulator tested(rules);
+                    tested.m_filling_engine = engine;
+                    tested.m_storage_precision = precision;
+                    tested.initialize(*(new aligned_matrix<float>(space)));
+
+                    double max_error = 0;
+
+                    for (int step = 0; step < 5; ++step)
+                    {
+                        reference.simulate_step();
+                        reference.m_space->swap();
+                        tested.simulate_step();
+                        tested.m_space->swap();
+
+                        aligned_matrix<float> space_reference = reference.get_current_space();
+                        aligned_matrix<float> space_tested = tested.get_current_space();
+
+                        for (int row = 0; row < space.getNumRows(); ++row)
+                            for (int column = 0; column < space.getNumCols(); ++column)
+                                max_error = fmax(max_error, fabs(space_reference.getValue(column, row) - space_tested.getValue(column, row)));
+
+                        cout << "Storage " << storage_precision_name(precision) << " | step " << step + 1 << " max. error against FP32 " << max_error << endl;
+                    }
+
+                    REQUIRE(max_error < (precision == storage_precision::FP16 ? 5.0e-3 : 5.0e-2));
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Test filling kernels for fixed point spaces", "[fixed_point][simd]")
+{
+    GIVEN("random 8 and 16 bit space blocks and mask blocks with the largest allowed weights")
+    {
+        default_random_engine re(42);
+        uniform_int_distribution<int> random_state8(0, fixed_point_scale<uint8_t>::state_one);
+        uniform_int_distribution<int> random_state16(0, fixed_point_scale<uint16_t>::state_one);
+        uniform_int_distribution<int> random_weight8(-INT8_KERNEL_WEIGHT_MAX, INT8_KERNEL_WEIGHT_MAX);
+        uniform_int_distribution<int> random_weight16(-INT16_KERNEL_WEIGHT_MAX, INT16_KERNEL_WEIGHT_MAX);
+
+        aligned_matrix<uint8_t> space8 = aligned_matrix<uint8_t>(144, 120);
+        aligned_matrix<uint16_t> space16 = aligned_matrix<uint16_t>(144, 120);
+        aligned_matrix<int8_t> inner8 = aligned_matrix<int8_t>(100, 110);
+        aligned_matrix<int8_t> outer8 = aligned_matrix<int8_t>(100, 110);
+        aligned_matrix<int16_t> inner16 = aligned_matrix<int16_t>(100, 110);
+        aligned_matrix<int16_t> outer16 = aligned_matrix<int16_t>(100, 110);
+
+        for (int y = 0; y < space8.getNumRows(); ++y)
+        {
+            for (int x = 0; x < space8.getNumCols(); ++x)
+            {
+                // the first rows are saturated, so the int32 lanes of the 16 bit kernel have to be flushed
+                space8.setValue(y < 60 ? fixed_point_scale<uint8_t>::state_one : random_state8(re), x, y);
+                space16.setValue(y < 60 ? fixed_point_scale<uint16_t>::state_one : random_state16(re), x, y);
+            }
+        }
+
+        for (int y = 0; y < inner8.getNumRows(); ++y)
+        {
+            for (int x = 0; x < inner8.getNumCols(); ++x)
+            {
+                inner8.setValue(y < 50 ? INT8_KERNEL_WEIGHT_MAX : random_weight8(re), x, y);
+                outer8.setValue(random_weight8(re), x, y);
+                inner16.setValue(y < 50 ? INT16_KERNEL_WEIGHT_MAX : random_weight16(re), x, y);
+                outer16.setValue(random_weight16(re), x, y);
+            }
+        }
+
+        for (int level = 0; level <= int(simd_level_detect()); ++level)
+        {
+            THEN("the kernels for " + simd_level_name(simd_level(level)) + " calculate the exact integer dot products")
+            {
+                // 48 columns: the width of the specialized kernels
+                for (int n : {0, 7, 14, 21, 28, 35, 42, 48, 49, 56, 63, 70, 77, 84, 91, 98})
+                {
+                    // the specialized kernels are used where they exist, the others have to be the same
+                    int8_fused_filling_kernel kernel8 = int8_fixed_fused_filling_kernel_for(simd_level(level), n);
+                    int16_fused_filling_kernel kernel16 = int16_fixed_fused_filling_kernel_for(simd_level(level), n);
+
+                    if (kernel8 == nullptr)
+                        kernel8 = int8_fused_filling_kernel_for(simd_level(level));
+                    if (kernel16 == nullptr)
+                        kernel16 = int16_fused_filling_kernel_for(simd_level(level));
+
+                    for (int rows = 1; rows < 110; rows += 9)
+                    {
+                        int64_t expected8[2] = {0, 0};
+                        int64_t expected16[2] = {0, 0};
+
+                        for (int y = 0; y < rows; ++y)
+                        {
+                            for (int x = 0; x < n; ++x)
+                            {
+                                expected8[0] += int64_t(space8.getValue(3 + x, 5 + y)) * inner8.getValue(1 + x, y);
+                                expected8[1] += int64_t(space8.getValue(3 + x, 5 + y)) * outer8.getValue(1 + x, y);
+                                expected16[0] += int64_t(space16.getValue(3 + x, 5 + y)) * inner16.getValue(1 + x, y);
+                                expected16[1] += int64_t(space16.getValue(3 + x, 5 + y)) * outer16.getValue(1 + x, y);
+                            }
+                        }
+
+                        int64_t f8[2] = {0, 0};
+                        int64_t f16[2] = {0, 0};
+                        kernel8(space8.getValue_ptr(3, 5), space8.getLd(), inner8.getValue_ptr(1, 0), outer8.getValue_ptr(1, 0), inner8.getLd(), rows, n, f8[0], f8[1]);
+                        kernel16(space16.getValue_ptr(3, 5), space16.getLd(), inner16.getValue_ptr(1, 0), outer16.getValue_ptr(1, 0), inner16.getLd(), rows, n, f16[0], f16[1]);
+
+                        REQUIRE(f8[0] == expected8[0]);
+                        REQUIRE(f8[1] == expected8[1]);
+                        REQUIRE(f16[0] == expected16[0]);
+                        REQUIRE(f16[1] == expected16[1]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Test accuracy of the fixed point engine against FP32", "[simulator][fixed_point]")
+{
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        THEN("the 8 bit and 16 bit engines stay close to FP32, 16 bit is more accurate")
+        {
+            double max_errors[2] = {0, 0};
+
+            for (int halo = 0; halo <= 1; ++halo)
+            {
+                for (int bits : {8, 16})
+                {
+                    simulator reference(rules);
+                    reference.m_filling_engine = filling_engine::FUSED;
+                    reference.m_halo = halo == 1;
+                    reference.initialize(*(new aligned_matrix<float>(space)));
+
+                    simulator tested(rules);
+                    tested.m_filling_engine = filling_engine::FIXED_POINT;
+                    tested.m_fixed_point_bits = bits;
+                    tested.m_halo = halo == 1;
+                    tested.initialize(*(new aligned_matrix<float>(space)));
+
+                    double max_error = 0;
+
+                    for (int step = 0; step < 5; ++step)
+                    {
+                        reference.simulate_step();
+                        reference.m_space->swap();
+                        tested.simulate_step();
+                        tested.m_space->swap();
+
+                        aligned_matrix<float> space_reference = reference.get_current_space();
+                        aligned_matrix<float> space_tested = tested.get_current_space();
+
+                        for (int row = 0; row < space.getNumRows(); ++row)
+                            for (int column = 0; column < space.getNumCols(); ++column)
+                                max_error = fmax(max_error, fabs(space_reference.getValue(column, row) - space_tested.getValue(column, row)));
+
+                        cout << "Fixed point " << bits << " bit" << (halo == 1 ? " with halo" : "") << " | step " << step + 1 << " max. error against FP32 " << max_error << endl;
+                    }
+
+                    max_errors[bits == 8 ? 0 : 1] = fmax(max_errors[bits == 8 ? 0 : 1], max_error);
+                }
+            }
+
+            REQUIRE(max_errors[0] < 2.0e-2);
+            REQUIRE(max_errors[1] < 1.0e-3);
+            REQUIRE(max_errors[1] < max_errors[0]);
+        }
+    }
+}
+
+SCENARIO("Test lockstep validation against the double precision reference", "[simulator][lockstep]")
+{
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        WHEN("the float core is compared to the double core")
+        {
+            simulator_core<float> core_float = simulator_core<float>(rules);
+            simulator_core<double> core_double = simulator_core<double>(rules);
+
+            THEN("the state functions are the same up to float precision")
+            {
+                for (int i = 0; i <= 100; ++i)
+                    for (int j = 0; j <= 100; ++j)
+                        REQUIRE(isApprox(core_float.state_function(i / 100.0f, j / 100.0f), core_double.state_function(i / 100.0, j / 100.0), 1.0e-6));
+            }
+        }
+
+        for (bool fp16 : {false, true})
+        {
+            WHEN(string("the unoptimized simulator with ") + (fp16 ? "FP16" : "FP32") + " storage runs in lockstep with the reference")
+            {
+                simulator production(rules);
+                production.m_optimize = false;
+                production.m_storage_precision = fp16 ? storage_precision::FP16 : storage_precision::FP32;
+                production.initialize(*(new aligned_matrix<float>(space)));
+
+                lockstep_validator validator(production);
+                vector<divergence_report> reports = validator.run(5, cout);
+
+                THEN("a report is created for each step and the divergence is bounded by the precision")
+                {
+                    REQUIRE(reports.size() == 5);
+                    REQUIRE(reports.back().step == 5);
+                    REQUIRE(reports.back().max_error < (fp16 ? 5.0e-3 : 1.0e-4));
+                    REQUIRE(reports.back().mean_error <= reports.back().rms_error);
+                    REQUIRE(reports.back().rms_error <= reports.back().max_error);
+
+                    if (fp16)
+                        REQUIRE(reports.back().max_error > 1.0e-5);
+                }
+            }
+        }
+
+        WHEN("the fused engine with the fast exp runs in lockstep with the reference")
+        {
+            ruleset fast_rules = rules;
+            fast_rules.set_fast_sigmoid(true);
+
+            simulator production(fast_rules);
+            production.m_filling_engine = filling_engine::FUSED;
+            production.initialize(*(new aligned_matrix<float>(space)));
+
+            lockstep_validator validator(production);
+            vector<divergence_report> reports = validator.run(5, cout);
+
+            THEN("the divergence stays small")
+            {
+                for (const divergence_report & report : reports)
+                    REQUIRE(report.max_error < 1.0e-3);
+            }
+        }
+    }
+}
+
+SCENARIO("Test temporal blocking against single steps", "[simulator][temporal]")
+{
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        vector<pair<string, function<void(simulator &)>>> configurations = {
+            {"DIRECT", [](simulator & s) { s.m_filling_engine = filling_engine::DIRECT; }},
+            {"FUSED", [](simulator & s) { s.m_filling_engine = filling_engine::FUSED; }},
+            {"FUSED with compact masks", [](simulator & s) { s.m_filling_engine = filling_engine::FUSED; s.m_compact_masks = true; }},
+            {"DIRECT with FP16 storage", [](simulator & s) { s.m_filling_engine = filling_engine::DIRECT; s.m_storage_precision = storage_precision::FP16; }},
+        };
+
+        for (const auto & configuration : configurations)
+        {
+            for (int steps : {1, 2, 3})
+            {
+                for (bool tiled : {false, true})
+                {
+                    THEN("a block of " + to_string(steps) + " steps of " + configuration.first + " with " + (tiled ? "40x36 tiles" : "the default tiles") + " calculates the same states as single steps")
+                    {
+                        simulator reference(rules);
+                        configuration.second(reference);
+                        reference.initialize(*(new aligned_matrix<float>(space)));
+
+                        simulator blocked(rules);
+                        configuration.second(blocked);
+                        blocked.m_temporal_steps = steps;
+
+                        if (tiled)
+                        {
+                            blocked.m_tile_width = 40;
+                            blocked.m_tile_height = 36;
+                        }
+
+                        blocked.initialize(*(new aligned_matrix<float>(space)));
+
+                        for (int block = 0; block < 2; ++block)
+                        {
+                            for (int step = 0; step < steps; ++step)
+                            {
+                                reference.simulate_step();
+                                reference.m_space->swap();
+                            }
+
+                            blocked.simulate_temporal_block();
+                            blocked.m_space->swap();
+
+                            aligned_matrix<float> space_reference = reference.get_current_space();
+                            aligned_matrix<float> space_blocked = blocked.get_current_space();
+
+                            // the tiles sum the FP16 states with the FP32 kernels, which can round to the neighboring FP16 value
+                            cfloat deviation = blocked.m_storage_precision == storage_precision::FP16 ? 1.0e-3 : 1.0e-4;
+
+                            for (int row = 0; row < space.getNumRows(); ++row)
+                                for (int column = 0; column < space.getNumCols(); ++column)
+                                    REQUIRE(isApprox(space_reference.getValue(column, row), space_blocked.getValue(column, row), deviation));
+                        }
+
+                        REQUIRE(blocked.spacetime == reference.spacetime);
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("a 256x64 state space with smooth states and a ruleset with outer radius 6")
+    {
+        aligned_matrix<float> space = aligned_matrix<float>(256, 64);
+
+        for (int row = 0; row < space.getNumRows(); ++row)
+            for (int column = 0; column < space.getNumCols(); ++column)
+                space.setValue(0.5f + 0.3f * sin(column * 2 * M_PI / 256) * cos(row * 4 * M_PI / 64), column, row);
+
+        ruleset rules = ruleset(256, 64, 6, 3, 0.257, 0.336, 0.365, 0.549, 0.3, 0.3, 0.5, false);
+
+        WHEN("two slaves calculate a chunk of 128 columns each and exchange the borders every 2 steps")
+        {
+            simulator reference(rules);
+            reference.initialize(*(new aligned_matrix<float>(space)));
+
+            cint chunk_width = 128;
+            simulator slave_0(rules);
+            simulator slave_1(rules);
+            simulator * slaves[2] = {&slave_0, &slave_1};
+
+            for (simulator * slave : slaves)
+            {
+                slave->m_temporal_steps = 2;
+                slave->initialize(*(new aligned_matrix<float>(space)));
+            }
+
+            // the layout of a slave: left border, chunk, right border (see run_simulation_slave)
+            cint border_width = slaves[0]->get_mpi_chunk_border_width();
+            REQUIRE(chunk_width + 2 * border_width <= space.getNumCols());
+            REQUIRE(2 * slaves[0]->get_mask_reach() <= border_width);
+
+            THEN("the chunks have the same states as the whole space after every step")
+            {
+                for (int step = 0; step < 6; ++step)
+                {
+                    cint temporal_phase = step % 2;
+
+                    for (int chunk = 0; chunk < 2; ++chunk)
+                    {
+                        simulator & slave = *slaves[chunk];
+
+                        // the exchange: the chunk and its borders from the whole space (exact before the first step,
+                        // the slaves calculate them in between)
+                        if (temporal_phase == 0)
+                        {
+                            aligned_matrix<float> space_reference = reference.get_current_space();
+
+                            for (int row = 0; row < space.getNumRows(); ++row)
+                                for (int column = 0; column < chunk_width + 2 * border_width; ++column)
+                                    if (step == 0 || column < border_width || column >= border_width + chunk_width)
+                                        slave.m_space->buffer_read_ptr()->setValue(space_reference.getValueWrapped(chunk * chunk_width - border_width + column, row), column, row);
+                        }
+
+                        slave.simulate_chunk_step(border_width, chunk_width, temporal_phase);
+                        slave.m_space->swap();
+                    }
+
+                    reference.simulate_step();
+                    reference.m_space->swap();
+
+                    aligned_matrix<float> space_reference = reference.get_current_space();
+
+                    for (int chunk = 0; chunk < 2; ++chunk)
+                    {
+                        aligned_matrix<float> space_slave = slaves[chunk]->get_current_space();
+
+                        for (int row = 0; row < space.getNumRows(); ++row)
+                            for (int column = 0; column < chunk_width; ++column)
+                                REQUIRE(isApprox(space_reference.getValue(chunk * chunk_width + column, row), space_slave.getValue(border_width + column, row), 1.0e-5));
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Test skipping of quiescent tiles against the full simulation", "[simulator][activity]")
+{
+    GIVEN("a 288x192 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(288, 192);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        for (bool tiled : {false, true})
+        {
+            THEN(string("skipping with ") + (tiled ? "40x36 tiles" : "the default tiles") + " calculates the same states and skips tiles")
+            {
+                simulator reference(rules);
+                reference.m_filling_engine = filling_engine::FUSED;
+                reference.initialize(*(new aligned_matrix<float>(space)));
+
+                simulator skipping(rules);
+                skipping.m_filling_engine = filling_engine::FUSED;
+                skipping.m_skip_quiescent = true;
+
+                if (tiled)
+                {
+                    skipping.m_tile_width = 40;
+                    skipping.m_tile_height = 36;
+                }
+
+                skipping.initialize(*(new aligned_matrix<float>(space)));
+
+                for (int step = 0; step < 5; ++step)
+                {
+                    reference.simulate_step();
+                    reference.m_space->swap();
+                    skipping.simulate_step();
+                    skipping.m_space->swap();
+
+                    aligned_matrix<float> space_reference = reference.get_current_space();
+                    aligned_matrix<float> space_skipping = skipping.get_current_space();
+
+                    for (int row = 0; row < space.getNumRows(); ++row)
+                        for (int column = 0; column < space.getNumCols(); ++column)
+                            REQUIRE(isApprox(space_reference.getValue(column, row), space_skipping.getValue(column, row), 1.0e-6));
+                }
+
+                REQUIRE(skipping.get_quiescent_tiles() > 0);
+            }
+        }
+
+        THEN("skipping with blocks of 2 temporal steps and 16x16 tiles calculates the same states and skips tiles")
+        {
+            simulator reference(rules);
+            reference.m_filling_engine = filling_engine::FUSED;
+            reference.initialize(*(new aligned_matrix<float>(space)));
+
+            simulator skipping(rules);
+            skipping.m_filling_engine = filling_engine::FUSED;
+            skipping.m_skip_quiescent = true;
+            skipping.m_temporal_steps = 2;
+            skipping.m_tile_width = 16;
+            skipping.m_tile_height = 16;
+            skipping.initialize(*(new aligned_matrix<float>(space)));
+
+            for (int block = 0; block < 2; ++block)
+            {
+                for (int step = 0; step < 2; ++step)
+                {
+                    reference.simulate_step();
+                    reference.m_space->swap();
+                }
+
+                skipping.simulate_temporal_block();
+                skipping.m_space->swap();
+
+                aligned_matrix<float> space_reference = reference.get_current_space();
+                aligned_matrix<float> space_skipping = skipping.get_current_space();
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        REQUIRE(isApprox(space_reference.getValue(column, row), space_skipping.getValue(column, row), 1.0e-4));
+            }
+
+            REQUIRE(skipping.get_quiescent_tiles() > 0);
+        }
+
+        THEN("skipping in a chunk whose neighborhood is only active across the wrapped borders calculates the same states")
+        {
+            // a block in the corner of the space, the chunk [0, 120) only sees it through the wrapped borders
+            aligned_matrix<float> corner_space = aligned_matrix<float>(space.getNumCols(), space.getNumRows());
+
+            for (int row = space.getNumRows() - 32; row < space.getNumRows(); ++row)
+                for (int column = space.getNumCols() - 32; column < space.getNumCols(); ++column)
+                    corner_space.setValue(1, column, row);
+
+            simulator reference(rules);
+            reference.m_filling_engine = filling_engine::FUSED;
+            reference.initialize(*(new aligned_matrix<float>(corner_space)));
+            reference.simulate_step();
+            reference.m_space->swap();
+
+            simulator skipping(rules);
+            skipping.m_filling_engine = filling_engine::FUSED;
+            skipping.m_skip_quiescent = true;
+            skipping.m_tile_width = 40;
+            skipping.m_tile_height = 36;
+            skipping.initialize(*(new aligned_matrix<float>(corner_space)));
+            skipping.simulate_step(0, 120);
+            skipping.m_space->swap();
+
+            aligned_matrix<float> space_reference = reference.get_current_space();
+            aligned_matrix<float> space_skipping = skipping.get_current_space();
+            bool wrapped_activity = false;
+
+            for (int row = 0; row < space.getNumRows(); ++row)
+            {
+                for (int column = 0; column < 120; ++column)
+                {
+                    REQUIRE(isApprox(space_reference.getValue(column, row), space_skipping.getValue(column, row), 1.0e-6));
+                    wrapped_activity |= space_reference.getValue(column, row) != 0;
+                }
+            }
+
+            REQUIRE(wrapped_activity);
+            REQUIRE(skipping.get_quiescent_tiles() > 0);
+        }
+
+        THEN("no tiles are skipped with discrete rules (0 is no fixed point)")
+        {
+            ruleset discrete_rules = rules;
+            discrete_rules.set_is_discrete(true);
+
+            simulator skipping(discrete_rules);
+            skipping.m_skip_quiescent = true;
+            skipping.initialize(*(new aligned_matrix<float>(space)));
+            skipping.simulate_step();
+
+            REQUIRE(skipping.get_quiescent_tiles() == 0);
+        }
+    }
+}
+
+SCENARIO("Test work stealing scheduler", "[scheduler]")
+{
+    GIVEN("tasks with unbalanced costs and 4 threads")
+    {
+        vector<float> costs(100, 1);
+
+        for (int task = 0; task < 10; ++task)
+            costs[task] = 20;
+
+        work_stealing_scheduler scheduler;
+        scheduler.distribute(costs, 4);
+
+        THEN("every task runs exactly once and a slow thread gets relieved")
+        {
+            vector<atomic<int>> runs(costs.size());
+
+            for (atomic<int> & count : runs)
+                count = 0;
+
+            scheduler.run([&](cint task)
+            {
+                // the first task of thread 0 blocks it, its other tasks have to be stolen
+                if (task == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+                ++runs[task];
+            });
+
+            for (atomic<int> & count : runs)
+                REQUIRE(count == 1);
+
+            REQUIRE(scheduler.get_steals() > 0);
+        }
+    }
+}
+
+SCENARIO("Test work stealing schedule against static schedule", "[simulator][scheduler]")
+{
+    GIVEN("a 288x192 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(288, 192);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        for (int variant = 0; variant < 3; ++variant)
+        {
+            THEN("work stealing with " + string(variant == 1 ? "40x36 tiles" : "the default tiles") + (variant == 2 ? " and skipped quiescent tiles" : "") + " calculates the same states")
+            {
+                simulator reference(rules);
+                reference.m_filling_engine = filling_engine::FUSED;
+                reference.initialize(*(new aligned_matrix<float>(space)));
+
+                simulator stealing(rules);
+                stealing.m_filling_engine = filling_engine::FUSED;
+                stealing.m_schedule = tile_schedule::WORK_STEALING;
+                stealing.m_skip_quiescent = variant == 2;
+
+                if (variant == 1)
+                {
+                    stealing.m_tile_width = 40;
+                    stealing.m_tile_height = 36;
+                }
+
+                stealing.initialize(*(new aligned_matrix<float>(space)));
+
+                for (int step = 0; step < 3; ++step)
+                {
+                    reference.simulate_step();
+                    reference.m_space->swap();
+                    stealing.simulate_step();
+                    stealing.m_space->swap();
+
+                    aligned_matrix<float> space_reference = reference.get_current_space();
+                    aligned_matrix<float> space_stealing = stealing.get_current_space();
+
+                    for (int row = 0; row < space.getNumRows(); ++row)
+                        for (int column = 0; column < space.getNumCols(); ++column)
+                            REQUIRE(isApprox(space_reference.getValue(column, row), space_stealing.getValue(column, row), 1.0e-6));
+                }
+
+                REQUIRE((variant == 2) == (stealing.get_quiescent_tiles() > 0));
+            }
+        }
+    }
+}
+
+SCENARIO("Test matrices with huge pages and parallel first touch", "[matrix][memory]")
+{
+    GIVEN("huge pages and parallel first touch enabled")
+    {
+        memory_placement & placement = memory_placement_settings();
+        const memory_placement previous = placement;
+        placement.huge_pages = true;
+        placement.first_touch = true;
+
+        THEN("large and small matrices are aligned, zeroed and usable")
+        {
+            for (int size : {1024, 64})
+            {
+                aligned_matrix<float> matrix = aligned_matrix<float>(size, size);
+
+                REQUIRE(size_t(matrix.getValues()) % ALIGNMENT == 0);
+
+                if (size == 1024)
+                    REQUIRE(size_t(matrix.getValues()) % NUMA_ALLOCATOR_HUGE_PAGE_SIZE == 0);
+
+                for (int row = 0; row < size; ++row)
+                    for (int column = 0; column < size; ++column)
+                        REQUIRE(matrix.getValue(column, row) == 0);
+
+                for (int row = 0; row < size; ++row)
+                    for (int column = 0; column < size; ++column)
+                        matrix.setValue(row + column, column, row);
+
+                aligned_matrix<float> copy = matrix;
+
+                REQUIRE(copy.getValue(size - 1, size - 1) == 2 * (size - 1));
+            }
+        }
+
+        placement = previous;
+    }
+}
+
+SCENARIO("Test switching the filling engine after initialize", "[simulator][engine]")
+{
+    GIVEN("a 120x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(120, 96);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        // these engines build their mask decompositions only if they are selected
+        for (filling_engine engine : {filling_engine::PREFIX_SUM, filling_engine::SLIDING_WINDOW, filling_engine::SAT, filling_engine::SYMMETRIC_Y})
+        {
+            THEN("the " + filling_engine_name(engine) + " engine selected after initialize calculates the same states as selected before")
+            {
+                simulator before(rules);
+                before.m_filling_engine = engine;
+                before.initialize(*(new aligned_matrix<float>(space)));
+
+                simulator after(rules);
+                after.initialize(*(new aligned_matrix<float>(space)));
+                after.m_filling_engine = engine;
+
+                for (int step = 0; step < 2; ++step)
+                {
+                    before.simulate_step();
+                    before.m_space->swap();
+                    after.simulate_step();
+                    after.m_space->swap();
+                }
+
+                aligned_matrix<float> space_before = before.get_current_space();
+                aligned_matrix<float> space_after = after.get_current_space();
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        REQUIRE(space_before.getValue(column, row) == space_after.getValue(column, row));
+            }
+        }
+    }
+}
+
+SCENARIO("Test multiple steps in one parallel region against single steps", "[simulator][steps]")
+{
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+        ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+
+        const vector<pair<string, function<void(simulator &)>>> configurations =
+        {
+            {"FUSED", [](simulator & s) { s.m_filling_engine = filling_engine::FUSED; }},
+            {"DIRECT with halo and 40x36 tiles", [](simulator & s) { s.m_halo = true; s.m_tile_width = 40; s.m_tile_height = 36; }},
+            {"PREFIX_SUM", [](simulator & s) { s.m_filling_engine = filling_engine::PREFIX_SUM; }},
+            {"FFT", [](simulator & s) { s.m_filling_engine = filling_engine::FFT; }},
+            {"FUSED with FP16 storage", [](simulator & s) { s.m_filling_engine = filling_engine::FUSED; s.m_storage_precision = storage_precision::FP16; }},
+            {"FIXED_POINT with 16 bits", [](simulator & s) { s.m_filling_engine = filling_engine::FIXED_POINT; s.m_fixed_point_bits = 16; }},
+            {"BLOCKED with halo", [](simulator & s) { s.m_filling_engine = filling_engine::BLOCKED; s.m_halo = true; }},
+            {"SEPARABLE", [](simulator & s) { s.m_filling_engine = filling_engine::SEPARABLE; }},
+            {"SAT", [](simulator & s) { s.m_filling_engine = filling_engine::SAT; }},
+            {"SYMMETRIC_Y", [](simulator & s) { s.m_filling_engine = filling_engine::SYMMETRIC_Y; }},
+            {"FUSED with work stealing and skipped quiescent tiles", [](simulator & s) { s.m_filling_engine = filling_engine::FUSED; s.m_schedule = tile_schedule::WORK_STEALING; s.m_skip_quiescent = true; }},
+        };
+
+        for (const auto & configuration : configurations)
+        {
+            THEN("simulate_steps calculates the same states as simulate_step with " + configuration.first)
+            {
+                simulator single(rules);
+                configuration.second(single);
+                single.initialize(*(new aligned_matrix<float>(space)));
+
+                simulator batched(rules);
+                configuration.second(batched);
+                batched.initialize(*(new aligned_matrix<float>(space)));
+
+                for (int step = 0; step < 4; ++step)
+                {
+                    single.simulate_step();
+                    single.m_space->swap();
+                }
+
+                batched.simulate_steps(4);
+
+                aligned_matrix<float> space_single = single.get_current_space();
+                aligned_matrix<float> space_batched = batched.get_current_space();
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        REQUIRE(space_single.getValue(column, row) == space_batched.getValue(column, row));
+
+                REQUIRE(batched.spacetime == single.spacetime);
+            }
+        }
+    }
+}
+
+SCENARIO("Test Runge-Kutta integrators and the s - f time stepping", "[simulator][integrator]")
+{
+    GIVEN("a 48x48 state space with smooth states and a ruleset with outer radius 6")
+    {
+        aligned_matrix<float> space = aligned_matrix<float>(48, 48);
+
+        for (int row = 0; row < space.getNumRows(); ++row)
+            for (int column = 0; column < space.getNumCols(); ++column)
+                space.setValue(0.5f + 0.3f * sin(column * 2 * M_PI / 48) * cos(row * 4 * M_PI / 48), column, row);
+
+        ruleset rules = ruleset(48, 48, 6, 3, 0.257, 0.336, 0.365, 0.549, 0.3, 0.3, 0.5, false);
+        rules.set_time_stepping(time_stepping::S_MINUS_F);
+
+        WHEN("one step of each integrator is compared to 64 RK4 steps with dt / 64")
+        {
+            // the states stay in [0,1] with f' = s - f, so the states are not clamped
+            ruleset reference_rules = rules;
+            reference_rules.set_integrator(integrator::RK4);
+            reference_rules.set_delta_time(rules.get_delta_time() / 64);
+
+            simulator_core<double> reference_core = simulator_core<double>(reference_rules);
+            aligned_matrix<double> reference = aligned_matrix<double>(48, 48);
+            aligned_matrix<double> reference_next = aligned_matrix<double>(48, 48);
+
+            for (int row = 0; row < space.getNumRows(); ++row)
+                for (int column = 0; column < space.getNumCols(); ++column)
+                    reference.setValue(space.getValue(column, row), column, row);
+
+            for (int step = 0; step < 64; ++step)
+            {
+                reference_core.step(reference, reference_next);
+                reference.swap(reference_next);
+            }
+
+            vector<double> errors;
+
+            for (integrator method : {integrator::EULER, integrator::MIDPOINT, integrator::RK4})
+            {
+                ruleset method_rules = rules;
+                method_rules.set_integrator(method);
+
+                simulator_core<double> core = simulator_core<double>(method_rules);
+                aligned_matrix<double> current = aligned_matrix<double>(48, 48);
+                aligned_matrix<double> next = aligned_matrix<double>(48, 48);
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        current.setValue(space.getValue(column, row), column, row);
+
+                core.step(current, next);
+
+                double error = 0;
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        error = fmax(error, fabs(next.getValue(column, row) - reference.getValue(column, row)));
+
+                cout << "Integrator " << integrator_name(method) << ": max error " << error << endl;
+                errors.push_back(error);
+            }
+
+            THEN("the error decreases with the order of the integrator")
+            {
+                REQUIRE(errors[1] < errors[0] / 2);
+                REQUIRE(errors[2] < errors[1] / 4);
+            }
+        }
+    }
+
+    GIVEN("a 144x96 state space with state '1' at the borders")
+    {
+        aligned_matrix<float> space = create_border_block_space(144, 96);
+
+        const vector<pair<string, function<void(ruleset &)>>> integrators =
+        {
+            {"MIDPOINT", [](ruleset & r) { r.set_integrator(integrator::MIDPOINT); }},
+            {"RK4", [](ruleset & r) { r.set_integrator(integrator::RK4); }},
+            {"EULER with s - f", [](ruleset & r) { r.set_time_stepping(time_stepping::S_MINUS_F); }},
+            {"RK4 with s - f", [](ruleset & r) { r.set_integrator(integrator::RK4); r.set_time_stepping(time_stepping::S_MINUS_F); }},
+        };
+
+        for (const auto & configuration : integrators)
+        {
+            ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+            configuration.second(rules);
+
+            WHEN("the fused engine with " + configuration.first + " runs in lockstep with the reference")
+            {
+                simulator production(rules);
+                production.m_filling_engine = filling_engine::FUSED;
+                production.initialize(*(new aligned_matrix<float>(space)));
+
+                lockstep_validator validator(production);
+                vector<divergence_report> reports = validator.run(2, cout);
+
+                THEN("the divergence is bounded by the precision")
+                {
+                    for (const divergence_report & report : reports)
+                        REQUIRE(report.max_error < 1.0e-4);
+                }
+            }
+        }
+
+        WHEN("a part of the space is simulated with RK4")
+        {
+            ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+            rules.set_integrator(integrator::RK4);
+
+            simulator full(rules);
+            full.m_filling_engine = filling_engine::FUSED;
+            full.initialize(*(new aligned_matrix<float>(space)));
+            full.simulate_step();
+
+            simulator part(rules);
+            part.m_filling_engine = filling_engine::FUSED;
+            part.initialize(*(new aligned_matrix<float>(space)));
+            part.simulate_step(0, 64);
+
+            THEN("the states within the part are the same as with the whole space")
+            {
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < 64; ++column)
+                        REQUIRE(part.m_space->buffer_write_ptr()->getValue(column, row) == full.m_space->buffer_write_ptr()->getValue(column, row));
+            }
+        }
+
+        WHEN("several RK4 steps are simulated with a halo")
+        {
+            ruleset rules = ruleset_smooth_life_l(space.getNumCols(), space.getNumRows());
+            rules.set_integrator(integrator::RK4);
+
+            simulator plain(rules);
+            plain.initialize(*(new aligned_matrix<float>(space)));
+
+            simulator halo(rules);
+            halo.m_halo = true;
+            halo.initialize(*(new aligned_matrix<float>(space)));
+
+            for (int step = 0; step < 3; ++step)
+            {
+                plain.simulate_step();
+                plain.m_space->swap();
+                halo.simulate_step();
+                halo.m_space->swap();
+
+                // the stages swap their buffers with the space
+                REQUIRE(halo.m_space->buffer_read_ptr()->hasHalo());
+                REQUIRE(halo.m_space->buffer_write_ptr()->hasHalo());
+            }
+
+            THEN("the states are the same as without halo")
+            {
+                aligned_matrix<float> space_plain = plain.get_current_space();
+                aligned_matrix<float> space_halo = halo.get_current_space();
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        REQUIRE(isApprox(space_plain.getValue(column, row), space_halo.getValue(column, row), 1.0e-5));
+            }
+        }
+    }
+}
+
+SCENARIO("Test adaptive time steps against small fixed time steps", "[simulator][adaptive]")
+{
+    GIVEN("a 48x48 state space with smooth states and a ruleset with outer radius 6")
+    {
+        aligned_matrix<float> space = aligned_matrix<float>(48, 48);
+
+        for (int row = 0; row < space.getNumRows(); ++row)
+            for (int column = 0; column < space.getNumCols(); ++column)
+                space.setValue(0.5f + 0.3f * sin(column * 2 * M_PI / 48) * cos(row * 4 * M_PI / 48), column, row);
+
+        ruleset rules = ruleset(48, 48, 6, 3, 0.257, 0.336, 0.365, 0.549, 0.3, 0.3, 0.5, false);
+        rules.set_time_stepping(time_stepping::S_MINUS_F);
+
+        for (integrator method : {integrator::EULER, integrator::RK4})
+        {
+            WHEN("the fused engine adapts dt with " + integrator_name(method))
+            {
+                ruleset method_rules = rules;
+                method_rules.set_integrator(method);
+
+                simulator adaptive(method_rules);
+                adaptive.m_filling_engine = filling_engine::FUSED;
+                adaptive.m_adaptive_dt = true;
+                adaptive.m_dt_tolerance = 1.0e-3f;
+                adaptive.m_dt_min = 0.01f;
+                adaptive.m_dt_max = 2.0f;
+                adaptive.initialize(*(new aligned_matrix<float>(space)));
+
+                adaptive.simulate_steps(8);
+
+                // reference: RK4 with about 0.01 per step up to the same time
+                cdouble time = adaptive.get_simulated_time();
+                cint reference_steps = ceil(time / 0.01);
+
+                ruleset reference_rules = rules;
+                reference_rules.set_integrator(integrator::RK4);
+                reference_rules.set_delta_time(time / reference_steps);
+
+                simulator_core<double> reference_core = simulator_core<double>(reference_rules);
+                aligned_matrix<double> reference = aligned_matrix<double>(48, 48);
+                aligned_matrix<double> reference_next = aligned_matrix<double>(48, 48);
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        reference.setValue(space.getValue(column, row), column, row);
+
+                for (int step = 0; step < reference_steps; ++step)
+                {
+                    reference_core.step(reference, reference_next);
+                    reference.swap(reference_next);
+                }
+
+                aligned_matrix<float> result = adaptive.get_current_space();
+                double error = 0;
+
+                for (int row = 0; row < space.getNumRows(); ++row)
+                    for (int column = 0; column < space.getNumCols(); ++column)
+                        error = fmax(error, fabs(result.getValue(column, row) - reference.getValue(column, row)));
+
+                cout << "Adaptive dt " << integrator_name(method) << " | t = " << time << ", dt = " << adaptive.get_delta_time()
+                     << ", rejected " << adaptive.get_rejected_steps() << ", max. error " << error << endl;
+
+                THEN("dt stays within its bounds and the error stays within the tolerance of the steps")
+                {
+                    REQUIRE(adaptive.spacetime == 8);
+                    REQUIRE(adaptive.get_delta_time() >= adaptive.m_dt_min);
+                    REQUIRE(adaptive.get_delta_time() <= adaptive.m_dt_max);
+                    REQUIRE(error < 8 * adaptive.m_dt_tolerance);
+                }
+            }
+        }
+
+        WHEN("the tolerance is too small for the initial dt")
+        {
+            simulator adaptive(rules);
+            adaptive.m_filling_engine = filling_engine::FUSED;
+            adaptive.m_adaptive_dt = true;
+            adaptive.m_dt_tolerance = 1.0e-5f;
+            adaptive.initialize(*(new aligned_matrix<float>(space)));
+
+            adaptive.simulate_step();
+
+            THEN("the step is rejected and repeated with a smaller dt")
+            {
+                REQUIRE(adaptive.get_rejected_steps() > 0);
+                REQUIRE(adaptive.get_simulated_time() < 0.5);
+                REQUIRE(adaptive.spacetime == 1);
+            }
+        }
+
+        WHEN("the space is calm (all states 0 with f' = 2s - 1)")
+        {
+            ruleset calm_rules = rules;
+            calm_rules.set_time_stepping(time_stepping::TWO_S_MINUS_ONE);
+
+            simulator adaptive(calm_rules);
+            adaptive.m_filling_engine = filling_engine::FUSED;
+            adaptive.m_adaptive_dt = true;
+            adaptive.m_dt_max = 2.0f;
+            adaptive.initialize(*(new aligned_matrix<float>(48, 48)));
+
+            adaptive.simulate_steps(8);
+
+            THEN("dt grows to its upper bound")
+            {
+                REQUIRE(adaptive.get_rejected_steps() == 0);
+                REQUIRE(adaptive.get_delta_time() == adaptive.m_dt_max);
+                REQUIRE(adaptive.get_simulated_time() > 8 * 0.5);
+            }
+        }
+    }
+}
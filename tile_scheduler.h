@@ -0,0 +1,191 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <omp.h>
+#include "matrix.h"
+
+using namespace std;
+
+/**
+ * @brief How the tiles (or columns) of a step are distributed to the threads
+ */
+enum class tile_schedule
+{
+    /**
+     * @brief OpenMP schedule(static): every thread gets the same number of columns / tiles
+     */
+    STATIC = 0,
+
+    /**
+     * @brief Tiles are distributed by cost hints to per-thread deques, idle threads steal from the others.
+     * See work_stealing_scheduler
+     */
+    WORK_STEALING = 1
+};
+
+/**
+ * @brief Returns the name of the schedule as used by tile_schedule_from_name
+ */
+inline string tile_schedule_name(tile_schedule schedule)
+{
+    switch (schedule)
+    {
+    case tile_schedule::WORK_STEALING: return "WORK_STEALING";
+    default: return "STATIC";
+    }
+}
+
+/**
+ * @brief Returns schedule from name. Returns STATIC if name is invalid
+ */
+inline tile_schedule tile_schedule_from_name(string name)
+{
+    if (name == "WORK_STEALING")
+        return tile_schedule::WORK_STEALING;
+    else if (name != "STATIC")
+        cerr << "Unknown schedule " << name << ", using STATIC" << endl;
+
+    return tile_schedule::STATIC;
+}
+
+/**
+ * @brief Runs a set of independent tasks (the tiles of a step) with one deque per thread and work stealing.
+ * - distribute splits the tasks into contiguous ranges of about the same total cost, so each thread starts with
+ *   neighboring tiles (which share most of the space rows they touch)
+ * - a thread takes tasks from the front of its own deque. If it is empty, it steals from the back of the others,
+ *   so threads that were slowed down (e.g. by the GUI or the queue of the master) are relieved
+ * - the tasks do not create new tasks, a thread is done when all deques are empty
+ */
+class work_stealing_scheduler
+{
+public:
+
+    work_stealing_scheduler() = default;
+
+    // the deques hold locks that are shared by the threads of a running step
+    work_stealing_scheduler(const work_stealing_scheduler &) = delete;
+    work_stealing_scheduler & operator=(const work_stealing_scheduler &) = delete;
+
+    /**
+     * @brief Distributes the tasks 0 .. costs.size() - 1 to the deques of threads threads
+     * @param costs the estimated cost of each task (any unit)
+     */
+    void distribute(const vector<float> & costs, cint threads)
+    {
+        if ((int)m_queues.size() != threads)
+        {
+            m_queues.clear();
+
+            for (int t = 0; t < threads; ++t)
+                m_queues.push_back(unique_ptr<task_queue>(new task_queue()));
+        }
+
+        double total = 0;
+
+        for (float cost : costs)
+            total += cost;
+
+        // a task goes to the thread whose share of the total cost contains the middle of the task
+        double before = 0;
+
+        for (int task = 0; task < (int)costs.size(); ++task)
+        {
+            cdouble middle = before + costs[task] / 2;
+            int thread = total > 0 ? int(middle / total * threads) : task * threads / costs.size();
+            thread = min(max(thread, 0), threads - 1);
+
+            m_queues[thread]->tasks.push_back(task);
+            before += costs[task];
+        }
+    }
+
+    /**
+     * @brief Runs all distributed tasks in an OpenMP parallel region. Calls function(task) once per task
+     */
+    template <class F>
+    void run(const F & function)
+    {
+        cint threads = m_queues.size();
+
+        #pragma omp parallel num_threads(threads)
+        {
+            work(function);
+        }
+    }
+
+    /**
+     * @brief Runs distributed tasks until all deques are empty. Called by each thread of an existing parallel region
+     * (see simulator::simulate_steps), there is no barrier at the end
+     */
+    template <class F>
+    void work(const F & function)
+    {
+        // if there are less threads than deques, the tasks of the missing ones are stolen
+        cint thread = omp_get_thread_num() % m_queues.size();
+        int task;
+
+        while (pop(thread, task) || steal(thread, task))
+            function(task);
+    }
+
+    /**
+     * @brief Returns the number of tasks that were stolen since construction
+     */
+    ulong get_steals() const
+    {
+        return m_steals;
+    }
+
+private:
+
+    struct task_queue
+    {
+        mutex lock;
+        deque<int> tasks;
+    };
+
+    vector<unique_ptr<task_queue>> m_queues;
+    atomic<ulong> m_steals {0};
+
+    bool pop(cint thread, int & task)
+    {
+        task_queue & queue = *m_queues[thread];
+        lock_guard<mutex> guard(queue.lock);
+
+        if (queue.tasks.empty())
+            return false;
+
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+
+        return true;
+    }
+
+    bool steal(cint thread, int & task)
+    {
+        cint threads = m_queues.size();
+
+        for (int i = 1; i < threads; ++i)
+        {
+            task_queue & victim = *m_queues[(thread + i) % threads];
+            lock_guard<mutex> guard(victim.lock);
+
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                ++m_steals;
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <math.h>
+#include "matrix.h"
+#include "ruleset.h"
+
+using namespace std;
+
+/**
+ * @brief Number of cells the transfer function is applied to at once
+ */
+#define TRANSFER_FUNCTION_BATCH_SIZE 64
+
+/**
+ * @brief exp(x) in float that can be vectorized by the compiler (no calls, no branches).
+ * - range reduction x = k * ln(2) + r with |r| <= ln(2)/2, exp(x) = 2^k * exp(r)
+ * - exp(r) is a Taylor polynomial of the given degree. The relative error is below |r|^(degree+1) / (degree+1)!,
+ *   i.e. 1.2e-7 for degree 6 (float precision) and 4.2e-5 for degree 4
+ * - x is clamped to [-87, 88], so 2^k never leaves the range of normalized floats
+ */
+template <int degree>
+inline float exp_vectorizable(float x)
+{
+    x = fminf(fmaxf(x, -87.0f), 88.0f);
+
+    cfloat k = floorf(x * 1.44269504f + 0.5f);
+    // ln(2) split in two parts (Cody-Waite), so k * ln(2) is subtracted without rounding error
+    cfloat r = (x - k * 0.693359375f) + k * 2.12194440e-4f;
+
+    static_assert(degree == 4 || degree == 6, "exp_vectorizable supports degree 4 and 6");
+
+    // Horner scheme of sum r^i / i!
+    float p = 1.0f / 24.0f;
+
+    if (degree == 6)
+        p = (1.0f / 720.0f * r + 1.0f / 120.0f) * r + p;
+
+    p = p * r + 1.0f / 6.0f;
+    p = p * r + 0.5f;
+    p = p * r + 1.0f;
+    p = p * r + 1.0f;
+
+    // 2^k by building the exponent bits
+    const int exponent = (int(k) + 127) << 23;
+    float scale;
+    memcpy(&scale, &exponent, sizeof (float));
+
+    return p * scale;
+}
+
+/**
+ * @brief The parameters of the transfer function known only at runtime (custom rulesets)
+ */
+struct transfer_parameters
+{
+    float birth_min;
+    float birth_max;
+    float death_min;
+    float death_max;
+    float steepness_n; // 4 / alpha_n
+    float steepness_m; // 4 / alpha_m
+    float delta_time;
+    bool discrete;
+    bool s_minus_f; // time_stepping::S_MINUS_F
+};
+
+/**
+ * @brief The parameters of the transfer function as compile time constants of a ruleset (e.g. ruleset_smooth_life_l_constants),
+ * same members as transfer_parameters
+ */
+template <class constants>
+struct transfer_parameters_fixed
+{
+    static constexpr float birth_min = constants::birth_min;
+    static constexpr float birth_max = constants::birth_max;
+    static constexpr float death_min = constants::death_min;
+    static constexpr float death_max = constants::death_max;
+    static constexpr float steepness_n = 4.0f / constants::alpha_n;
+    static constexpr float steepness_m = 4.0f / constants::alpha_m;
+    static constexpr float delta_time = constants::delta_time;
+    static constexpr bool discrete = constants::is_discrete;
+    static constexpr bool s_minus_f = false;
+};
+
+/**
+ * @brief Calculates the next states of a batch of cells from their fillings (see simulator_core::state_function and
+ * simulator_core::next_state). The scalar functions use double exp() six times per cell, this one evaluates five
+ * sigmoids in float with a vectorizable exp.
+ * - the precision of the exp is selected by ruleset::get_fast_sigmoid
+ * - optionally s(n, m) is tabulated (see build_table) and evaluated with bilinear interpolation instead
+ * - for the predefined rulesets the parameters are compile time constants (see transfer_parameters_fixed)
+ */
+class transfer_function
+{
+public:
+
+    transfer_function() { }
+
+    transfer_function(const ruleset & rules) :
+        m_birth_min(rules.get_birth_min()),
+        m_birth_max(rules.get_birth_max()),
+        m_death_min(rules.get_death_min()),
+        m_death_max(rules.get_death_max()),
+        m_steepness_n(4.0f / rules.get_alpha_n()),
+        m_steepness_m(4.0f / rules.get_alpha_m()),
+        m_delta_time(rules.get_delta_time()),
+        m_discrete(rules.get_is_discrete()),
+        m_s_minus_f(rules.get_time_stepping() == time_stepping::S_MINUS_F),
+        m_fast(rules.get_fast_sigmoid())
+    {
+        // the presets use the default time stepping
+        if (m_s_minus_f)
+            m_preset = GENERIC;
+        else if (ruleset_has_constants<ruleset_smooth_life_l_constants>(rules))
+            m_preset = SMOOTH_LIFE_L;
+        else if (ruleset_has_constants<ruleset_rafler_paper_constants>(rules))
+            m_preset = RAFLER_PAPER;
+    }
+
+    /**
+     * @brief Calculates the next states of count cells
+     * @param outer outer fillings n
+     * @param inner inner fillings m
+     * @param state the current states (only used for Euler integration)
+     * @param next receives the next states. Clamped to [0,1] in Euler mode, like the scalar version
+     * @param count number of cells
+     */
+    void apply(const float * outer, const float * inner, const float * state, float * next, cint count) const
+    {
+        apply_output<false>(outer, inner, state, next, count);
+    }
+
+    /**
+     * @brief Calculates s(n, m) of count cells (the stages of the Runge-Kutta integrators, see integrator_tableau)
+     * @param outer outer fillings n
+     * @param inner inner fillings m
+     * @param s receives s(n, m)
+     * @param count number of cells
+     */
+    void apply_state_function(const float * outer, const float * inner, float * s, cint count) const
+    {
+        // the state is not read, any valid pointer will do
+        apply_output<true>(outer, inner, outer, s, count);
+    }
+
+    /**
+     * @brief Returns true if the parameters are compile time constants of a predefined ruleset
+     */
+    bool isSpecialized() const
+    {
+        return m_preset != GENERIC;
+    }
+
+    /**
+     * @brief Disables the compile time constants of the predefined rulesets, the generic version is used instead
+     */
+    void disable_specialization()
+    {
+        m_preset = GENERIC;
+    }
+
+    /**
+     * @brief s(n, m) of the ruleset in double precision, i.e. simulator_core::state_function in double
+     */
+    double state_function(cdouble n, cdouble m) const
+    {
+        cdouble alive = sigmoid(m, 0.5, m_steepness_m);
+        cdouble birth = sigmoid(n, m_birth_min, m_steepness_n) * (1.0 - sigmoid(n, m_birth_max, m_steepness_n));
+        cdouble death = sigmoid(n, m_death_min, m_steepness_n) * (1.0 - sigmoid(n, m_death_max, m_steepness_n));
+
+        return birth * (1.0 - alive) + death * alive;
+    }
+
+    /**
+     * @brief Tabulates s(n, m) on a size x size grid over [0,1]^2. apply uses the table from now on
+     * @return the max. error of the bilinear interpolation against state_function, sampled at the centers and
+     * edge midpoints of all table cells (where the interpolation error of smooth functions is largest)
+     */
+    double build_table(cint size)
+    {
+        if (size < 2)
+        {
+            cerr << "Invalid transition table size " << size << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        m_table_size = size;
+        m_table.resize(size_t(size) * size);
+
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < size; ++j)
+            for (int i = 0; i < size; ++i)
+                m_table[size_t(j) * size + i] = state_function(i / double(size - 1), j / double(size - 1));
+
+        double max_error = 0;
+
+        #pragma omp parallel for schedule(static) reduction(max:max_error)
+        for (int j = 0; j < 2 * (size - 1); ++j)
+        {
+            for (int i = 0; i < 2 * (size - 1); ++i)
+            {
+                // odd indices are between grid points
+                if (i % 2 == 0 && j % 2 == 0)
+                    continue;
+
+                cdouble n = i / double(2 * (size - 1));
+                cdouble m = j / double(2 * (size - 1));
+                max_error = fmax(max_error, fabs(table_lookup(n, m) - state_function(n, m)));
+            }
+        }
+
+        return max_error;
+    }
+
+    /**
+     * @brief Returns the size of the transition table, 0 if there is none
+     */
+    int getTableSize() const
+    {
+        return m_table_size;
+    }
+
+private:
+
+    float m_birth_min = 0;
+    float m_birth_max = 0;
+    float m_death_min = 0;
+    float m_death_max = 0;
+    float m_steepness_n = 0; // 4 / alpha_n
+    float m_steepness_m = 0; // 4 / alpha_m
+    float m_delta_time = 0;
+    bool m_discrete = false;
+    bool m_s_minus_f = false; // time_stepping::S_MINUS_F
+    bool m_fast = false;
+    enum { GENERIC, SMOOTH_LIFE_L, RAFLER_PAPER } m_preset = GENERIC; // compile time parameters used by apply
+    int m_table_size = 0;
+    vector<float> m_table; // s(i / (size - 1), j / (size - 1)) at j * size + i
+
+    static double sigmoid(cdouble x, cdouble a, cdouble steepness)
+    {
+        return 1.0 / (1.0 + exp(-(x - a) * steepness));
+    }
+
+    /**
+     * @brief bilinear interpolation of the table at (n, m). Both are clamped to [0,1]
+     */
+    inline float table_lookup(cfloat n, cfloat m) const
+    {
+        cint size = m_table_size;
+        const float * __restrict__ table = m_table.data();
+
+        cfloat fx = fminf(fmaxf(n, 0.0f), 1.0f) * (size - 1);
+        cfloat fy = fminf(fmaxf(m, 0.0f), 1.0f) * (size - 1);
+        cint ix = min(int(fx), size - 2);
+        cint iy = min(int(fy), size - 2);
+        cfloat tx = fx - ix;
+        cfloat ty = fy - iy;
+
+        const float * row0 = table + iy * size + ix;
+        const float * row1 = row0 + size;
+        cfloat s0 = row0[0] + tx * (row0[1] - row0[0]);
+        cfloat s1 = row1[0] + tx * (row1[1] - row1[0]);
+
+        return s0 + ty * (s1 - s0);
+    }
+
+    /**
+     * @brief Selects the implementation. With state_only, s(n, m) is written instead of the next state
+     */
+    template <bool state_only>
+    void apply_output(const float * outer, const float * inner, const float * state, float * next, cint count) const
+    {
+        if (!m_table.empty())
+            apply_table<state_only>(outer, inner, state, next, count);
+        else if (m_preset == SMOOTH_LIFE_L)
+            apply_degree<state_only>(transfer_parameters_fixed<ruleset_smooth_life_l_constants>(), outer, inner, state, next, count);
+        else if (m_preset == RAFLER_PAPER)
+            apply_degree<state_only>(transfer_parameters_fixed<ruleset_rafler_paper_constants>(), outer, inner, state, next, count);
+        else
+            apply_degree<state_only>(transfer_parameters{m_birth_min, m_birth_max, m_death_min, m_death_max, m_steepness_n, m_steepness_m, m_delta_time, m_discrete, m_s_minus_f}, outer, inner, state, next, count);
+    }
+
+    template <bool state_only>
+    void apply_table(const float * __restrict__ outer, const float * __restrict__ inner, const float * __restrict__ state, float * __restrict__ next, cint count) const
+    {
+        cfloat dt = m_delta_time;
+        const bool discrete = m_discrete || state_only;
+        const bool s_minus_f = m_s_minus_f;
+
+        #pragma omp simd
+        for (int i = 0; i < count; ++i)
+        {
+            cfloat s = table_lookup(outer[i], inner[i]);
+            cfloat derivative = s_minus_f ? s - state[i] : 2.0f * s - 1.0f;
+            next[i] = discrete ? s : fmaxf(0.0f, fminf(1.0f, state[i] + dt * derivative));
+        }
+    }
+
+    template <bool state_only, class parameters>
+    void apply_degree(const parameters & p, const float * outer, const float * inner, const float * state, float * next, cint count) const
+    {
+        if (m_fast)
+            apply_with<4, state_only>(p, outer, inner, state, next, count);
+        else
+            apply_with<6, state_only>(p, outer, inner, state, next, count);
+    }
+
+    /**
+     * @brief parameters is transfer_parameters or transfer_parameters_fixed. With the latter, all parameters are
+     * folded into the code
+     */
+    template <int degree, bool state_only, class parameters>
+    void apply_with(const parameters & p, const float * __restrict__ outer, const float * __restrict__ inner, const float * __restrict__ state, float * __restrict__ next, cint count) const
+    {
+        cfloat b1 = p.birth_min;
+        cfloat b2 = p.birth_max;
+        cfloat d1 = p.death_min;
+        cfloat d2 = p.death_max;
+        cfloat kn = p.steepness_n;
+        cfloat km = p.steepness_m;
+        cfloat dt = p.delta_time;
+        const bool discrete = p.discrete || state_only;
+        const bool s_minus_f = p.s_minus_f;
+
+        #pragma omp simd
+        for (int i = 0; i < count; ++i)
+        {
+            cfloat n = outer[i];
+            cfloat m = inner[i];
+
+            // sigma1(x, a, alpha) = 1 / (1 + exp(-(x - a) * 4 / alpha))
+            cfloat alive = 1.0f / (1.0f + exp_vectorizable<degree>(-(m - 0.5f) * km));
+            cfloat birth = 1.0f / (1.0f + exp_vectorizable<degree>(-(n - b1) * kn)) * (1.0f - 1.0f / (1.0f + exp_vectorizable<degree>(-(n - b2) * kn)));
+            cfloat death = 1.0f / (1.0f + exp_vectorizable<degree>(-(n - d1) * kn)) * (1.0f - 1.0f / (1.0f + exp_vectorizable<degree>(-(n - d2) * kn)));
+            cfloat s = birth * (1.0f - alive) + death * alive;
+            cfloat derivative = s_minus_f ? s - state[i] : 2.0f * s - 1.0f;
+
+            next[i] = discrete ? s : fmaxf(0.0f, fminf(1.0f, state[i] + dt * derivative));
+        }
+    }
+};